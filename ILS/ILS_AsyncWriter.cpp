@@ -0,0 +1,183 @@
+#include <chrono>
+#include <cstdint>
+#include "ILS_AsyncWriter.h"
+
+//=============================================================================
+// AsyncWriter - асинхронный вывод записей лога через кольцевой буфер.
+//-----------------------------------------------------------------------------
+// Конструктор
+AsyncWriter::AsyncWriter(IAsyncSink& sink, size_t capacity, OverflowPolicy policy)
+	: m_Sink(sink), m_Policy(policy), m_nEnqueuePos(0), m_nDequeuePos(0), m_nDropped(0),
+	  m_nSpillSize(0), m_nSpillIn(0), m_nSpillOut(0), m_bSleeping(false), m_bStop(false), m_bRunning(true) {
+	// Ёмкость - степень двойки, чтобы позиция в буфере вычислялась маской
+	size_t n = 2;
+	while (n < capacity) n <<= 1;
+	m_Ring = std::vector<Slot>(n);
+	m_nMask = n - 1;
+	for (size_t i = 0; i < n; ++i) m_Ring[i].seq.store(i, std::memory_order_relaxed);
+	m_Thread = std::thread(&AsyncWriter::run, this);
+}
+AsyncWriter::~AsyncWriter() {
+	stop();
+}
+//-----------------------------------------------------------------------------
+// Постановка в очередь
+// Ячейка свободна для позиции pos, если её порядковый номер равен pos,
+// и заполнена, если он равен pos+1.
+bool AsyncWriter::tryPush(int chan, const char* data, size_t len) {
+	size_t pos = m_nEnqueuePos.load(std::memory_order_relaxed);
+	Slot* slot;
+	for (;;) {
+		slot = &m_Ring[pos & m_nMask];
+		size_t seq = slot->seq.load(std::memory_order_acquire);
+		intptr_t diff = intptr_t(seq) - intptr_t(pos);
+		if (diff == 0) {
+			if (m_nEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+		}
+		else if (diff < 0) return false; // буфер полон
+		else pos = m_nEnqueuePos.load(std::memory_order_relaxed);
+	}
+	slot->chan = chan;
+	slot->rec.assign(data, len); // после прогрева ёмкость строки переиспользуется
+	slot->seq.store(pos + 1, std::memory_order_release);
+	return true;
+}
+void AsyncWriter::spill(int chan, const char* data, size_t len) {
+	{
+		std::lock_guard<std::mutex> lock(m_SpillMutex);
+		m_Spill.emplace_back(chan, std::string(data, len));
+		m_nSpillSize.store(m_Spill.size(), std::memory_order_release);
+	}
+	m_nSpillIn.fetch_add(1, std::memory_order_release);
+}
+void AsyncWriter::wake() {
+	// Системный вызов только если писатель действительно спит
+	if (m_bSleeping.load(std::memory_order_acquire)) {
+		std::lock_guard<std::mutex> lock(m_WakeMutex);
+		m_WakeCond.notify_one();
+	}
+}
+bool AsyncWriter::push(int chan, const char* data, size_t len) {
+	// Писатель остановлен: запись никто не выведет
+	if (!m_bRunning.load(std::memory_order_acquire)) {
+		m_nDropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	bool res = true;
+	// Пока список переполнения не пуст, пишем в него, чтобы не менять порядок записей
+	if (m_Policy == OverflowPolicy::Spill && m_nSpillSize.load(std::memory_order_acquire) != 0)
+		spill(chan, data, len);
+	else if (!tryPush(chan, data, len)) {
+		switch (m_Policy) {
+		case OverflowPolicy::Block:
+			do {
+				// Писатель остановился, пока производитель ждал места
+				if (!m_bRunning.load(std::memory_order_acquire)) {
+					m_nDropped.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				}
+				wake();
+				std::this_thread::yield();
+			} while (!tryPush(chan, data, len));
+			break;
+		case OverflowPolicy::DropNewest:
+			m_nDropped.fetch_add(1, std::memory_order_relaxed);
+			res = false;
+			break;
+		case OverflowPolicy::Spill:
+			spill(chan, data, len);
+			break;
+		}
+	}
+	wake();
+	return res;
+}
+//-----------------------------------------------------------------------------
+// Фоновый поток
+size_t AsyncWriter::drainRing() {
+	size_t n = 0;
+	size_t pos = m_nDequeuePos.load(std::memory_order_relaxed);
+	for (;;) {
+		Slot& slot = m_Ring[pos & m_nMask];
+		if (slot.seq.load(std::memory_order_acquire) != pos + 1) break;
+		try { m_Sink.asyncWrite(slot.chan, slot.rec); }
+		catch (...) {}
+		slot.seq.store(pos + m_nMask + 1, std::memory_order_release);
+		m_nDequeuePos.store(++pos, std::memory_order_release);
+		++n;
+	}
+	return n;
+}
+size_t AsyncWriter::drainSpill() {
+	if (m_nSpillSize.load(std::memory_order_acquire) == 0) return 0;
+	std::deque<std::pair<int, std::string> > batch;
+	{
+		std::lock_guard<std::mutex> lock(m_SpillMutex);
+		batch.swap(m_Spill);
+		m_nSpillSize.store(0, std::memory_order_release);
+	}
+	for (auto& rec : batch) {
+		try { m_Sink.asyncWrite(rec.first, rec.second); }
+		catch (...) {}
+	}
+	m_nSpillOut.fetch_add(batch.size(), std::memory_order_release);
+	return batch.size();
+}
+void AsyncWriter::run() {
+	for (;;) {
+		size_t n = drainRing();
+		n += drainSpill();
+		if (n != 0) continue;
+		// Очередь пуста - сбрасываем буферы и сообщаем ожидающим в flush()
+		try { m_Sink.asyncFlush(); }
+		catch (...) {}
+		std::unique_lock<std::mutex> lock(m_WakeMutex);
+		m_DoneCond.notify_all();
+		if (m_bStop.load(std::memory_order_acquire)) {
+			// Повторная проверка: запись могла появиться после drain
+			lock.unlock();
+			if (drainRing() + drainSpill() == 0) {
+				m_bRunning.store(false, std::memory_order_release);
+				// Запись, принятая до снятия флага, тоже выводится
+				drainRing();
+				drainSpill();
+				try { m_Sink.asyncFlush(); }
+				catch (...) {}
+				break;
+			}
+			continue;
+		}
+		m_bSleeping.store(true, std::memory_order_release);
+		// Таймаут страхует от потерянного пробуждения между drain и ожиданием
+		m_WakeCond.wait_for(lock, std::chrono::milliseconds(10));
+		m_bSleeping.store(false, std::memory_order_release);
+	}
+	std::lock_guard<std::mutex> lock(m_WakeMutex);
+	m_DoneCond.notify_all();
+}
+//-----------------------------------------------------------------------------
+// Барьер и остановка
+void AsyncWriter::flush() {
+	// Все позиции, зарезервированные до этого момента, должны быть выведены
+	const size_t ring_target = m_nEnqueuePos.load(std::memory_order_acquire);
+	const unsigned long long spill_target = m_nSpillIn.load(std::memory_order_acquire);
+	if (!m_bRunning.load(std::memory_order_acquire)) return;
+	std::unique_lock<std::mutex> lock(m_WakeMutex);
+	m_WakeCond.notify_one();
+	while (m_nDequeuePos.load(std::memory_order_acquire) < ring_target ||
+	       m_nSpillOut.load(std::memory_order_acquire) < spill_target) {
+		if (!m_bRunning.load(std::memory_order_acquire)) break;
+		m_WakeCond.notify_one();
+		m_DoneCond.wait_for(lock, std::chrono::milliseconds(10));
+	}
+}
+void AsyncWriter::stop() {
+	std::lock_guard<std::mutex> join(m_JoinMutex);
+	if (!m_Thread.joinable()) return;
+	{
+		std::lock_guard<std::mutex> lock(m_WakeMutex);
+		m_bStop.store(true, std::memory_order_release);
+		m_WakeCond.notify_one();
+	}
+	m_Thread.join();
+}
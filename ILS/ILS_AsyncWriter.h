@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//=============================================================================
+/// Политика поведения асинхронного писателя при переполнении кольцевого буфера.
+/// @ingroup Kernel
+enum class OverflowPolicy {
+	Block,      ///< Производитель ждёт, пока писатель освободит место.
+	DropNewest, ///< Новая запись отбрасывается, увеличивается счётчик потерь.
+	Spill       ///< Новая запись уходит в список переполнения (без ограничения размера).
+};
+
+//=============================================================================
+/// Получатель записей асинхронного писателя.
+/// @ingroup Kernel
+/// Функции вызываются <b>только</b> из фонового потока писателя.
+struct IAsyncSink {
+	/// Вывод одной готовой записи.
+	/// \param chan - номер канала (например, 0 - log, 1 - wrn, 2 - err).
+	/// \param rec  - готовая строка записи.
+	virtual void asyncWrite(int chan, const std::string& rec) = 0;
+	/// Сброс буферов после того, как очередь опустела.
+	virtual void asyncFlush() {}
+	virtual ~IAsyncSink() {}
+};
+
+//=============================================================================
+/// Асинхронный писатель записей лога.
+/// @ingroup Kernel
+/// Производители только копируют готовую запись в ограниченный lock-free
+/// кольцевой буфер (схема с порядковыми номерами ячеек, много производителей -
+/// один потребитель), а отдельный фоновый поток выбирает записи и передаёт их
+/// получателю \c IAsyncSink. Поведение при переполнении задаётся \c OverflowPolicy.
+/// \note flush() является барьером: возвращается только после того, как все
+/// записи, принятые до его вызова, переданы получателю.
+class AsyncWriter {
+public:
+	/// Конструктор.
+	/// \param sink     - получатель записей, должен жить дольше писателя.
+	/// \param capacity - ёмкость кольцевого буфера (округляется вверх до степени двойки).
+	/// \param policy   - политика при переполнении.
+	AsyncWriter(IAsyncSink& sink, size_t capacity = 8192, OverflowPolicy policy = OverflowPolicy::Block);
+	/// Деструктор дожидается вывода всех принятых записей.
+	~AsyncWriter();
+	AsyncWriter(const AsyncWriter&) = delete;
+	AsyncWriter& operator=(const AsyncWriter&) = delete;
+	/// Постановка записи в очередь.
+	/// После остановки фонового потока записи не принимаются и учитываются в dropped().
+	/// \return false, если запись была отброшена (OverflowPolicy::DropNewest или писатель остановлен).
+	bool push(int chan, const char* data, size_t len);
+	bool push(int chan, const std::string& rec) { return push(chan, rec.data(), rec.size()); }
+	/// Барьер: ожидание вывода всех записей, принятых до вызова.
+	void flush();
+	/// Остановка фонового потока с выводом всех принятых записей.
+	void stop();
+	/// Количество записей, отброшенных из-за переполнения или после остановки.
+	unsigned long long dropped() const { return m_nDropped.load(std::memory_order_relaxed); }
+	/// Количество записей, ушедших в список переполнения.
+	unsigned long long spilled() const { return m_nSpillIn.load(std::memory_order_relaxed); }
+	/// Политика при переполнении.
+	OverflowPolicy policy() const { return m_Policy; }
+private:
+	struct Slot {
+		std::atomic<size_t> seq;
+		int chan;
+		std::string rec;
+	};
+	bool tryPush(int chan, const char* data, size_t len);
+	void spill(int chan, const char* data, size_t len);
+	void wake();
+	size_t drainRing();
+	size_t drainSpill();
+	void run();
+
+	IAsyncSink& m_Sink;
+	const OverflowPolicy m_Policy;
+	std::vector<Slot> m_Ring;
+	size_t m_nMask;
+	alignas(64) std::atomic<size_t> m_nEnqueuePos;  // Следующая свободная позиция для производителей.
+	alignas(64) std::atomic<size_t> m_nDequeuePos;  // Следующая позиция для писателя.
+	std::atomic<unsigned long long> m_nDropped;
+	// Список переполнения (OverflowPolicy::Spill).
+	std::mutex m_SpillMutex;
+	std::deque<std::pair<int, std::string> > m_Spill;
+	std::atomic<size_t> m_nSpillSize;
+	std::atomic<unsigned long long> m_nSpillIn, m_nSpillOut;
+	// Синхронизация с фоновым потоком.
+	std::mutex m_WakeMutex;
+	std::condition_variable m_WakeCond;  // Будит писателя.
+	std::condition_variable m_DoneCond;  // Будит ожидающих в flush().
+	std::atomic<bool> m_bSleeping;
+	std::atomic<bool> m_bStop;
+	std::atomic<bool> m_bRunning;  // Фоновый поток ещё выбирает записи.
+	std::mutex m_JoinMutex;        // Ожидание завершения потока в stop().
+	std::thread m_Thread;
+}; //class AsyncWriter
@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#include "ILS_BatchLog.h"
+
+//=============================================================================
+// Работа с файлом (зависит от платформы)
+namespace {
+	int fileOpen(const std::string& path, bool append) {
+#ifdef _WIN32
+		return _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_BINARY | (append ? _O_APPEND : _O_TRUNC), _S_IREAD | _S_IWRITE);
+#else
+		return ::open(path.c_str(), O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC), 0644);
+#endif
+	}
+	// Длина открытого файла (начальное смещение при дописывании)
+	unsigned long long fileSize(int fd) {
+#ifdef _WIN32
+		const long long n = _lseeki64(fd, 0, SEEK_END);
+#else
+		const off_t n = ::lseek(fd, 0, SEEK_END);
+#endif
+		return n > 0 ? (unsigned long long)n : 0;
+	}
+	void fileClose(int fd) {
+#ifdef _WIN32
+		_close(fd);
+#else
+		::close(fd);
+#endif
+	}
+	// Запись блоков пакета с учётом частичной записи и прерывания сигналом.
+	// \param written - записано байт.
+	// \param err     - код ошибки (errno), 0 - пакет записан целиком.
+	// \return количество системных вызовов.
+	unsigned long long fileWrite(int fd, const std::vector<std::string>& blocks, size_t& written, int& err) {
+		unsigned long long calls = 0;
+		written = 0;
+		err = 0;
+#ifdef _WIN32
+		for (const std::string& b : blocks) {
+			for (size_t done = 0; done < b.size(); ) {
+				const int n = _write(fd, b.data() + done, unsigned(b.size() - done));
+				++calls;
+				if (n <= 0) {
+					err = n < 0 ? errno : ENOSPC;
+					return calls;
+				}
+				done += size_t(n);
+				written += size_t(n);
+			}
+		}
+#else
+		enum { maxIov = 64 };
+		struct iovec iov[maxIov];
+		size_t first = 0, skip = 0;  // Первый незаписанный блок и записанная часть этого блока
+		while (first < blocks.size()) {
+			int cnt = 0;
+			for (size_t i = first; i < blocks.size() && cnt < maxIov; ++i, ++cnt) {
+				iov[cnt].iov_base = const_cast<char*>(blocks[i].data()) + (i == first ? skip : 0);
+				iov[cnt].iov_len = blocks[i].size() - (i == first ? skip : 0);
+			}
+			ssize_t n = ::writev(fd, iov, cnt);
+			++calls;
+			if (n < 0 && errno == EINTR) continue;
+			// Ноль байт при непустом пакете - тоже сбой (иначе цикл не закончится)
+			if (n <= 0) {
+				err = n < 0 ? errno : ENOSPC;
+				return calls;
+			}
+			written += size_t(n);
+			// Пропуск записанного
+			while (first < blocks.size() && size_t(n) >= blocks[first].size() - skip) {
+				n -= ssize_t(blocks[first].size() - skip);
+				++first;
+				skip = 0;
+			}
+			skip += size_t(n);
+		}
+#endif
+		return calls;
+	}
+}
+
+//=============================================================================
+// BatchLogger - пакетная запись лога в файл.
+//-----------------------------------------------------------------------------
+// Конструктор
+BatchLogger::BatchLogger(const std::string& file, size_t batch_bytes,
+                         std::chrono::milliseconds deadline, std::ios_base::openmode mode)
+	: m_nFd(-1), m_nBatchBytes(std::max<size_t>(batch_bytes, 1)), m_Deadline(deadline),
+	  m_nStaged(0), m_nRecords(0), m_nOffset(0), m_bFailing(false), m_bStop(false) {
+	m_nFd = fileOpen(file, (mode & std::ios_base::app) != 0);
+	if (m_nFd < 0) return;
+	m_nOffset = fileSize(m_nFd);
+	m_Worker = std::thread(&BatchLogger::worker, this);
+}
+BatchLogger::~BatchLogger() {
+	BaseLogger::onLogFinish(true, false, false);
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bStop = true;
+	}
+	m_Cond.notify_all();
+	if (m_Worker.joinable()) m_Worker.join();
+	writeBatch();
+	if (m_nFd >= 0) fileClose(m_nFd);
+	m_pIndex.reset();
+}
+bool BatchLogger::setIndex(const std::string& file, unsigned block, int exact_level) {
+	std::lock_guard<std::mutex> io(m_IoMutex);
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	std::unique_ptr<LogIndexWriter> index(new LogIndexWriter);
+	if (!index->open(file, m_nOffset > 0, block, exact_level)) return false;
+	m_pIndex = std::move(index);
+	return true;
+}
+BatchLogger::TBatchStats BatchLogger::stats() const {
+	std::lock_guard<std::mutex> lock(m_IoMutex);
+	return m_Stats;
+}
+void BatchLogger::formatStats(std::string& res, const TBatchStats& st) {
+	ils_appendf(res, "BatchStats flushes=%llu records=%llu bytes=%llu syscalls=%llu failures=%llu dropped_bytes=%llu"
+		" bytes/syscall=%.0f write_avg=%.3fms write_max=%.3fms age_max=%.3fms batch_hist=",
+		st.flushes, st.records, st.bytes, st.syscalls, st.failures, st.dropped_bytes,
+		st.syscalls ? double(st.bytes) / double(st.syscalls) : 0.,
+		st.flushes ? double(st.write_ns_total) / double(st.flushes) / 1e6 : 0.,
+		double(st.write_ns_max) / 1e6, double(st.age_ns_max) / 1e6);
+	// Распределение выводится до последней непустой корзины: "1:3,2:10,4:0,8:7"
+	int last = TBatchStats::histSize - 1;
+	while (last > 0 && !st.size_hist[last]) --last;
+	for (int k = 0; k <= last; ++k)
+		ils_appendf(res, "%s%llu:%llu", k ? "," : "", 1ULL << k, st.size_hist[k]);
+}
+//-----------------------------------------------------------------------------
+// Функции механизма вывода
+void BatchLogger::lOut(MsgView msg) const { stage(msg, ILS_LEVEL_LOG, LogId()); }
+void BatchLogger::wOut(MsgView msg) const { stage(msg, ILS_LEVEL_WRN, LogId()); }
+void BatchLogger::eOut(MsgView msg) const { stage(msg, ILS_LEVEL_ERR, LogId()); }
+void BatchLogger::recordOut(int level, MsgView line, const LogId& id) const { stage(line, level, id); }
+void BatchLogger::stage(MsgView msg, int level, const LogId& id) const {
+	if (m_nFd < 0) return;
+	bool full, first;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		first = m_nRecords == 0;
+		if (first) m_First = std::chrono::steady_clock::now();
+		// В индекс строка попадёт после записи пакета, когда известно её смещение
+		if (m_pIndex) m_StageIndex.push_back(TIndexLine{ msg.size() + 1, level, id,
+			std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count() });
+		put(msg.data(), msg.size());
+		put("\n", 1);
+		++m_nRecords;
+		m_nStaged += msg.size() + 1;
+		full = m_nStaged >= m_nBatchBytes;
+	}
+	// Фоновый поток отсчитывает deadline от первой строки пакета
+	if (first) m_Cond.notify_all();
+	// Ошибки записываются сразу
+	if (level >= ILS_LEVEL_ERR || full) writeBatch();
+}
+void BatchLogger::put(const char* p, size_t n) const {
+	while (n) {
+		if (m_Stage.empty() || m_Stage.back().size() == blockSize) {
+			if (!m_Spare.empty()) {
+				m_Stage.push_back(std::move(m_Spare.back()));
+				m_Spare.pop_back();
+			} else {
+				m_Stage.emplace_back();
+				m_Stage.back().reserve(blockSize);
+			}
+		}
+		std::string& b = m_Stage.back();
+		const size_t k = std::min<size_t>(n, blockSize - b.size());
+		b.append(p, k);
+		p += k;
+		n -= k;
+	}
+}
+//-----------------------------------------------------------------------------
+// Запись пакета: буфер подменяется под блокировкой, запись идёт без неё
+void BatchLogger::writeBatch() const {
+	if (m_nFd < 0) return;
+	std::lock_guard<std::mutex> io(m_IoMutex);
+	size_t records, bytes;
+	std::chrono::steady_clock::time_point first;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!m_nRecords) return;
+		m_Writing.swap(m_Stage);
+		m_WritingIndex.swap(m_StageIndex);
+		records = m_nRecords;
+		bytes = m_nStaged;
+		first = m_First;
+		m_nRecords = 0;
+		m_nStaged = 0;
+	}
+	const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	size_t written;
+	int err;
+	const unsigned long long calls = fileWrite(m_nFd, m_Writing, written, err);
+	const std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+	// Статистика
+	const long long write_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+	const long long age_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - first).count();
+	int k = 0;
+	while (k + 1 < TBatchStats::histSize && (size_t(2) << k) <= records) ++k;
+	++m_Stats.size_hist[k];
+	++m_Stats.flushes;
+	m_Stats.bytes += written;
+	m_Stats.syscalls += calls;
+	// Строки пакета с ошибкой записи не считаются записанными
+	if (!err) m_Stats.records += records;
+	else {
+		++m_Stats.failures;
+		m_Stats.dropped_bytes += bytes - written;
+		m_Stats.last_error = err;
+	}
+	const bool report = err && !m_bFailing;
+	m_bFailing = err != 0;
+	m_Stats.write_ns_total += write_ns;
+	m_Stats.write_ns_max = std::max(m_Stats.write_ns_max, write_ns);
+	m_Stats.age_ns_max = std::max(m_Stats.age_ns_max, age_ns);
+	// Индекс - только строки, записанные целиком (обрывок строки при ошибке не
+	// индексируется, следующий пакет начинается за ним)
+	if (m_pIndex) {
+		unsigned long long offset = m_nOffset;
+		for (const TIndexLine& l : m_WritingIndex) {
+			if (offset + l.size > m_nOffset + written) break;
+			m_pIndex->add(offset, l.size, l.level, l.id, l.wall_us);
+			offset += l.size;
+		}
+	}
+	m_WritingIndex.clear();
+	m_nOffset += written;
+	// Блоки возвращаются в запас вместе с выделенной памятью
+	for (std::string& b : m_Writing) b.clear();
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (std::string& b : m_Writing) m_Spare.push_back(std::move(b));
+		m_Writing.clear();
+	}
+	// Через stderr, один раз на серию сбоев: запись в этот же лог снова упрётся в сбой
+	if (report)
+		fprintf(stderr, "BatchLogger: ошибка записи в лог (%s), потеряно %llu байт; следующие пакеты будут записываться снова\n",
+		        strerror(err), (unsigned long long)(bytes - written));
+}
+void BatchLogger::worker() {
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (!m_bStop) {
+		if (!m_nRecords) {
+			m_Cond.wait(lock);
+			continue;
+		}
+		const std::chrono::steady_clock::time_point due = m_First + m_Deadline;
+		if (std::chrono::steady_clock::now() < due) {
+			m_Cond.wait_until(lock, due);
+			continue;
+		}
+		lock.unlock();
+		writeBatch();
+		lock.lock();
+	}
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <ios>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ILS_StdLog.h"
+#include "ILS_LogIndex.h"
+
+//=============================================================================
+/// Регистратор хода процесса (Логгер) в файл с пакетной записью.
+/// @ingroup Kernel
+/// Готовые строки лога копируются в промежуточный буфер из блоков по 64 КБ,
+/// а в файл уходят пакетом - одним вызовом \c writev() на все блоки
+/// (в Windows - по одному \c _write() на блок). Пакет записывается, когда:
+/// - в буфере набралось \c batch_bytes байт;
+/// - самой старой строке в буфере исполнилось \c deadline (фоновый поток);
+/// - пришло сообщение об ошибке (сразу, вместе со всем накопленным);
+/// - вызван flush() или логгер разрушается.
+///
+/// Запись пакета выполняется вне блокировки буфера: производители в это
+/// время продолжают наполнять следующий пакет. Каждая запись пакета
+/// обновляет статистику (stats()): распределение размеров пакетов, байты на
+/// системный вызов, время записи и возраст самой старой строки.
+///
+/// Частичная запись и прерывание сигналом (EINTR) дописываются повторным
+/// вызовом. При ошибке записи (нет места на диске и т.п.) остаток пакета
+/// отбрасывается и учитывается в stats() (failures, dropped_bytes,
+/// last_error), в stderr один раз на серию сбоев выводится сообщение, а
+/// следующий пакет записывается снова. Строки индекса (setIndex()) пакета
+/// пишутся после его записи и только для строк, попавших в файл целиком,
+/// со смещениями по фактической длине файла.
+/// \see BaseLogger
+class BatchLogger : public BaseLogger {
+public:
+	/// Статистика пакетной записи.
+	struct TBatchStats {
+		enum { histSize = 16 };
+		unsigned long long flushes = 0;        ///< Записано пакетов.
+		unsigned long long records = 0;        ///< Записано строк (пакеты, записанные целиком).
+		unsigned long long bytes = 0;          ///< Записано байт (фактически попавших в файл).
+		unsigned long long syscalls = 0;       ///< Системных вызовов записи.
+		unsigned long long failures = 0;       ///< Пакетов, записанных не полностью (ошибка записи).
+		unsigned long long dropped_bytes = 0;  ///< Байт, не записанных из-за ошибок.
+		int last_error = 0;                    ///< Код (errno) последней ошибки записи, 0 - не было.
+		/// Распределение строк в пакете: элемент k - пакеты из [2^k, 2^(k+1)) строк.
+		unsigned long long size_hist[histSize] = {};
+		long long write_ns_total = 0;          ///< Суммарное время записи пакетов, нс.
+		long long write_ns_max = 0;            ///< Наибольшее время записи пакета, нс.
+		long long age_ns_max = 0;              ///< Наибольший возраст строки к моменту записи, нс.
+	};
+	//---------------------------------------------------------------------------
+	/// Конструктор.
+	/// \param file        - имя файла лога.
+	/// \param batch_bytes - размер пакета, при наборе которого он записывается сразу.
+	/// \param deadline    - наибольшее время ожидания строки в буфере.
+	/// \param mode        - режим открытия (std::ios_base::app - дописывать в существующий файл).
+	BatchLogger(const std::string& file, size_t batch_bytes = 1 << 20,
+	            std::chrono::milliseconds deadline = std::chrono::milliseconds(5),
+	            std::ios_base::openmode mode = std::ios_base::out);
+	virtual ~BatchLogger();
+	BatchLogger(const BatchLogger&) = delete;
+	BatchLogger& operator=(const BatchLogger&) = delete;
+	/// Удалось ли открыть файл.
+	bool isOpen() const { return m_nFd >= 0; }
+	/// Запись всего накопленного.
+	void flush() const { writeBatch(); }
+	/// Статистика пакетной записи.
+	TBatchStats stats() const;
+	/// Форматирование статистики в одну строку.
+	static void formatStats(std::string& res, const TBatchStats& st);
+	/// Ведение индекса лога (см. LogIndexWriter, утилита ils-query).
+	/// Вызывается до начала регистрации сообщений; при дописывании в лог
+	/// (std::ios_base::app) индекс тоже дописывается.
+	/// \param file        - имя файла индекса, обычно имя лога + ".idx".
+	/// \param block       - размер блока индекса в байтах лога.
+	/// \param exact_level - уровень, начиная с которого сохраняются точные смещения строк.
+	bool setIndex(const std::string& file, unsigned block = LogIndexWriter::defaultBlock, int exact_level = ILS_LEVEL_WRN);
+	//---------------------------------------------------------------------------
+protected: // Функции механизма вывода
+	virtual void lOut(MsgView msg) const;
+	virtual void wOut(MsgView msg) const;
+	virtual void eOut(MsgView msg) const;
+	virtual void recordOut(int level, MsgView line, const LogId& id) const;
+	/// Добавление строки в буфер.
+	/// \param level - уровень сообщения (ошибки записываются сразу).
+	/// \param id    - идентификатор сообщения (для индекса).
+	void stage(MsgView msg, int level, const LogId& id) const;
+	/// Копирование байтов в блоки буфера (вызывается под m_Mutex).
+	void put(const char* p, size_t n) const;
+	/// Запись накопленного пакета в файл.
+	void writeBatch() const;
+	/// Фоновый поток: запись пакетов по истечении deadline.
+	void worker();
+	enum { blockSize = 1 << 16 };
+	/// Строка пакета для индекса (смещение известно после записи пакета).
+	struct TIndexLine {
+		size_t size;
+		int level;
+		std::string id;
+		long long wall_us;
+	};
+	int m_nFd;
+	size_t m_nBatchBytes;
+	std::chrono::milliseconds m_Deadline;
+	mutable std::mutex m_Mutex;                   // Защищает наполняемый пакет
+	mutable std::condition_variable m_Cond;
+	mutable std::vector<std::string> m_Stage;     // Блоки наполняемого пакета
+	mutable std::vector<std::string> m_Spare;     // Свободные блоки (с выделенной памятью)
+	mutable size_t m_nStaged;                     // Байт в наполняемом пакете
+	mutable size_t m_nRecords;                    // Строк в наполняемом пакете
+	mutable std::vector<TIndexLine> m_StageIndex; // Строки наполняемого пакета для индекса
+	std::unique_ptr<LogIndexWriter> m_pIndex;     // Под m_Mutex и m_IoMutex, NULL - без индекса
+	mutable std::chrono::steady_clock::time_point m_First; // Время первой строки пакета
+	mutable std::mutex m_IoMutex;                 // Сериализует запись пакетов (порядок строк)
+	mutable std::vector<std::string> m_Writing;   // Записываемый пакет (под m_IoMutex)
+	mutable std::vector<TIndexLine> m_WritingIndex; // Его строки для индекса (под m_IoMutex)
+	mutable unsigned long long m_nOffset;         // Длина файла (под m_IoMutex)
+	mutable TBatchStats m_Stats;                  // Под m_IoMutex
+	mutable bool m_bFailing;                      // Предыдущий пакет не записан (под m_IoMutex)
+	bool m_bStop;
+	std::thread m_Worker;
+}; //class BatchLogger
@@ -0,0 +1,350 @@
+#include <stdint.h>
+#include <string.h>
+#include "ILS_BinLog.h"
+#include "ILS_StdLog.h"
+
+//=============================================================================
+// Вспомогательные функции записи в буфер
+namespace {
+	struct TBinTag;
+	const uint16_t endian_mark = 0x0102;
+
+	template<class T> inline void put(std::string& rec, const T& v) {
+		rec.append(reinterpret_cast<const char*>(&v), sizeof(v));
+	}
+	inline void putBytes(std::string& rec, const char* p, size_t n) {
+		rec.append(p, n);
+	}
+	// Беззнаковые преобразования сохраняются без расширения знака
+	inline bool isUnsigned(char conv) {
+		return conv == 'u' || conv == 'o' || conv == 'x' || conv == 'X';
+	}
+}
+
+//=============================================================================
+// BinLogger - запись лога в бинарный файл с отложенным форматированием.
+//-----------------------------------------------------------------------------
+// Конструктор
+BinLogger::BinLogger(const std::string& file, unsigned show_info, std::ios_base::openmode mode)
+	: m_pFile(NULL), m_Start(std::chrono::steady_clock::now()) {
+	m_pFile = fopen(file.c_str(), (mode & std::ios_base::app) ? "ab" : "wb");
+	if (!m_pFile) return;
+	setvbuf(m_pFile, NULL, _IOFBF, 1 << 16);
+	// Заголовок пишется в начало каждого сеанса, чтобы файл можно было дописывать
+	std::string rec("ILSB", 4);
+	put(rec, uint16_t(version));
+	put(rec, endian_mark);
+	put(rec, uint32_t(show_info));
+	// Системное время старта: время записи = время старта + монотонное смещение
+	put(rec, int64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count()));
+	fwrite(rec.data(), 1, rec.size(), m_pFile);
+}
+BinLogger::~BinLogger() {
+	if (m_pFile) fclose(m_pFile);
+}
+void BinLogger::flush() const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (m_pFile) fflush(m_pFile);
+}
+//-----------------------------------------------------------------------------
+// Функции интерфейса
+void BinLogger::infOut(MsgView msg, const LogId& id) const { textOut(ILS_LEVEL_INF, msg, id); }
+void BinLogger::logOut(MsgView msg, const LogId& id) const { textOut(ILS_LEVEL_LOG, msg, id); }
+void BinLogger::wrnOut(MsgView msg, const LogId& id) const { textOut(ILS_LEVEL_WRN, msg, id); }
+void BinLogger::errOut(MsgView msg, const LogId& id) const { textOut(ILS_LEVEL_ERR, msg, id); }
+//-----------------------------------------------------------------------------
+// Общая часть записи: тип, уровень, идентификатор и монотонное время от старта
+void BinLogger::putHeader(std::string& rec, int type, int level, const LogId& id) const {
+	put(rec, uint8_t(type));
+	put(rec, uint8_t(level));
+	const uint16_t idlen = uint16_t(id.size() < 0xFFFF ? id.size() : 0xFFFF);
+	put(rec, idlen);
+	putBytes(rec, id.data(), idlen);
+	put(rec, int64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - m_Start).count()));
+}
+void BinLogger::textOut(int level, MsgView msg, const LogId& id) const {
+	if (!m_pFile || !logEnabled(level)) return;
+	TThreadBuf<TBinTag> rec;
+	putHeader(rec.str(), rtText, level, id);
+	put(rec.str(), uint32_t(msg.size()));
+	putBytes(rec.str(), msg.data(), msg.size());
+	commit(rec.str(), NULL);
+}
+// Сохранение сырых аргументов по разобранному формату места вызова
+bool BinLogger::rawOut(int level, const TFmtSite& site, const LogId& id, va_list marker) const {
+	if (!m_pFile) return true;
+	if (!logEnabled(level)) return true;
+	TThreadBuf<TBinTag> buf;
+	std::string& rec = buf.str();
+	putHeader(rec, rtMessage, level, id);
+	put(rec, uint32_t(site.id));
+	const size_t len_pos = rec.size();
+	put(rec, uint32_t(0));
+	for (const TFmtSpec& spec : site.specs) {
+		for (int i = 0; i < spec.stars; ++i) put(rec, int64_t(va_arg(marker, int)));
+		const bool u = isUnsigned(spec.conv);
+		switch (spec.kind) {
+		case akInt:      put(rec, u ? int64_t(va_arg(marker, unsigned int)) : int64_t(va_arg(marker, int))); break;
+		case akLong:     put(rec, u ? int64_t(va_arg(marker, unsigned long)) : int64_t(va_arg(marker, long))); break;
+		case akLongLong: put(rec, int64_t(va_arg(marker, long long))); break;
+		case akSize:     put(rec, int64_t(va_arg(marker, size_t))); break;
+		case akIntMax:   put(rec, int64_t(va_arg(marker, intmax_t))); break;
+		case akPtrDiff:  put(rec, int64_t(va_arg(marker, ptrdiff_t))); break;
+		case akDouble:   put(rec, va_arg(marker, double)); break;
+		case akLongDouble: put(rec, double(va_arg(marker, long double))); break;
+		case akPtr:      put(rec, uint64_t(uintptr_t(va_arg(marker, void*)))); break;
+		case akStr: {
+			const char* s = va_arg(marker, const char*);
+			if (!s) { put(rec, uint32_t(0xFFFFFFFF)); break; }
+			const size_t n = strlen(s);
+			put(rec, uint32_t(n));
+			putBytes(rec, s, n);
+			break;
+		}
+		default: break;
+		}
+	}
+	const uint32_t args_len = uint32_t(rec.size() - len_pos - sizeof(uint32_t));
+	memcpy(&rec[len_pos], &args_len, sizeof(args_len));
+	commit(rec, &site);
+	return true;
+}
+// Запись в файл под блокировкой; формат места вызова пишется перед первым сообщением
+void BinLogger::commit(const std::string& rec, const TFmtSite* site) const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (site && (site->id >= m_Defs.size() || !m_Defs[site->id])) {
+		if (site->id >= m_Defs.size()) m_Defs.resize(site->id + 1, false);
+		m_Defs[site->id] = true;
+		std::string def;
+		put(def, uint8_t(rtFormat));
+		put(def, uint32_t(site->id));
+		const size_t n = strlen(site->fmt);
+		put(def, uint32_t(n));
+		putBytes(def, site->fmt, n);
+		fwrite(def.data(), 1, def.size(), m_pFile);
+	}
+	fwrite(rec.data(), 1, rec.size(), m_pFile);
+	// Ошибки не должны задерживаться в буфере - их важно не потерять при аварии
+	if (rec.size() > 1 && uint8_t(rec[1]) >= ILS_LEVEL_ERR) fflush(m_pFile);
+}
+
+//=============================================================================
+// BinLogDecoder - восстановление текстового лога
+//-----------------------------------------------------------------------------
+bool BinLogDecoder::open(const std::string& file) {
+	close();
+	m_pFile = fopen(file.c_str(), "rb");
+	if (!m_pFile) return false;
+	char magic[4];
+	uint16_t ver, endian;
+	uint32_t info;
+	int64_t wall;
+	if (!read(magic, 4) || memcmp(magic, "ILSB", 4) != 0 || !get(ver) || !get(endian) || !get(info) || !get(wall) ||
+	    ver != BinLogger::version || endian != endian_mark) {
+		close();
+		return false;
+	}
+	m_nShowInfo = info;
+	m_nStartWall = wall;
+	m_nSession = 1;
+	m_nRecPos = 0;
+	m_bCorrupt = false;
+	// Размер файла ограничивает длины полей: повреждённая длина не приводит к огромному выделению
+	const long pos = ftell(m_pFile);
+	fseek(m_pFile, 0, SEEK_END);
+	m_nSize = (long long)ftell(m_pFile);
+	fseek(m_pFile, pos, SEEK_SET);
+	return true;
+}
+void BinLogDecoder::close() {
+	if (m_pFile) fclose(m_pFile);
+	m_pFile = NULL;
+	m_Formats.clear();
+	m_Specs.clear();
+}
+bool BinLogDecoder::read(void* p, size_t n) {
+	return n == 0 || fread(p, 1, n, m_pFile) == n;
+}
+template<class T> bool BinLogDecoder::get(T& v) {
+	return read(&v, sizeof(v));
+}
+bool BinLogDecoder::avail(size_t n) const {
+	return (long long)ftell(m_pFile) + (long long)n <= m_nSize;
+}
+//-----------------------------------------------------------------------------
+// Чтение записей
+bool BinLogDecoder::next(TRecord& rec) {
+	if (!m_pFile || m_bCorrupt) return false;
+	for (;;) {
+		m_nRecPos = (long long)ftell(m_pFile);
+		uint8_t type;
+		// Ни одного байта следующей записи - обычный конец файла
+		if (!get(type)) return ferror(m_pFile) ? fail() : false;
+		if (type == 'I') {
+			// Заголовок следующего сеанса записи (файл дописывался)
+			char magic[3];
+			uint16_t ver, endian;
+			uint32_t info;
+			int64_t wall;
+			if (!read(magic, 3) || memcmp(magic, "LSB", 3) != 0 || !get(ver) || !get(endian) || !get(info) || !get(wall)) return fail();
+			m_nStartWall = wall;
+			// Номера форматов у нового сеанса свои
+			m_Formats.clear();
+			m_Specs.clear();
+			++m_nSession;
+			continue;
+		}
+		if (type == BinLogger::rtFormat) {
+			uint32_t site, len;
+			if (!get(site) || !get(len) || !avail(len)) return fail();
+			std::string fmt(len, '\0');
+			if (!read(&fmt[0], len)) return fail();
+			if (site >= m_Formats.size()) { m_Formats.resize(site + 1); m_Specs.resize(site + 1); }
+			m_Specs[site].clear();
+			ils_parse_format(fmt.c_str(), m_Specs[site]);
+			m_Formats[site].swap(fmt);
+			continue;
+		}
+		if (type != BinLogger::rtMessage && type != BinLogger::rtText) return fail();
+		uint8_t level;
+		uint16_t idlen;
+		int64_t mono;
+		if (!get(level) || !get(idlen)) return fail();
+		rec.level = level;
+		rec.id.resize(idlen);
+		if (!read(&rec.id[0], idlen) || !get(mono)) return fail();
+		rec.wall_us = m_nStartWall + mono;
+		rec.mono_us = mono;
+		uint32_t site = 0, len;
+		if (type == BinLogger::rtMessage && !get(site)) return fail();
+		if (!get(len) || !avail(len)) return fail();
+		std::string data(len, '\0');
+		if (!read(&data[0], len)) return fail();
+		if (type == BinLogger::rtText) rec.text.swap(data);
+		else {
+			rec.text.clear();
+			if (site >= m_Formats.size() || !renderRaw(m_Formats[site], m_Specs[site], data, rec.text)) return fail();
+		}
+		return true;
+	}
+}
+//-----------------------------------------------------------------------------
+// Форматирование сохранённых аргументов.
+// Каждый спецификатор форматируется отдельно: длина целых заменяется на "ll"
+// (значения сохранены в 64 битах), ключ %t - на %f, как в ILogger::msgTranslate().
+namespace {
+	template<class T> void appendSpec(std::string& res, const std::string& spec, const int* stars, int nstars, T v) {
+		switch (nstars) {
+		case 0: ils_appendf(res, spec.c_str(), v); break;
+		case 1: ils_appendf(res, spec.c_str(), stars[0], v); break;
+		default: ils_appendf(res, spec.c_str(), stars[0], stars[1], v); break;
+		}
+	}
+}
+bool BinLogDecoder::renderRaw(const std::string& fmt, const std::vector<TFmtSpec>& specs, const std::string& args, std::string& res) const {
+	size_t pos = 0, lit = 0;
+	auto take = [&](void* p, size_t n) {
+		if (pos + n > args.size()) return false;
+		memcpy(p, args.data() + pos, n);
+		pos += n;
+		return true;
+	};
+	std::string spec;
+	for (const TFmtSpec& s : specs) {
+		res.append(fmt, lit, s.begin - lit);
+		lit = s.end;
+		if (s.kind == akNone) { res += '%'; continue; }
+		int stars[2] = { 0, 0 };
+		for (int i = 0; i < s.stars && i < 2; ++i) {
+			int64_t v;
+			if (!take(&v, sizeof(v))) return false;
+			stars[i] = int(v);
+		}
+		spec.assign(fmt, s.begin, s.len_pos - s.begin);
+		switch (s.kind) {
+		case akInt: {
+			int64_t v;
+			if (!take(&v, sizeof(v))) return false;
+			spec.append(fmt, s.len_pos, s.end - s.len_pos);
+			appendSpec(res, spec, stars, s.stars, int(v));
+			break;
+		}
+		case akLong: case akLongLong: case akSize: case akIntMax: case akPtrDiff: {
+			int64_t v;
+			if (!take(&v, sizeof(v))) return false;
+			spec += "ll";
+			spec += s.conv;
+			appendSpec(res, spec, stars, s.stars, (long long)v);
+			break;
+		}
+		case akDouble: case akLongDouble: {
+			double v;
+			if (!take(&v, sizeof(v))) return false;
+			spec += s.conv == 't' ? 'f' : s.conv;
+			appendSpec(res, spec, stars, s.stars, v);
+			break;
+		}
+		case akPtr: {
+			uint64_t v;
+			if (!take(&v, sizeof(v))) return false;
+			spec += 'p';
+			appendSpec(res, spec, stars, s.stars, (void*)uintptr_t(v));
+			break;
+		}
+		case akStr: {
+			uint32_t n;
+			if (!take(&n, sizeof(n))) return false;
+			std::string str;
+			if (n == 0xFFFFFFFF) str = "(null)";
+			else {
+				if (pos + n > args.size()) return false;
+				str.assign(args, pos, n);
+				pos += n;
+			}
+			spec += 's';
+			appendSpec(res, spec, stars, s.stars, str.c_str());
+			break;
+		}
+		default:
+			return false;
+		}
+	}
+	res.append(fmt, lit, std::string::npos);
+	return true;
+}
+//-----------------------------------------------------------------------------
+// Строка лога в формате BaseLogger
+void BinLogDecoder::formatLine(std::string& res, const TRecord& rec, unsigned show_info, long long start_us, bool first) {
+	if (show_info & (BaseLogger::siDate | BaseLogger::siTime | BaseLogger::siElapsed))
+		BaseLogger::formatTitle(res, show_info, rec.wall_us, (rec.mono_us - start_us) / 1000, first);
+	switch (rec.level) {
+	case ILS_LEVEL_INF: res += "|INFO> "; break;
+	case ILS_LEVEL_WRN: res += "|WARNING> "; break;
+	case ILS_LEVEL_ERR: res += "|ERROR> "; break;
+	default: res += "> "; break;
+	}
+	res += rec.text;
+}
+long long BinLogDecoder::decode(const std::string& file, std::ostream& out, unsigned show_info, long long* corrupt_at) {
+	if (corrupt_at) *corrupt_at = -1;
+	BinLogDecoder dec;
+	if (!dec.open(file)) return -1;
+	if (show_info == unsigned(-1)) show_info = dec.showInfo();
+	TRecord rec;
+	std::string line;
+	long long n = 0, start_us = 0;
+	unsigned session = 0;
+	while (dec.next(rec)) {
+		// Каждый сеанс - отдельный логгер со своим временем старта
+		const bool first = dec.session() != session;
+		if (first) { session = dec.session(); start_us = rec.mono_us; }
+		line.clear();
+		formatLine(line, rec, show_info, start_us, first);
+		out << line << '\n';
+		++n;
+	}
+	if (corrupt_at && dec.corrupt()) *corrupt_at = dec.offset();
+	return n;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "ILS_Logger.h"
+
+//=============================================================================
+/// Регистратор хода процесса (Логгер) в компактный бинарный файл.
+/// @ingroup Kernel
+/// Сообщения, зарегистрированные макросами ILS_BLOG/ILS_BWRN/... (см. ILogger::out()),
+/// сохраняются без форматирования: номер формата места вызова, уровень,
+/// идентификатор, время и сырые байты аргументов. Строка формата записывается
+/// в файл один раз, при первом использовании. Сообщения, пришедшие уже
+/// отформатированными (ILogger::log(), ILS_LOG, секции), сохраняются текстом.
+/// Текстовый лог в формате BaseLogger восстанавливается утилитой ils-decode
+/// (см. BinLogDecoder).
+///
+/// Формат файла: заголовок "ILSB", версия, маска show_info, системное время
+/// старта; далее записи с монотонным временем от старта
+/// (rtFormat, rtMessage, rtText), числа записываются в порядке байтов машины,
+/// файл с другим порядком (поле endian заголовка) не декодируется.
+/// \note Для отложенно форматируемых сообщений ILogger::msgTranslate() не вызывается:
+/// ключ %t преобразуется в %f при декодировании.
+/// \see BinLogDecoder
+class BinLogger : public ILogger {
+public:
+	/// Типы записей файла.
+	enum { rtFormat = 1, rtMessage = 2, rtText = 3 };
+	/// Версия формата.
+	enum { version = 1 };
+	//---------------------------------------------------------------------------
+	/// Конструктор.
+	/// \param file      - имя бинарного файла.
+	/// \param show_info - маска полей заголовка для декодирования (см. BaseLogger::show_info).
+	/// \param mode      - режим открытия (std::ios_base::app - дописывать в существующий файл).
+	BinLogger(const std::string& file, unsigned show_info = 0, std::ios_base::openmode mode = std::ios_base::out);
+	virtual ~BinLogger();
+	BinLogger(const BinLogger&) = delete;
+	BinLogger& operator=(const BinLogger&) = delete;
+	/// Удалось ли открыть файл.
+	bool isOpen() const { return m_pFile != NULL; }
+	/// Сброс буферов файла.
+	void flush() const;
+	//---------------------------------------------------------------------------
+public: // Функции интерфейса
+	virtual void infOut(MsgView msg, const LogId& id) const;
+	virtual void logOut(MsgView msg, const LogId& id) const;
+	virtual void wrnOut(MsgView msg, const LogId& id) const;
+	virtual void errOut(MsgView msg, const LogId& id) const;
+	virtual bool rawOut(int level, const TFmtSite& site, const LogId& id, va_list marker) const;
+	//---------------------------------------------------------------------------
+protected:
+	/// Запись текстового сообщения.
+	void textOut(int level, MsgView msg, const LogId& id) const;
+	/// Запись готовой записи (и, при необходимости, определения формата) в файл.
+	void commit(const std::string& rec, const TFmtSite* site) const;
+	/// Дописывание общей части записи: уровень, идентификатор и время.
+	void putHeader(std::string& rec, int type, int level, const LogId& id) const;
+	std::FILE* m_pFile;
+	mutable std::mutex m_Mutex;
+	mutable std::vector<bool> m_Defs;  // Номера форматов, уже записанных в файл.
+	std::chrono::steady_clock::time_point m_Start;
+}; //class BinLogger
+
+//=============================================================================
+/// Восстановление текстового лога из бинарного файла BinLogger.
+/// @ingroup Kernel
+/// Текст каждой записи совпадает с тем, что вывел бы BaseLogger с той же
+/// маской show_info: заголовок (BaseLogger::formatTitle()), суффикс уровня
+/// ("> ", "|INFO> ", "|WARNING> ", "|ERROR> ") и тело сообщения.
+class BinLogDecoder {
+public:
+	/// Одна декодированная запись.
+	struct TRecord {
+		int level;
+		std::string id;
+		long long wall_us;  ///< Системное время, мкс от начала эпохи (время старта сеанса + mono_us).
+		long long mono_us;  ///< Монотонное время от создания логгера, мкс.
+		std::string text;   ///< Тело сообщения (без заголовка).
+	};
+	BinLogDecoder() : m_pFile(NULL), m_nShowInfo(0), m_nSession(0), m_nStartWall(0), m_nRecPos(0), m_nSize(0), m_bCorrupt(false) {}
+	~BinLogDecoder() { close(); }
+	/// Открытие файла и проверка заголовка.
+	bool open(const std::string& file);
+	void close();
+	/// Маска show_info, сохранённая в файле.
+	unsigned showInfo() const { return m_nShowInfo; }
+	/// Номер сеанса записи (увеличивается, если файл дописывался новым логгером).
+	unsigned session() const { return m_nSession; }
+	/// Чтение следующей записи с сообщением.
+	/// \return false - конец файла или повреждённая запись (см. corrupt()).
+	bool next(TRecord& rec);
+	/// Чтение остановлено на повреждённой (или обрезанной) записи, а не в конце файла.
+	bool corrupt() const { return m_bCorrupt; }
+	/// Смещение от начала файла последней прочитанной (при corrupt() - повреждённой) записи.
+	long long offset() const { return m_nRecPos; }
+	/// Формирование строки лога в формате BaseLogger.
+	/// \param first - это первая строка лога (вместо секунд с начала выводится время).
+	static void formatLine(std::string& res, const TRecord& rec, unsigned show_info, long long start_us, bool first);
+	/// Декодирование всего файла в поток.
+	/// \param show_info  - маска заголовка, (unsigned)-1 - взять из файла.
+	/// \param corrupt_at - если задан, сюда записывается смещение повреждённой записи,
+	///                     на которой остановилось декодирование, или -1, если файл прочитан целиком.
+	/// \return количество выведенных записей или -1, если файл не удалось открыть.
+	static long long decode(const std::string& file, std::ostream& out, unsigned show_info = unsigned(-1), long long* corrupt_at = NULL);
+private:
+	bool read(void* p, size_t n);
+	template<class T> bool get(T& v);
+	bool avail(size_t n) const;
+	bool fail() { m_bCorrupt = true; return false; }
+	bool renderRaw(const std::string& fmt, const std::vector<TFmtSpec>& specs, const std::string& args, std::string& res) const;
+	std::FILE* m_pFile;
+	unsigned m_nShowInfo;
+	unsigned m_nSession;
+	long long m_nStartWall;  // Системное время старта текущего сеанса, мкс.
+	long long m_nRecPos;     // Смещение начала текущей записи.
+	long long m_nSize;       // Размер файла при открытии.
+	bool m_bCorrupt;
+	std::vector<std::string> m_Formats;
+	std::vector<std::vector<TFmtSpec> > m_Specs;
+}; //class BinLogDecoder
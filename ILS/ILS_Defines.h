@@ -2,6 +2,7 @@
 #define ILS_DefinesH
 
 #include "ILS_LoggerStream.h"
+#include "ILS_RateLimit.h"
 
 /// Макрос записи сообщения в лог.
 /// Макрос надо обязательно вызывать в двух парах скобок!
@@ -9,21 +10,63 @@
 /// \code
 /// ILS_LOG(( "SOME_FUNC", "f(%f,%d) ", fSmth, iSmth  ));
 /// \endcode
-#define ILS_LOG(LOG_ARG) {TLoggerStream(this,&ILogger::logOut)LOG_ARG;}
-#define ILS_LOG_(PTR, LOG_ARG) {TLoggerStream(PTR,&ILogger::logOut)LOG_ARG;}
+/// Если уровень ILS_LEVEL_LOG отсечён порогом компиляции ILS_MIN_LEVEL или 
+/// порогом логгера, поток не создаётся и аргументы не вычисляются.
+/// Частота сообщений места вызова ограничивается TRateSite (если ограничение
+/// включено RateLimiter::setDefault()); подавленное сообщение тоже не форматируется.
+/// Подготовленный формат места вызова запоминается (TMsgSlot), поэтому
+/// формат должен быть строковой константой (см. MsgCatalog).
+#define ILS_LOG(LOG_ARG) ILS_OUT_LIMIT_(this, ILS_LEVEL_LOG, &ILogger::logOut, 0., 1, LOG_ARG)
+#define ILS_LOG_(PTR, LOG_ARG) ILS_OUT_LIMIT_(PTR, ILS_LEVEL_LOG, &ILogger::logOut, 0., 1, LOG_ARG)
 
 /// Макрос записи предупреждения в лог.
 /// @ingroup Common
-#define ILS_WRN(LOG_ARG)  {TLoggerStream(this,&ILogger::wrnOut)LOG_ARG;}
-#define ILS_WRN_(PTR, LOG_ARG)  {TLoggerStream(PTR,&ILogger::wrnOut)LOG_ARG;}
+#define ILS_WRN(LOG_ARG)  ILS_OUT_LIMIT_(this, ILS_LEVEL_WRN, &ILogger::wrnOut, 0., 1, LOG_ARG)
+#define ILS_WRN_(PTR, LOG_ARG)  ILS_OUT_LIMIT_(PTR, ILS_LEVEL_WRN, &ILogger::wrnOut, 0., 1, LOG_ARG)
+
+/// Макросы записи с собственным ограничением частоты места вызова.
+/// \note Пример работы:
+/// \code
+/// ILS_WRN_LIMIT(10, 5, ("app", "loading box %d failed", i));  // не более 10/с, серия до 5
+/// \endcode
+/// @ingroup Common
+#define ILS_LOG_LIMIT(PER_SEC, BURST, LOG_ARG) ILS_OUT_LIMIT_(this, ILS_LEVEL_LOG, &ILogger::logOut, PER_SEC, BURST, LOG_ARG)
+#define ILS_WRN_LIMIT(PER_SEC, BURST, LOG_ARG) ILS_OUT_LIMIT_(this, ILS_LEVEL_WRN, &ILogger::wrnOut, PER_SEC, BURST, LOG_ARG)
+#define ILS_OUT_LIMIT_(PTR, LEVEL, FUNC, PER_SEC, BURST, LOG_ARG) {if (ILS_ENABLED(PTR, LEVEL)) {\
+	static TRateSite ils_rate(__FILE__, __LINE__, PER_SEC, BURST); \
+	static TMsgSlot ils_msg; \
+	if (ils_rate.allow(PTR, LEVEL)) TLoggerStream(PTR,FUNC,&ils_rate,&ils_msg)LOG_ARG;}}
+
+/// Макросы записи сообщения с постоянным форматом.
+/// Строка формата регистрируется один раз на место вызова (TFmtSite), что 
+/// позволяет логгерам с отложенным форматированием (BinLogger) сохранять 
+/// только номер формата и сырые аргументы. Для остальных логгеров результат 
+/// совпадает с ILogger::log()/wrn()/...
+/// \note Пример работы:
+/// \code
+/// ILS_BLOG("SOME_FUNC", "f(%f,%d) ", fSmth, iSmth);
+/// \endcode
+/// @ingroup Common
+#define ILS_BOUT_(PTR, LEVEL, ID, FMT, ...) {if (ILS_ENABLED(PTR, LEVEL)) {\
+	static const TFmtSite ils_site(FMT); \
+	static TRateSite ils_rate(__FILE__, __LINE__, 0., 1, ils_site.fmt); \
+	if (ils_rate.allow(PTR, LEVEL)) (PTR)->out(LEVEL, ID, &ils_site, ##__VA_ARGS__);}}
+#define ILS_BINF(ID, FMT, ...) ILS_BOUT_(this, ILS_LEVEL_INF, ID, FMT, ##__VA_ARGS__)
+#define ILS_BLOG(ID, FMT, ...) ILS_BOUT_(this, ILS_LEVEL_LOG, ID, FMT, ##__VA_ARGS__)
+#define ILS_BWRN(ID, FMT, ...) ILS_BOUT_(this, ILS_LEVEL_WRN, ID, FMT, ##__VA_ARGS__)
+#define ILS_BERR(ID, FMT, ...) ILS_BOUT_(this, ILS_LEVEL_ERR, ID, FMT, ##__VA_ARGS__)
 
 /// Макрос начала секции.
 /// Макрос создает try-блок скобку его начала, чтобы в макросе закрытия секции сообщить о наличии исключений в ней.
+/// Решение о выводе секции (уровень ILS_LEVEL_INF) принимается один раз в начале,
+/// при отключенной секции аргументы начала и конца не вычисляются.
 /// @ingroup Common
 #define ILS_SECTB(SECTID, LOG_ARG) {\
 	TLoggerStream oSection##SECTID(this,&ILogger::infOut,#SECTID); \
-	oSection##SECTID.SectBegin LOG_ARG; \
-	oSection##SECTID.Flush();\
+	if (ILS_ENABLED(this, ILS_LEVEL_INF)) {\
+		oSection##SECTID.SectBegin LOG_ARG; \
+		oSection##SECTID.Flush();\
+	} else oSection##SECTID.Disable();\
 	try
 
 /// Макрос начала нумерованной секции.
@@ -31,25 +74,29 @@
 /// @ingroup Common
 #define ILS_SECTBI(SECTID, INDEX, LOG_ARG) {\
 	TLoggerStream oSection##SECTID(this,&ILogger::infOut,#SECTID,INDEX); \
-	oSection##SECTID.SectBegin LOG_ARG; \
-	oSection##SECTID.Flush();\
+	if (ILS_ENABLED(this, ILS_LEVEL_INF)) {\
+		oSection##SECTID.SectBegin LOG_ARG; \
+		oSection##SECTID.Flush();\
+	} else oSection##SECTID.Disable();\
 	try
 
 /// Макрос окончания секции.
+/// Если секцию покидает исключение, выводится предупреждение и вызывается
+/// ILogger::incidentOut() (например, для сброса журнала FlightRecorder).
 /// @ingroup Common
 #define ILS_SECTE(SECTID, LOG_ARG) \
-	catch(const std::exception& e)  {wrn("SectException", "Секция %s не завершена из-за: %s", oSection##SECTID.SectId(), e.what());throw;}\
-	catch(...) {wrn("SectException", "Секция %s не завершена из-за: %s", oSection##SECTID.SectId(), "unknown");throw;}\
-	oSection##SECTID.SectEnd LOG_ARG;\
+	catch(const std::exception& e)  {wrn("SectException", "Секция %s не завершена из-за: %s", oSection##SECTID.SectId(), e.what());incidentOut(#SECTID);throw;}\
+	catch(...) {wrn("SectException", "Секция %s не завершена из-за: %s", oSection##SECTID.SectId(), "unknown");incidentOut(#SECTID);throw;}\
+	if (oSection##SECTID.Enabled()) oSection##SECTID.SectEnd LOG_ARG;\
 	}
 
 /// Макрос окончания нумерованной секции.
 /// @ingroup Common
 #define ILS_SECTEI(SECTID, INDEX, LOG_ARG) \
-	catch(const std::exception& e)  {wrn("SectException", "Секция %s не завершена из-за: %s", oSection##SECTID.SectId(), e.what());throw;}\
-	catch(...) {wrn("SectException", "Секция %s не завершена из-за: %s", oSection##SECTID.SectId(), "unknown");throw;}\
+	catch(const std::exception& e)  {wrn("SectException", "Секция %s не завершена из-за: %s", oSection##SECTID.SectId(), e.what());incidentOut(#SECTID);throw;}\
+	catch(...) {wrn("SectException", "Секция %s не завершена из-за: %s", oSection##SECTID.SectId(), "unknown");incidentOut(#SECTID);throw;}\
 	oSection##SECTID.SectCheck(#SECTID, INDEX);\
-	oSection##SECTID.SectEnd LOG_ARG;\
+	if (oSection##SECTID.Enabled()) oSection##SECTID.SectEnd LOG_ARG;\
 	}
 
 #endif  // ILS_DefinesH
@@ -0,0 +1,209 @@
+#include <cstring>
+#include "ILS_FanoutLog.h"
+
+//=============================================================================
+// Очередь приёмника.
+// Запись очереди - "<id>\0<текст>", канал - уровень важности; для отметок
+// секций - "<секция>\0<время>" в каналах chSectBegin/chSectEnd.
+struct FanoutLogger::TQueue : public IAsyncSink {
+	enum { chSectBegin = 8, chSectEnd = 9 };
+	std::shared_ptr<ILogger> logger;
+	LogId id;  // Используется только фоновым потоком
+	AsyncWriter writer;
+	TQueue(std::shared_ptr<ILogger> l, size_t capacity, OverflowPolicy policy)
+		: logger(l), writer(*this, capacity, policy) {}
+	~TQueue() { writer.stop(); }
+	virtual void asyncWrite(int chan, const std::string& rec) {
+		const size_t z = rec.find('\0');
+		if (z == std::string::npos) return;
+		try {
+			if (chan == chSectBegin || chan == chSectEnd) {
+				long long ticks = 0;
+				if (rec.size() - z - 1 == sizeof(ticks)) memcpy(&ticks, rec.data() + z + 1, sizeof(ticks));
+				const std::chrono::steady_clock::time_point t{ std::chrono::steady_clock::duration(ticks) };
+				logger->sectOut(chan == chSectBegin, rec.c_str(), t);
+				return;
+			}
+			id.assign(rec, 0, z);
+			(logger.get()->*FanoutLogger::levelOut(chan))(MsgView(rec).substr(z + 1), id);
+		}
+		catch (...) {}
+	}
+};
+
+namespace {
+	struct TPackTag; struct TFanFmtTag; struct TFanMsgTag; struct TSkipTag;
+	inline bool startsWith(const std::string& s, const std::string& prefix) {
+		return s.size() >= prefix.size() && s.compare(0, prefix.size(), prefix) == 0;
+	}
+}
+
+//=============================================================================
+// FanoutLogger - раздача сообщений нескольким приёмникам.
+//-----------------------------------------------------------------------------
+// Конструктор: без приёмников выводить некуда
+FanoutLogger::FanoutLogger() {
+	log_level.store(ILS_LEVEL_OFF, std::memory_order_relaxed);
+}
+// Очереди останавливаются (с выводом принятого) до разрушения приёмников
+FanoutLogger::~FanoutLogger() {
+	for (TSink& s : m_Sinks) s.queue.reset();
+}
+size_t FanoutLogger::addSink(std::shared_ptr<ILogger> sink, const TSinkOptions& opt) {
+	TSink s;
+	s.logger = sink;
+	s.opt = opt;
+	if (opt.async) s.queue.reset(new TQueue(sink, opt.capacity, opt.policy));
+	m_Sinks.push_back(std::move(s));
+	// Порог - наименьший из порогов приёмников
+	if (opt.level < log_level.load(std::memory_order_relaxed)) setLogLevel(opt.level);
+	return m_Sinks.size() - 1;
+}
+void FanoutLogger::flush() const {
+	for (const TSink& s : m_Sinks)
+		if (s.queue) s.queue->writer.flush();
+}
+unsigned long long FanoutLogger::dropped() const {
+	unsigned long long n = 0;
+	for (const TSink& s : m_Sinks)
+		if (s.queue) n += s.queue->writer.dropped();
+	return n;
+}
+//-----------------------------------------------------------------------------
+// Фильтр приёмника: порог, затем исключения, затем разрешённые префиксы
+bool FanoutLogger::TSink::acceptsLevel(int level) const {
+	return level >= opt.level && logger->logEnabled(level);
+}
+bool FanoutLogger::TSink::accepts(int level, const LogId& id) const {
+	if (!acceptsLevel(level)) return false;
+	for (const std::string& p : opt.exclude)
+		if (startsWith(id, p)) return false;
+	if (opt.include.empty()) return true;
+	for (const std::string& p : opt.include)
+		if (startsWith(id, p)) return true;
+	return false;
+}
+//-----------------------------------------------------------------------------
+// Функции интерфейса
+void FanoutLogger::dispatch(int level, MsgView msg, const LogId& id, const char* skip) const {
+	const TOutFunc out = levelOut(level);
+	// Запись для очередей собирается один раз, при первом асинхронном приёмнике
+	TThreadBuf<TPackTag> pack;
+	bool packed = false;
+	for (size_t i = 0; i < m_Sinks.size(); ++i) {
+		if (skip && skip[i]) continue;
+		const TSink& s = m_Sinks[i];
+		try {
+			if (!s.accepts(level, id)) continue;
+			if (!s.queue) {
+				(s.logger.get()->*out)(msg, id);
+				continue;
+			}
+			if (!packed) {
+				pack.str().append(id);
+				pack.str() += '\0';
+				pack.str().append(msg.data(), msg.size());
+				packed = true;
+			}
+			s.queue->writer.push(level, pack.str());
+		}
+		catch (...) {}
+	}
+}
+// Приёмники с отложенным форматированием получают сырые аргументы,
+// остальным текст форматируется один раз. Если сырые аргументы не принял ни
+// один приёмник, текст формирует и раздаёт вызывающий (ILogger::out())
+bool FanoutLogger::rawOut(int level, const TFmtSite& site, const LogId& id, va_list marker) const {
+	// Отметки приёмников, получивших сообщение (буфер потока, без выделения памяти)
+	TThreadBuf<TSkipTag> done;
+	done.str().assign(m_Sinks.size(), '\0');
+	bool raw = false, text = false;
+	for (size_t i = 0; i < m_Sinks.size(); ++i) {
+		const TSink& s = m_Sinks[i];
+		try {
+			if (!s.accepts(level, id)) continue;
+			bool ok = false;
+			if (!s.queue) {
+				va_list args;
+				va_copy(args, marker);
+				ok = s.logger->rawOut(level, site, id, args);
+				va_end(args);
+			}
+			if (ok) done.str()[i] = 1;
+			else text = true;
+			raw = raw || ok;
+		}
+		catch (...) {}
+	}
+	if (!raw) return false;
+	if (text) {
+		TThreadBuf<TFanFmtTag> fmt;
+		TThreadBuf<TFanMsgTag> str;
+		ils_vappendf(str.str(), msgTranslate(id, site.fmt, fmt.str()), marker);
+		dispatch(level, str.str(), id, done.str().data());
+	}
+	return true;
+}
+void FanoutLogger::sectOut(bool begin, const char* sect, std::chrono::steady_clock::time_point t) const {
+	if (m_Sinks.empty()) return;
+	// Имя секции - не идентификатор сообщения: действует только порог приёмника
+	const LogId name(sect ? sect : "");
+	for (const TSink& s : m_Sinks) {
+		try {
+			if (!s.acceptsLevel(ILS_LEVEL_INF)) continue;
+			if (!s.queue) {
+				s.logger->sectOut(begin, sect, t);
+				continue;
+			}
+			TThreadBuf<TPackTag> pack;
+			const long long ticks = t.time_since_epoch().count();
+			pack.str().append(name);
+			pack.str() += '\0';
+			pack.str().append(reinterpret_cast<const char*>(&ticks), sizeof(ticks));
+			s.queue->writer.push(begin ? TQueue::chSectBegin : TQueue::chSectEnd, pack.str());
+		}
+		catch (...) {}
+	}
+}
+// Отметка передаётся всем приёмникам в вызывающем потоке
+void FanoutLogger::incidentOut(const char* what) const {
+	for (const TSink& s : m_Sinks) {
+		try { s.logger->incidentOut(what); }
+		catch (...) {}
+	}
+}
+
+//=============================================================================
+// RingLogger - кольцевой буфер последних строк лога.
+//-----------------------------------------------------------------------------
+RingLogger::RingLogger(size_t capacity) : m_Ring(capacity ? capacity : 1), m_nTotal(0) {}
+RingLogger::~RingLogger() {
+	BaseLogger::onLogFinish(true, false, false);
+}
+std::vector<std::string> RingLogger::snapshot() const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	std::vector<std::string> res;
+	const size_t n = m_Ring.size();
+	const unsigned long long first = m_nTotal > n ? m_nTotal - n : 0;
+	res.reserve(size_t(m_nTotal - first));
+	for (unsigned long long i = first; i < m_nTotal; ++i) res.push_back(m_Ring[size_t(i % n)]);
+	return res;
+}
+void RingLogger::dump(std::ostream& out) const {
+	for (const std::string& line : snapshot()) out << line << '\n';
+	out.flush();
+}
+void RingLogger::clear() {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_nTotal = 0;
+}
+unsigned long long RingLogger::total() const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_nTotal;
+}
+// Строка заменяет самую старую, память строки переиспользуется
+void RingLogger::put(MsgView msg) const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Ring[size_t(m_nTotal % m_Ring.size())].assign(msg.data(), msg.size());
+	++m_nTotal;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "ILS_StdLog.h"
+#include "ILS_AsyncWriter.h"
+
+//=============================================================================
+/// Регистратор, раздающий каждое сообщение нескольким логгерам (приёмникам).
+/// @ingroup Kernel
+/// Текст сообщения форматируется один раз (printf-формат и аргументы), и
+/// готовый текст передаётся всем приёмникам; каждый приёмник только добавляет
+/// свой заголовок и выводит строку. У каждого приёмника свой порог важности и
+/// фильтр по идентификатору сообщения (списки префиксов LogId; к отметкам
+/// секций sectOut() применяется только порог):
+/// \code
+/// auto fan = std::make_shared<FanoutLogger>();
+/// fan->addSink(std::make_shared<StdLogger>("app.log"));
+/// FanoutLogger::TSinkOptions con;
+/// con.level = ILS_LEVEL_WRN;                  // в консоль - только предупреждения и ошибки
+/// fan->addSink(std::make_shared<StdLogger>(), con);
+/// FanoutLogger::TSinkOptions net;
+/// net.include.push_back("net.");              // отдельный файл для сетевой подсистемы
+/// net.async = true;                           // медленный приёмник - на своей очереди
+/// fan->addSink(std::make_shared<StdLogger>("net.log"), net);
+/// app.setPersonalLogger(fan);
+/// \endcode
+///
+/// Приёмник с \c async получает сообщения через собственную очередь
+/// \c AsyncWriter с фоновым потоком, так что медленный вывод не задерживает
+/// ни вызывающий поток, ни остальные приёмники.
+///
+/// Сообщения с постоянным форматом (ILS_BLOG ...) передаются приёмникам,
+/// поддерживающим отложенное форматирование (BinLogger), без форматирования;
+/// текст формируется только если он нужен хотя бы одному другому приёмнику.
+///
+/// Порог важности FanoutLogger-а - наименьший из порогов приёмников, поэтому
+/// сообщение, не нужное ни одному приёмнику, не форматируется.
+/// \warning Приёмники добавляются до начала регистрации сообщений из других потоков.
+/// \see ILogger , AsyncWriter
+class FanoutLogger : public ILogger {
+public:
+	/// Настройки приёмника.
+	struct TSinkOptions {
+		/// Порог важности сообщений приёмника (действует вместе с порогом самого логгера).
+		int level = ILS_LEVEL_DBG;
+		/// Префиксы идентификаторов, которые принимаются (пустой список - все).
+		std::vector<std::string> include;
+		/// Префиксы идентификаторов, которые отбрасываются (проверяются первыми).
+		std::vector<std::string> exclude;
+		/// Выводить через собственную очередь с фоновым потоком.
+		bool async = false;
+		/// Ёмкость очереди (для async).
+		size_t capacity = 8192;
+		/// Поведение при переполнении очереди (для async).
+		OverflowPolicy policy = OverflowPolicy::Block;
+	};
+	//---------------------------------------------------------------------------
+	FanoutLogger();
+	virtual ~FanoutLogger();
+	FanoutLogger(const FanoutLogger&) = delete;
+	FanoutLogger& operator=(const FanoutLogger&) = delete;
+	/// Добавление приёмника.
+	/// \return номер приёмника.
+	size_t addSink(std::shared_ptr<ILogger> sink, const TSinkOptions& opt);
+	/// Добавление приёмника без фильтров, с выводом в вызывающем потоке.
+	size_t addSink(std::shared_ptr<ILogger> sink) { return addSink(sink, TSinkOptions()); }
+	/// Количество приёмников.
+	size_t sinkCount() const { return m_Sinks.size(); }
+	/// Приёмник с номером \c n.
+	std::shared_ptr<ILogger> sink(size_t n) const { return m_Sinks[n].logger; }
+	/// Барьер: ожидание вывода всех записей из очередей приёмников.
+	void flush() const;
+	/// Количество записей, потерянных очередями приёмников (OverflowPolicy::DropNewest).
+	unsigned long long dropped() const;
+	//---------------------------------------------------------------------------
+public: // Функции интерфейса
+	virtual void infOut(MsgView msg, const LogId& id) const { dispatch(ILS_LEVEL_INF, msg, id, NULL); }
+	virtual void logOut(MsgView msg, const LogId& id) const { dispatch(ILS_LEVEL_LOG, msg, id, NULL); }
+	virtual void wrnOut(MsgView msg, const LogId& id) const { dispatch(ILS_LEVEL_WRN, msg, id, NULL); }
+	virtual void errOut(MsgView msg, const LogId& id) const { dispatch(ILS_LEVEL_ERR, msg, id, NULL); }
+	virtual bool rawOut(int level, const TFmtSite& site, const LogId& id, va_list marker) const;
+	virtual void sectOut(bool begin, const char* sect, std::chrono::steady_clock::time_point t) const;
+	virtual void incidentOut(const char* what) const;
+	virtual double logParam(int param) const { return m_Sinks.empty() ? 0. : m_Sinks[0].logger->logParam(param); }
+protected:
+	/// Очередь приёмника: фоновый поток передаёт записи логгеру.
+	struct TQueue;
+	struct TSink {
+		std::shared_ptr<ILogger> logger;
+		TSinkOptions opt;
+		std::unique_ptr<TQueue> queue;  // NULL - вывод в вызывающем потоке
+		/// Нужно ли приёмнику сообщение.
+		bool accepts(int level, const LogId& id) const;
+		/// Проходит ли уровень \c level порог приёмника (без фильтра по идентификатору).
+		bool acceptsLevel(int level) const;
+	};
+	/// Передача готового текста всем приёмникам, кроме отмеченных в \c skip
+	/// (ненулевой элемент - приёмник уже получил сообщение через rawOut(); NULL - нет таких).
+	void dispatch(int level, MsgView msg, const LogId& id, const char* skip) const;
+	std::vector<TSink> m_Sinks;
+}; //class FanoutLogger
+
+//=============================================================================
+/// Регистратор хода процесса (Логгер) в кольцевой буфер в памяти.
+/// @ingroup Kernel
+/// Хранит последние \c capacity строк (с заголовками BaseLogger); старые
+/// строки вытесняются новыми. Удобен как приёмник FanoutLogger-а, чтобы
+/// иметь под рукой хвост лога, например для вывода в окне приложения или в
+/// отчёте об ошибке. Память под строки переиспользуется.
+/// \see BaseLogger , FanoutLogger
+class RingLogger : public BaseLogger {
+public:
+	/// Конструктор.
+	/// \param capacity - количество хранимых строк.
+	explicit RingLogger(size_t capacity = 1024);
+	virtual ~RingLogger();
+	/// Хранимые строки, от старых к новым.
+	std::vector<std::string> snapshot() const;
+	/// Вывод хранимых строк в поток.
+	void dump(std::ostream& out) const;
+	/// Удаление хранимых строк.
+	void clear();
+	/// Всего записано строк с создания или clear() (включая вытесненные).
+	unsigned long long total() const;
+	//---------------------------------------------------------------------------
+protected: // Функции механизма вывода
+	virtual void lOut(MsgView msg) const { put(msg); }
+	virtual void wOut(MsgView msg) const { put(msg); }
+	virtual void eOut(MsgView msg) const { put(msg); }
+	void put(MsgView msg) const;
+	mutable std::mutex m_Mutex;
+	mutable std::vector<std::string> m_Ring;
+	mutable unsigned long long m_nTotal;  // Номер следующей строки
+}; //class RingLogger
@@ -0,0 +1,404 @@
+#include <algorithm>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <signal.h>
+#include <unistd.h>
+#endif
+#include "ILS_FlightRecorder.h"
+
+//=============================================================================
+// Буфер потока.
+// Запись занимает stride слов: номер версии (seqlock, нечётный - запись идёт),
+// уровень/длина/номер потока, время в нс от создания самописца и текст.
+// Все слова атомарные, поэтому чтение буфера из другого потока (или из
+// обработчика сигнала) во время записи корректно: повреждённая запись
+// распознаётся по номеру версии и пропускается.
+struct FlightRecorder::TRing {
+	enum { hdrWords = 3 };
+	std::atomic<bool> owned;                 // Буфер занят живым потоком
+	std::atomic<bool> alive;                 // Самописец ещё существует
+	std::atomic<unsigned long long> head;    // Записано всего
+	unsigned long long dumped;               // Выведено до этого номера (под m_DumpMutex)
+	const size_t capacity, words, stride;
+	std::unique_ptr<std::atomic<uint64_t>[]> data;
+	TRing(size_t cap, size_t text_words)
+		: owned(true), alive(true), head(0), dumped(0), capacity(cap), words(text_words),
+		  stride(hdrWords + text_words), data(new std::atomic<uint64_t>[cap * (hdrWords + text_words)]) {
+		for (size_t i = 0; i < capacity * stride; ++i) data[i].store(0, std::memory_order_relaxed);
+	}
+	// Запись (только поток-владелец)
+	void put(int level, unsigned tid, long long ns, const char* p, size_t len) {
+		const unsigned long long n = head.load(std::memory_order_relaxed);
+		std::atomic<uint64_t>* s = &data[size_t(n % capacity) * stride];
+		const uint64_t seq = s[0].load(std::memory_order_relaxed);
+		s[0].store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		len = std::min(len, words * 8);
+		s[1].store(uint64_t(level & 0xFF) | uint64_t(len) << 8 | uint64_t(tid) << 32, std::memory_order_relaxed);
+		s[2].store(uint64_t(ns), std::memory_order_relaxed);
+		for (size_t w = 0; w * 8 < len; ++w) {
+			uint64_t v = 0;
+			memcpy(&v, p + w * 8, std::min<size_t>(8, len - w * 8));
+			s[hdrWords + w].store(v, std::memory_order_relaxed);
+		}
+		s[0].store(seq + 2, std::memory_order_release);
+		head.store(n + 1, std::memory_order_release);
+	}
+	// Чтение записи номер n; false - запись уже затёрта или пишется
+	bool get(unsigned long long n, int& level, unsigned& tid, long long& ns, char* text, size_t& len) const {
+		const std::atomic<uint64_t>* s = &data[size_t(n % capacity) * stride];
+		const uint64_t seq = s[0].load(std::memory_order_acquire);
+		// Каждая запись в ячейку увеличивает версию на 2
+		if (seq != 2 * (n / capacity + 1)) return false;
+		const uint64_t meta = s[1].load(std::memory_order_relaxed);
+		ns = (long long)s[2].load(std::memory_order_relaxed);
+		level = int(meta & 0xFF);
+		tid = unsigned(meta >> 32);
+		len = std::min<size_t>(size_t(meta >> 8 & 0xFFFFFF), words * 8);
+		for (size_t w = 0; w * 8 < len; ++w) {
+			const uint64_t v = s[hdrWords + w].load(std::memory_order_relaxed);
+			memcpy(text + w * 8, &v, std::min<size_t>(8, len - w * 8));
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return s[0].load(std::memory_order_relaxed) == seq;
+	}
+};
+
+namespace {
+	typedef FlightRecorder::TRing TRing;
+
+	// Буферы текущего потока; при завершении потока буферы освобождаются
+	// (записи остаются и доступны для вывода)
+	struct TLocalRings {
+		std::vector<std::pair<unsigned long long, std::shared_ptr<TRing> > > rings;
+		~TLocalRings() {
+			for (auto& p : rings)
+				if (p.second) p.second->owned.store(false, std::memory_order_release);
+		}
+	};
+	thread_local TLocalRings tls_rings;
+
+	std::atomic<unsigned long long>& recorderCounter() {
+		static std::atomic<unsigned long long> n(0);
+		return n;
+	}
+
+	//-------------------------------------------------------------------------
+	// Форматирование записи без выделения памяти (используется и в обработчике сигнала)
+	void putUInt(char*& p, unsigned long long v, int width) {
+		char s[24];
+		int n = 0;
+		do { s[n++] = char('0' + v % 10); v /= 10; } while (v);
+		while (n < width) s[n++] = '0';
+		while (n) *p++ = s[--n];
+	}
+	void putStr(char*& p, const char* s) {
+		while (*s) *p++ = *s++;
+	}
+	// "  [T3 12.345678 WRN] текст\n"; буфер - не менее maxRecordSize + 64
+	size_t formatRecord(char* buf, int level, unsigned tid, long long ns, const char* text, size_t len) {
+		static const char* const names[] = { "DBG", "LOG", "INF", "WRN", "ERR" };
+		char* p = buf;
+		putStr(p, "  [T");
+		putUInt(p, tid, 0);
+		*p++ = ' ';
+		if (ns < 0) ns = 0;
+		putUInt(p, (unsigned long long)(ns / 1000000000), 0);
+		*p++ = '.';
+		putUInt(p, (unsigned long long)(ns % 1000000000 / 1000), 6);
+		*p++ = ' ';
+		putStr(p, level >= 0 && level <= ILS_LEVEL_ERR ? names[level] : "???");
+		putStr(p, "] ");
+		memcpy(p, text, len);
+		p += len;
+		*p++ = '\n';
+		return size_t(p - buf);
+	}
+	// Обход записей буфера с номерами [from, head); \return head
+	template<class F> unsigned long long visitRing(const TRing& r, unsigned long long from, F f) {
+		const unsigned long long head = r.head.load(std::memory_order_acquire);
+		if (head > r.capacity) from = std::max(from, head - r.capacity);
+		char text[FlightRecorder::maxRecordSize];
+		for (unsigned long long n = from; n < head; ++n) {
+			int level;
+			unsigned tid;
+			long long ns;
+			size_t len;
+			if (r.get(n, level, tid, ns, text, len)) f(level, tid, ns, text, len);
+		}
+		return head;
+	}
+	void writeAll(int fd, const char* p, size_t n) {
+		while (n) {
+#ifdef _WIN32
+			const int k = _write(fd, p, unsigned(n));
+#else
+			const ssize_t k = ::write(fd, p, n);
+#endif
+			if (k <= 0) return;
+			p += k;
+			n -= size_t(k);
+		}
+	}
+
+	//-------------------------------------------------------------------------
+	// Обработчики аварийных сигналов
+	const int g_Signals[] = { SIGSEGV, SIGABRT, SIGFPE, SIGILL,
+#ifdef SIGBUS
+		SIGBUS,
+#endif
+	};
+	const size_t g_nSignals = sizeof(g_Signals) / sizeof(g_Signals[0]);
+	std::atomic<const FlightRecorder*> g_pSignalRec(NULL);
+	std::atomic<int> g_nSignalFd(2);
+	bool g_bInstalled = false;
+
+	// Вывод самописца (однократный: повторный сигнал во время вывода не зацикливается)
+	void flightDump(int sig) {
+		if (const FlightRecorder* rec = g_pSignalRec.exchange(NULL)) {
+			char reason[32];
+			char* p = reason;
+			putStr(p, "signal ");
+			putUInt(p, unsigned(sig), 0);
+			*p = 0;
+			rec->dumpTo(g_nSignalFd.load(), reason);
+		}
+	}
+#ifdef _WIN32
+	void (*g_PrevHandlers[g_nSignals])(int);
+
+	void flightSignal(int sig) {
+		flightDump(sig);
+		signal(sig, SIG_DFL);
+		raise(sig);
+	}
+#else
+	struct sigaction g_PrevActions[g_nSignals];
+
+	// Обработчик выполняется на альтернативном стеке (SA_ONSTACK), если он
+	// задан потоку, поэтому срабатывает и при переполнении стека.
+	// После вывода восстанавливается прежний обработчик, и сигнал доставляется
+	// ему: аппаратная ошибка (SIGSEGV, SIGFPE...) повторяется при возврате из
+	// обработчика, а сигнал, посланный kill()/raise()/abort(), посылается заново.
+	void flightSignal(int sig, siginfo_t* info, void*) {
+		flightDump(sig);
+		for (size_t i = 0; i < g_nSignals; ++i)
+			if (g_Signals[i] == sig) sigaction(sig, &g_PrevActions[i], NULL);
+		if (!info || info->si_code <= 0) raise(sig);
+	}
+	// Альтернативный стек обработчиков сигналов текущего потока
+	struct TSignalStack {
+		std::unique_ptr<char[]> mem;
+		~TSignalStack() {
+			if (!mem) return;
+			stack_t ss = {};
+			ss.ss_flags = SS_DISABLE;
+			sigaltstack(&ss, NULL);
+		}
+	};
+	thread_local TSignalStack tls_signal_stack;
+#endif
+}
+
+//=============================================================================
+// FlightRecorder - последние сообщения всех уровней в памяти.
+//-----------------------------------------------------------------------------
+// Конструктор
+FlightRecorder::FlightRecorder(std::shared_ptr<ILogger> next, size_t records, size_t record_size)
+	: m_pNext(next), m_nCapacity(std::max<size_t>(records, 1)),
+	  m_nWords((std::min<size_t>(std::max<size_t>(record_size, 8), maxRecordSize) + 7) / 8),
+	  m_nId(++recorderCounter()), m_Start(std::chrono::steady_clock::now()), m_nRings(0) {
+	for (size_t i = 0; i < maxRings; ++i) m_Rings[i].store(NULL, std::memory_order_relaxed);
+	// Порог самописца - все сообщения
+	log_level.store(ILS_LEVEL_DBG, std::memory_order_relaxed);
+}
+FlightRecorder::~FlightRecorder() {
+	const FlightRecorder* self = this;
+	g_pSignalRec.compare_exchange_strong(self, NULL);
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (const std::shared_ptr<TRing>& r : m_Owned) r->alive.store(false, std::memory_order_release);
+}
+//-----------------------------------------------------------------------------
+// Буфер текущего потока
+FlightRecorder::TRing* FlightRecorder::ring() const {
+	TLocalRings& local = tls_rings;
+	for (const auto& p : local.rings)
+		if (p.first == m_nId) return p.second.get();
+	// Буферы разрушенных самописцев больше не нужны
+	local.rings.erase(std::remove_if(local.rings.begin(), local.rings.end(), [](const std::pair<unsigned long long, std::shared_ptr<TRing> >& p) {
+		if (!p.second || p.second->alive.load(std::memory_order_acquire)) return false;
+		p.second->owned.store(false, std::memory_order_release);
+		return true;
+	}), local.rings.end());
+	std::shared_ptr<TRing> res;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		// Сначала - буфер завершившегося потока
+		for (const std::shared_ptr<TRing>& r : m_Owned) {
+			bool free = false;
+			if (r->owned.compare_exchange_strong(free, true, std::memory_order_acq_rel)) { res = r; break; }
+		}
+		if (!res && m_Owned.size() < maxRings) {
+			res = std::make_shared<TRing>(m_nCapacity, m_nWords);
+			m_Owned.push_back(res);
+			const size_t n = m_nRings.load(std::memory_order_relaxed);
+			m_Rings[n].store(res.get(), std::memory_order_release);
+			m_nRings.store(n + 1, std::memory_order_release);
+		}
+	}
+	// Если буферов не хватило, поток не записывает сообщения (запоминается NULL)
+	local.rings.emplace_back(m_nId, res);
+	return res.get();
+}
+void FlightRecorder::record(int level, MsgView msg) const {
+	if (!logEnabled(level)) return;
+	TRing* r = ring();
+	if (!r) return;
+	const long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_Start).count();
+	r->put(level, ils_thread_no(), ns, msg.data(), msg.size());
+}
+//-----------------------------------------------------------------------------
+// Вывод записей
+size_t FlightRecorder::dump(std::string& res, bool all) const {
+	struct TLine {
+		long long ns;
+		std::string text;
+	};
+	std::vector<TLine> lines;
+	std::vector<char> buf(maxRecordSize + 64);
+	{
+		std::lock_guard<std::mutex> lock(m_DumpMutex);
+		const size_t rings = m_nRings.load(std::memory_order_acquire);
+		for (size_t k = 0; k < rings; ++k) {
+			TRing* r = m_Rings[k].load(std::memory_order_acquire);
+			r->dumped = visitRing(*r, all ? 0 : r->dumped, [&](int level, unsigned tid, long long ns, const char* text, size_t len) {
+				lines.push_back(TLine{ ns, std::string(buf.data(), formatRecord(buf.data(), level, tid, ns, text, len)) });
+			});
+		}
+	}
+	// Записи разных потоков - в порядке времени
+	std::stable_sort(lines.begin(), lines.end(), [](const TLine& a, const TLine& b) { return a.ns < b.ns; });
+	for (const TLine& l : lines) res += l.text;
+	return lines.size();
+}
+void FlightRecorder::dumpTo(int fd, const char* reason) const {
+	char buf[maxRecordSize + 64];
+	char* p = buf;
+	putStr(p, "FlightRecorder: ");
+	writeAll(fd, buf, size_t(p - buf));
+	writeAll(fd, reason, strlen(reason));
+	writeAll(fd, "\n", 1);
+	const size_t rings = m_nRings.load(std::memory_order_acquire);
+	for (size_t k = 0; k < rings; ++k) {
+		const TRing* r = m_Rings[k].load(std::memory_order_acquire);
+		visitRing(*r, 0, [&](int level, unsigned tid, long long ns, const char* text, size_t len) {
+			writeAll(fd, buf, formatRecord(buf, level, tid, ns, text, len));
+		});
+	}
+}
+void FlightRecorder::installSignalHandlers(const FlightRecorder* rec, int fd) {
+	g_nSignalFd.store(fd);
+	g_pSignalRec.store(rec);
+	if (rec && !g_bInstalled) {
+#ifdef _WIN32
+		for (size_t i = 0; i < g_nSignals; ++i) g_PrevHandlers[i] = signal(g_Signals[i], flightSignal);
+#else
+		installSignalStack();
+		struct sigaction sa = {};
+		sa.sa_sigaction = flightSignal;
+		sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+		sigemptyset(&sa.sa_mask);
+		for (size_t i = 0; i < g_nSignals; ++i) sigaction(g_Signals[i], &sa, &g_PrevActions[i]);
+#endif
+		g_bInstalled = true;
+	} else if (!rec && g_bInstalled) {
+#ifdef _WIN32
+		for (size_t i = 0; i < g_nSignals; ++i) signal(g_Signals[i], g_PrevHandlers[i] == SIG_ERR ? SIG_DFL : g_PrevHandlers[i]);
+#else
+		for (size_t i = 0; i < g_nSignals; ++i) sigaction(g_Signals[i], &g_PrevActions[i], NULL);
+#endif
+		g_bInstalled = false;
+	}
+}
+bool FlightRecorder::installSignalStack() {
+#ifdef _WIN32
+	return false;
+#else
+	stack_t cur = {};
+	if (sigaltstack(NULL, &cur) != 0) return false;
+	// Стек, заданный самим приложением, не заменяется
+	if (!(cur.ss_flags & SS_DISABLE)) return true;
+	TSignalStack& local = tls_signal_stack;
+	const size_t size = std::max<size_t>(SIGSTKSZ, 64 * 1024);
+	std::unique_ptr<char[]> mem(new char[size]);
+	stack_t ss = {};
+	ss.ss_sp = mem.get();
+	ss.ss_size = size;
+	if (sigaltstack(&ss, NULL) != 0) return false;
+	local.mem = std::move(mem);
+	return true;
+#endif
+}
+//-----------------------------------------------------------------------------
+// Функции интерфейса: всё записывается в буфер и передаётся следующему логгеру
+const char* FlightRecorder::msgTranslate(const LogId& id, const char* msg, Msg& buf) const {
+	if (m_pNext) return m_pNext->msgTranslate(id, msg, buf);
+	return ILogger::msgTranslate(id, msg, buf);
+}
+void FlightRecorder::infOut(MsgView msg, const LogId& id) const {
+	record(ILS_LEVEL_INF, msg);
+	if (m_pNext && m_pNext->logEnabled(ILS_LEVEL_INF)) m_pNext->infOut(msg, id);
+}
+void FlightRecorder::logOut(MsgView msg, const LogId& id) const {
+	record(ILS_LEVEL_LOG, msg);
+	if (m_pNext && m_pNext->logEnabled(ILS_LEVEL_LOG)) m_pNext->logOut(msg, id);
+}
+void FlightRecorder::wrnOut(MsgView msg, const LogId& id) const {
+	record(ILS_LEVEL_WRN, msg);
+	if (m_pNext && m_pNext->logEnabled(ILS_LEVEL_WRN)) m_pNext->wrnOut(msg, id);
+}
+// К ошибке добавляются записи, накопленные с прошлого вывода
+void FlightRecorder::errOut(MsgView msg, const LogId& id) const {
+	if (!m_pNext || !m_pNext->logEnabled(ILS_LEVEL_ERR)) {
+		record(ILS_LEVEL_ERR, msg);
+		return;
+	}
+	std::string lines;
+	const size_t n = dump(lines);
+	record(ILS_LEVEL_ERR, msg);
+	{
+		// Сама ошибка выводится следующим логгером и в следующий вывод не попадает
+		std::lock_guard<std::mutex> lock(m_DumpMutex);
+		if (TRing* r = ring()) r->dumped = r->head.load(std::memory_order_relaxed);
+	}
+	if (!n) {
+		m_pNext->errOut(msg, id);
+		return;
+	}
+	std::string text(msg);
+	ils_appendf(text, "\nFlightRecorder: %u previous records:\n", unsigned(n));
+	lines.pop_back();  // последний '\n'
+	text += lines;
+	m_pNext->errOut(text, id);
+}
+void FlightRecorder::sectOut(bool begin, const char* sect, std::chrono::steady_clock::time_point t) const {
+	if (m_pNext) m_pNext->sectOut(begin, sect, t);
+}
+// Исключение покинуло секцию: контекст выводится отдельным предупреждением
+void FlightRecorder::incidentOut(const char* what) const {
+	if (!m_pNext) return;
+	m_pNext->incidentOut(what);
+	if (!m_pNext->logEnabled(ILS_LEVEL_WRN)) return;
+	std::string lines;
+	const size_t n = dump(lines);
+	if (!n) return;
+	std::string text;
+	ils_appendf(text, "FlightRecorder: %s, %u previous records:\n", what ? what : "", unsigned(n));
+	lines.pop_back();
+	text += lines;
+	m_pNext->wrnOut(text, "FlightRecorder");
+}
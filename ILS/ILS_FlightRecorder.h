@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ILS_Logger.h"
+
+//=============================================================================
+/// Бортовой самописец: последние сообщения всех уровней в памяти.
+/// @ingroup Kernel
+/// Логгер-посредник: каждое сообщение, включая отладочные и информационные,
+/// которые следующий логгер \c next отсёк бы своим порогом, копируется в
+/// кольцевой буфер своего потока (фиксированного размера, без блокировок и
+/// выделения памяти), а дальше передаётся \c next как обычно. Ввода-вывода
+/// для отсечённых сообщений нет, но они форматируются: порог самописца
+/// (setLogLevel(), по умолчанию ILS_LEVEL_DBG) определяет, что попадает в буфер.
+///
+/// Содержимое буферов выводится:
+/// - при ошибке (errOut): записи, накопленные с прошлого вывода, добавляются
+///   к тексту самой ошибки, так что контекст идёт одной записью с ней;
+/// - когда секцию покидает исключение (ILS_SECTE вызывает incidentOut()):
+///   отдельным предупреждением с идентификатором "FlightRecorder";
+/// - из обработчика аварийного сигнала (installSignalHandlers()): все записи,
+///   напрямую в файловый дескриптор, без выделения памяти и блокировок.
+///
+/// \code
+/// auto log = std::make_shared<StdLogger>("app.log");
+/// log->setLogLevel(ILS_LEVEL_WRN);                       // в файл - только wrn/err
+/// auto rec = std::make_shared<FlightRecorder>(log);      // в памяти - всё
+/// FlightRecorder::installSignalHandlers(rec.get());
+/// app.setPersonalLogger(rec);
+/// \endcode
+///
+/// Длинные сообщения обрезаются до \c record_size байт. Буфер создаётся на
+/// каждый поток при первом сообщении; буфер завершившегося потока сохраняет
+/// свои записи и переходит к следующему новому потоку.
+/// \see ILogger::incidentOut()
+class FlightRecorder : public ILogger {
+public:
+	/// Наибольшее число буферов (одновременно работающих потоков).
+	enum { maxRings = 256 };
+	/// Наибольший размер текста записи.
+	enum { maxRecordSize = 1024 };
+	/// Буфер потока (определён в ILS_FlightRecorder.cpp).
+	struct TRing;
+	//---------------------------------------------------------------------------
+	/// Конструктор.
+	/// \param next        - логгер, которому передаются все сообщения (может быть NULL).
+	/// \param records     - количество записей в буфере каждого потока.
+	/// \param record_size - наибольший размер текста записи (не более maxRecordSize).
+	FlightRecorder(std::shared_ptr<ILogger> next, size_t records = 256, size_t record_size = 232);
+	virtual ~FlightRecorder();
+	FlightRecorder(const FlightRecorder&) = delete;
+	FlightRecorder& operator=(const FlightRecorder&) = delete;
+	/// Дописывание записей в строку, по строке на запись (с '\n' в конце).
+	/// \param res - строка, в конец которой дописываются записи.
+	/// \param all - все хранимые записи, иначе только не выведенные ранее.
+	/// \return количество записей.
+	size_t dump(std::string& res, bool all = false) const;
+	/// Вывод всех хранимых записей в файловый дескриптор.
+	/// Не выделяет память и не захватывает блокировок, поэтому может
+	/// вызываться из обработчика сигнала.
+	/// \param fd     - дескриптор (2 - stderr).
+	/// \param reason - причина вывода для заголовка.
+	void dumpTo(int fd, const char* reason) const;
+	/// Установка обработчиков аварийных сигналов (SIGSEGV, SIGABRT, SIGFPE,
+	/// SIGILL, SIGBUS): содержимое \c rec выводится в \c fd, после чего сигнал
+	/// передаётся обработчику, установленному до самописца (по умолчанию -
+	/// завершение процесса). NULL снимает самописец с обработчиков и
+	/// восстанавливает прежние.
+	/// \note В POSIX обработчики устанавливаются через sigaction() с SA_ONSTACK,
+	/// а вызывающему потоку задаётся альтернативный стек (installSignalStack()).
+	static void installSignalHandlers(const FlightRecorder* rec, int fd = 2);
+	/// Альтернативный стек обработчиков сигналов для текущего потока, чтобы
+	/// вывод срабатывал и при переполнении стека. Стек, уже заданный
+	/// приложением, сохраняется. Вызывается в потоках, которые могут
+	/// переполнить стек (поток, вызвавший installSignalHandlers(), получает его сам).
+	/// \return false, если стек задать не удалось (или система их не поддерживает).
+	static bool installSignalStack();
+	//---------------------------------------------------------------------------
+public: // Функции интерфейса
+	virtual void infOut(MsgView msg, const LogId& id) const;
+	virtual void logOut(MsgView msg, const LogId& id) const;
+	virtual void wrnOut(MsgView msg, const LogId& id) const;
+	virtual void errOut(MsgView msg, const LogId& id) const;
+	virtual void sectOut(bool begin, const char* sect, std::chrono::steady_clock::time_point t) const;
+	virtual void incidentOut(const char* what) const;
+	virtual double logParam(int param) const { return m_pNext ? m_pNext->logParam(param) : 0.; }
+protected:
+	virtual const char* msgTranslate(const LogId& id, const char* msg, Msg& buf) const;
+	/// Копирование сообщения в буфер текущего потока.
+	void record(int level, MsgView msg) const;
+	/// Буфер текущего потока (создаётся или берётся свободный при первом сообщении).
+	TRing* ring() const;
+	std::shared_ptr<ILogger> m_pNext;
+	size_t m_nCapacity;                            // Записей в буфере
+	size_t m_nWords;                               // Слов на текст записи
+	unsigned long long m_nId;                      // Номер самописца (для поиска буфера потока)
+	std::chrono::steady_clock::time_point m_Start;
+	mutable std::mutex m_Mutex;                    // Создание буферов
+	mutable std::mutex m_DumpMutex;                // Вывод записей (кроме dumpTo())
+	mutable std::vector<std::shared_ptr<TRing> > m_Owned;
+	mutable std::atomic<TRing*> m_Rings[maxRings]; // Для обхода без блокировки
+	mutable std::atomic<size_t> m_nRings;
+}; //class FlightRecorder
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+#include "ILS_MsgCatalog.h"
+
+//=============================================================================
+/// Тип аргумента, определяемый по спецификатору формата \c printf().
+/// @ingroup Kernel
+enum TArgKind {
+	akNone,        ///< Нет аргумента (например, "%%").
+	akInt,         ///< int (а также char и short после продвижения типов).
+	akLong,        ///< long.
+	akLongLong,    ///< long long.
+	akSize,        ///< size_t.
+	akIntMax,      ///< intmax_t.
+	akPtrDiff,     ///< ptrdiff_t.
+	akDouble,      ///< double (а также float после продвижения и ключ %t).
+	akLongDouble,  ///< long double.
+	akStr,         ///< const char*.
+	akPtr,         ///< void*.
+	akUnsupported  ///< %n, %ls и т.п. - отложенное форматирование невозможно.
+};
+
+//=============================================================================
+/// Описание одного спецификатора формата \c printf().
+/// @ingroup Kernel
+struct TFmtSpec {
+	unsigned begin;     ///< Позиция '%' в строке формата.
+	unsigned end;       ///< Позиция за символом преобразования.
+	unsigned len_pos;   ///< Позиция модификатора длины (или символа преобразования, если его нет).
+	char conv;          ///< Символ преобразования ('d', 's', 't' ...).
+	unsigned char stars;///< Количество '*' (ширина/точность из аргументов типа int).
+	TArgKind kind;      ///< Тип аргумента.
+};
+
+//-----------------------------------------------------------------------------
+/// Разбор строки формата \c printf() на спецификаторы.
+/// Ключ %t (время) считается преобразованием типа double, как и в ILogger::msgTranslate().
+/// \param fmt   - строка формата.
+/// \param specs - сюда дописываются найденные спецификаторы.
+/// \return false, если встречен спецификатор, для которого отложенное форматирование невозможно.
+inline bool ils_parse_format(const char* fmt, std::vector<TFmtSpec>& specs) {
+	bool ok = true;
+	for (const char* p = fmt; *p; ++p) {
+		if (*p != '%') continue;
+		TFmtSpec spec;
+		spec.begin = unsigned(p - fmt);
+		spec.stars = 0;
+		++p;
+		if (*p == '%') { spec.end = unsigned(p + 1 - fmt); spec.len_pos = spec.end - 1; spec.conv = '%'; spec.kind = akNone; specs.push_back(spec); continue; }
+		while (*p && strchr("-+ #0'", *p)) ++p;                          // флаги
+		if (*p == '*') { ++spec.stars; ++p; } else while (*p >= '0' && *p <= '9') ++p;  // ширина
+		if (*p == '.') {                                                   // точность
+			++p;
+			if (*p == '*') { ++spec.stars; ++p; } else while (*p >= '0' && *p <= '9') ++p;
+		}
+		spec.len_pos = unsigned(p - fmt);
+		int len = 0; // 1 - h, 2 - hh, 3 - l, 4 - ll, 5 - z, 6 - j, 7 - t, 8 - L
+		if (*p == 'h') { len = 1; if (*++p == 'h') { len = 2; ++p; } }
+		else if (*p == 'l') { len = 3; if (*++p == 'l') { len = 4; ++p; } }
+		else if (*p == 'z') { len = 5; ++p; }
+		else if (*p == 'j') { len = 6; ++p; }
+		else if (*p == 't' && p[1] && strchr("diouxX", p[1])) { len = 7; ++p; }
+		else if (*p == 'L') { len = 8; ++p; }
+		else if (*p == 'I' && p[1] == '6' && p[2] == '4') { len = 4; p += 3; } // MSVC
+		if (!*p) return false;
+		spec.conv = *p;
+		spec.end = unsigned(p + 1 - fmt);
+		switch (*p) {
+		case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+			spec.kind = len == 3 ? akLong : len == 4 ? akLongLong : len == 5 ? akSize :
+			            len == 6 ? akIntMax : len == 7 ? akPtrDiff : akInt;
+			break;
+		case 'c':
+			spec.kind = len == 3 ? akUnsupported : akInt;
+			break;
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': case 't':
+			spec.kind = len == 8 ? akLongDouble : akDouble;
+			break;
+		case 's':
+			spec.kind = len == 3 ? akUnsupported : akStr;
+			break;
+		case 'p':
+			spec.kind = akPtr;
+			break;
+		default:
+			spec.kind = akUnsupported;
+		}
+		if (spec.kind == akUnsupported) ok = false;
+		specs.push_back(spec);
+	}
+	return ok;
+}
+
+//=============================================================================
+/// Место вызова с постоянной строкой формата.
+/// @ingroup Kernel
+/// Создаётся один раз на место вызова (статическая переменная в макросах
+/// ILS_BLOG, ILS_BWRN ...). При создании строка формата разбирается и
+/// получает уникальный номер, поэтому логгеры с отложенным форматированием
+/// (BinLogger) могут сохранять только номер формата и сырые аргументы.
+struct TFmtSite {
+	const char* fmt;              ///< Строка формата (литерал, живёт всё время работы).
+	unsigned id;                  ///< Уникальный номер формата (с 0).
+	bool raw_ok;                  ///< Все аргументы можно сохранить без форматирования.
+	std::vector<TFmtSpec> specs;  ///< Разобранные спецификаторы.
+	explicit TFmtSite(const char* f) : fmt(f), id(counter().fetch_add(1)) {
+		raw_ok = ils_parse_format(f, specs);
+		// Формат места вызова - константа: перевод запоминается по её адресу
+		MsgCatalog::instance().addStatic(f);
+	}
+	TFmtSite(const TFmtSite&) = delete;
+	TFmtSite& operator=(const TFmtSite&) = delete;
+private:
+	static std::atomic<unsigned>& counter() {
+		static std::atomic<unsigned> n(0);
+		return n;
+	}
+}; //struct TFmtSite
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <stdarg.h>
+
+//=============================================================================
+/// Переиспользуемый буфер текущего потока.
+/// @ingroup Kernel
+/// Объект "арендует" строку, принадлежащую текущему потоку, и очищает её.
+/// Ёмкость строки сохраняется между сообщениями, поэтому после прогрева
+/// форматирование не выделяет память. Если буфер уже занят (повторный вход,
+/// например, вывод сообщения изнутри вывода), используется локальная строка.
+/// \param Tag - тип-метка, разные метки дают независимые буферы.
+template<class Tag> class TThreadBuf {
+	struct TState {
+		std::string buf;
+		bool busy = false;
+	};
+	static TState& state() {
+		static thread_local TState s;
+		return s;
+	}
+	TState* m_pOwner;
+	std::string m_sLocal;
+	std::string* m_pStr;
+public:
+	TThreadBuf() : m_pOwner(NULL), m_pStr(&m_sLocal) {
+		TState& s = state();
+		if (!s.busy) {
+			s.busy = true;
+			s.buf.clear();
+			m_pOwner = &s;
+			m_pStr = &s.buf;
+		}
+	}
+	~TThreadBuf() { if (m_pOwner) m_pOwner->busy = false; }
+	TThreadBuf(const TThreadBuf&) = delete;
+	TThreadBuf& operator=(const TThreadBuf&) = delete;
+	std::string& str() { return *m_pStr; }
+}; //class TThreadBuf
+
+//-----------------------------------------------------------------------------
+/// Форматирование по принципу \c printf() с дописыванием в конец строки.
+/// Длина результата не ограничена: короткий текст форматируется в буфер на
+/// стеке и дописывается (строка не заполняется нулями сверх текста), длинный -
+/// повторно, прямо в строку, увеличенную ровно до нужной длины.
+/// \param res    - строка, в конец которой дописывается результат.
+/// \param fmt    - формат в стиле \c printf().
+/// \param marker - аргументы.
+inline void ils_vappendf(std::string& res, const char* fmt, va_list marker) {
+	char buf[512];
+	va_list args;
+	va_copy(args, marker);
+	const int n = vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+	if (n < 0) return;
+	if (size_t(n) < sizeof(buf)) {
+		res.append(buf, size_t(n));
+		return;
+	}
+	const size_t start = res.size();
+	res.resize(start + n);
+	va_copy(args, marker);
+	vsnprintf(&res[start], size_t(n) + 1, fmt, args);
+	va_end(args);
+}
+inline void ils_appendf(std::string& res, const char* fmt, ...) {
+	va_list marker;
+	va_start(marker, fmt);
+	ils_vappendf(res, fmt, marker);
+	va_end(marker);
+}
+
+//-----------------------------------------------------------------------------
+/// Дописывание целого без знака с дополнением нулями до \c width знаков.
+inline void ils_append_uint(std::string& res, unsigned long long v, int width) {
+	char s[24];
+	int n = 0;
+	do { s[n++] = char('0' + v % 10); v /= 10; } while (v);
+	while (n < width) s[n++] = '0';
+	while (n) res += s[--n];
+}
+/// Номер текущего потока (1, 2, ... в порядке первого обращения).
+/// Счётчик общий для всех регистраторов, поэтому один поток имеет один
+/// номер в JSON, трассировке и дампе FlightRecorder.
+inline unsigned ils_thread_no() {
+	static std::atomic<unsigned> counter(0);
+	thread_local unsigned no = ++counter;
+	return no;
+}
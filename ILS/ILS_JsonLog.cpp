@@ -0,0 +1,198 @@
+#include <chrono>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "ILS_JsonLog.h"
+#include "ILS_LoggerStream.h"
+
+//=============================================================================
+// Вспомогательные функции формирования записи
+namespace {
+	struct TJsonTag;
+	struct TJsonFmtTag;
+	struct TJsonMsgTag;
+
+	// Кэш даты и времени с точностью до секунды, свой у каждого потока
+	struct TTimeCache {
+		long long sec = -1;
+		char text[32];
+		size_t len = 0;
+	};
+	thread_local TTimeCache tls_time;
+
+	inline void safe_gmtime(const time_t& t, struct tm& res) {
+#ifdef _WIN32
+		gmtime_s(&res, &t);
+#else
+		gmtime_r(&t, &res);
+#endif
+	}
+	// Время UTC "YYYY-MM-DDTHH:MM:SS.uuuuuuZ"
+	inline void append_time(std::string& res) {
+		const long long us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+		const long long sec = us / 1000000;
+		TTimeCache& c = tls_time;
+		if (c.sec != sec) {
+			struct tm t;
+			safe_gmtime(time_t(sec), t);
+			c.len = strftime(c.text, sizeof(c.text), "%Y-%m-%dT%H:%M:%S.", &t);
+			c.sec = sec;
+		}
+		res.append(c.text, c.len);
+		ils_append_uint(res, (unsigned long long)(us % 1000000), 6);
+		res += 'Z';
+	}
+
+	// Есть ли среди 8 байт такие, которые нельзя скопировать без проверки:
+	// не ASCII, управляющие символы, кавычка и обратная косая черта
+	inline bool special8(uint64_t v) {
+		const uint64_t ones = 0x0101010101010101ULL, high = 0x8080808080808080ULL;
+		const uint64_t q = v ^ (ones * '"'), b = v ^ (ones * '\\');
+		return ((v & high) | ((v - ones * 0x20) & ~v & high) |
+		        ((q - ones) & ~q & high) | ((b - ones) & ~b & high)) != 0;
+	}
+	// Длина корректной последовательности UTF-8, начинающейся с p (первый байт >= 0x80), 0 - ошибка
+	inline size_t utf8_len(const unsigned char* p, const unsigned char* end) {
+		const unsigned c = p[0];
+		size_t n;
+		unsigned lo = 0x80, hi = 0xBF;  // Допустимый диапазон второго байта
+		if (c >= 0xC2 && c <= 0xDF) n = 2;
+		else if (c >= 0xE0 && c <= 0xEF) {
+			n = 3;
+			if (c == 0xE0) lo = 0xA0;       // без избыточных форм
+			else if (c == 0xED) hi = 0x9F;  // без суррогатов
+		}
+		else if (c >= 0xF0 && c <= 0xF4) {
+			n = 4;
+			if (c == 0xF0) lo = 0x90;
+			else if (c == 0xF4) hi = 0x8F;  // не больше U+10FFFF
+		}
+		else return 0;
+		if (size_t(end - p) < n || p[1] < lo || p[1] > hi) return 0;
+		for (size_t k = 2; k < n; ++k)
+			if ((p[k] & 0xC0) != 0x80) return 0;
+		return n;
+	}
+}
+
+//=============================================================================
+// JsonLogger - запись сообщений в формате JSON Lines.
+//-----------------------------------------------------------------------------
+// Конструктор
+JsonLogger::JsonLogger(const std::string& file, std::shared_ptr<ILogger> next, bool append)
+	: m_pFile(NULL), m_pNext(next) {
+	m_pFile = fopen(file.c_str(), append ? "ab" : "wb");
+	if (m_pFile) setvbuf(m_pFile, NULL, _IOFBF, 1 << 16);
+}
+JsonLogger::~JsonLogger() {
+	if (m_pFile) fclose(m_pFile);
+}
+void JsonLogger::flush() const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (m_pFile) fflush(m_pFile);
+}
+//-----------------------------------------------------------------------------
+// Функции интерфейса: запись в файл и передача следующему логгеру
+const char* JsonLogger::msgTranslate(const LogId& id, const char* msg, Msg& buf) const {
+	if (m_pNext) return m_pNext->msgTranslate(id, msg, buf);
+	return ILogger::msgTranslate(id, msg, buf);
+}
+void JsonLogger::infOut(MsgView msg, const LogId& id) const {
+	if (m_pNext) m_pNext->infOut(msg, id);
+	if (logEnabled(ILS_LEVEL_INF)) recordOut(ILS_LEVEL_INF, msg, id);
+}
+void JsonLogger::logOut(MsgView msg, const LogId& id) const {
+	if (m_pNext) m_pNext->logOut(msg, id);
+	if (logEnabled(ILS_LEVEL_LOG)) recordOut(ILS_LEVEL_LOG, msg, id);
+}
+void JsonLogger::wrnOut(MsgView msg, const LogId& id) const {
+	if (m_pNext) m_pNext->wrnOut(msg, id);
+	if (logEnabled(ILS_LEVEL_WRN)) recordOut(ILS_LEVEL_WRN, msg, id);
+}
+void JsonLogger::errOut(MsgView msg, const LogId& id) const {
+	if (m_pNext) m_pNext->errOut(msg, id);
+	if (logEnabled(ILS_LEVEL_ERR)) recordOut(ILS_LEVEL_ERR, msg, id);
+}
+// Следующий логгер получает сырые аргументы (отложенное форматирование, BinLogger);
+// текст для записи JSON форматируется здесь, только если запись включена
+bool JsonLogger::rawOut(int level, const TFmtSite& site, const LogId& id, va_list marker) const {
+	if (!m_pNext) return false;
+	va_list args;
+	va_copy(args, marker);
+	const bool raw = m_pNext->rawOut(level, site, id, args);
+	va_end(args);
+	// Следующему логгеру нужен текст: сообщение отформатирует ILogger::out() и передаст в logOut() ...
+	if (!raw) return false;
+	if (m_pFile && logEnabled(level)) {
+		TThreadBuf<TJsonFmtTag> fmt;
+		TThreadBuf<TJsonMsgTag> str;
+		ils_vappendf(str.str(), msgTranslate(id, site.fmt, fmt.str()), marker);
+		recordOut(level, str.str(), id);
+	}
+	return true;
+}
+//-----------------------------------------------------------------------------
+// Формирование и запись
+void JsonLogger::recordOut(int level, MsgView msg, const LogId& id) const {
+	if (!m_pFile) return;
+	static const char* const names[] = { "dbg", "log", "inf", "wrn", "err" };
+	try {
+		TThreadBuf<TJsonTag> buf;
+		std::string& rec = buf.str();
+		rec += "{\"ts\":\"";
+		append_time(rec);
+		rec += "\",\"lvl\":\"";
+		rec += names[level < 0 ? 0 : level > ILS_LEVEL_ERR ? ILS_LEVEL_ERR : level];
+		rec += "\",\"id\":\"";
+		appendJson(rec, id);
+		rec += "\",\"thr\":";
+		ils_append_uint(rec, threadNo(), 1);
+		rec += ",\"sect\":\"";
+		appendJson(rec, TLoggerStream::SectPath());
+		rec += "\",\"msg\":\"";
+		appendJson(rec, msg);
+		rec += "\"}\n";
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		fwrite(rec.data(), 1, rec.size(), m_pFile);
+		if (level >= ILS_LEVEL_ERR) fflush(m_pFile);
+	} catch(...){}
+}
+unsigned JsonLogger::threadNo() {
+	return ils_thread_no();
+}
+// Куски текста без спецсимволов копируются целиком; ASCII проверяется по 8 байт
+void JsonLogger::appendJson(std::string& res, MsgView s) {
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(s.data());
+	const unsigned char* const end = p + s.size();
+	const unsigned char* run = p;  // Начало ещё не скопированного куска
+	while (p < end) {
+		if (end - p >= 8) {
+			uint64_t v;
+			memcpy(&v, p, 8);
+			if (!special8(v)) { p += 8; continue; }
+		}
+		const unsigned c = *p;
+		if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') { ++p; continue; }
+		size_t n = 0;
+		if (c >= 0x80 && (n = utf8_len(p, end)) != 0) { p += n; continue; }
+		res.append(reinterpret_cast<const char*>(run), size_t(p - run));
+		switch (c) {
+		case '"':  res += "\\\""; break;
+		case '\\': res += "\\\\"; break;
+		case '\n': res += "\\n"; break;
+		case '\r': res += "\\r"; break;
+		case '\t': res += "\\t"; break;
+		default:
+			if (c < 0x20) {
+				static const char hex[] = "0123456789abcdef";
+				res += "\\u00";
+				res += hex[c >> 4];
+				res += hex[c & 15];
+			}
+			else res += "\xEF\xBF\xBD";  // U+FFFD вместо некорректного байта UTF-8
+		}
+		run = ++p;
+	}
+	res.append(reinterpret_cast<const char*>(run), size_t(end - run));
+}
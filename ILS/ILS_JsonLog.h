@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "ILS_Logger.h"
+
+//=============================================================================
+/// Регистратор в формате JSON Lines: одна запись - один объект JSON в строке.
+/// @ingroup Kernel
+/// Каждая запись содержит поля, которые в текстовом логе приходится
+/// выделять регулярными выражениями:
+/// \code
+/// {"ts":"2026-10-16T16:34:52.558123Z","lvl":"wrn","id":"net","thr":3,"sect":"Load/Box3","msg":"..."}
+/// \endcode
+/// - \c ts   - системное время UTC с микросекундами (ISO 8601);
+/// - \c lvl  - уровень: "log", "inf", "wrn", "err";
+/// - \c id   - идентификатор сообщения (LogId);
+/// - \c thr  - номер потока (ils_thread_no(), общий с TraceLogger и FlightRecorder);
+/// - \c sect - путь секций потока через '/' (TLoggerStream::SectPath()), "" - вне секций;
+/// - \c msg  - текст сообщения.
+///
+/// Строки экранируются appendJson(): текст без спецсимволов копируется
+/// целиком, корректные последовательности UTF-8 (в том числе кириллица)
+/// сохраняются как есть, некорректные байты заменяются на U+FFFD, так что
+/// результат всегда является допустимым JSON в UTF-8.
+///
+/// Запись собирается в буфере текущего потока и пишется в файл одним
+/// вызовом под блокировкой; ошибки сразу сбрасываются на диск. Все
+/// сообщения передаются дальше, следующему логгеру \c next, если он задан;
+/// сообщения ILS_BLOG/ILS_BWRN - без форматирования (rawOut()), если он это
+/// умеет:
+/// \code
+/// auto log = std::make_shared<StdLogger>("app.log");
+/// app.setPersonalLogger(std::make_shared<JsonLogger>("app.jsonl", log));
+/// \endcode
+/// \note Путь секций берётся в потоке, вызвавшем функцию вывода. За
+/// асинхронным FanoutLogger (вывод в фоновом потоке) поле \c sect пустое.
+class JsonLogger : public ILogger {
+public:
+	/// Конструктор.
+	/// \param file   - имя файла (.jsonl).
+	/// \param next   - логгер, которому передаются все сообщения (может быть NULL).
+	/// \param append - дописывать в существующий файл.
+	JsonLogger(const std::string& file, std::shared_ptr<ILogger> next = NULL, bool append = false);
+	virtual ~JsonLogger();
+	JsonLogger(const JsonLogger&) = delete;
+	JsonLogger& operator=(const JsonLogger&) = delete;
+	/// Удалось ли открыть файл.
+	bool isOpen() const { return m_pFile != NULL; }
+	/// Сброс буферов файла.
+	void flush() const;
+	/// Дописывание строки с экранированием по правилам JSON (без кавычек).
+	static void appendJson(std::string& res, MsgView s);
+	/// Номер текущего потока (1, 2, ... в порядке первой записи), см. ils_thread_no().
+	static unsigned threadNo();
+	//---------------------------------------------------------------------------
+public: // Функции интерфейса
+	virtual void infOut(MsgView msg, const LogId& id) const;
+	virtual void logOut(MsgView msg, const LogId& id) const;
+	virtual void wrnOut(MsgView msg, const LogId& id) const;
+	virtual void errOut(MsgView msg, const LogId& id) const;
+	virtual bool rawOut(int level, const TFmtSite& site, const LogId& id, va_list marker) const;
+	virtual void sectOut(bool begin, const char* sect, std::chrono::steady_clock::time_point t) const { if (m_pNext) m_pNext->sectOut(begin, sect, t); }
+	virtual void incidentOut(const char* what) const { if (m_pNext) m_pNext->incidentOut(what); }
+	virtual double logParam(int param) const { return m_pNext ? m_pNext->logParam(param) : 0.; }
+protected:
+	virtual const char* msgTranslate(const LogId& id, const char* msg, Msg& buf) const;
+	/// Формирование и запись записи уровня \c level.
+	void recordOut(int level, MsgView msg, const LogId& id) const;
+	std::FILE* m_pFile;
+	std::shared_ptr<ILogger> m_pNext;
+	mutable std::mutex m_Mutex;
+}; //class JsonLogger
@@ -0,0 +1,504 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ILS_ANALYZER_SSE2
+#endif
+#include "ILS_FormatBuf.h"
+#include "ILS_Logger.h"
+#include "ILS_LogAnalyzer.h"
+
+//=============================================================================
+// LogFileMap - отображение файла в память только для чтения.
+//-----------------------------------------------------------------------------
+#ifdef _WIN32
+bool LogFileMap::open(const std::string& file) {
+	close();
+	HANDLE f = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (f == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(f, &size) || (sizeof(size_t) < 8 && size.QuadPart >> 31)) { CloseHandle(f); return false; }
+	if (size.QuadPart) {
+		HANDLE map = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+		const void* p = map ? MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0) : NULL;
+		if (map) CloseHandle(map);  // Отображение держит открытый вид
+		if (!p) { CloseHandle(f); return false; }
+		m_pData = static_cast<const char*>(p);
+		m_nSize = size_t(size.QuadPart);
+	}
+	m_pHandle = f;
+	return true;
+}
+void LogFileMap::close() {
+	if (m_pData) UnmapViewOfFile(m_pData);
+	if (m_pHandle) CloseHandle(HANDLE(m_pHandle));
+	m_pData = NULL;
+	m_nSize = 0;
+	m_pHandle = NULL;
+}
+#else
+bool LogFileMap::open(const std::string& file) {
+	close();
+	const int fd = ::open(file.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	bool ok = fstat(fd, &st) == 0;
+	if (ok && st.st_size > 0) {
+		void* p = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED) ok = false;
+		else {
+			// Файл читается один раз от начала к концу
+			madvise(p, size_t(st.st_size), MADV_SEQUENTIAL);
+			m_pData = static_cast<const char*>(p);
+			m_nSize = size_t(st.st_size);
+		}
+	}
+	::close(fd);  // Отображение остаётся действительным
+	return ok;
+}
+void LogFileMap::close() {
+	if (m_pData) munmap(const_cast<char*>(m_pData), m_nSize);
+	m_pData = NULL;
+	m_nSize = 0;
+}
+#endif
+
+//=============================================================================
+// TLogLine - разбор строки лога.
+//-----------------------------------------------------------------------------
+namespace {
+	inline bool isDigit(char c) { return c >= '0' && c <= '9'; }
+	inline bool digits(const char* p, int n, long long& v) {
+		v = 0;
+		for (int i = 0; i < n; ++i) {
+			if (!isDigit(p[i])) return false;
+			v = v * 10 + (p[i] - '0');
+		}
+		return true;
+	}
+	// Номер дня от 1970/01/01 по григорианскому календарю
+	long long civilDays(long long y, long long m, long long d) {
+		y -= m <= 2;
+		const long long era = (y >= 0 ? y : y - 399) / 400;
+		const long long yoe = y - era * 400;
+		const long long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+		const long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+		return era * 146097 + doe - 719468;
+	}
+	inline bool startsWith(std::string_view s, const char* prefix, size_t n) {
+		return s.size() >= n && !memcmp(s.data(), prefix, n);
+	}
+	// Длительность из суффикса " [12.345 ms]" строки SectionEnd, -1 - нет суффикса
+	double suffixDuration(std::string_view s) {
+		if (s.size() < 8 || s.compare(s.size() - 4, 4, " ms]")) return -1;
+		size_t i = s.size() - 4;
+		const size_t stop = i > 32 ? i - 32 : 0;
+		while (i > stop && s[i - 1] != '[') --i;
+		if (i < 2 || s[i - 1] != '[' || s[i - 2] != ' ') return -1;
+		double v = 0, scale = 0;
+		for (; i < s.size() - 4; ++i) {
+			if (s[i] == '.' && !scale) scale = 1;
+			else if (isDigit(s[i])) {
+				v = v * 10 + (s[i] - '0');
+				if (scale) scale *= 10;
+			}
+			else return -1;
+		}
+		return scale ? v / scale : v;
+	}
+}
+const char* TLogLine::find(const char* p, const char* end, char c) {
+#ifdef ILS_ANALYZER_SSE2
+	// 16 байт за шаг: сравнение всех байтов блока и поиск первого совпадения по маске
+	const __m128i pattern = _mm_set1_epi8(c);
+	for (; end - p >= 16; p += 16) {
+		const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), pattern));
+		if (mask) {
+			int k = 0;
+			while (!(mask & (1 << k))) ++k;
+			return p + k;
+		}
+	}
+#endif
+	const void* r = p < end ? memchr(p, c, size_t(end - p)) : NULL;
+	return r ? static_cast<const char*>(r) : end;
+}
+bool TLogLine::parse(const char* p, const char* end, TLogLine& res) {
+	res.level = -1;
+	res.time_kind = tkNone;
+	res.time_us = 0;
+	res.thread = 0;
+	res.body = std::string_view(p, size_t(end - p));
+	const char* s = p;
+	long long days = -1, tod = -1, centi = -1, y, m, d, hh, mm, ss;
+	// Дата "YYYY/MM/DD "
+	if (end - s >= 11 && digits(s, 4, y) && s[4] == '/' && digits(s + 5, 2, m) && s[7] == '/' && digits(s + 8, 2, d) && s[10] == ' ') {
+		days = civilDays(y, m, d);
+		s += 11;
+	}
+	// Время "HH:MM:SS", ".mmm" или ".uuuuuu", пробел
+	if (end - s >= 9 && digits(s, 2, hh) && s[2] == ':' && digits(s + 3, 2, mm) && s[5] == ':' && digits(s + 6, 2, ss)) {
+		tod = ((hh * 60 + mm) * 60 + ss) * 1000000;
+		s += 8;
+		if (s < end && *s == '.') {
+			long long frac = 0, scale = 1000000;
+			for (++s; s < end && isDigit(*s) && scale > 1; ++s) { frac = frac * 10 + (*s - '0'); scale /= 10; }
+			tod += frac * scale;
+		}
+		if (s == end || *s != ' ') return false;
+		++s;
+	}
+	// Секунды с начала "% 8.2f "
+	{
+		const char* q = s;
+		while (q < end && *q == ' ') ++q;
+		if (q < end && isDigit(*q)) {
+			long long v = 0;
+			while (q < end && isDigit(*q)) v = v * 10 + (*q++ - '0');
+			long long cc;
+			if (end - q >= 4 && *q == '.' && digits(q + 1, 2, cc) && q[3] == ' ') {
+				centi = v * 100 + cc;
+				s = q + 4;
+			}
+		}
+	}
+	// Номер потока "#N "
+	unsigned thread = 0;
+	if (s < end && *s == '#') {
+		const char* q = s + 1;
+		unsigned v = 0;
+		while (q < end && isDigit(*q) && v < 100000000) v = v * 10 + unsigned(*q++ - '0');
+		if (q > s + 1 && q < end && *q == ' ') {
+			thread = v;
+			s = q + 1;
+		}
+	}
+	// Суффикс уровня
+	static const struct { const char* text; size_t len; int level; } marks[] = {
+		{ "> ", 2, ILS_LEVEL_LOG }, { "|INFO> ", 7, ILS_LEVEL_INF },
+		{ "|WARNING> ", 10, ILS_LEVEL_WRN }, { "|ERROR> ", 8, ILS_LEVEL_ERR } };
+	const std::string_view rest(s, size_t(end - s));
+	for (const auto& mk : marks) {
+		if (!startsWith(rest, mk.text, mk.len)) continue;
+		res.level = mk.level;
+		res.thread = thread;
+		res.body = rest.substr(mk.len);
+		if (tod >= 0) {
+			res.time_kind = tkWall;
+			res.time_us = (days >= 0 ? days * 86400000000LL : 0) + tod;
+		}
+		else if (centi >= 0) {
+			res.time_kind = tkElapsed;
+			res.time_us = centi * 10000;
+		}
+		return true;
+	}
+	return false;
+}
+
+//=============================================================================
+// LogAnalyzer - дерево секций и длительности.
+//-----------------------------------------------------------------------------
+// Начало или окончание секции
+struct LogAnalyzer::TEvent {
+	bool begin;
+	int time_kind;
+	unsigned thread;          // Номер потока, 0 - не указан
+	unsigned long long line;  // Номер строки в части (с 1)
+	long long time_us;
+	double duration_ms;       // Из суффикса SectionEnd, -1 - нет
+	std::string_view id;      // Текст в отображении файла
+};
+// Часть файла и результаты её разбора
+struct LogAnalyzer::TChunk {
+	const char* begin;
+	const char* end;
+	unsigned long long lines = 0;
+	unsigned long long levels[5] = { 0, 0, 0, 0, 0 };
+	std::vector<TEvent> events;
+	bool done = false;
+};
+//-----------------------------------------------------------------------------
+LogAnalyzer::LogAnalyzer() {
+	clear();
+}
+LogAnalyzer::LogAnalyzer(const TOptions& opt) : m_Opt(opt) {
+	clear();
+}
+void LogAnalyzer::clear() {
+	m_nLines = m_nBytes = 0;
+	m_dSeconds = 0;
+	std::fill(m_nLevels, m_nLevels + 5, 0ULL);
+	std::fill(m_nProblems, m_nProblems + 3, 0ULL);
+	m_Nodes.assign(1, TNode());
+	m_Problems.clear();
+	m_Files.clear();
+	m_Stacks.clear();
+	m_Ids.clear();
+}
+bool LogAnalyzer::analyze(const std::string& file) {
+	LogFileMap map;
+	if (!map.open(file)) return false;
+	analyze(map.data(), map.size(), file);
+	return true;
+}
+void LogAnalyzer::analyze(const char* data, size_t size, const std::string& name) {
+	m_Files.push_back(name);
+	const auto t0 = std::chrono::steady_clock::now();
+	// Деление на части по границам строк
+	std::vector<TChunk> chunks;
+	const char* end = data + size;
+	for (const char* p = data; p < end;) {
+		const char* q = p + std::min(std::max<size_t>(m_Opt.chunk, 4096), size_t(end - p));
+		if (q < end) q = std::min(TLogLine::find(q, end, '\n') + 1, end);
+		chunks.emplace_back();
+		chunks.back().begin = p;
+		chunks.back().end = q;
+		p = q;
+	}
+	// Части разбираются рабочими потоками, события сводятся в дерево этим
+	// потоком по порядку, по мере готовности частей
+	unsigned threads = m_Opt.threads ? m_Opt.threads : std::thread::hardware_concurrency();
+	threads = unsigned(std::max<size_t>(1, std::min<size_t>(threads ? threads : 1, chunks.size())));
+	std::atomic<size_t> next(0);
+	std::mutex mutex;
+	std::condition_variable ready;
+	auto work = [&] {
+		for (size_t i; (i = next.fetch_add(1)) < chunks.size();) {
+			scan(chunks[i].begin, chunks[i].end, chunks[i]);
+			std::lock_guard<std::mutex> lock(mutex);
+			chunks[i].done = true;
+			ready.notify_all();
+		}
+	};
+	std::vector<std::thread> pool;
+	for (unsigned t = 0; t < threads && chunks.size() > 1; ++t) pool.emplace_back(work);
+	if (pool.empty()) work();
+	unsigned long long lines = 0;
+	for (TChunk& c : chunks) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			ready.wait(lock, [&] { return c.done; });
+		}
+		merge(c, lines);
+		lines += c.lines;
+		for (int k = 0; k < 5; ++k) m_nLevels[k] += c.levels[k];
+		std::vector<TEvent>().swap(c.events);
+	}
+	for (auto& t : pool) t.join();
+	m_nLines += lines;
+	// Секции, открытые в конце файла, переходят в следующий файл сеанса:
+	// их идентификаторы копируются, так как отображение файла закрывается
+	for (auto& st : m_Stacks) {
+		for (TFrame& f : st.second) {
+			if (f.file + 1 != m_Files.size()) continue;
+			m_Ids.emplace_back(f.id);
+			f.id = m_Ids.back();
+		}
+	}
+	m_nBytes += size;
+	m_dSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+// Разбор части файла: счётчики строк и события секций
+void LogAnalyzer::scan(const char* p, const char* end, TChunk& res) const {
+	static const char begin[] = "SectionBegin ", finish[] = "SectionEnd ";
+	TLogLine line;
+	for (unsigned long long n = 1; p < end; ++n) {
+		const char* nl = TLogLine::find(p, end, '\n');
+		const char* e = nl > p && nl[-1] == '\r' ? nl - 1 : nl;
+		TLogLine::parse(p, e, line);
+		++res.levels[line.level < 0 ? 0 : line.level];
+		++res.lines;
+		p = nl + 1;
+		if (line.level != ILS_LEVEL_INF || line.body.size() < 12 || line.body[0] != 'S') continue;
+		TEvent ev;
+		size_t skip;
+		if (startsWith(line.body, begin, sizeof(begin) - 1)) { ev.begin = true; skip = sizeof(begin) - 1; }
+		else if (startsWith(line.body, finish, sizeof(finish) - 1)) { ev.begin = false; skip = sizeof(finish) - 1; }
+		else continue;
+		const std::string_view rest = line.body.substr(skip);
+		ev.id = rest.substr(0, rest.find(' '));
+		if (ev.id.empty()) continue;
+		ev.line = n;
+		ev.thread = line.thread;
+		ev.time_kind = line.time_kind;
+		ev.time_us = line.time_us;
+		ev.duration_ms = ev.begin ? -1 : suffixDuration(rest);
+		res.events.push_back(ev);
+	}
+}
+// Сведение событий части в дерево (first_line - строк в файле до части)
+void LogAnalyzer::merge(const TChunk& chunk, unsigned long long first_line) {
+	const size_t file = m_Files.size() - 1;
+	// Секции потока вкладываются только в секции того же потока
+	unsigned thread = 0;
+	std::vector<TFrame>* cur = &m_Stacks[0];
+	for (const TEvent& ev : chunk.events) {
+		if (ev.thread != thread) {
+			thread = ev.thread;
+			cur = &m_Stacks[thread];
+		}
+		std::vector<TFrame>& stack = *cur;
+		const unsigned long long line = first_line + ev.line;
+		if (ev.begin) {
+			const size_t node = child(stack.empty() ? 0 : stack.back().node, ev.id);
+			stack.push_back(TFrame{ node, ev.id, file, line, ev.time_kind, ev.time_us });
+			continue;
+		}
+		size_t k = stack.size();
+		while (k > 0 && stack[k - 1].id != ev.id) --k;
+		if (!k) {
+			problem(pkUnopened, ev.id, file, line);
+			continue;
+		}
+		// Вложенные секции, оставшиеся открытыми, закрывает окончание объемлющей
+		for (size_t j = stack.size(); j > k; --j) {
+			const TFrame& f = stack[j - 1];
+			++m_Nodes[f.node].unclosed;
+			problem(pkMismatched, f.id, f.file, f.line, ev.id, file, line);
+		}
+		const TFrame& f = stack[k - 1];
+		TNode& node = m_Nodes[f.node];
+		++node.count;
+		double ms = ev.duration_ms;
+		if (ms < 0 && f.time_kind != TLogLine::tkNone && f.time_kind == ev.time_kind) {
+			long long dt = ev.time_us - f.time_us;
+			// Время суток без даты: секция через полночь
+			if (dt < 0 && f.time_kind == TLogLine::tkWall && ev.time_us < 86400000000LL) dt += 86400000000LL;
+			if (dt >= 0) ms = double(dt) / 1000.0;
+		}
+		if (ms >= 0) node.durations.add((long long)(ms * 1e6 + 0.5));
+		stack.resize(k - 1);
+	}
+}
+void LogAnalyzer::finish() {
+	for (const auto& st : m_Stacks) {
+		for (const TFrame& f : st.second) {
+			++m_Nodes[f.node].unclosed;
+			problem(pkUnclosed, f.id, f.file, f.line);
+		}
+	}
+	m_Stacks.clear();
+	m_Ids.clear();
+}
+void LogAnalyzer::problem(TProblemKind kind, std::string_view id, size_t file, unsigned long long line,
+                          std::string_view closer, size_t closer_file, unsigned long long closer_line) {
+	++m_nProblems[kind];
+	if (m_Problems.size() >= maxProblems) return;
+	m_Problems.push_back(TProblem{ kind, std::string(id), file, line, std::string(closer), closer_file, closer_line });
+}
+// Узел секции \c id среди вложенных в \c parent (создаётся при первом появлении)
+size_t LogAnalyzer::child(size_t parent, std::string_view id) {
+	// Индексная секция: имя без завершающих цифр, ключ с '[' отличает её от обычной с тем же именем
+	size_t base = id.size();
+	if (!m_Opt.exact_ids) while (base > 0 && isDigit(id[base - 1])) --base;
+	const bool indexed = base > 0 && base < id.size() && id.size() - base <= 18 && base < 255;
+	unsigned long long index = 0;
+	char key[256];
+	std::string_view k = id;
+	if (indexed) {
+		for (size_t i = base; i < id.size(); ++i) index = index * 10 + unsigned(id[i] - '0');
+		memcpy(key, id.data(), base);
+		key[base] = '[';
+		k = std::string_view(key, base + 1);
+	}
+	auto it = m_Nodes[parent].lookup.find(k);
+	size_t n;
+	if (it != m_Nodes[parent].lookup.end()) n = it->second;
+	else {
+		n = m_Nodes.size();
+		m_Nodes.emplace_back();
+		TNode& node = m_Nodes.back();
+		node.name = std::string(id.substr(0, indexed ? base : id.size()));
+		node.indexed = indexed;
+		node.min_index = node.max_index = index;
+		m_Nodes[parent].lookup.emplace(std::string(k), n);
+		m_Nodes[parent].children.push_back(n);
+	}
+	TNode& node = m_Nodes[n];
+	if (node.indexed) {
+		node.min_index = std::min(node.min_index, index);
+		node.max_index = std::max(node.max_index, index);
+	}
+	return n;
+}
+//-----------------------------------------------------------------------------
+// Отчёт
+std::string LogAnalyzer::displayName(const TNode& node) {
+	std::string res = node.name;
+	if (node.indexed) {
+		if (node.min_index == node.max_index) ils_appendf(res, "[%llu]", node.min_index);
+		else ils_appendf(res, "[%llu..%llu]", node.min_index, node.max_index);
+	}
+	return res;
+}
+void LogAnalyzer::printNode(std::ostream& out, size_t n, int depth) {
+	TNode& node = m_Nodes[n];
+	if (depth >= 0) {
+		std::string line(size_t(depth) * 2, ' ');
+		line += displayName(node);
+		if (line.size() < 40) line.resize(40, ' ');
+		ils_appendf(line, " %10llu %8llu", node.count, node.unclosed);
+		const TDurationStats& d = node.durations;
+		if (d.count) {
+			const double total = double(d.total) / 1e6;
+			ils_appendf(line, " %12.3f %10.3f %10.3f %10.3f %10.3f %10.3f",
+				total, total / double(d.count), double(d.min) / 1e6, d.quantile(0.5) / 1e6, d.quantile(0.99) / 1e6, double(d.max) / 1e6);
+		}
+		out << line << '\n';
+	}
+	for (size_t c : node.children) printNode(out, c, depth + 1);
+}
+void LogAnalyzer::report(std::ostream& out) {
+	finish();
+	std::string line;
+	ils_appendf(line, "Lines: %llu (LOG %llu, INFO %llu, WARNING %llu, ERROR %llu, other %llu)\n",
+		m_nLines, m_nLevels[ILS_LEVEL_LOG], m_nLevels[ILS_LEVEL_INF], m_nLevels[ILS_LEVEL_WRN], m_nLevels[ILS_LEVEL_ERR], m_nLevels[0]);
+	ils_appendf(line, "Parsed %.1f MB in %.3f s (%.0f MB/s)\n", double(m_nBytes) / 1048576, m_dSeconds,
+		m_dSeconds > 0 ? double(m_nBytes) / 1048576 / m_dSeconds : 0.0);
+	ils_appendf(line, "\n%-40s %10s %8s %12s %10s %10s %10s %10s %10s\n",
+		"Section", "count", "unclosed", "total ms", "mean ms", "min ms", "p50 ms", "p99 ms", "max ms");
+	out << line;
+	printNode(out, 0, -1);
+	line.clear();
+	ils_appendf(line, "\nProblems: unclosed %llu, mismatched %llu, unopened %llu\n",
+		m_nProblems[pkUnclosed], m_nProblems[pkMismatched], m_nProblems[pkUnopened]);
+	const size_t shown = m_Opt.max_problems ? std::min(m_Opt.max_problems, m_Problems.size()) : m_Problems.size();
+	for (size_t i = 0; i < shown; ++i) {
+		const TProblem& p = m_Problems[i];
+		const char* file = m_Files[p.file].c_str();
+		switch (p.kind) {
+		case pkUnclosed:
+			ils_appendf(line, "  %s:%llu: section %s is not closed\n", file, p.line, p.id.c_str());
+			break;
+		case pkMismatched:
+			ils_appendf(line, "  %s:%llu: section %s is closed by SectionEnd %s at ", file, p.line, p.id.c_str(), p.closer.c_str());
+			if (p.closer_file != p.file) ils_appendf(line, "%s:%llu\n", m_Files[p.closer_file].c_str(), p.closer_line);
+			else ils_appendf(line, "line %llu\n", p.closer_line);
+			break;
+		case pkUnopened:
+			ils_appendf(line, "  %s:%llu: SectionEnd %s without SectionBegin\n", file, p.line, p.id.c_str());
+			break;
+		}
+	}
+	const unsigned long long total = m_nProblems[0] + m_nProblems[1] + m_nProblems[2];
+	if (shown < total) ils_appendf(line, "  ... %llu more\n", total - shown);
+	out << line;
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "ILS_SectProfiler.h"
+
+//=============================================================================
+/// Файл, отображённый в память только для чтения.
+/// @ingroup Kernel
+/// Используется утилитами разбора логов: файл в несколько гигабайт читается
+/// без копирования, страницы подгружает система.
+class LogFileMap {
+public:
+	LogFileMap() : m_pData(NULL), m_nSize(0), m_pHandle(NULL) {}
+	~LogFileMap() { close(); }
+	LogFileMap(const LogFileMap&) = delete;
+	LogFileMap& operator=(const LogFileMap&) = delete;
+	/// Отображение файла. Пустой файл открывается успешно (data() == NULL).
+	bool open(const std::string& file);
+	void close();
+	const char* data() const { return m_pData; }
+	size_t size() const { return m_nSize; }
+private:
+	const char* m_pData;
+	size_t m_nSize;
+	void* m_pHandle;  // Описатель отображения (зависит от платформы)
+}; //class LogFileMap
+
+//=============================================================================
+/// Разбор строк текстового лога BaseLogger.
+/// @ingroup Kernel
+/// Строка лога - заголовок BaseLogger::formatTitle() (дата, время, секунды с
+/// начала, номер потока - в зависимости от show_info), суффикс уровня ("> ", "|INFO> ",
+/// "|WARNING> ", "|ERROR> ") и тело сообщения.
+struct TLogLine {
+	/// Вид метки времени строки.
+	enum { tkNone, tkWall, tkElapsed };
+	int level;            ///< ILS_LEVEL_LOG .. ILS_LEVEL_ERR, -1 - строка без заголовка (продолжение сообщения).
+	int time_kind;        ///< tkNone, tkWall (время суток/дата) или tkElapsed (секунды с начала).
+	long long time_us;    ///< Время в мкс (для tkWall без даты - от начала суток).
+	unsigned thread;      ///< Номер потока (BaseLogger::siThread), 0 - не указан.
+	std::string_view body;  ///< Тело сообщения без заголовка и перевода строки.
+	/// Разбор строки [p, end) без завершающего '\\n'.
+	/// \return false, если заголовок не распознан (level == -1, body - вся строка).
+	static bool parse(const char* p, const char* end, TLogLine& res);
+	/// Первый символ \c c в [p, end) или \c end (SSE2, где доступно).
+	static const char* find(const char* p, const char* end, char c);
+};
+
+//=============================================================================
+/// Анализатор текстовых логов: дерево секций и длительности.
+/// @ingroup Kernel
+/// Восстанавливает вложенность секций по строкам
+/// "|INFO> SectionBegin <id> ..." / "|INFO> SectionEnd <id> ...", собирает
+/// статистику длительностей по узлам дерева и находит незакрытые и
+/// несогласованные секции.
+///
+/// Файл отображается в память и делится по границам строк на части, которые
+/// разбираются параллельно: каждая часть даёт счётчики строк и список событий
+/// секций (ссылки на текст в отображении, без копирования). Дерево строится
+/// последовательным проходом по событиям частей в порядке файла.
+///
+/// Секции с индексом (ILS_SECTBI: LoadBox0, LoadBox1 ...) объединяются в один
+/// узел "LoadBox[0..N]", если не задан TOptions::exact_ids. Длительность
+/// берётся из суффикса " [x.xxx ms]" строки SectionEnd (см. SectProfiler), а
+/// при его отсутствии - из разности меток времени строк, если они есть.
+///
+/// Несколько файлов, разобранных подряд (сегменты RotatingLogger в порядке
+/// записи), образуют один сеанс: секция, начатая в одном сегменте и
+/// закрытая в следующем, учитывается как обычная. Незакрытыми секции
+/// считаются только в конце сеанса (finish(), report()). Номера строк в
+/// проблемах - номера строк в своём файле.
+///
+/// Если строки содержат номер потока (BaseLogger::siThread), вложенность
+/// секций восстанавливается для каждого потока отдельно; без номера секции
+/// разных потоков, перемежающиеся в одном файле, будут отмечены как
+/// несогласованные. Длительности узла накапливаются в гистограмме
+/// (TDurationStats): память не зависит от количества секций.
+/// \code
+/// LogAnalyzer a;
+/// if (a.analyze("app.log")) a.report(std::cout);
+/// \endcode
+class LogAnalyzer {
+public:
+	/// Параметры разбора.
+	struct TOptions {
+		unsigned threads = 0;             ///< Потоков разбора, 0 - по числу процессоров.
+		size_t chunk = size_t(32) << 20;  ///< Размер части файла в байтах.
+		bool exact_ids = false;           ///< Не объединять секции с индексом.
+		size_t max_problems = 20;         ///< Сколько проблем выводить в отчёте (0 - все).
+	};
+	/// Узел дерева секций.
+	struct TNode {
+		std::string name;           ///< Идентификатор (для индексных - без индекса).
+		bool indexed = false;       ///< Объединённые секции с индексом.
+		unsigned long long min_index = 0, max_index = 0;
+		unsigned long long count = 0;     ///< Закрытых секций.
+		unsigned long long unclosed = 0;  ///< Незакрытых секций.
+		TDurationStats durations;         ///< Длительности закрытых секций, нс (где известны).
+		std::vector<size_t> children;     ///< Вложенные узлы в порядке появления.
+		std::map<std::string, size_t, std::less<> > lookup;  ///< Вложенные узлы по имени.
+	};
+	/// Вид проблемы.
+	enum TProblemKind {
+		pkUnclosed,    ///< Секция не закрыта до конца файла.
+		pkMismatched,  ///< Секция закрыта окончанием объемлющей секции.
+		pkUnopened     ///< SectionEnd без SectionBegin.
+	};
+	/// Найденная проблема.
+	struct TProblem {
+		TProblemKind kind;
+		std::string id;                 ///< Секция.
+		size_t file;                    ///< Файл строки line (индекс в files()).
+		unsigned long long line;        ///< Строка SectionBegin (для pkUnopened - SectionEnd) в файле.
+		std::string closer;             ///< Секция, окончание которой закрыло эту (pkMismatched).
+		size_t closer_file;             ///< Файл строки closer_line.
+		unsigned long long closer_line; ///< Строка этого окончания в файле.
+	};
+	//---------------------------------------------------------------------------
+	LogAnalyzer();
+	explicit LogAnalyzer(const TOptions& opt);
+	/// Разбор файла (результаты добавляются к результатам прежних файлов).
+	/// Секции, не закрытые к концу файла, остаются открытыми для следующего файла.
+	/// \return false, если файл не удалось открыть.
+	bool analyze(const std::string& file);
+	/// Разбор текста в памяти.
+	/// \param name - имя текста в проблемах.
+	void analyze(const char* data, size_t size, const std::string& name = "<memory>");
+	/// Конец сеанса: секции, оставшиеся открытыми, считаются незакрытыми.
+	/// Следующий analyze() начинает новый сеанс (результаты продолжают суммироваться).
+	void finish();
+	/// Сброс результатов.
+	void clear();
+	/// Текстовый отчёт: счётчики строк, дерево секций со статистикой, проблемы.
+	/// Завершает сеанс (finish()).
+	void report(std::ostream& out);
+	//---------------------------------------------------------------------------
+	/// Строк всего.
+	unsigned long long lines() const { return m_nLines; }
+	/// Строк по уровням: [ILS_LEVEL_LOG .. ILS_LEVEL_ERR], [0] - строки без заголовка.
+	const unsigned long long* levelCounts() const { return m_nLevels; }
+	/// Узлы дерева; nodes()[0] - корень (без имени).
+	const std::vector<TNode>& nodes() const { return m_Nodes; }
+	/// Найденные проблемы в порядке обнаружения (не более maxProblems).
+	const std::vector<TProblem>& problems() const { return m_Problems; }
+	/// Разобранные файлы в порядке разбора.
+	const std::vector<std::string>& files() const { return m_Files; }
+	/// Количество проблем вида \c kind (включая не сохранённые).
+	unsigned long long problemCount(TProblemKind kind) const { return m_nProblems[kind]; }
+	/// Наибольшее количество сохраняемых проблем.
+	enum { maxProblems = 100000 };
+	/// Имя узла для вывода: "LoadBox[0..2]" для объединённых индексных секций.
+	static std::string displayName(const TNode& node);
+private:
+	struct TEvent;
+	struct TChunk;
+	// Открытая секция
+	struct TFrame {
+		size_t node;
+		std::string_view id;      // Текст в отображении файла или в m_Ids
+		size_t file;
+		unsigned long long line;
+		int time_kind;
+		long long time_us;
+	};
+	void scan(const char* p, const char* end, TChunk& res) const;
+	void merge(const TChunk& chunk, unsigned long long first_line);
+	void problem(TProblemKind kind, std::string_view id, size_t file, unsigned long long line,
+	             std::string_view closer = std::string_view(), size_t closer_file = 0, unsigned long long closer_line = 0);
+	size_t child(size_t parent, std::string_view id);
+	void printNode(std::ostream& out, size_t node, int depth);
+	TOptions m_Opt;
+	unsigned long long m_nLines;
+	unsigned long long m_nLevels[5];
+	unsigned long long m_nBytes;
+	double m_dSeconds;  // Время разбора
+	std::vector<TNode> m_Nodes;
+	std::vector<TProblem> m_Problems;
+	unsigned long long m_nProblems[3];
+	std::vector<std::string> m_Files;
+	std::map<unsigned, std::vector<TFrame> > m_Stacks;  // Открытые секции сеанса по номерам потоков (0 - без номера)
+	std::deque<std::string> m_Ids;    // Идентификаторы открытых секций прежних файлов сеанса
+}; //class LogAnalyzer
@@ -0,0 +1,358 @@
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include "ILS_LogConfig.h"
+#include "ILS_RateLimit.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+	inline bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+	// Слова строки до комментария
+	std::vector<std::string_view> split(std::string_view line) {
+		std::vector<std::string_view> res;
+		size_t i = 0;
+		while (i < line.size()) {
+			while (i < line.size() && is_space(line[i])) ++i;
+			if (i == line.size() || line[i] == '#') break;
+			const size_t b = i;
+			while (i < line.size() && !is_space(line[i])) ++i;
+			res.push_back(line.substr(b, i - b));
+		}
+		return res;
+	}
+	bool read_file(const std::string& file, std::string& res) {
+		std::ifstream in(file.c_str(), std::ios::binary);
+		if (!in) return false;
+		res.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		return !in.bad();
+	}
+}
+
+//=============================================================================
+// LogConfig - настройки лога, меняемые во время работы
+//-----------------------------------------------------------------------------
+LogConfig& LogConfig::instance() {
+	// Объект не разрушается: опубликованные наборы читаются до завершения программы
+	static LogConfig* p = new LogConfig();
+	return *p;
+}
+int LogConfig::parseLevel(std::string_view s) {
+	static const char* const names[] = { "dbg", "log", "inf", "wrn", "err", "off" };
+	for (int level = 0; level <= ILS_LEVEL_OFF; ++level)
+		if (s == names[level]) return level;
+	if (s.size() == 1 && s[0] >= '0' && s[0] <= '0' + ILS_LEVEL_OFF) return s[0] - '0';
+	return -1;
+}
+//-----------------------------------------------------------------------------
+// Разбор текста
+bool LogConfig::parse(const std::string& text, TConfig& res, std::string* error) {
+	bool ok = true;
+	std::string_view rest(text);
+	if (rest.compare(0, 3, "\xEF\xBB\xBF") == 0) rest.remove_prefix(3);
+	for (unsigned n = 1; !rest.empty(); ++n) {
+		const size_t nl = rest.find('\n');
+		const std::string_view line = rest.substr(0, nl);
+		rest.remove_prefix(nl == std::string_view::npos ? rest.size() : nl + 1);
+		const std::vector<std::string_view> w = split(line);
+		if (w.empty()) continue;
+		const char* problem = NULL;
+		if (w[0] == "level") {
+			const int level = w.size() == 3 ? parseLevel(w[2]) : -1;
+			if (level < 0) problem = "ожидается: level <идентификатор|начало*|*> <уровень>";
+			else {
+				TLevelOverrides::TEntry e;
+				e.prefix = w[1].back() == '*';
+				e.id = std::string(w[1].substr(0, w[1].size() - e.prefix));
+				e.level = level;
+				// Повторная директива для того же идентификатора заменяет прежнюю
+				auto same = std::find_if(res.levels.entries.begin(), res.levels.entries.end(),
+					[&](const TLevelOverrides::TEntry& x) { return x.prefix == e.prefix && x.id == e.id; });
+				if (same != res.levels.entries.end()) *same = e;
+				else res.levels.entries.push_back(e);
+			}
+		}
+		else if (w[0] == "sink") {
+			const int level = w.size() != 3 ? -2 : w[2] == "on" ? -1 : parseLevel(w[2]);
+			if (level < -1) problem = "ожидается: sink <имя> <on|off|уровень>";
+			else {
+				auto same = std::find_if(res.sinks.begin(), res.sinks.end(),
+					[&](const std::pair<std::string, int>& x) { return x.first == w[1]; });
+				if (same != res.sinks.end()) same->second = level;
+				else res.sinks.emplace_back(std::string(w[1]), level);
+			}
+		}
+		else if (w[0] == "rate") {
+			char* end = NULL;
+			const std::string per(w.size() > 1 ? w[1] : std::string_view()), burst(w.size() > 2 ? w[2] : std::string_view());
+			const double r = strtod(per.c_str(), &end);
+			const bool per_ok = !per.empty() && !*end && r >= 0.;
+			const long b = burst.empty() ? 1 : strtol(burst.c_str(), &end, 10);
+			if (w.size() < 2 || w.size() > 3 || !per_ok || (!burst.empty() && *end) || b < 1) problem = "ожидается: rate <сообщений/с> [серия]";
+			else {
+				res.rate_set = true;
+				res.rate_per_sec = r;
+				res.rate_burst = unsigned(b);
+			}
+		}
+		else problem = "неизвестная директива";
+		if (problem) {
+			ok = false;
+			if (error) *error += std::to_string(n) + ": " + problem + "\n";
+		}
+	}
+	// Точные идентификаторы проверяются первыми, затем начала от длинных к коротким
+	TLevelOverrides& o = res.levels;
+	std::stable_sort(o.entries.begin(), o.entries.end(), [](const TLevelOverrides::TEntry& a, const TLevelOverrides::TEntry& b) {
+		return a.prefix != b.prefix ? !a.prefix : a.prefix && a.id.size() > b.id.size();
+	});
+	o.min_level = ILS_LEVEL_OFF;
+	o.has_default = false;
+	for (const TLevelOverrides::TEntry& e : o.entries) {
+		o.min_level = std::min(o.min_level, e.level);
+		if (e.prefix && e.id.empty()) o.has_default = true;
+	}
+	return ok;
+}
+//-----------------------------------------------------------------------------
+// Приёмники
+void LogConfig::applySink(const TSink& s, const TConfig* cfg) const {
+	std::shared_ptr<ILogger> l = s.sink.lock();
+	if (!l) return;
+	int level = s.level;
+	if (cfg)
+		for (const std::pair<std::string, int>& p : cfg->sinks)
+			if (p.first == s.name && p.second >= 0) level = p.second;
+	if (l->getLogLevel() != level) l->setLogLevel(level);
+}
+void LogConfig::addSink(const std::string& name, std::shared_ptr<ILogger> sink) {
+	if (!sink) return;
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	removeSinkLocked(name);
+	m_Sinks.push_back(TSink{ name, sink, sink->getLogLevel() });
+	applySink(m_Sinks.back(), m_pCurrent.get());
+}
+void LogConfig::removeSink(const std::string& name) {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	removeSinkLocked(name);
+}
+void LogConfig::removeSinkLocked(const std::string& name) {
+	for (auto s = m_Sinks.begin(); s != m_Sinks.end(); ++s) {
+		if (s->name != name) continue;
+		applySink(*s, NULL);
+		m_Sinks.erase(s);
+		return;
+	}
+}
+//-----------------------------------------------------------------------------
+// Применение
+bool LogConfig::apply(const std::string& text, std::string* error) {
+	std::unique_ptr<TConfig> cfg(new TConfig());
+	if (!parse(text, *cfg, error)) return false;
+	apply(std::move(cfg));
+	return true;
+}
+void LogConfig::apply(std::unique_ptr<TConfig> cfg) {
+	if (!cfg) return;
+	std::shared_ptr<const TConfig> c(std::move(cfg)), prev;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (const TSink& s : m_Sinks) applySink(s, c.get());
+		if (c->rate_set) {
+			if (!m_bRateSet) RateLimiter::getDefault(m_nSavedRate, m_nSavedBurst);
+			m_bRateSet = true;
+			RateLimiter::setDefault(c->rate_per_sec, c->rate_burst);
+		}
+		else if (m_bRateSet) {
+			m_bRateSet = false;
+			RateLimiter::setDefault(m_nSavedRate, m_nSavedBurst);
+		}
+		prev.swap(m_pCurrent);
+		m_pCurrent = c;
+		ILogger::publishOverrides(c->levels.entries.empty() ? NULL : &c->levels);
+		m_nApplied.fetch_add(1, std::memory_order_relaxed);
+	}
+	// Прежний набор снят с публикации: освобождается, когда его перестанут читать
+	LogReaders::retire(std::move(prev));
+	LogReaders::reclaim();
+}
+bool LogConfig::load(const std::string& file, std::string* error) {
+	std::string text;
+	if (!read_file(file, text)) {
+		if (error) *error += file + ": не удалось открыть файл\n";
+		return false;
+	}
+	std::string e;
+	if (apply(text, &e)) return true;
+	if (error) {
+		std::istringstream lines(e);
+		for (std::string line; std::getline(lines, line);) *error += file + ":" + line + "\n";
+	}
+	return false;
+}
+
+//=============================================================================
+// LogConfigWatcher - слежение за файлом настроек
+//-----------------------------------------------------------------------------
+LogConfigWatcher::LogConfigWatcher(const std::string& file, unsigned poll_ms)
+	: m_sFile(file), m_nPoll(poll_ms ? poll_ms : 1), m_nStamp(0), m_nSize(0), m_bStop(false), m_bNotified(false), m_nReloads(0) {
+	m_nWake[0] = m_nWake[1] = -1;
+#ifdef __linux__
+	if (pipe2(m_nWake, O_CLOEXEC | O_NONBLOCK) != 0) m_nWake[0] = m_nWake[1] = -1;
+#endif
+	stampChanged();
+	check();
+	m_Thread = std::thread(&LogConfigWatcher::run, this);
+}
+LogConfigWatcher::~LogConfigWatcher() {
+	{
+		std::lock_guard<std::mutex> lock(m_StopMutex);
+		m_bStop = true;
+	}
+	m_Cond.notify_all();
+#ifdef __linux__
+	if (m_nWake[1] >= 0 && write(m_nWake[1], "", 1) < 0) {}
+#endif
+	if (m_Thread.joinable()) m_Thread.join();
+#ifdef __linux__
+	if (m_nWake[0] >= 0) { close(m_nWake[0]); close(m_nWake[1]); }
+#endif
+}
+std::string LogConfigWatcher::lastError() const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_sError;
+}
+bool LogConfigWatcher::check() {
+	try {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		std::string text;
+		if (!read_file(m_sFile, text)) {
+			// Файл мог быть удалён перед заменой: действуют прежние настройки
+			m_sError = m_sFile + ": не удалось открыть файл\n";
+			return false;
+		}
+		if (text == m_sText && m_nReloads.load(std::memory_order_relaxed)) {
+			m_sError.clear();
+			return false;
+		}
+		std::string e;
+		if (!LogConfig::instance().apply(text, &e)) {
+			m_sError.clear();
+			std::istringstream lines(e);
+			for (std::string line; std::getline(lines, line);) m_sError += m_sFile + ":" + line + "\n";
+			return false;
+		}
+		m_sText.swap(text);
+		m_sError.clear();
+		m_nReloads.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	} catch(...){}
+	return false;
+}
+//-----------------------------------------------------------------------------
+// Фоновый поток: события inotify или опрос
+void LogConfigWatcher::run() {
+	if (watchNotify()) return;
+	std::unique_lock<std::mutex> lock(m_StopMutex);
+	while (!m_bStop) {
+		if (m_Cond.wait_for(lock, std::chrono::milliseconds(m_nPoll), [this] { return m_bStop; })) break;
+		lock.unlock();
+		if (stampChanged()) check();
+		lock.lock();
+	}
+}
+bool LogConfigWatcher::stampChanged() {
+	try {
+		std::error_code ec;
+		const fs::path real = fs::canonical(m_sFile, ec);
+		if (ec) return false;
+		const long long stamp = (long long)fs::last_write_time(real, ec).time_since_epoch().count();
+		const unsigned long long size = ec ? 0 : (unsigned long long)fs::file_size(real, ec);
+		if (ec) return false;
+		const std::string name = real.string();
+		if (name == m_sReal && stamp == m_nStamp && size == m_nSize) return false;
+		m_sReal = name;
+		m_nStamp = stamp;
+		m_nSize = size;
+		return true;
+	} catch(...){}
+	return false;
+}
+bool LogConfigWatcher::watchNotify() {
+#ifdef __linux__
+	if (m_nWake[0] < 0) return false;
+	const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) return false;
+	// Следим за каталогом: редакторы заменяют файл новым, и наблюдение за самим файлом теряется
+	const fs::path path(m_sFile);
+	const std::string dir = path.has_parent_path() ? path.parent_path().string() : std::string(".");
+	const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+	const int wd = inotify_add_watch(fd, dir.c_str(), mask);
+	if (wd < 0) {
+		close(fd);
+		return false;
+	}
+	// Каталог реального файла, если файл - символическая ссылка в другой каталог
+	int real_wd = -1;
+	std::string real_dir;
+	auto watchReal = [&]() {
+		std::error_code ec;
+		const fs::path real = fs::canonical(m_sFile, ec);
+		const std::string d = ec ? std::string() : real.parent_path().string();
+		if (d == real_dir) return;
+		if (real_wd >= 0 && real_wd != wd) inotify_rm_watch(fd, real_wd);
+		real_dir = d;
+		real_wd = d.empty() || fs::equivalent(d, dir, ec) ? -1 : inotify_add_watch(fd, d.c_str(), mask);
+	};
+	watchReal();
+	m_bNotified.store(true, std::memory_order_relaxed);
+	// Изменения между загрузкой в конструкторе и началом наблюдения
+	if (stampChanged()) check();
+	alignas(struct inotify_event) char buf[4096];
+	for (;;) {
+		pollfd p[2] = { { fd, POLLIN, 0 }, { m_nWake[0], POLLIN, 0 } };
+		if (poll(p, 2, -1) < 0) continue;
+		if (p[1].revents) break;
+		bool event = false, lost = false;
+		for (ssize_t n; (n = read(fd, buf, sizeof(buf))) > 0;) {
+			for (char* e = buf; e < buf + n;) {
+				const struct inotify_event* ev = reinterpret_cast<const struct inotify_event*>(e);
+				event = true;
+				if ((ev->mask & IN_IGNORED) && ev->wd == wd) lost = true;
+				// Каталог прежней версии удалён (обычно после подмены ссылки)
+				if ((ev->mask & IN_IGNORED) && ev->wd == real_wd) {
+					real_wd = -1;
+					real_dir.clear();
+				}
+				e += sizeof(struct inotify_event) + ev->len;
+			}
+		}
+		// Имя в событии может быть именем промежуточной ссылки (..data), а не
+		// файла: после любого события файл сверяется по реальному пути
+		if (event) {
+			watchReal();
+			if (stampChanged()) check();
+		}
+		// Каталог удалён: переход к опросу
+		if (lost) {
+			close(fd);
+			m_bNotified.store(false, std::memory_order_relaxed);
+			return false;
+		}
+	}
+	close(fd);
+	return true;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "ILS_Logger.h"
+
+//=============================================================================
+/// Настройки лога, меняемые во время работы: пороги по идентификаторам
+/// сообщений, пороги и отключение приёмников, ограничение частоты.
+/// @ingroup Kernel
+/// Текст настроек (UTF-8, по директиве на строку, '#' - комментарий до конца строки):
+/// \code
+/// level net.* dbg     # все идентификаторы, начинающиеся с "net."
+/// level db.query wrn  # один идентификатор
+/// level * inf         # остальные идентификаторы
+/// sink console off    # приёмник, зарегистрированный addSink("console", ...)
+/// sink file wrn
+/// rate 100 20         # RateLimiter::setDefault(100, 20)
+/// \endcode
+/// Уровни: dbg, log, inf, wrn, err, off или число. Пороги по идентификаторам
+/// действуют в объектах Logger (идентификатор - с префиксом объекта, как в
+/// логе) поверх их собственного порога; директивы sink вызывают setLogLevel()
+/// приёмника, а при удалении директивы возвращается порог, который был у
+/// приёмника при регистрации. Без директивы rate общее ограничение частоты не
+/// меняется; при удалении директивы восстанавливается ограничение, которое
+/// действовало до неё (RateLimiter::setDefault()).
+///
+/// Настройки публикуются целиком: новый набор собирается отдельно, затем
+/// указатель на него записывается атомарно (ILogger::publishOverrides()), и
+/// поток, регистрирующий сообщение, видит либо старый, либо новый набор, но
+/// никогда их смесь. Проверка не захватывает блокировок и не меняет счётчиков
+/// ссылок; заменённый набор освобождается через LogReaders, когда его
+/// перестанут читать потоки, начавшие проверку до замены. Пока пороги по
+/// идентификаторам не заданы, проверка - одно чтение указателя.
+/// \code
+/// LogConfig::instance().addSink("console", console);
+/// LogConfigWatcher watcher("app.logconf");  // перечитывает файл при изменении
+/// \endcode
+/// \see LogConfigWatcher
+class LogConfig {
+public:
+	/// Разобранные настройки. После публикации не меняются.
+	struct TConfig {
+		TLevelOverrides levels;                            ///< Пороги по идентификаторам.
+		std::vector<std::pair<std::string, int> > sinks;   ///< Пороги приёмников, -1 - исходный.
+		bool rate_set = false;                             ///< Задана директива rate.
+		double rate_per_sec = 0.;                          ///< Сообщений в секунду с места вызова.
+		unsigned rate_burst = 1;                           ///< Допустимая серия.
+	};
+	/// Глобальные настройки.
+	static LogConfig& instance();
+	/// Разбор текста настроек.
+	/// \param text  - текст.
+	/// \param res   - результат.
+	/// \param error - сюда дописываются описания ошибочных строк (может быть NULL).
+	/// \return false, если в тексте есть ошибки.
+	static bool parse(const std::string& text, TConfig& res, std::string* error = NULL);
+	/// Уровень по имени ("dbg" ... "err", "off") или числу, -1 - ошибка.
+	static int parseLevel(std::string_view s);
+	/// Регистрация приёмника для директив sink (заменяет приёмник с тем же именем).
+	/// Действующие настройки сразу применяются к приёмнику.
+	/// \note Приёмник не удерживается: после его разрушения директива не действует.
+	void addSink(const std::string& name, std::shared_ptr<ILogger> sink);
+	/// Отмена регистрации, приёмнику возвращается исходный порог.
+	void removeSink(const std::string& name);
+	/// Разбор и применение текста. Текст с ошибками не применяется.
+	bool apply(const std::string& text, std::string* error = NULL);
+	/// Применение готовых настроек.
+	void apply(std::unique_ptr<TConfig> cfg);
+	/// Загрузка и применение файла.
+	/// \return false, если файл не удалось прочитать или в нём есть ошибки.
+	bool load(const std::string& file, std::string* error = NULL);
+	/// Действующие настройки, NULL - не применялись.
+	std::shared_ptr<const TConfig> current() const {
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_pCurrent;
+	}
+	/// Количество применённых наборов.
+	unsigned long long applied() const { return m_nApplied.load(std::memory_order_relaxed); }
+private:
+	struct TSink {
+		std::string name;
+		std::weak_ptr<ILogger> sink;
+		int level;  // Порог при регистрации
+	};
+	LogConfig() : m_bRateSet(false), m_nSavedRate(0.), m_nSavedBurst(1), m_nApplied(0) {}
+	void applySink(const TSink& s, const TConfig* cfg) const;
+	void removeSinkLocked(const std::string& name);
+	mutable std::mutex m_Mutex;  // Запись настроек и списка приёмников
+	std::shared_ptr<const TConfig> m_pCurrent;  // Действующий набор (заменённые - в LogReaders)
+	std::vector<TSink> m_Sinks;
+	bool m_bRateSet;             // Общее ограничение частоты задано директивой rate
+	double m_nSavedRate;         // Ограничение, действовавшее до директивы rate
+	unsigned m_nSavedBurst;
+	std::atomic<unsigned long long> m_nApplied;
+}; //class LogConfig
+
+//=============================================================================
+/// Слежение за файлом настроек LogConfig.
+/// @ingroup Kernel
+/// Конструктор загружает файл, фоновый поток перечитывает его после каждого
+/// изменения: в Linux - по событиям inotify каталога файла (в том числе при
+/// замене файла переименованием, как это делают редакторы), на других
+/// системах или если inotify недоступен - опросом раз в \c poll_ms.
+/// Изменение определяется по реальному пути файла, времени изменения и
+/// размеру, поэтому замечается и подмена символической ссылки, в том числе
+/// промежуточной (том ConfigMap: файл -> ..data/файл, ..data -> каталог
+/// версии); за каталогом реального файла inotify тоже следит. Файл
+/// применяется, только если его текст изменился и разобран без ошибок; иначе
+/// действуют прежние настройки, а описание ошибок доступно через lastError().
+class LogConfigWatcher {
+public:
+	/// Конструктор, загружает файл и запускает фоновый поток.
+	/// \param file    - имя файла настроек.
+	/// \param poll_ms - период опроса, мс (если события файловой системы недоступны).
+	LogConfigWatcher(const std::string& file, unsigned poll_ms = 1000);
+	~LogConfigWatcher();
+	LogConfigWatcher(const LogConfigWatcher&) = delete;
+	LogConfigWatcher& operator=(const LogConfigWatcher&) = delete;
+	/// Немедленная проверка файла.
+	/// \return true, если применён новый текст.
+	bool check();
+	/// Количество применений файла.
+	unsigned long long reloads() const { return m_nReloads.load(std::memory_order_relaxed); }
+	/// Ошибки последней неудачной загрузки (пусто - последняя загрузка успешна).
+	std::string lastError() const;
+	/// Изменения отслеживаются событиями файловой системы (иначе - опросом).
+	bool notified() const { return m_bNotified.load(std::memory_order_relaxed); }
+private:
+	void run();
+	/// Ожидание событий inotify до остановки; false - inotify недоступен.
+	bool watchNotify();
+	/// Сравнение реального пути, времени изменения и размера файла с
+	/// запомненными (запоминаются новые). Вызывается конструктором и фоновым потоком.
+	bool stampChanged();
+	const std::string m_sFile;
+	const unsigned m_nPoll;
+	mutable std::mutex m_Mutex;  // Проверка файла (фоновый поток и check())
+	std::string m_sText;         // Последний применённый текст
+	std::string m_sError;
+	std::string m_sReal;         // Реальный путь, время изменения и размер при последней проверке
+	long long m_nStamp;
+	unsigned long long m_nSize;
+	std::mutex m_StopMutex;
+	std::condition_variable m_Cond;
+	bool m_bStop;
+	std::atomic<bool> m_bNotified;
+	std::atomic<unsigned long long> m_nReloads;
+	int m_nWake[2];              // Канал пробуждения фонового потока (Linux)
+	std::thread m_Thread;
+}; //class LogConfigWatcher
@@ -0,0 +1,325 @@
+#include <chrono>
+#include <string.h>
+#include <time.h>
+#include "ILS_LogAnalyzer.h"
+#include "ILS_LogIndex.h"
+
+//=============================================================================
+// Вспомогательные функции записи и чтения
+namespace {
+	const uint16_t endian_mark = 0x0102;
+
+	template<class T> inline void put(std::string& rec, const T& v) {
+		rec.append(reinterpret_cast<const char*>(&v), sizeof(v));
+	}
+	// Чтение из загруженного индекса с проверкой границы
+	struct TReader {
+		const char* p;
+		const char* end;
+		template<class T> bool get(T& v) {
+			if (size_t(end - p) < sizeof(v)) return false;
+			memcpy(&v, p, sizeof(v));
+			p += sizeof(v);
+			return true;
+		}
+		bool bytes(std::string& s, size_t n) {
+			if (size_t(end - p) < n) return false;
+			s.assign(p, n);
+			p += n;
+			return true;
+		}
+	};
+	inline long long wallNow() {
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+	// Перевод местного времени строки лога (TLogLine::time_us с датой) в
+	// системное. Смещение часового пояса запоминается на час: переход на
+	// летнее время и обратно происходит на границе часа.
+	class TLocalTime {
+	public:
+		long long wall(long long local_us) {
+			const long long sec = local_us >= 0 ? local_us / 1000000 : (local_us + 1) / 1000000 - 1;
+			const long long hour = sec >= 0 ? sec / 3600 : (sec + 1) / 3600 - 1;
+			if (hour != m_nHour) {
+				struct tm t;
+				const time_t h = time_t(hour * 3600);
+#ifdef _WIN32
+				gmtime_s(&t, &h);
+#else
+				gmtime_r(&h, &t);
+#endif
+				t.tm_isdst = -1;
+				const time_t w = mktime(&t);
+				m_nHour = hour;
+				m_nShift = w == time_t(-1) ? 0 : ((long long)w - hour * 3600) * 1000000;
+			}
+			return local_us + m_nShift;
+		}
+	private:
+		long long m_nHour = -(1LL << 62), m_nShift = 0;
+	};
+}
+
+//=============================================================================
+// LogIndexWriter - запись индекса по мере вывода строк.
+//-----------------------------------------------------------------------------
+bool LogIndexWriter::open(const std::string& file, bool append, unsigned block, int exact_level) {
+	close();
+	m_pFile = fopen(file.c_str(), append ? "ab" : "wb");
+	if (!m_pFile) return false;
+	setvbuf(m_pFile, NULL, _IOFBF, 1 << 16);
+	m_nBlock = block ? block : unsigned(defaultBlock);
+	m_nExact = exact_level;
+	m_bBlock = false;
+	m_Ids.clear();
+	m_IdLevels.clear();
+	m_Touched.clear();
+	m_sLastId.clear();
+	m_nLastId = uint32_t(-1);
+	// Заголовок сеанса: номера идентификаторов начинаются заново
+	std::string rec("ILSX", 4);
+	put(rec, uint16_t(version));
+	put(rec, endian_mark);
+	put(rec, uint32_t(m_nBlock));
+	put(rec, uint8_t(m_nExact));
+	fwrite(rec.data(), 1, rec.size(), m_pFile);
+	return true;
+}
+void LogIndexWriter::close() {
+	if (!m_pFile) return;
+	finishBlock();
+	fclose(m_pFile);
+	m_pFile = NULL;
+}
+void LogIndexWriter::flush() {
+	if (m_pFile) fflush(m_pFile);
+}
+void LogIndexWriter::add(unsigned long long offset, size_t size, int level, const std::string& id) {
+	if (m_pFile) add(offset, size, level, id, wallNow());
+}
+void LogIndexWriter::add(unsigned long long offset, size_t size, int level, const std::string& id, long long now) {
+	if (!m_pFile) return;
+	const unsigned long long no = offset / m_nBlock;
+	if (!m_bBlock || no != m_nBlockNo) {
+		finishBlock();
+		m_bBlock = true;
+		m_nBlockNo = no;
+		m_nBegin = offset;
+		m_nFirstUs = noTime;
+		m_nLastUs = noTime;
+		m_nRecords = 0;
+		m_nLevels = 0;
+	}
+	m_nEnd = offset + size;
+	// Строки разобранного лога могут идти не по порядку времени
+	if (now != noTime) {
+		if (m_nFirstUs == noTime || now < m_nFirstUs) m_nFirstUs = now;
+		if (m_nLastUs == noTime || now > m_nLastUs) m_nLastUs = now;
+	}
+	++m_nRecords;
+	const uint8_t bit = uint8_t(1u << (level & 7));
+	m_nLevels |= bit;
+	const uint32_t n = idNo(id);
+	if (!m_IdLevels[n]) m_Touched.push_back(n);
+	m_IdLevels[n] |= bit;
+	if (level >= m_nExact) {
+		m_Rec.clear();
+		put(m_Rec, uint8_t(rtRecord));
+		put(m_Rec, uint64_t(offset));
+		put(m_Rec, n);
+		put(m_Rec, uint8_t(level));
+		put(m_Rec, int64_t(now));
+		fwrite(m_Rec.data(), 1, m_Rec.size(), m_pFile);
+		// Ошибки не должны задерживаться в буфере, как и в самом логе
+		if (level >= ILS_LEVEL_ERR) fflush(m_pFile);
+	}
+}
+// Номер идентификатора сеанса; новый идентификатор сразу записывается в индекс
+uint32_t LogIndexWriter::idNo(const std::string& id) {
+	if (m_nLastId != uint32_t(-1) && id == m_sLastId) return m_nLastId;
+	auto it = m_Ids.find(id);
+	uint32_t n;
+	if (it != m_Ids.end()) n = it->second;
+	else {
+		n = uint32_t(m_Ids.size());
+		m_Ids.emplace(id, n);
+		m_IdLevels.push_back(0);
+		const uint16_t len = uint16_t(id.size() < 0xFFFF ? id.size() : 0xFFFF);
+		m_Rec.clear();
+		put(m_Rec, uint8_t(rtId));
+		put(m_Rec, n);
+		put(m_Rec, len);
+		m_Rec.append(id.data(), len);
+		fwrite(m_Rec.data(), 1, m_Rec.size(), m_pFile);
+	}
+	m_sLastId = id;
+	m_nLastId = n;
+	return n;
+}
+void LogIndexWriter::finishBlock() {
+	if (!m_bBlock) return;
+	m_bBlock = false;
+	m_Rec.clear();
+	put(m_Rec, uint8_t(rtBlock));
+	put(m_Rec, uint64_t(m_nBegin));
+	put(m_Rec, uint64_t(m_nEnd));
+	put(m_Rec, int64_t(m_nFirstUs));
+	put(m_Rec, int64_t(m_nFirstUs == noTime ? -noTime : m_nLastUs));
+	put(m_Rec, m_nRecords);
+	put(m_Rec, m_nLevels);
+	put(m_Rec, uint32_t(m_Touched.size()));
+	for (uint32_t n : m_Touched) {
+		put(m_Rec, n);
+		put(m_Rec, m_IdLevels[n]);
+		m_IdLevels[n] = 0;
+	}
+	m_Touched.clear();
+	fwrite(m_Rec.data(), 1, m_Rec.size(), m_pFile);
+}
+
+// Индекс по тексту готового лога
+bool LogIndexWriter::build(const std::string& log, const std::string& file, unsigned block, int exact_level) {
+	LogFileMap map;
+	if (!map.open(log)) return false;
+	LogIndexWriter index;
+	if (!index.open(file, false, block, exact_level)) return false;
+	const std::string id;
+	TLocalTime local;
+	const char* const data = map.data();
+	const char* const end = data + map.size();
+	// Текущее сообщение: строки до начала лога без заголовка относятся к первому
+	unsigned long long start = 0;
+	int level = ILS_LEVEL_LOG;
+	long long wall = noTime;
+	for (const char* p = data; p < end; ) {
+		const char* nl = TLogLine::find(p, end, '\n');
+		TLogLine line;
+		if (TLogLine::parse(p, nl, line)) {
+			const unsigned long long offset = (unsigned long long)(p - data);
+			if (offset > start) index.add(start, size_t(offset - start), level, id, wall);
+			start = offset;
+			level = line.level;
+			// Время суток без даты не переводится в системное
+			wall = line.time_kind == TLogLine::tkWall && line.time_us >= 86400000000LL ? local.wall(line.time_us) : noTime;
+		}
+		p = nl + (nl < end);
+	}
+	if (map.size() > start) index.add(start, size_t(map.size() - start), level, id, wall);
+	index.close();
+	return true;
+}
+
+//=============================================================================
+// LogIndex - чтение индекса.
+//-----------------------------------------------------------------------------
+bool LogIndex::open(const std::string& file) {
+	m_Blocks.clear();
+	m_Records.clear();
+	m_Names.clear();
+	m_NameNo.clear();
+	m_Bits.clear();
+	m_nEnd = 0;
+	m_nExact = ILS_LEVEL_OFF;
+	LogFileMap map;
+	if (!map.open(file)) return false;
+	TReader in = { map.data(), map.data() + map.size() };
+	std::vector<unsigned> local;  // Номер идентификатора сеанса -> номер в m_Names
+	std::string name;
+	bool header = false;
+	while (in.p < in.end) {
+		// Заголовок сеанса
+		if (size_t(in.end - in.p) >= 4 && !memcmp(in.p, "ILSX", 4)) {
+			in.p += 4;
+			uint16_t ver, mark;
+			uint32_t block;
+			uint8_t exact;
+			if (!in.get(ver) || !in.get(mark) || !in.get(block) || !in.get(exact) || ver != LogIndexWriter::version || mark != endian_mark) break;
+			// Точные смещения полны только для уровней, сохранявшихся во всех сеансах
+			if (!header || exact > m_nExact) m_nExact = exact;
+			local.clear();
+			header = true;
+			continue;
+		}
+		uint8_t type;
+		if (!header || !in.get(type)) break;
+		if (type == LogIndexWriter::rtId) {
+			uint32_t n;
+			uint16_t len;
+			if (!in.get(n) || !in.get(len) || !in.bytes(name, len)) break;
+			auto it = m_NameNo.find(name);
+			const unsigned g = it != m_NameNo.end() ? it->second : unsigned(m_Names.size());
+			if (it == m_NameNo.end()) {
+				m_NameNo.emplace(name, g);
+				m_Names.push_back(name);
+			}
+			if (local.size() <= n) local.resize(n + 1, unsigned(-1));
+			local[n] = g;
+		}
+		else if (type == LogIndexWriter::rtBlock) {
+			uint64_t begin, end;
+			int64_t first, last;
+			uint32_t records, count;
+			uint8_t levels;
+			if (!in.get(begin) || !in.get(end) || !in.get(first) || !in.get(last) ||
+			    !in.get(records) || !in.get(levels) || !in.get(count)) break;
+			if (size_t(in.end - in.p) < size_t(count) * 5) break;
+			const size_t b = m_Blocks.size();
+			m_Blocks.push_back(TBlock{ begin, end, first, last, records, levels });
+			if (end > m_nEnd) m_nEnd = end;
+			for (uint32_t k = 0; k < count; ++k) {
+				uint32_t n = 0;
+				uint8_t mask = 0;
+				in.get(n);
+				in.get(mask);
+				if (n >= local.size() || local[n] == unsigned(-1)) continue;
+				const size_t base = size_t(local[n]) * 5;
+				if (m_Bits.size() < base + 5) m_Bits.resize(base + 5);
+				for (int level = 0; level < 5; ++level) {
+					if (!(mask & (1u << level))) continue;
+					std::vector<uint64_t>& bits = m_Bits[base + level];
+					if (bits.size() <= b / 64) bits.resize(b / 64 + 1, 0);
+					bits[b / 64] |= uint64_t(1) << (b % 64);
+				}
+			}
+		}
+		else if (type == LogIndexWriter::rtRecord) {
+			uint64_t offset;
+			uint32_t n;
+			uint8_t level;
+			int64_t wall;
+			if (!in.get(offset) || !in.get(n) || !in.get(level) || !in.get(wall)) break;
+			if (n < local.size() && local[n] != unsigned(-1))
+				m_Records.push_back(TRecord{ offset, local[n], level, wall });
+		}
+		else break;
+	}
+	return header;
+}
+int LogIndex::idNo(const std::string& id) const {
+	auto it = m_NameNo.find(id);
+	return it != m_NameNo.end() ? int(it->second) : -1;
+}
+unsigned LogIndex::levelMask(int min_level) {
+	unsigned mask = 0;
+	for (int level = min_level < 0 ? 0 : min_level; level <= ILS_LEVEL_ERR; ++level) mask |= 1u << level;
+	return mask;
+}
+bool LogIndex::contains(size_t block, unsigned id, unsigned levels) const {
+	for (int level = 0; level < 5; ++level) {
+		if (!(levels & (1u << level)) || size_t(id) * 5 + level >= m_Bits.size()) continue;
+		const std::vector<uint64_t>& bits = m_Bits[size_t(id) * 5 + level];
+		if (block / 64 < bits.size() && (bits[block / 64] >> (block % 64) & 1)) return true;
+	}
+	return false;
+}
+std::vector<size_t> LogIndex::select(long long from_us, long long to_us, int id, unsigned levels) const {
+	std::vector<size_t> res;
+	for (size_t b = 0; b < m_Blocks.size(); ++b) {
+		const TBlock& blk = m_Blocks[b];
+		if (blk.last_us < from_us || blk.first_us > to_us || !(blk.levels & levels)) continue;
+		if (id >= 0 && !contains(b, unsigned(id), levels)) continue;
+		res.push_back(b);
+	}
+	return res;
+}
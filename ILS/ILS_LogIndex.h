@@ -0,0 +1,147 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ILS_Logger.h"
+
+//=============================================================================
+/// Запись индекса текстового лога (файл рядом с логом, обычно "<лог>.idx").
+/// @ingroup Kernel
+/// Лог делится на блоки: блок - строки, начинающиеся в одном окне из
+/// \c block байт файла. По каждому блоку в индекс пишется сводка: диапазон
+/// байтов, время первой и последней строки (контрольные точки время -> смещение),
+/// маска уровней и список идентификаторов (LogId) с масками их уровней.
+/// Для строк уровня \c exact_level и выше (по умолчанию предупреждения и
+/// ошибки) дополнительно пишется точное смещение строки с её идентификатором,
+/// так что такие сообщения одного LogId находятся без чтения блоков.
+///
+/// Файл только дописывается; каждый сеанс записи начинается заголовком,
+/// номера идентификаторов действуют внутри сеанса. LogIndex строит по
+/// сводкам блоков битовые карты "идентификатор и уровень -> блоки".
+///
+/// Запись вызывается приёмником под его блокировкой, в порядке строк в
+/// файле (см. MMapLogger::setIndex(), BatchLogger::setIndex()); сам объект
+/// не потокобезопасен. Для логов приёмников без индекса (StdLogger,
+/// RotatingLogger) индекс строится по тексту готового лога (build()):
+/// время берётся из заголовков строк, идентификаторы не известны.
+class LogIndexWriter {
+public:
+	/// Размер блока по умолчанию.
+	enum { defaultBlock = 1 << 16 };
+	/// Версия формата.
+	enum { version = 1 };
+	/// Типы записей индекса.
+	enum { rtId = 1, rtBlock = 2, rtRecord = 3 };
+	/// Время строки не известно (в заголовке строки нет даты). Блок без
+	/// известного времени покрывает весь интервал [noTime, -noTime].
+	static constexpr long long noTime = -(1LL << 62);
+	LogIndexWriter() : m_pFile(NULL), m_nBlock(defaultBlock), m_nExact(0), m_bBlock(false), m_nLastId(0) {}
+	~LogIndexWriter() { close(); }
+	LogIndexWriter(const LogIndexWriter&) = delete;
+	LogIndexWriter& operator=(const LogIndexWriter&) = delete;
+	/// Открытие файла индекса.
+	/// \param file        - имя файла индекса.
+	/// \param append      - дописывать в существующий индекс (лог открыт на дописывание).
+	/// \param block       - размер блока в байтах лога.
+	/// \param exact_level - уровень, начиная с которого сохраняются точные смещения строк.
+	bool open(const std::string& file, bool append, unsigned block = defaultBlock, int exact_level = ILS_LEVEL_WRN);
+	/// Запись сводки последнего блока и закрытие файла.
+	void close();
+	bool isOpen() const { return m_pFile != NULL; }
+	/// Учёт строки лога, выводимой сейчас.
+	/// \param offset - смещение строки в файле лога.
+	/// \param size   - длина строки с переводом строки.
+	/// \param level  - уровень сообщения (ILS_LEVEL_...).
+	/// \param id     - идентификатор сообщения.
+	void add(unsigned long long offset, size_t size, int level, const std::string& id);
+	/// Учёт строки лога с заданным временем.
+	/// \param wall_us - системное время строки, мкс от начала эпохи, или noTime.
+	void add(unsigned long long offset, size_t size, int level, const std::string& id, long long wall_us);
+	/// Построение индекса по тексту готового лога BaseLogger (см. TLogLine).
+	/// Строка с заголовком и следующие строки без заголовка - одно сообщение;
+	/// время строк с датой переводится из местного в системное, строки без
+	/// даты учитываются без времени. Все строки получают пустой идентификатор.
+	/// \param log  - файл лога.
+	/// \param file - создаваемый файл индекса.
+	static bool build(const std::string& log, const std::string& file,
+	                  unsigned block = defaultBlock, int exact_level = ILS_LEVEL_WRN);
+	/// Сброс буферов файла индекса.
+	void flush();
+private:
+	void finishBlock();
+	uint32_t idNo(const std::string& id);
+	FILE* m_pFile;
+	unsigned m_nBlock;
+	int m_nExact;
+	// Текущий блок
+	bool m_bBlock;
+	unsigned long long m_nBlockNo, m_nBegin, m_nEnd;
+	long long m_nFirstUs, m_nLastUs;
+	uint32_t m_nRecords;
+	uint8_t m_nLevels;
+	std::vector<uint8_t> m_IdLevels;    // Маска уровней идентификатора в текущем блоке
+	std::vector<uint32_t> m_Touched;    // Идентификаторы текущего блока
+	// Идентификаторы сеанса
+	std::unordered_map<std::string, uint32_t> m_Ids;
+	std::string m_sLastId;
+	uint32_t m_nLastId;
+	std::string m_Rec;
+}; //class LogIndexWriter
+
+//=============================================================================
+/// Чтение индекса текстового лога и выбор блоков по времени, LogId и уровню.
+/// @ingroup Kernel
+/// \code
+/// LogIndex idx;
+/// if (idx.open("app.log.idx"))
+///     for (size_t b : idx.select(from_us, to_us, idx.idNo("net"), LogIndex::levelMask(ILS_LEVEL_WRN)))
+///         ...  // строки лога в [blocks()[b].begin, blocks()[b].end)
+/// \endcode
+class LogIndex {
+public:
+	/// Сводка блока.
+	struct TBlock {
+		unsigned long long begin, end;  ///< Байты лога [begin, end).
+		long long first_us, last_us;    ///< Системное время первой и последней строки, мкс от начала эпохи.
+		unsigned records;               ///< Строк в блоке.
+		unsigned levels;                ///< Маска уровней (бит 1 << ILS_LEVEL_...).
+	};
+	/// Строка с точным смещением (уровни от exact_level записи).
+	struct TRecord {
+		unsigned long long offset;
+		unsigned id;        ///< Номер в ids().
+		int level;
+		long long wall_us;
+	};
+	/// Открытие и загрузка индекса. Оборванная последняя запись игнорируется.
+	bool open(const std::string& file);
+	const std::vector<TBlock>& blocks() const { return m_Blocks; }
+	const std::vector<TRecord>& records() const { return m_Records; }
+	const std::vector<std::string>& ids() const { return m_Names; }
+	/// Номер идентификатора в ids(), -1 - не встречался.
+	int idNo(const std::string& id) const;
+	/// Уровень, начиная с которого records() содержит все строки лога.
+	int exactLevel() const { return m_nExact; }
+	/// Наибольшее смещение, покрытое блоками (дальше строки не проиндексированы).
+	unsigned long long indexedEnd() const { return m_nEnd; }
+	/// Маска уровней от \c min_level до ILS_LEVEL_ERR.
+	static unsigned levelMask(int min_level);
+	/// Содержит ли блок \c block строки идентификатора \c id уровней из маски.
+	bool contains(size_t block, unsigned id, unsigned levels) const;
+	/// Номера блоков, пересекающихся с интервалом времени и содержащих строки
+	/// идентификатора \c id (-1 - любого) уровней из маски \c levels.
+	/// \param from_us, to_us - интервал системного времени, мкс (включительно).
+	std::vector<size_t> select(long long from_us, long long to_us, int id, unsigned levels) const;
+private:
+	std::vector<TBlock> m_Blocks;
+	std::vector<TRecord> m_Records;
+	std::vector<std::string> m_Names;
+	std::unordered_map<std::string, unsigned> m_NameNo;
+	// Битовые карты блоков: [id * 5 + level] -> слова по 64 блока
+	std::vector<std::vector<uint64_t> > m_Bits;
+	unsigned long long m_nEnd = 0;
+	int m_nExact = ILS_LEVEL_OFF;
+}; //class LogIndex
@@ -1,10 +1,214 @@
 #pragma once
 
 #include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 #include <stdarg.h>
 
+#include "ILS_FormatBuf.h"
+#include "ILS_FmtSite.h"
+#include "ILS_TypedFmt.h"
+#include "ILS_MsgCatalog.h"
+
+//=============================================================================
+/// Уровни важности сообщений.
+/// @ingroup Kernel
+/// Сообщения с уровнем ниже порога не форматируются и не выводятся.
+/// Уровни заданы макросами, чтобы их можно было сравнивать в препроцессоре.
+#define ILS_LEVEL_DBG 0  ///< ILogger::dbg()
+#define ILS_LEVEL_LOG 1  ///< ILogger::log(), ILS_LOG
+#define ILS_LEVEL_INF 2  ///< ILogger::inf(), секции ILS_SECTB/ILS_SECTE
+#define ILS_LEVEL_WRN 3  ///< ILogger::wrn(), ILS_WRN
+#define ILS_LEVEL_ERR 4  ///< ILogger::err()
+#define ILS_LEVEL_OFF 5  ///< Вывод отключен полностью
+
+/// Порог важности на этапе компиляции.
+/// Вызовы макросов ILS_LOG, ILS_WRN и секций с уровнем ниже порога 
+/// превращаются в мёртвый код и удаляются компилятором, например:
+/// \code
+/// #define ILS_MIN_LEVEL ILS_LEVEL_WRN  // в release-сборке оставить только wrn и err
+/// \endcode
+#ifndef ILS_MIN_LEVEL
+#define ILS_MIN_LEVEL ILS_LEVEL_DBG
+#endif
+
+/// Проверка, нужно ли регистрировать сообщение уровня LEVEL для логгера PTR.
+/// Сначала проверяется порог компиляции (константа), затем порог логгера 
+/// (одно чтение и одно сравнение).
+#define ILS_ENABLED(PTR, LEVEL) ((LEVEL) >= ILS_MIN_LEVEL && (PTR)->logEnabled(LEVEL))
+
+//=============================================================================
+/// Пороги важности по идентификаторам сообщений (см. LogConfig).
+/// @ingroup Kernel
+/// Набор публикуется целиком и после публикации не меняется и не удаляется,
+/// поэтому читается без блокировок. Идентификатор сообщения дополняется
+/// префиксом логгера (Logger::setPrefix()), так что в настройках указывается
+/// полный идентификатор, как он выглядит в логе.
+struct TLevelOverrides {
+	/// Порог для идентификатора.
+	struct TEntry {
+		std::string id;  ///< Идентификатор или его начало.
+		bool prefix;     ///< Задано начало идентификатора ("net.*" - все, начинающиеся с "net.").
+		int level;       ///< Порог.
+	};
+	/// Пороги: сначала точные, затем начала по убыванию длины ("*" - пустое начало, последний).
+	std::vector<TEntry> entries;
+	/// Наименьший из порогов.
+	int min_level = ILS_LEVEL_OFF;
+	/// Задан порог для всех идентификаторов ("*").
+	bool has_default = false;
+	/// Порог для идентификатора \c pfx + \c id, -1 - не задан.
+	int level(std::string_view pfx, std::string_view id) const {
+		const size_t n = pfx.size() + id.size();
+		for (const TEntry& e : entries) {
+			if (e.prefix ? e.id.size() > n : e.id.size() != n) continue;
+			const size_t k = std::min(e.id.size(), pfx.size());
+			if (pfx.compare(0, k, e.id, 0, k) == 0 && id.compare(0, e.id.size() - k, e.id, k, e.id.size() - k) == 0) return e.level;
+		}
+		return -1;
+	}
+	/// Порог, проверяемый до форматирования, для логгера с порогом \c base.
+	int gate(int base) const { return has_default ? min_level : std::min(base, min_level); }
+};
+
+//=============================================================================
+/// Отложенное освобождение объектов, которые могут ещё читать другие потоки.
+/// @ingroup Kernel
+/// Так освобождаются логгеры и префиксы, заменённые в Logger, и наборы
+/// настроек LogConfig и MsgCatalog: читатель берёт опубликованный указатель
+/// без копирования shared_ptr, поэтому заменённый объект нельзя удалить сразу.
+///
+/// Читатель отмечается в ячейке своего потока на время чтения (TGuard):
+/// вход и выход - запись в свою ячейку, без общих счётчиков. Отметку ставят
+/// функции регистрации ILogger, одну на сообщение; отметки в функциях вывода
+/// (Logger) вложенные и сводятся к счётчику вложенности.
+///
+/// Заменённый объект передаётся в retire() и снимается с публикации, после
+/// чего reclaim() запоминает потоки, читающие в этот момент. Объект
+/// освобождается, когда все они выйдут из чтения: следующим вызовом reclaim()
+/// или самим читателем при выходе из чтения. reclaim() никого не ждёт и может
+/// вызываться внутри чтения (текущий поток тогда тоже считается читателем).
+class LogReaders {
+	struct alignas(64) TSlot {
+		std::atomic<unsigned long long> seq{0};  // Нечётное - поток внутри чтения
+		unsigned depth = 0;                      // Вложенность чтения (только поток-владелец)
+		bool used = true;                        // Ячейка занята живым потоком (под mutex())
+	};
+	/// Объект, ожидающий освобождения.
+	struct TRetired {
+		std::shared_ptr<const void> obj;
+		bool sealed = false;                                        // Читатели запомнены (reclaim())
+		std::vector<std::pair<TSlot*, unsigned long long> > busy;  // Читатели, которых ждёт объект
+	};
+	static std::mutex& mutex() { static std::mutex* m = new std::mutex(); return *m; }
+	// Ячейки всех потоков: не удаляются, ячейки завершённых потоков используются повторно
+	static std::vector<TSlot*>& slots() { static std::vector<TSlot*>* v = new std::vector<TSlot*>(); return *v; }
+	static std::vector<TRetired>& retired() {
+		static std::vector<TRetired>* v = new std::vector<TRetired>();
+		return *v;
+	}
+	// Количество объектов с запомненными читателями (проверяется при выходе из чтения)
+	static std::atomic<size_t>& sealed() { static std::atomic<size_t> n(0); return n; }
+	static TSlot& slot() {
+		thread_local TSlot* p = NULL;
+		if (!p) p = attach();
+		return *p;
+	}
+	static TSlot* attach() {
+		// Ячейка освобождается при завершении потока
+		struct THolder {
+			TSlot* slot = NULL;
+			~THolder() { if (slot) { std::lock_guard<std::mutex> lock(mutex()); slot->used = false; } }
+		};
+		thread_local THolder holder;
+		std::lock_guard<std::mutex> lock(mutex());
+		for (TSlot* s : slots())
+			if (!s->used) { s->used = true; holder.slot = s; return s; }
+		slots().push_back(new TSlot());
+		holder.slot = slots().back();
+		return holder.slot;
+	}
+	/// Освобождение объектов, все читатели которых вышли из чтения.
+	/// \param seal - запомнить читателей новых объектов (иначе только проверка, без ожидания блокировки).
+	static void collect(bool seal) {
+		std::vector<std::shared_ptr<const void> > batch;
+		{
+			std::unique_lock<std::mutex> lock(mutex(), std::defer_lock);
+			if (seal) lock.lock();
+			else if (!lock.try_lock()) return;
+			std::vector<TRetired>& r = retired();
+			if (seal) {
+				// Указатели на новые объекты сняты с публикации до этой точки
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				for (TRetired& x : r) {
+					if (x.sealed) continue;
+					x.sealed = true;
+					for (TSlot* s : slots()) {
+						const unsigned long long seq = s->seq.load(std::memory_order_acquire);
+						if (seq & 1) x.busy.emplace_back(s, seq);
+					}
+				}
+			}
+			size_t waiting = 0;
+			for (size_t i = 0; i < r.size();) {
+				std::vector<std::pair<TSlot*, unsigned long long> >& b = r[i].busy;
+				b.erase(std::remove_if(b.begin(), b.end(), [](const std::pair<TSlot*, unsigned long long>& x) {
+					return x.first->seq.load(std::memory_order_acquire) != x.second;
+				}), b.end());
+				if (r[i].sealed && b.empty()) {
+					batch.push_back(std::move(r[i].obj));
+					r[i] = std::move(r.back());
+					r.pop_back();
+				}
+				else waiting += r[i++].sealed;
+			}
+			sealed().store(waiting, std::memory_order_relaxed);
+		}
+		// Объекты разрушаются здесь, вне блокировки
+	}
+public:
+	/// Отметка чтения опубликованных объектов (вложенные отметки допустимы).
+	class TGuard {
+		TSlot& m_Slot;
+	public:
+		TGuard() : m_Slot(slot()) {
+			// Вложенная отметка - только счётчик, барьер ставит внешняя
+			if (m_Slot.depth++) return;
+			m_Slot.seq.store(m_Slot.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+		~TGuard() {
+			if (--m_Slot.depth) return;
+			m_Slot.seq.store(m_Slot.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+			// Объекты, ожидавшие выхода читателей, освобождает последний из них
+			if (sealed().load(std::memory_order_relaxed)) collect(false);
+		}
+		TGuard(const TGuard&) = delete;
+		TGuard& operator=(const TGuard&) = delete;
+	};
+	/// Передача заменённого объекта на освобождение.
+	/// Объект освобождается не раньше, чем после следующего вызова reclaim().
+	static void retire(std::shared_ptr<const void> p) {
+		if (!p) return;
+		std::lock_guard<std::mutex> lock(mutex());
+		retired().emplace_back();
+		retired().back().obj = std::move(p);
+	}
+	/// Запоминание читателей объектов, переданных в retire() (указатели на них
+	/// должны быть уже сняты с публикации), и освобождение объектов, которые уже
+	/// никто не читает. Не ждёт читателей.
+	/// \note Нельзя вызывать, удерживая блокировку, которую могут ждать деструкторы освобождаемых объектов.
+	static void reclaim() { collect(true); }
+}; //class LogReaders
+
 //=============================================================================
 /// Интерфейс для регистрации хода процессов.
 /// @ingroup Kernel
@@ -18,6 +222,7 @@
 /// - ILogger::log(const LogId&, const char*, ...)
 /// - ILogger::wrn(const LogId&, const char*, ...)
 /// - ILogger::err(const LogId&, const char*, ...)
+/// - те же функции с форматом ILS_FMT("..."), проверяемым при компиляции.
 ///
 /// Функция для регитсрации прогресса выполнения:
 /// - ILogger::progress(double pop)
@@ -32,33 +237,194 @@ public:
 	typedef std::string LogId;
 	/// Тип содержания всех сообщений.
 	typedef std::string Msg;
-	/// Константа, максимальная длина сообщения.
+	/// Тип ссылки на готовый текст сообщения, передаваемый в функции вывода.
+	typedef std::string_view MsgView;
+	/// Начальный размер буфера сообщения (длинные сообщения увеличивают буфер, а не обрезаются).
 	static const unsigned long max_msg_size = 1024;
 	// Регистрация сообщения для анализатора логов.
-	virtual void infOut(const Msg& msg, const LogId& id) const = 0;
+	virtual void infOut(MsgView msg, const LogId& id) const = 0;
 	// Регистрация информационного сообщения, которую надо переобпределить.
-	virtual void logOut(const Msg& msg, const LogId& id) const = 0;
+	virtual void logOut(MsgView msg, const LogId& id) const = 0;
 	// Регистрация предупреждения (warning) и не фатальной ошибки, которую надо переобпределить.
-	virtual void wrnOut(const Msg& msg, const LogId& id) const = 0;
+	virtual void wrnOut(MsgView msg, const LogId& id) const = 0;
 	// Регистрация фатальной ошибки, которую надо переобпределить.
-	virtual void errOut(const Msg& msg, const LogId& id) const = 0;
+	virtual void errOut(MsgView msg, const LogId& id) const = 0;
+	/// Тип указателя на функцию вывода.
+	typedef void (ILogger::*TOutFunc)(MsgView msg, const LogId& id) const;
+	//---------------------------------------------------------------------------
+	ILogger() : log_level(ILS_LEVEL_DBG) {}
+	ILogger(const ILogger& src) : log_level(src.log_level.load(std::memory_order_relaxed)) {}
+	ILogger& operator=(const ILogger& src) { log_level.store(src.log_level.load(std::memory_order_relaxed), std::memory_order_relaxed); return *this; }
+	virtual ~ILogger() {}
+	/// Нужно ли регистрировать сообщение данного уровня.
+	/// \param level - уровень важности (ILS_LEVEL_DBG ... ILS_LEVEL_ERR).
+	/// Новые пороги по идентификаторам (LogConfig) учитываются первой проверкой после их публикации.
+	bool logEnabled(int level) const {
+		if (overrides_gen.load(std::memory_order_relaxed) != overridesGen().load(std::memory_order_relaxed)) overridesPickup();
+		return level >= log_level.load(std::memory_order_relaxed);
+	}
+	/// Порог важности сообщений этого логгера.
+	int getLogLevel() const { return log_level.load(std::memory_order_relaxed); }
+	/// Установить порог важности сообщений.
+	/// Сообщения с уровнем ниже порога не форматируются и не выводятся.
+	virtual void setLogLevel(int level) const { log_level.store(level, std::memory_order_relaxed); }
+	/// Нужно ли регистрировать сообщение с идентификатором \c id с учётом
+	/// порогов по идентификаторам (LogConfig). Проверяется после logEnabled();
+	/// пока пороги не заданы - одно чтение указателя.
+	bool idEnabled(int level, const LogId& id) const {
+		if (!levelOverrides().load(std::memory_order_relaxed)) return true;
+		// Набор порогов освобождается через LogReaders после замены
+		LogReaders::TGuard guard;
+		const TLevelOverrides* o = levelOverrides().load(std::memory_order_acquire);
+		return !o || idLevelEnabled(*o, level, id);
+	}
+protected:
+	/// Действующий порог важности, проверяемый перед форматированием.
+	mutable std::atomic<int> log_level;
+	/// Поколение порогов по идентификаторам, учтённое в log_level.
+	mutable std::atomic<unsigned> overrides_gen{0};
+	/// Действующие пороги по идентификаторам (публикует LogConfig), NULL - не заданы.
+	static std::atomic<const TLevelOverrides*>& levelOverrides() {
+		static std::atomic<const TLevelOverrides*> p(NULL);
+		return p;
+	}
+	/// Поколение порогов по идентификаторам (растёт при каждой публикации).
+	static std::atomic<unsigned>& overridesGen() {
+		static std::atomic<unsigned> n(0);
+		return n;
+	}
+	/// Публикация порогов по идентификаторам \c o (NULL - не заданы).
+	/// Объекты пересчитывают порог сами, при следующей проверке logEnabled();
+	/// заменённый набор освобождается через LogReaders.
+	static void publishOverrides(const TLevelOverrides* o) {
+		levelOverrides().store(o, std::memory_order_release);
+		overridesGen().fetch_add(1, std::memory_order_seq_cst);
+	}
+	/// Учёт новых порогов по идентификаторам в log_level.
+	/// По умолчанию порог логгера от них не зависит (их учитывает Logger).
+	virtual void overridesPickup() const { overrides_gen.store(overridesGen().load(std::memory_order_relaxed), std::memory_order_relaxed); }
+	/// Проверка сообщения по порогам идентификаторов.
+	/// По умолчанию пороги идентификаторов не учитываются (их учитывает Logger).
+	virtual bool idLevelEnabled(const TLevelOverrides& o, int level, const LogId& id) const { return true; }
 protected: // Функции, которые надо переопределить при определении реального логгера
 	friend struct Logger;
+	friend class TraceLogger;
+	friend class JsonLogger;
+	friend class MetricsLogger;
+	friend class FlightRecorder;
+	friend class LogConfig;
 	/// Перевод текста сообщения.
 	/// Эту функция переводит (или как-то транслирует) текст сообщения для вывода 
 	/// пользователю, сохраняя при этом его printf-формат.
-	/// \param id - идентификатор текстовый сообщения.
+	/// \param id  - идентификатор текстовый сообщения.
 	/// \param msg - текст сообщения по умолчанию (на английском языке).
-	/// \return - транслированное сообщение.
-	/// \note По умолчанию данная функция возвращает тоже сообщение, что и получила на вход.
-	virtual Msg msgTranslate(const LogId& id, const char* msg) const {
+	/// \param buf - буфер текущего потока, в который можно записать результат.
+	/// \return - транслированное сообщение: либо сам \c msg, либо \c buf.c_str().
+	/// \note По умолчанию сообщение переводится по каталогу MsgCatalog, а ключ %t
+	/// заменяется на %f; формат места вызова-константы (TFmtSite) готовится один
+	/// раз и дальше берётся из кэша каталога по адресу, остальные форматы ищутся
+	/// по тексту в снимке переводов.
+	/// Вызывается внутри отметки чтения LogReaders::TGuard.
+	virtual const char* msgTranslate(const LogId& id, const char* msg, Msg& buf) const {
 		// Для отображение параметра типа "время" используется специальный ключ %t, для логов просто переводим его в %f
-		Msg str = msg;
-		size_t start_pos = 0;
-		while ((start_pos = str.find("%t")) != std::string::npos) {
-			str[start_pos + 1] = 'f';
+		return MsgCatalog::instance().translate(msg, buf);
+	}
+	/// Перевод текста сообщения в новую строку (прежняя сигнатура).
+	/// Объявлена final: переопределение со старой сигнатурой перестало бы
+	/// вызываться, поэтому оно не компилируется - переопределяется
+	/// msgTranslate(const LogId&, const char*, Msg&).
+	virtual Msg msgTranslate(const LogId& id, const char* msg) const final {
+		LogReaders::TGuard guard;
+		Msg buf;
+		const char* res = msgTranslate(id, msg, buf);
+		return res == buf.c_str() ? buf : Msg(res);
+	}
+	/// Форматирование сообщения в буфер текущего потока и передача его в функцию вывода.
+	void vformatOut(TOutFunc out, const LogId& id, const char* msg, va_list marker) const {
+		struct TFmtTag; struct TMsgTag;
+		TThreadBuf<TFmtTag> fmt;
+		TThreadBuf<TMsgTag> str;
+		ils_vappendf(str.str(), msgTranslate(id, msg, fmt.str()), marker);
+		(this->*out)(str.str(), id);
+	}
+	/// Форматирование сообщения ILS_FMT (формат проверен при компиляции) и передача его в функцию вывода.
+	/// Текст пишется сразу в буфер текущего потока. Перевод берётся из каталога
+	/// MsgCatalog (переопределённая msgTranslate() не вызывается).
+	template<class F, class... Args> void typedOut(int level, const LogId& id, const Args&... args) const {
+		ils_fmt_assert<F, Args...>();
+		if (!ILS_ENABLED(this, level)) return;
+		LogReaders::TGuard guard;
+		if (!idEnabled(level, id)) return;
+		try {
+			const TFmtArg a[] = { ils_fmt_arg(args)..., TFmtArg() };
+			Msg buf;
+			const char* fmt = F::str();
+			if (MsgCatalog::instance().hasTranslations()) fmt = MsgCatalog::instance().translateStatic(fmt, buf);
+			TThreadBuf<TTypedFmtTag> str;
+			ils_format_typed(str.str(), fmt, a);
+			(this->*levelOut(level))(str.str(), id);
+		}
+		catch (...) {}
+	}
+	/// Функция вывода, соответствующая уровню важности.
+	static TOutFunc levelOut(int level) {
+		switch (level) {
+		case ILS_LEVEL_INF: return &ILogger::infOut;
+		case ILS_LEVEL_WRN: return &ILogger::wrnOut;
+		case ILS_LEVEL_ERR: return &ILogger::errOut;
+		default: return &ILogger::logOut;
+		}
+	}
+public:
+	/// Регистрация сообщения без форматирования (отложенное форматирование).
+	/// Логгер, умеющий сохранять номер формата и сырые аргументы (например, BinLogger),
+	/// переопределяет эту функцию и возвращает true. По умолчанию возвращается false,
+	/// и сообщение форматируется обычным образом.
+	/// \param level  - уровень важности (ILS_LEVEL_LOG ... ILS_LEVEL_ERR).
+	/// \param site   - место вызова с разобранной строкой формата.
+	/// \param id     - идентификатор сообщения.
+	/// \param marker - аргументы (функция может их прочитать только если вернёт true).
+	virtual bool rawOut(int level, const TFmtSite& site, const LogId& id, va_list marker) const { return false; }
+	/// Отметка начала или окончания секции (ILS_SECTB/ILS_SECTE).
+	/// Вызывается в дополнение к текстовым сообщениям SectionBegin/SectionEnd,
+	/// с моментами времени, по которым считается длительность секции.
+	/// Используется логгерами, которым нужна временная шкала (TraceLogger),
+	/// по умолчанию ничего не делает.
+	/// \param begin - true - начало секции, false - окончание.
+	/// \param sect  - идентификатор секции (с номером для ILS_SECTBI).
+	/// \param t     - момент начала или окончания.
+	virtual void sectOut(bool begin, const char* sect, std::chrono::steady_clock::time_point t) const {}
+	/// Отметка аварийной ситуации: исключение покинуло секцию (ILS_SECTE) и т.п.
+	/// Вызывается после сообщения о ситуации. Используется логгерами, которым
+	/// нужно сохранить контекст происшествия (FlightRecorder), по умолчанию
+	/// ничего не делает.
+	/// \param what - описание ситуации (например, идентификатор секции).
+	virtual void incidentOut(const char* what) const {}
+	/// Регистрация сообщения с постоянным форматом (см. макросы ILS_BLOG, ILS_BWRN ...).
+	/// Если логгер поддерживает отложенное форматирование (rawOut()), \c vsnprintf()
+	/// на вызывающем потоке не выполняется.
+	/// \param level - уровень важности.
+	/// \param id    - идентификатор сообщения.
+	/// \param site  - место вызова (статический объект).
+	/// \param ...   - набор данных для вывода в сообщении по принципу \c printf().
+	void out(int level, const LogId& id, const TFmtSite* site, ...) const {
+		if (!ILS_ENABLED(this, level)) return;
+		LogReaders::TGuard guard;
+		if (!idEnabled(level, id)) return;
+		va_list marker;
+		va_start(marker, site);
+		try {
+			bool done = false;
+			if (site->raw_ok) {
+				va_list args;
+				va_copy(args, marker);
+				done = rawOut(level, *site, id, args);
+				va_end(args);
+			}
+			if (!done) vformatOut(levelOut(level), id, site->fmt, marker);
 		}
-		return str;
+		catch (...) {}
+		va_end(marker);
 	}
 	//---------------------------------------------------------------------------
 	/// Подготовка потоков к выводу (вывод заголовка лога).
@@ -78,16 +444,14 @@ public:
 	/// \param msg - тело сообщения в формате функции \c printf().
 	/// \param ... - набор данных для вывода в сообщении по принципу \c printf().
 	void inf(const LogId& id, const char* msg, ...) const {
-		char* str = new char[max_msg_size];
-		try {
-			va_list marker;
-			va_start(marker, msg);
-			vsnprintf(str, max_msg_size, msgTranslate(id, msg).c_str(), marker);
-			va_end(marker);
-			infOut(str, id);
-		}
+		if (!ILS_ENABLED(this, ILS_LEVEL_INF)) return;
+		LogReaders::TGuard guard;
+		if (!idEnabled(ILS_LEVEL_INF, id)) return;
+		va_list marker;
+		va_start(marker, msg);
+		try { vformatOut(&ILogger::infOut, id, msg, marker); }
 		catch (...) {}
-		delete[] str;
+		va_end(marker);
 	}
 	//---------------------------------------------------------------------------
 	/// Регистрация информационного сообщения.
@@ -96,16 +460,14 @@ public:
 	/// \param msg - тело сообщения в формате функции \c printf().
 	/// \param ... - набор данных для вывода в сообщении по принципу \c printf().
 	void log(const LogId& id, const char* msg, ...) const {
-		char* str = new char[max_msg_size];
-		try {
-			va_list marker;
-			va_start(marker, msg);
-			vsnprintf(str, max_msg_size, msgTranslate(id, msg).c_str(), marker);
-			va_end(marker);
-			logOut(str, id);
-		}
+		if (!ILS_ENABLED(this, ILS_LEVEL_LOG)) return;
+		LogReaders::TGuard guard;
+		if (!idEnabled(ILS_LEVEL_LOG, id)) return;
+		va_list marker;
+		va_start(marker, msg);
+		try { vformatOut(&ILogger::logOut, id, msg, marker); }
 		catch (...) {}
-		delete[] str;
+		va_end(marker);
 	}
 	/// Регистрация предупреждения (warning) и не фатальной ошибки.
 	/// Регистрация предупреждения (warning) и не фатальной ошибки в ходе 
@@ -114,16 +476,14 @@ public:
 	/// \param msg - тело сообщения в формате функции \c printf().
 	/// \param ... - набор данных для вывода в сообщении по принципу \c printf().
 	void wrn(const LogId& id, const char* msg, ...) const {
-		char* str = new char[max_msg_size];
-		try {
-			va_list marker;
-			va_start(marker, msg);
-			vsnprintf(str, max_msg_size, msgTranslate(id, msg).c_str(), marker);
-			va_end(marker);
-			wrnOut(str, id);
-		}
+		if (!ILS_ENABLED(this, ILS_LEVEL_WRN)) return;
+		LogReaders::TGuard guard;
+		if (!idEnabled(ILS_LEVEL_WRN, id)) return;
+		va_list marker;
+		va_start(marker, msg);
+		try { vformatOut(&ILogger::wrnOut, id, msg, marker); }
 		catch (...) {}
-		delete[] str;
+		va_end(marker);
 	}
 	/// Регистрация фатальной ошибки. 
 	/// Регистрация фатальной ошибки, после которой результаты процесса не определены.
@@ -131,17 +491,33 @@ public:
 	/// \param msg - тело сообщения в формате функции \c printf().
 	/// \param ... - набор данных для вывода в сообщении по принципу \c printf().
 	void err(const LogId& id, const char* msg, ...) const {
-		char* str = new char[max_msg_size];
-		try {
-			va_list marker;
-			va_start(marker, msg);
-			vsnprintf(str, max_msg_size, msgTranslate(id, msg).c_str(), marker);
-			va_end(marker);
-			errOut(str, id);
-		}
+		if (!ILS_ENABLED(this, ILS_LEVEL_ERR)) return;
+		LogReaders::TGuard guard;
+		if (!idEnabled(ILS_LEVEL_ERR, id)) return;
+		va_list marker;
+		va_start(marker, msg);
+		try { vformatOut(&ILogger::errOut, id, msg, marker); }
 		catch (...) {}
-		delete[] str;
+		va_end(marker);
 	}
+	//---------------------------------------------------------------------------
+	/// Регистрация сообщений с форматом, проверяемым при компиляции.
+	/// Формат задаётся макросом ILS_FMT; количество и типы аргументов сверяются
+	/// с ним при компиляции, ключ %t поддерживается без копирования формата:
+	/// \code
+	/// log("app", ILS_FMT("loaded %d boxes in %t s"), n, seconds);
+	/// \endcode
+	/// \param id   - идентификатор сообщения.
+	/// \param fmt  - формат ILS_FMT("...").
+	/// \param args - набор данных для вывода в сообщении.
+	template<class F, class... Args, class = typename std::enable_if<TIsFmtString<F>::value>::type>
+	void inf(const LogId& id, F fmt, const Args&... args) const { typedOut<F>(ILS_LEVEL_INF, id, args...); }
+	template<class F, class... Args, class = typename std::enable_if<TIsFmtString<F>::value>::type>
+	void log(const LogId& id, F fmt, const Args&... args) const { typedOut<F>(ILS_LEVEL_LOG, id, args...); }
+	template<class F, class... Args, class = typename std::enable_if<TIsFmtString<F>::value>::type>
+	void wrn(const LogId& id, F fmt, const Args&... args) const { typedOut<F>(ILS_LEVEL_WRN, id, args...); }
+	template<class F, class... Args, class = typename std::enable_if<TIsFmtString<F>::value>::type>
+	void err(const LogId& id, F fmt, const Args&... args) const { typedOut<F>(ILS_LEVEL_ERR, id, args...); }
 	/// Регистрация отладочных сообщений ошибки. 
 	/// Регистрация фатальной ошибки, после которой результаты процесса не определены.
 	/// \param id  - идентификатор сообщения.
@@ -149,23 +525,26 @@ public:
 	/// \param ... - набор данных для вывода в сообщении по принципу \c printf().
 	inline void dbg(const char* msg, ...) const {
 #ifdef _DEBUG
-		char* str = new char[max_msg_size + 6];
-		strcpy(str, "DEBUG:");
+		if (!ILS_ENABLED(this, ILS_LEVEL_DBG)) return;
+		LogReaders::TGuard guard;
+		struct TDbgTag;
+		TThreadBuf<TDbgTag> str;
+		va_list marker;
+		va_start(marker, msg);
 		try {
-			va_list marker;
-			va_start(marker, msg);
-			vsnprintf(str + 6, max_msg_size, msg, marker);
-			va_end(marker);
-			logOut(str, "dbg");
+			str.str() = "DEBUG:";
+			ils_vappendf(str.str(), msg, marker);
+			logOut(str.str(), "dbg");
 		}
 		catch (...) {}
-		delete[] str;
+		va_end(marker);
 #endif //#ifdef _DEBUG
 	}
 	/// Параметр логгирования
 	virtual double logParam(int param) const { return 0.; };
 }; //struct Logger
 
+
 //=============================================================================
 /// Реализация "родительского" регистратора событий.
 /// @ingroup Kernel
@@ -180,50 +559,331 @@ public:
 /// - Никакой логгер не указан и лог событий вообще не ведется
 /// 
 /// по умолчанию никакой логгер не указан.
+/// Пока логгер не указан, порог важности объекта равен ILS_LEVEL_OFF, и 
+/// макросы ILS_LOG/ILS_WRN не вычисляют свои аргументы.
+///
+/// Если родительский логгер сам является объектом Logger, объекты образуют
+/// дерево: потомок без персонального логгера выводит в логгер предка, а
+/// порог важности (если он не задан через setLogLevel()) и префикс
+/// идентификаторов сообщений (setLogPrefix()) наследуются от родителя.
+/// Так одна цепочка вывода настраивается у корня и действует для всех объектов:
+/// \code
+/// Logger root;  root.setPersonalLogger(std::make_shared<StdLogger>("app.log"));
+/// root.setLogPrefix("app.");
+/// App a;  a.setParentLogger(root);   // выводит в app.log с идентификаторами "app.<id>"
+/// \endcode
+///
+/// Действующие настройки (логгер вывода, порог, префикс) вычисляются один раз
+/// и хранятся атомарно, поэтому передача сообщения не копирует shared_ptr и
+/// не обходит дерево. Изменение настроек объекта сразу пересчитывает настройки
+/// его поддерева (только его), функции регистрации блокировок не захватывают.
+/// Родитель, заданный без владения (setParentLogger(const Logger&)), при
+/// разрушении отсоединяет потомков. Смена логгера безопасна при
+/// одновременной регистрации сообщений из других потоков: заменённый логгер
+/// разрушается (через LogReaders), когда из чтения выйдут все потоки, которые
+/// могли его использовать. Функции вывода Logger ставят вложенную отметку
+/// чтения: внешнюю, одну на сообщение, ставят функции регистрации ILogger.
+///
+/// Пороги по идентификаторам, заданные в LogConfig, действуют поверх порога
+/// объекта: идентификатор сообщения с префиксом объекта сверяется с ними в
+/// функциях регистрации, после проверки порога (idEnabled()). Новый набор
+/// порогов объект учитывает сам, при первой проверке порога после публикации
+/// (overridesPickup()), так что публикация не обходит объекты.
 /// \see Logger
 struct Logger : public ILogger {
 private: // Указатели на регистраторы на которые транслируются сообщения
 	mutable std::shared_ptr<ILogger> personal_logger;   // Персональный логгер данного объекта.
 	mutable std::shared_ptr<ILogger> parent_logger;     // Родительский логгер, используется если не указан перссональный.
+	mutable const Logger* parent_node = NULL;           // Родитель в дереве (parent_logger, если это Logger).
+	mutable int own_level = ILS_LEVEL_DBG;              // Порог, заданный через setLogLevel().
+	mutable bool own_level_set = false;                 // Порог задан явно (иначе наследуется от родителя).
+	mutable int tree_level = ILS_LEVEL_DBG;             // Действующий порог без учёта наличия логгера.
+	mutable std::string own_prefix;                     // Префикс, заданный через setLogPrefix().
+	mutable std::vector<const Logger*> children;        // Потомки в дереве (их parent_node - данный объект).
+	/// Связей в дереве (родитель и потомки). Объект без связей создаётся и
+	/// разрушается без configMutex(): его настройки никто, кроме него, не читает.
+	mutable std::atomic<unsigned> links{0};
+	/// Действующий логгер (персональный, родительский или логгер предка), 
+	/// функции вывода читают только этот указатель, без копирования shared_ptr.
+	mutable std::atomic<ILogger*> sink{NULL};
+	/// Действующий префикс идентификаторов (строка prefix_holder, NULL - нет префикса).
+	mutable std::atomic<const std::string*> prefix{NULL};
+	/// Действующий порог без учёта порогов по идентификаторам (ILS_LEVEL_OFF - нет логгера).
+	mutable std::atomic<int> base_level{ILS_LEVEL_OFF};
+	/// Строка действующего префикса. Строка, которую читает другой поток, не
+	/// меняется; заменённая строка освобождается через LogReaders.
+	mutable std::shared_ptr<const std::string> prefix_holder;
+	/// Блокировка изменения и пересчёта настроек (общая: настройки меняются редко).
+	static std::mutex& configMutex() {
+		static std::mutex m;
+		return m;
+	}
+	/// Смена родителя в дереве (под configMutex()).
+	void setParentNode(const Logger* node) const {
+		if (parent_node == node) return;
+		if (parent_node) {
+			std::vector<const Logger*>& c = parent_node->children;
+			c.erase(std::find(c.begin(), c.end(), this));
+			parent_node->links.fetch_sub(1, std::memory_order_release);
+			links.fetch_sub(1, std::memory_order_release);
+		}
+		parent_node = node;
+		if (node) {
+			node->children.push_back(this);
+			node->links.fetch_add(1, std::memory_order_relaxed);
+			links.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+	/// Замена логгера в ячейке \c slot (под configMutex()).
+	/// Поток, прочитавший старое значение sink, может ещё выводить в заменённый
+	/// логгер, поэтому он освобождается через LogReaders (после LogReaders::reclaim()).
+	void assign(std::shared_ptr<ILogger>& slot, std::shared_ptr<ILogger> l) const {
+		if (slot && slot != l) LogReaders::retire(slot);
+		slot = l;
+	}
+	/// Пересчёт настроек объекта и его поддерева после их изменения (под configMutex()).
+	void configChanged() const {
+		refreshLocked();
+		for (const Logger* c : children) c->configChanged();
+	}
+	/// Пересчёт действующих настроек по настройкам родителя (под configMutex()).
+	void refreshLocked() const {
+		ILogger* s = personal_logger ? personal_logger.get() :
+		             parent_node ? parent_node->sink.load(std::memory_order_relaxed) : parent_logger.get();
+		tree_level = own_level_set ? own_level : parent_node ? parent_node->tree_level : ILS_LEVEL_DBG;
+		// Пустой префикс хранится как NULL, чтобы передача сообщения проверяла только указатель
+		const std::string* pp = parent_node ? parent_node->prefix.load(std::memory_order_relaxed) : NULL;
+		const std::string* cur = prefix.load(std::memory_order_relaxed);
+		const size_t plen = pp ? pp->size() : 0;
+		if (!pp && own_prefix.empty()) {
+			prefix.store(NULL, std::memory_order_release);
+			LogReaders::retire(std::move(prefix_holder));
+			prefix_holder.reset();
+		}
+		else if (!cur || cur->size() != plen + own_prefix.size() ||
+		         (pp && cur->compare(0, plen, *pp) != 0) || cur->compare(plen, std::string::npos, own_prefix) != 0) {
+			std::shared_ptr<const std::string> p = std::make_shared<const std::string>(pp ? *pp + own_prefix : own_prefix);
+			prefix.store(p.get(), std::memory_order_release);
+			LogReaders::retire(std::move(prefix_holder));
+			prefix_holder = std::move(p);
+		}
+		sink.store(s, std::memory_order_release);
+		// Без логгера вывод отключен полностью, чтобы макросы не строили 
+		// сообщения, которые некому вывести
+		base_level.store(s ? tree_level : ILS_LEVEL_OFF, std::memory_order_seq_cst);
+		// log_level пересчитает следующая проверка logEnabled() (overridesPickup())
+		overrides_gen.store(overridesGen().load(std::memory_order_relaxed) - 1, std::memory_order_seq_cst);
+	}
+	/// Пересчёт log_level по base_level и действующим порогам по идентификаторам.
+	/// Вызывается из потоков регистрации без блокировок. Если одновременно
+	/// изменились настройки (refreshLocked()), поколение снова сбрасывается, и
+	/// пересчёт повторяется при следующей проверке.
+	virtual void overridesPickup() const {
+		overrides_gen.store(overridesGen().load(std::memory_order_acquire), std::memory_order_seq_cst);
+		LogReaders::TGuard guard;
+		const int base = base_level.load(std::memory_order_seq_cst);
+		const TLevelOverrides* o = levelOverrides().load(std::memory_order_acquire);
+		// При порогах по идентификаторам до форматирования пропускается всё, что
+		// может понадобиться хоть одному идентификатору; остальное отсекает idEnabled()
+		log_level.store(o && sink.load(std::memory_order_relaxed) ? o->gate(base) : base, std::memory_order_relaxed);
+	}
+	friend class LogConfig;
 	/// Логгер данного объекта.
 	/// Функция возварщает персональный логер данного объекта если он есть, 
-	/// или общий логгер если его нет. Если нет ни того не другого функция вернет NULL.
-	std::shared_ptr<ILogger> logger() const {
-		if (personal_logger != NULL) return personal_logger;
-		else if (parent_logger != NULL) return parent_logger;
-		else return NULL;
+	/// или логгер родителя если его нет. Если нет ни того не другого функция вернет NULL.
+	ILogger* logger() const {
+		return sink.load(std::memory_order_acquire);
+	}
+	/// Передача сообщения действующему логгеру с добавлением префикса к идентификатору.
+	template<class F> void forward(const LogId& id, F f) const {
+		LogReaders::TGuard guard;
+		ILogger* l = logger();
+		if (!l) return;
+		const std::string* p = prefix.load(std::memory_order_acquire);
+		if (!p) { f(l, id); return; }
+		struct TIdTag;
+		TThreadBuf<TIdTag> buf;
+		buf.str() = *p;
+		buf.str() += id;
+		f(l, buf.str());
+	}
+public:
+	Logger() {
+		// Новый объект без связей другим потокам не виден
+		refreshLocked();
+	}
+	Logger(const Logger& src) : ILogger(src) {
+		// Блокировка нужна, только если копия входит в дерево родителя src
+		// (в пустых ячейках нового объекта заменять нечего, reclaim() не нужен)
+		if (!src.links.load(std::memory_order_acquire)) copyConfig(src);
+		else {
+			std::lock_guard<std::mutex> lock(configMutex());
+			copyConfig(src);
+		}
+	}
+	Logger& operator=(const Logger& src) {
+		if (this == &src) return *this;
+		ILogger::operator=(src);
+		{
+			std::lock_guard<std::mutex> lock(configMutex());
+			copyConfig(src);
+		}
+		LogReaders::reclaim();
+		return *this;
+	}
+	/// Деструктор. Потомки отсоединяются от объекта и пересчитывают настройки
+	/// без него; логгеры и префикс объекта, входившего в дерево, освобождаются
+	/// через LogReaders (их могли читать потомки).
+	virtual ~Logger() {
+		if (!links.load(std::memory_order_acquire)) return;
+		{
+			std::lock_guard<std::mutex> lock(configMutex());
+			while (!children.empty()) {
+				const Logger* c = children.back();
+				// Связь потомка снимается последней, чтобы его деструктор без
+				// блокировки не застал пересчёт его настроек
+				c->links.fetch_add(1, std::memory_order_relaxed);
+				c->setParentNode(NULL);
+				c->assign(c->parent_logger, NULL);
+				c->configChanged();
+				c->links.fetch_sub(1, std::memory_order_release);
+			}
+			setParentNode(NULL);
+			LogReaders::retire(std::move(personal_logger));
+			LogReaders::retire(std::move(parent_logger));
+			LogReaders::retire(std::move(prefix_holder));
+		}
+		LogReaders::reclaim();
+	}
+private:
+	void copyConfig(const Logger& src) {
+		own_level = src.own_level;
+		own_level_set = src.own_level_set;
+		own_prefix = src.own_prefix;
+		std::shared_ptr<ILogger> p = src.personal_logger, r = src.parent_logger;
+		const Logger* node = src.parent_node;
+		for (const Logger* n = node; n; n = n->parent_node)
+			if (n == this) { r.reset(); node = NULL; break; }
+		assign(personal_logger, p);
+		assign(parent_logger, r);
+		setParentNode(node);
+		configChanged();
 	}
 public:
 	/// Персональный логгер объекта.
 	/// Функция возвращает персональный логгер объекта.
 	/// Если он нет установлен, то возвратится NULL.
-	virtual std::shared_ptr<ILogger> getPersonalLogger() const { return personal_logger; }
+	virtual std::shared_ptr<ILogger> getPersonalLogger() const {
+		std::lock_guard<std::mutex> lock(configMutex());
+		return personal_logger;
+	}
 	/// Установить персональный логгер.
 	/// Функция устанавливает персональный логгер данного объекта.
 	/// По умолчанию она его обнуляет.
-	virtual void setPersonalLogger(std::shared_ptr<ILogger> l = NULL) const { personal_logger = l; }
-private:
+	/// \note Замена логгера атомарна для потоков, которые в это время регистрируют сообщения.
+	virtual void setPersonalLogger(std::shared_ptr<ILogger> l = NULL) const {
+		{
+			std::lock_guard<std::mutex> lock(configMutex());
+			assign(personal_logger, l);
+			configChanged();
+		}
+		LogReaders::reclaim();
+	}
 	/// Родительский логгер объекта.
 	/// Функция возвращает родительский логгер объекта.
 	/// Если он нет установлен, то возвратится NULL.
-	std::shared_ptr<ILogger> getParentLogger() const { return personal_logger; }
+	std::shared_ptr<ILogger> getParentLogger() const {
+		std::lock_guard<std::mutex> lock(configMutex());
+		return parent_logger;
+	}
 	/// Установить родительский логгер.
 	/// Функция устанавливает родительский логгер данного объекта.
+	/// Если это объект Logger, данный объект наследует его настройки (см. описание класса).
 	/// По умолчанию она его обнуляет.
-	void setParentLogger(std::shared_ptr<ILogger> l = NULL) const { personal_logger = l; }
+	/// \note Родитель, образующий цикл (сам объект или его потомок), не устанавливается.
+	void setParentLogger(std::shared_ptr<ILogger> l = NULL) const {
+		{
+			std::lock_guard<std::mutex> lock(configMutex());
+			const Logger* node = dynamic_cast<const Logger*>(l.get());
+			for (const Logger* p = node; p; p = p->parent_node)
+				if (p == this) return;
+			assign(parent_logger, l);
+			setParentNode(node);
+			configChanged();
+		}
+		LogReaders::reclaim();
+	}
+	/// Установить родителя, которым объект не владеет (например, объект-владелец данного).
+	/// При разрушении родителя объект отсоединяется от него (как после setParentLogger()).
+	void setParentLogger(const Logger& parent) const {
+		setParentLogger(std::shared_ptr<ILogger>(std::shared_ptr<ILogger>(), const_cast<Logger*>(&parent)));
+	}
+	/// Установить порог важности сообщений данного объекта (и его потомков, не задавших свой порог).
+	virtual void setLogLevel(int level) const {
+		std::lock_guard<std::mutex> lock(configMutex());
+		own_level = level;
+		own_level_set = true;
+		configChanged();
+	}
+	/// Наследовать порог важности от родителя (отменить setLogLevel()).
+	void inheritLogLevel() const {
+		std::lock_guard<std::mutex> lock(configMutex());
+		own_level_set = false;
+		configChanged();
+	}
+	/// Установить префикс идентификаторов сообщений.
+	/// Действующий префикс - префикс родителя, за которым следует \c pfx
+	/// (например, "app." у корня и "net." у потомка дают "app.net.<id>").
+	void setLogPrefix(const std::string& pfx) const {
+		{
+			std::lock_guard<std::mutex> lock(configMutex());
+			own_prefix = pfx;
+			configChanged();
+		}
+		LogReaders::reclaim();
+	}
+	/// Действующий префикс идентификаторов сообщений.
+	std::string getLogPrefix() const {
+		LogReaders::TGuard guard;
+		const std::string* p = prefix.load(std::memory_order_acquire);
+		return p ? *p : std::string();
+	}
+protected:
+	/// Порог идентификатора (с префиксом объекта) из набора \c o или собственный порог.
+	virtual bool idLevelEnabled(const TLevelOverrides& o, int level, const LogId& id) const {
+		LogReaders::TGuard guard;
+		const std::string* p = prefix.load(std::memory_order_acquire);
+		const int l = o.level(p ? std::string_view(*p) : std::string_view(), id);
+		return level >= (l < 0 ? base_level.load(std::memory_order_relaxed) : l);
+	}
 public:  // Реализация функций Logger-а.
-	virtual Msg msgTranslate(const LogId& id, const char* msg) const {
-		if (logger()) return logger()->msgTranslate(id, msg);
+	virtual const char* msgTranslate(const LogId& id, const char* msg, Msg& buf) const {
+		LogReaders::TGuard guard;
+		if (ILogger* l = logger()) return l->msgTranslate(id, msg, buf);
 		else return msg;
 	}
-	virtual void infOut(const Msg& msg, const LogId& id) const { if (logger()) logger()->infOut(msg, id); }
-	virtual void logOut(const Msg& msg, const LogId& id) const { if (logger()) logger()->logOut(msg, id); }
-	virtual void wrnOut(const Msg& msg, const LogId& id) const { if (logger()) logger()->wrnOut(msg, id); }
-	virtual void errOut(const Msg& msg, const LogId& id) const { if (logger()) logger()->errOut(msg, id); }
+	virtual void infOut(MsgView msg, const LogId& id) const { forward(id, [&](ILogger* l, const LogId& i) { l->infOut(msg, i); }); }
+	virtual void logOut(MsgView msg, const LogId& id) const { forward(id, [&](ILogger* l, const LogId& i) { l->logOut(msg, i); }); }
+	virtual void wrnOut(MsgView msg, const LogId& id) const { forward(id, [&](ILogger* l, const LogId& i) { l->wrnOut(msg, i); }); }
+	virtual void errOut(MsgView msg, const LogId& id) const { forward(id, [&](ILogger* l, const LogId& i) { l->errOut(msg, i); }); }
+	virtual bool rawOut(int level, const TFmtSite& site, const LogId& id, va_list marker) const {
+		bool res = false;
+		forward(id, [&](ILogger* l, const LogId& i) { res = l->rawOut(level, site, i, marker); });
+		return res;
+	}
+	virtual void sectOut(bool begin, const char* sect, std::chrono::steady_clock::time_point t) const {
+		LogReaders::TGuard guard;
+		if (ILogger* l = logger()) l->sectOut(begin, sect, t);
+	}
+	virtual void incidentOut(const char* what) const {
+		LogReaders::TGuard guard;
+		if (ILogger* l = logger()) l->incidentOut(what);
+	}
 public:
 	/// Параметр логгирования
 	virtual double logParam(int param) const {
-		if (logger()) return logger()->logParam(param);
+		LogReaders::TGuard guard;
+		if (ILogger* l = logger()) return l->logParam(param);
 		else return 0.;
 	};
 }; //struct Logger
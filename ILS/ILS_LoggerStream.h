@@ -2,158 +2,233 @@
 #define ILS_LoggerStreamH
 
 #include <cstring>
-#include <sstream>
-
+#include <chrono>
 #include "ILS_Logger.h"
+#include "ILS_MsgBuf.h"
+#include "ILS_RateLimit.h"
+#include "ILS_SectProfiler.h"
 
 //------------------------------------------------------------------------------
 /// Тривиальный класс, для возможности потокового формирования сообщения в макросе ILS_LOG.
+/// Сообщение накапливается в буфере TMsgBuf внутри объекта (объект создаётся
+/// макросом на стеке), так что строка обычной длины формируется и передаётся
+/// логгеру без выделения памяти.
 class TLoggerStream
 {
 	typedef std::string Msg;
 	typedef std::string LogId;
-	typedef void (ILogger::*TFuncPtr)(const Msg& msg, const LogId& id) const;
-	mutable std::ostringstream out;  // Поток для накопления вывода.
-	mutable std::string m_sSectId;
+	typedef ILogger::TOutFunc TFuncPtr;
+	mutable TMsgBuf<256> out;  // Буфер для накопления вывода.
+	mutable TMsgBuf<48> m_sSectId;
 	mutable LogId id;
 	const ILogger* m_pLogger;
 	TFuncPtr m_pFunc;
+	TRateSite* m_pRate = NULL;       // Место вызова (схлопывание повторов), NULL - нет
+	TMsgSlot* m_pSlot = NULL;        // Запомненный формат места вызова, NULL - нет
+	mutable bool m_bEnabled = true;  // false - сообщение отсечено порогом важности, вывода нет
+	const char* m_pSectBase = NULL;  // Имя секции без номера (для сводки SectProfiler)
+	mutable std::chrono::steady_clock::time_point m_Start;  // Время начала секции
+	mutable long long m_nDuration = -1;  // Длительность завершённой секции, нс
+	mutable int m_nDepth = 0;  // Уровень вложенности секции в потоке (с 1), 0 - секция не начата
+	mutable size_t m_nPathLen = size_t(-1);  // Длина пути секций потока до начала этой секции
+	/// Текущий уровень вложенности секций потока.
+	static int& SectDepth() { thread_local int n = 0; return n; }
+	/// Путь начатых секций потока ("Load/Box3").
+	static std::string& SectPathBuf() { thread_local std::string s; return s; }
+	/// Фиксация окончания секции: длительность, уровень вложенности, профиль.
+	void SectStop(bool completed) const {
+		if (!m_nDepth) return;
+		const std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+		m_nDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - m_Start).count();
+		if (m_pLogger) m_pLogger->sectOut(false, m_sSectId.c_str(), stop);
+		--SectDepth();
+		m_nDepth = 0;
+		// Секции, прерванные исключением, в сводку не попадают
+		if (completed && SectProfiler::instance().isActive()) SectProfiler::instance().add(m_pSectBase, m_nDuration);
+	}
+	/// Форматирование сообщения в конец буфера.
+	void Format(const char* msg, va_list marker) const {
+		try {
+			// Для отображение параметра типа "время" используется специальный ключ %t, для логов просто переводим его в %f;
+			// перевод и замена делаются один раз на строку формата (MsgCatalog)
+			std::string buf;
+			LogReaders::TGuard guard;
+			const MsgCatalog& cat = MsgCatalog::instance();
+			out.vappendf(m_pSlot ? cat.translate(msg, buf, *m_pSlot) : cat.translate(msg, buf), marker);
+		} catch(...){}
+	}
+	/// Форматирование сообщения ILS_FMT (формат проверен при компиляции) в конец буфера.
+	template<class F, class... Args> void FormatTyped(const Args&... args) const {
+		ils_fmt_assert<F, Args...>();
+		try {
+			const TFmtArg a[] = { ils_fmt_arg(args)..., TFmtArg() };
+			std::string buf;
+			const char* fmt = F::str();
+			LogReaders::TGuard guard;
+			if (MsgCatalog::instance().hasTranslations()) fmt = MsgCatalog::instance().translateStatic(fmt, buf);
+			ils_format_typed(out, fmt, a);
+		} catch(...){}
+	}
+	/// Идентификатор сообщения для функции вывода.
+	void SetId(const LogId& v) const {
+		try { id = v; } catch(...){}
+	}
+	/// Заголовок строки начала или окончания секции.
+	void SectHead(const char* word) const {
+		try {
+			out.put(word);
+			out.append(m_sSectId.view());
+			out.put(' ');
+		} catch(...){}
+	}
+	/// Начало отсчёта времени секции.
+	void SectStart() const {
+		try {
+			std::string& path = SectPathBuf();
+			m_nPathLen = path.size();
+			if (!path.empty()) path += '/';
+			path.append(m_sSectId.data(), m_sSectId.size());
+		} catch(...){}
+		m_nDepth = ++SectDepth();
+		m_Start = std::chrono::steady_clock::now();
+		if (m_pLogger) m_pLogger->sectOut(true, m_sSectId.c_str(), m_Start);
+	}
+	/// Проверка, что секция называется \c sect с номером \c ind (если задан).
+	void SectMatch(const char* sect, const unsigned int* ind) const {
+		if (!m_pLogger) return;
+		TMsgBuf<48> expected;
+		expected.put(sect);
+		if (ind) expected.put(*ind);
+		if (m_sSectId.view() != expected.view()) {
+			TMsgBuf<128> msg;
+			msg.put("Ожидается окончание секции ");
+			msg.append(m_sSectId.view());
+			msg.put(" вместо указанной ");
+			msg.append(expected.view());
+			m_pLogger->errOut(msg.view(), id);
+		}
+	}
+	/// Уровень сообщения по функции вывода.
+	int Level() const {
+		return m_pFunc == &ILogger::errOut ? ILS_LEVEL_ERR : m_pFunc == &ILogger::wrnOut ? ILS_LEVEL_WRN :
+		       m_pFunc == &ILogger::infOut ? ILS_LEVEL_INF : ILS_LEVEL_LOG;
+	}
+	/// Проверка идентификатора по порогам LogConfig; отсечённое сообщение не форматируется.
+	bool IdCheck(const LogId& id) const {
+		if (!m_pLogger || !m_bEnabled) return m_bEnabled;
+		if (!m_pLogger->idEnabled(Level(), id)) m_bEnabled = false;
+		return m_bEnabled;
+	}
 public:
 	/// Конструктор.
 	TLoggerStream(const ILogger* pLogger, TFuncPtr pFunc) : m_pLogger(pLogger), m_pFunc(pFunc) {}
-	TLoggerStream(const ILogger* pLogger, TFuncPtr pFunc, const char* sect) : m_pLogger(pLogger), m_pFunc(pFunc), m_sSectId(sect) {}
-	TLoggerStream(const ILogger* pLogger, TFuncPtr pFunc, const char* sect, unsigned int ind) : m_pLogger(pLogger), m_pFunc(pFunc), m_sSectId(sect+std::to_string(ind)) {}
+	/// Конструктор сообщения места вызова \c rate (повторы схлопываются, см. TRateSite).
+	/// \param slot - запомненный формат места вызова (см. MsgCatalog), NULL - нет.
+	TLoggerStream(const ILogger* pLogger, TFuncPtr pFunc, TRateSite* rate, TMsgSlot* slot = NULL)
+		: m_pLogger(pLogger), m_pFunc(pFunc), m_pRate(rate), m_pSlot(slot) {}
+	TLoggerStream(const ILogger* pLogger, TFuncPtr pFunc, const char* sect) : m_pLogger(pLogger), m_pFunc(pFunc), m_pSectBase(sect) {
+		m_sSectId.put(sect);
+	}
+	TLoggerStream(const ILogger* pLogger, TFuncPtr pFunc, const char* sect, unsigned int ind) : m_pLogger(pLogger), m_pFunc(pFunc), m_pSectBase(sect) {
+		m_sSectId.put(sect);
+		m_sSectId.put(ind);
+	}
 	const TLoggerStream& operator()(const LogId& id, const char* msg, ...) const {
-		unsigned int max_msg_size = 1024;
-		char* str = new char[max_msg_size];
-		char* buf = NULL; // дополнительный буффер, может пригодится, а может нет
-		try {
-			va_list marker;
-			// Для отображение параметра типа "время" используется специальный ключ %t, для логов просто переводим его в %f
-			// ради этого приходится копировать строку msg в отдельный редактируемый буффер buf
-			const char* ct = strstr(msg, "%t");
-			if (ct) {
-				buf = new char[strlen(msg) + 1];
-				strcpy(buf, msg);
-				char* t = strstr(buf, "%t");
-				while (t) {
-					t[1] = 'f';
-					t = strstr(buf, "%t");
-				}
-				va_start(marker, msg);
-				vsnprintf(str, max_msg_size, buf, marker);
-				va_end(marker);
-			}
-			else {
-				va_start(marker, msg);
-				vsnprintf(str, max_msg_size, msg, marker);
-				va_end(marker);
-			}
-			out << str;
-//			logOut(str,id);
-		} catch(...){}
-		delete[] str;
-		if (buf != NULL) delete[] buf;
+		if (!IdCheck(id)) return *this;
+		SetId(id);
+		va_list marker;
+		va_start(marker, msg);
+		Format(msg, marker);
+		va_end(marker);
 		return *this;
 	}
-	const TLoggerStream& SectBegin(const char* msg, ...) const {
-		unsigned int max_msg_size = 1024;
-		char* str = new char[max_msg_size];
-		char* buf = NULL; // дополнительный буффер, может пригодится, а может нет
-		try {
-			out << "SectionBegin " << m_sSectId <<" ";
-			va_list marker;
-			// Для отображение параметра типа "время" используется специальный ключ %t, для логов просто переводим его в %f
-			// ради этого приходится копировать строку msg в отдельный редактируемый буффер buf
-			const char* ct = strstr(msg, "%t");
-			if (ct) {
-				buf = new char[strlen(msg) + 1];
-				strcpy(buf, msg);
-				char* t = strstr(buf, "%t");
-				while (t) {
-					t[1] = 'f';
-					t = strstr(buf, "%t");
-				}
-				va_start(marker, msg);
-				vsnprintf(str, max_msg_size, buf, marker);
-				va_end(marker);
-			}
-			else {
-				va_start(marker, msg);
-				vsnprintf(str, max_msg_size, msg, marker);
-				va_end(marker);
-			}
-			out << str;
-			//			logOut(str,id);
-		}
-		catch (...) {}
-		delete[] str;
-		if (buf != NULL) delete[] buf;
+	/// Сообщение с форматом ILS_FMT("..."), проверяемым при компиляции.
+	template<class F, class... Args, class = typename std::enable_if<TIsFmtString<F>::value>::type>
+	const TLoggerStream& operator()(const LogId& id, F fmt, const Args&... args) const {
+		if (!IdCheck(id)) return *this;
+		SetId(id);
+		FormatTyped<F>(args...);
 		return *this;
 	}
-	void SectCheck(const char* sect) const {
-		if (m_sSectId!=sect && m_pLogger) {
-			m_pLogger->errOut("Ожидается окончание секции " + m_sSectId + " вместо указанной " + sect, id);
-		}
+	const TLoggerStream& SectBegin(const char* msg, ...) const {
+		SectHead("SectionBegin ");
+		va_list marker;
+		va_start(marker, msg);
+		Format(msg, marker);
+		va_end(marker);
+		// Отсчёт времени начинается после формирования сообщения начала секции
+		SectStart();
+		return *this;
 	}
-	void SectCheck(const char* sect, unsigned int ind) const {
-		if (m_sSectId != (sect+std::to_string(ind)) && m_pLogger) {
-			m_pLogger->errOut("Ожидается окончание секции " + m_sSectId + " вместо указанной " + (sect + std::to_string(ind)), id);
-		}
+	template<class F, class... Args, class = typename std::enable_if<TIsFmtString<F>::value>::type>
+	const TLoggerStream& SectBegin(F fmt, const Args&... args) const {
+		SectHead("SectionBegin ");
+		FormatTyped<F>(args...);
+		SectStart();
+		return *this;
 	}
+	void SectCheck(const char* sect) const { SectMatch(sect, NULL); }
+	void SectCheck(const char* sect, unsigned int ind) const { SectMatch(sect, &ind); }
 	const TLoggerStream& SectEnd(const char* msg, ...) const {
-		unsigned int max_msg_size = 1024;
-		char* str = new char[max_msg_size];
-		char* buf = NULL; // дополнительный буффер, может пригодится, а может нет
-		try {
-			out << "SectionEnd " << m_sSectId << " ";
-			va_list marker;
-			// Для отображение параметра типа "время" используется специальный ключ %t, для логов просто переводим его в %f
-			// ради этого приходится копировать строку msg в отдельный редактируемый буффер buf
-			const char* ct = strstr(msg, "%t");
-			if (ct) {
-				buf = new char[strlen(msg) + 1];
-				strcpy(buf, msg);
-				char* t = strstr(buf, "%t");
-				while (t) {
-					t[1] = 'f';
-					t = strstr(buf, "%t");
-				}
-				va_start(marker, msg);
-				vsnprintf(str, max_msg_size, buf, marker);
-				va_end(marker);
-			}
-			else {
-				va_start(marker, msg);
-				vsnprintf(str, max_msg_size, msg, marker);
-				va_end(marker);
-			}
-			out << str;
-			//			logOut(str,id);
-		}
-		catch (...) {}
-		delete[] str;
-		if (buf != NULL) delete[] buf;
-		m_sSectId = "";
+		SectStop(true);
+		SectHead("SectionEnd ");
+		va_list marker;
+		va_start(marker, msg);
+		Format(msg, marker);
+		va_end(marker);
+		m_sSectId.clear();
+		return *this;
+	}
+	template<class F, class... Args, class = typename std::enable_if<TIsFmtString<F>::value>::type>
+	const TLoggerStream& SectEnd(F fmt, const Args&... args) const {
+		SectStop(true);
+		SectHead("SectionEnd ");
+		FormatTyped<F>(args...);
+		m_sSectId.clear();
 		return *this;
 	}
 	const char* SectId() const {
 		return m_sSectId.c_str();
 	}
+	/// Путь секций текущего потока через '/' (внешняя первой), пустой - вне секций.
+	/// Строки начала и окончания секции содержат в пути саму секцию. Путь
+	/// доступен функциям вывода логгера, вызванным в потоке сообщения (см. JsonLogger).
+	static std::string_view SectPath() { return SectPathBuf(); }
+	/// Уровень вложенности начатой секции в текущем потоке (с 1), 0 - секция не начата или завершена.
+	int Depth() const { return m_nDepth; }
+	/// Длительность завершённой секции в наносекундах, -1 - секция не завершена.
+	long long Duration() const { return m_nDuration; }
+	/// Отключение вывода (секция отсечена порогом важности).
+	void Disable() { m_bEnabled = false; }
+	/// Включен ли вывод.
+	bool Enabled() const { return m_bEnabled; }
 	void Flush() const {
-		(m_pLogger->*m_pFunc)(out.str(), id);
-		out.str("");
+		if (!m_bEnabled) return;
+		(m_pLogger->*m_pFunc)(out.view(), id);
+		out.clear();
+	}
+	/// Вывод в поток (форматирование как у std::ostream, см. TMsgBuf::put()).
+	template<class T> inline const TLoggerStream& operator<<(const T& t) const {
+		try { out.put(t); } catch(...){}
+		return *this;
 	}
-	/// Вывод в поток.
-	template<class T> inline const TLoggerStream& operator<<(const T& t) const {out<<t;return *this;}
 	~TLoggerStream() {
-		if (m_sSectId != "") {
-			// Если m_sSectId!="" знаачит она не была начата, но не закончена, заканчиваем насильно
-			out << "SectionEnd " << m_sSectId << " ";
-		}
-		else {
-			(m_pLogger->*m_pFunc)(out.str(), id);
+		SectStop(false);
+		if (m_bEnabled) {
+			if (!m_sSectId.empty()) {
+				// Если m_sSectId!="" знаачит она не была начата, но не закончена, заканчиваем насильно
+				SectHead("SectionEnd ");
+			}
+			else {
+				try {
+					// Длительность завершённой секции - в конце строки SectionEnd
+					if (m_nDuration >= 0) out.appendf(" [%.3f ms]", double(m_nDuration) / 1e6);
+					if (!m_pRate || !m_pRate->collapse(m_pLogger, Level(), out.view(), id)) (m_pLogger->*m_pFunc)(out.view(), id);
+				} catch(...){}
+			}
 		}
+		// Секция убирается из пути потока после вывода строки окончания
+		if (m_nPathLen != size_t(-1)) SectPathBuf().resize(m_nPathLen);
 	}
 };
 
@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#include <vector>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "ILS_MMapLog.h"
+
+//=============================================================================
+// Отображение файла в память (зависит от платформы)
+#ifdef _WIN32
+struct MMapLogger::TMapping {
+	HANDLE file = INVALID_HANDLE_VALUE;
+};
+namespace {
+	typedef MMapLogger::TMapping TMap;
+	bool mapOpen(TMap& m, const std::string& path, bool append) {
+		m.file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+			NULL, append ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		return m.file != INVALID_HANDLE_VALUE;
+	}
+	bool mapIsOpen(const TMap& m) { return m.file != INVALID_HANDLE_VALUE; }
+	// Создание отображения нужного размера увеличивает файл; описатель
+	// отображения закрывается сразу - окно удерживает его само
+	char* mapView(TMap& m, unsigned long long off, size_t len) {
+		const unsigned long long end = off + len;
+		HANDLE map = CreateFileMappingA(m.file, NULL, PAGE_READWRITE, DWORD(end >> 32), DWORD(end), NULL);
+		if (!map) return NULL;
+		void* p = MapViewOfFile(map, FILE_MAP_WRITE, DWORD(off >> 32), DWORD(off), len);
+		CloseHandle(map);
+		return static_cast<char*>(p);
+	}
+	void mapUnview(TMap& m, char* p, size_t len) {
+		UnmapViewOfFile(p);
+	}
+	void mapSync(TMap& m, char* p, size_t len, bool whole_file) {
+		FlushViewOfFile(p, len);
+		FlushFileBuffers(m.file);
+	}
+	void mapClose(TMap& m, unsigned long long len) {
+		LARGE_INTEGER li;
+		li.QuadPart = LONGLONG(len);
+		if (SetFilePointerEx(m.file, li, NULL, FILE_BEGIN)) SetEndOfFile(m.file);
+		CloseHandle(m.file);
+		m.file = INVALID_HANDLE_VALUE;
+	}
+	size_t pageSize() { return 4096; }
+}
+#else
+struct MMapLogger::TMapping {
+	int fd = -1;
+};
+namespace {
+	typedef MMapLogger::TMapping TMap;
+	bool mapOpen(TMap& m, const std::string& path, bool append) {
+		m.fd = ::open(path.c_str(), O_RDWR | O_CREAT | (append ? 0 : O_TRUNC), 0644);
+		return m.fd >= 0;
+	}
+	bool mapIsOpen(const TMap& m) { return m.fd >= 0; }
+	char* mapView(TMap& m, unsigned long long off, size_t len) {
+		if (ftruncate(m.fd, off_t(off + len)) != 0) return NULL;
+		void* p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, m.fd, off_t(off));
+		return p == MAP_FAILED ? NULL : static_cast<char*>(p);
+	}
+	void mapUnview(TMap& m, char* p, size_t len) {
+		munmap(p, len);
+	}
+	// Страницы уже снятых окон сбрасываются fsync()
+	void mapSync(TMap& m, char* p, size_t len, bool whole_file) {
+		msync(p, len, MS_SYNC);
+		if (whole_file) fsync(m.fd);
+	}
+	void mapClose(TMap& m, unsigned long long len) {
+		if (ftruncate(m.fd, off_t(len)) != 0) {}
+		::close(m.fd);
+		m.fd = -1;
+	}
+	size_t pageSize() { return size_t(sysconf(_SC_PAGESIZE)); }
+}
+#endif
+
+namespace {
+	// Длина данных файла без нулевого хвоста (остаток окна оборванного запуска)
+	unsigned long long dataLength(const std::string& path) {
+		std::error_code ec;
+		unsigned long long size = std::filesystem::file_size(path, ec);
+		if (ec) return 0;
+		std::ifstream in(path.c_str(), std::ios_base::in | std::ios_base::binary);
+		std::vector<char> buf(1 << 16);
+		while (size > 0) {
+			const size_t n = size_t(std::min<unsigned long long>(size, buf.size()));
+			if (!in.seekg(std::streamoff(size - n)) || !in.read(buf.data(), std::streamsize(n))) break;
+			size_t i = n;
+			while (i > 0 && buf[i - 1] == 0) --i;
+			if (i) return size - n + i;
+			size -= n;
+		}
+		return size;
+	}
+}
+
+//=============================================================================
+// MMapLogger - запись лога в файл, отображённый в память.
+//-----------------------------------------------------------------------------
+// Конструктор
+MMapLogger::MMapLogger(const std::string& file, size_t chunk, unsigned sync,
+                       std::chrono::milliseconds interval, std::ios_base::openmode mode)
+	: m_pMap(new TMapping), m_sFile(file), m_nSync(sync), m_SyncInterval(interval),
+	  m_pView(NULL), m_nViewOff(0), m_nPos(0), m_nSynced(0), m_LastSync(std::chrono::steady_clock::now()),
+	  m_nLost(0), m_bFailing(false) {
+	// Окно кратно гранулярности отображения (64 КБ в Windows)
+	m_nChunk = std::max<size_t>(1 << 16, (chunk + 0xFFFF) & ~size_t(0xFFFF));
+	const bool append = (mode & std::ios_base::app) != 0;
+	if (append) m_nPos = dataLength(file);
+	if (!mapOpen(*m_pMap, file, append)) return;
+	m_nSynced = m_nPos;
+	remap(m_nPos - m_nPos % m_nChunk);
+}
+MMapLogger::~MMapLogger() {
+	BaseLogger::onLogFinish(true, false, false);
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (m_pView) {
+		if (m_nSync & syncOnClose) syncLocked();
+		mapUnview(*m_pMap, m_pView, m_nChunk);
+		m_pView = NULL;
+	}
+	// Файл обрезается до реальной длины
+	if (mapIsOpen(*m_pMap)) mapClose(*m_pMap, m_nPos);
+	m_pIndex.reset();
+}
+bool MMapLogger::isOpen() const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_pView != NULL;
+}
+unsigned long long MMapLogger::size() const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_nPos;
+}
+unsigned long long MMapLogger::lost() const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_nLost;
+}
+void MMapLogger::sync() const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (m_pView) syncLocked();
+	if (m_pIndex) m_pIndex->flush();
+}
+bool MMapLogger::setIndex(const std::string& file, unsigned block, int exact_level) {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	std::unique_ptr<LogIndexWriter> index(new LogIndexWriter);
+	if (!index->open(file, m_nPos > 0, block, exact_level)) return false;
+	m_pIndex = std::move(index);
+	return true;
+}
+//-----------------------------------------------------------------------------
+// Функции механизма вывода
+void MMapLogger::lOut(MsgView msg) const { write(msg, ILS_LEVEL_LOG, LogId()); }
+void MMapLogger::wOut(MsgView msg) const { write(msg, ILS_LEVEL_WRN, LogId()); }
+void MMapLogger::eOut(MsgView msg) const { write(msg, ILS_LEVEL_ERR, LogId()); }
+void MMapLogger::recordOut(int level, MsgView line, const LogId& id) const { write(line, level, id); }
+void MMapLogger::write(MsgView msg, int level, const LogId& id) const {
+	bool report = false;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!mapIsOpen(*m_pMap)) return;
+		const unsigned long long start = m_nPos;
+		// Окна нет после сбоя: повторная попытка отобразить окно текущей позиции
+		bool ok = m_pView || remap(m_nPos - m_nPos % m_nChunk);
+		ok = ok && put(msg.data(), msg.size()) && put("\n", 1);
+		if (!ok) {
+			rollback(start);
+			++m_nLost;
+			report = !m_bFailing;
+			m_bFailing = true;
+		}
+		else {
+			m_bFailing = false;
+			// Индекс ссылается только на целиком записанные строки
+			if (m_pIndex) m_pIndex->add(start, msg.size() + 1, level, id);
+			if ((level >= ILS_LEVEL_ERR && (m_nSync & syncOnError)) ||
+			    (m_SyncInterval.count() > 0 && std::chrono::steady_clock::now() - m_LastSync >= m_SyncInterval))
+				syncLocked();
+		}
+	}
+	// Через stderr: запись в этот же лог снова упрётся в сбой
+	if (report)
+		fprintf(stderr, "MMapLogger: не удалось увеличить или отобразить файл %s, сообщения пропускаются до восстановления\n", m_sFile.c_str());
+}
+bool MMapLogger::put(const char* p, size_t n) const {
+	while (n) {
+		if (m_nPos >= m_nViewOff + m_nChunk && !remap(m_nViewOff + m_nChunk)) return false;
+		const size_t k = std::min<size_t>(n, size_t(m_nViewOff + m_nChunk - m_nPos));
+		memcpy(m_pView + (m_nPos - m_nViewOff), p, k);
+		m_nPos += k;
+		p += k;
+		n -= k;
+	}
+	return true;
+}
+// Сдвиг окна: файл увеличивается на chunk, записанное остаётся в кэше страниц ОС.
+// Старое окно снимается только после отображения нового, при сбое оно остаётся.
+bool MMapLogger::remap(unsigned long long off) const {
+	char* view = mapView(*m_pMap, off, m_nChunk);
+	if (!view) return false;
+	if (m_pView) mapUnview(*m_pMap, m_pView, m_nChunk);
+	m_pView = view;
+	m_nViewOff = off;
+	return true;
+}
+// Отказ от недописанной строки: позиция возвращается к её началу, уже
+// скопированная часть в окне обнуляется (как хвост оборванного запуска)
+void MMapLogger::rollback(unsigned long long start) const {
+	m_nPos = start;
+	if (m_pView && (start < m_nViewOff || start > m_nViewOff + m_nChunk) && !remap(start - start % m_nChunk)) {
+		mapUnview(*m_pMap, m_pView, m_nChunk);
+		m_pView = NULL;
+	}
+	if (m_pView) memset(m_pView + (start - m_nViewOff), 0, size_t(m_nViewOff + m_nChunk - start));
+}
+void MMapLogger::syncLocked() const {
+	m_LastSync = std::chrono::steady_clock::now();
+	if (m_nPos == m_nSynced) return;
+	// Начало диапазона выравнивается на страницу
+	unsigned long long from = std::max(m_nSynced, m_nViewOff);
+	from -= (from - m_nViewOff) % pageSize();
+	mapSync(*m_pMap, m_pView + (from - m_nViewOff), size_t(m_nPos - from), m_nSynced < m_nViewOff);
+	m_nSynced = m_nPos;
+}
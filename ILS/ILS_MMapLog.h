@@ -0,0 +1,99 @@
+#pragma once
+
+#include <chrono>
+#include <ios>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "ILS_StdLog.h"
+#include "ILS_LogIndex.h"
+
+//=============================================================================
+/// Регистратор хода процесса (Логгер) в файл, отображённый в память.
+/// @ingroup Kernel
+/// Файл заранее увеличивается на размер окна (chunk), окно отображается в
+/// память (mmap / MapViewOfFile), и каждая строка лога просто копируется в
+/// него \c memcpy, без системного вызова на сообщение. Когда окно
+/// заполняется, оно сдвигается вперёд на следующий chunk.
+///
+/// Записанные в окно данные принадлежат кэшу страниц ОС, поэтому при
+/// аварийном завершении процесса всё записанное остаётся в файле; хвост
+/// окна при этом заполнен нулями. При закрытии файл обрезается до реальной
+/// длины, а при дописывании (std::ios_base::app) нулевой хвост
+/// оборванного запуска отбрасывается.
+///
+/// Если файл не удалось увеличить или отобразить следующее окно (нет места
+/// на диске и т.п.), недописанная строка отбрасывается, в stderr один раз
+/// выводится сообщение, а окно пробует отобразить следующая запись; количество
+/// потерянных строк возвращает lost().
+///
+/// Надёжность записи на диск (msync / FlushViewOfFile) задаётся маской
+/// syncOn... и интервалом: сброс после сообщения об ошибке, периодически
+/// (проверяется при записи) и при закрытии.
+/// \see BaseLogger
+class MMapLogger : public BaseLogger {
+public:
+	/// Биты маски сброса на диск.
+	enum { syncOnError = 1, syncOnClose = 2 };
+	//---------------------------------------------------------------------------
+	/// Конструктор.
+	/// \param file     - имя файла лога.
+	/// \param chunk    - размер окна отображения (округляется вверх до 64 КБ).
+	/// \param sync     - маска сброса на диск (syncOnError, syncOnClose).
+	/// \param interval - период сброса на диск, 0 - без периодического сброса.
+	/// \param mode     - режим открытия (std::ios_base::app - дописывать в существующий файл).
+	MMapLogger(const std::string& file, size_t chunk = 16 << 20, unsigned sync = syncOnError | syncOnClose,
+	           std::chrono::milliseconds interval = std::chrono::milliseconds(0),
+	           std::ios_base::openmode mode = std::ios_base::out);
+	virtual ~MMapLogger();
+	MMapLogger(const MMapLogger&) = delete;
+	MMapLogger& operator=(const MMapLogger&) = delete;
+	/// Удалось ли открыть и отобразить файл.
+	bool isOpen() const;
+	/// Количество байт лога (длина файла после закрытия).
+	unsigned long long size() const;
+	/// Количество строк, потерянных из-за сбоя увеличения или отображения файла.
+	unsigned long long lost() const;
+	/// Сброс записанного на диск.
+	void sync() const;
+	/// Ведение индекса лога (см. LogIndexWriter, утилита ils-query).
+	/// Вызывается до начала регистрации сообщений; при дописывании в лог
+	/// (std::ios_base::app) индекс тоже дописывается.
+	/// \param file        - имя файла индекса, обычно имя лога + ".idx".
+	/// \param block       - размер блока индекса в байтах лога.
+	/// \param exact_level - уровень, начиная с которого сохраняются точные смещения строк.
+	bool setIndex(const std::string& file, unsigned block = LogIndexWriter::defaultBlock, int exact_level = ILS_LEVEL_WRN);
+	/// Дескрипторы файла и отображения (зависят от платформы, определены в ILS_MMapLog.cpp).
+	struct TMapping;
+	//---------------------------------------------------------------------------
+protected: // Функции механизма вывода
+	virtual void lOut(MsgView msg) const;
+	virtual void wOut(MsgView msg) const;
+	virtual void eOut(MsgView msg) const;
+	virtual void recordOut(int level, MsgView line, const LogId& id) const;
+	/// Копирование строки в окно (со сдвигом окна при необходимости).
+	void write(MsgView msg, int level, const LogId& id) const;
+	/// Копирование байтов в окно (вызывается под m_Mutex).
+	bool put(const char* p, size_t n) const;
+	/// Отображение окна с позиции \c off (вызывается под m_Mutex).
+	/// При неудаче прежнее окно остаётся отображённым.
+	bool remap(unsigned long long off) const;
+	/// Возврат позиции к началу недописанной строки (вызывается под m_Mutex).
+	void rollback(unsigned long long start) const;
+	/// Сброс на диск всего, что записано после предыдущего сброса (вызывается под m_Mutex).
+	void syncLocked() const;
+	std::unique_ptr<TMapping> m_pMap;
+	std::string m_sFile;
+	size_t m_nChunk;
+	unsigned m_nSync;
+	std::chrono::milliseconds m_SyncInterval;
+	mutable std::mutex m_Mutex;
+	mutable char* m_pView;                 // Текущее окно, NULL - файл не открыт или сбой отображения
+	mutable unsigned long long m_nViewOff; // Смещение окна в файле
+	mutable unsigned long long m_nPos;     // Длина записанных данных
+	mutable unsigned long long m_nSynced;  // Граница последнего сброса на диск
+	mutable std::chrono::steady_clock::time_point m_LastSync;
+	mutable unsigned long long m_nLost;    // Строки, потерянные из-за сбоя отображения
+	mutable bool m_bFailing;               // Сбой уже сообщён, записи ещё не восстановились
+	std::unique_ptr<LogIndexWriter> m_pIndex;  // Под m_Mutex, NULL - без индекса
+}; //class MMapLogger
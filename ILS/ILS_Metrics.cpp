@@ -0,0 +1,408 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include "ILS_FanoutLog.h"
+#include "ILS_JsonLog.h"
+#include "ILS_Metrics.h"
+#include "ILS_MMapLog.h"
+#include "ILS_RateLimit.h"
+
+namespace fs = std::filesystem;
+
+//=============================================================================
+// Вспомогательные функции экспорта
+namespace {
+	const char* const levelNames[] = { "dbg", "log", "inf", "wrn", "err" };
+
+	// Значение метки Prometheus: экранируются '\\', '"' и перевод строки
+	void appendLabel(std::string& res, const std::string& s) {
+		for (char c : s) {
+			if (c == '\\' || c == '"') { res += '\\'; res += c; }
+			else if (c == '\n') res += "\\n";
+			else res += c;
+		}
+	}
+	void appendHeader(std::string& res, const char* name, const char* type, const char* help) {
+		ils_appendf(res, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+	}
+	// Начало строки метрики приёмника: name{sink="..."
+	void appendSink(std::string& res, const char* name, const std::string& sink) {
+		res += name;
+		res += "{sink=\"";
+		appendLabel(res, sink);
+		res += '"';
+	}
+	// Потери следующего логгера: функция чтения для LogMetrics::addCounter(),
+	// пустая - у логгера нет счётчика потерь. Логгер удерживается слабой ссылкой.
+	std::function<unsigned long long()> droppedReader(const std::shared_ptr<ILogger>& next) {
+		const std::weak_ptr<ILogger> w(next);
+		if (dynamic_cast<const StdLogger*>(next.get()))
+			return [w]() -> unsigned long long {
+				const std::shared_ptr<ILogger> p = w.lock();
+				return p ? static_cast<const StdLogger*>(p.get())->dropped() : 0;
+			};
+		if (dynamic_cast<const FanoutLogger*>(next.get()))
+			return [w]() -> unsigned long long {
+				const std::shared_ptr<ILogger> p = w.lock();
+				return p ? static_cast<const FanoutLogger*>(p.get())->dropped() : 0;
+			};
+		if (dynamic_cast<const MMapLogger*>(next.get()))
+			return [w]() -> unsigned long long {
+				const std::shared_ptr<ILogger> p = w.lock();
+				return p ? static_cast<const MMapLogger*>(p.get())->lost() : 0;
+			};
+		return std::function<unsigned long long()>();
+	}
+}
+
+//=============================================================================
+// LogMetrics - счётчики сообщений по приёмникам и идентификаторам.
+//-----------------------------------------------------------------------------
+LogMetrics& LogMetrics::instance() {
+	// Объект не разрушается: сообщения могут выводиться в деструкторах статических объектов
+	static LogMetrics* p = new LogMetrics();
+	return *p;
+}
+// Таблица текущего потока, регистрируется при первом использовании и
+// переносится в итоги при завершении потока
+LogMetrics::TShard* LogMetrics::shard() {
+	struct THolder {
+		std::shared_ptr<TShard> shard;
+		bool done = false;
+		~THolder() {
+			done = true;
+			if (shard) LogMetrics::instance().retire(shard);
+			shard.reset();
+		}
+	};
+	thread_local THolder tls_shard;
+	if (!tls_shard.shard) {
+		// Сообщения из деструкторов объектов потока после переноса таблицы не учитываются
+		if (tls_shard.done) return NULL;
+		tls_shard.shard = std::make_shared<TShard>();
+		tls_shard.shard->gen.store(m_nGen.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Shards.push_back(tls_shard.shard);
+	}
+	return tls_shard.shard.get();
+}
+unsigned LogMetrics::sinkNo(const std::string& sink) {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (size_t n = 0; n < m_SinkNames.size(); ++n)
+		if (m_SinkNames[n] == sink) return unsigned(n);
+	m_SinkNames.push_back(sink);
+	return unsigned(m_SinkNames.size() - 1);
+}
+void LogMetrics::add(unsigned sink, const LogId& id, int level, size_t bytes, long long ns) {
+	if (!isActive()) return;
+	TShard* s = shard();
+	if (!s) return;
+	const unsigned gen = m_nGen.load(std::memory_order_relaxed);
+	if (s->gen.load(std::memory_order_relaxed) != gen) clear(*s, gen);
+	TSinkCounters& c = sink < s->sinks.size() && s->sinks[sink] ? *s->sinks[sink] : addSink(*s, sink);
+	// Сообщения одного Logger передают одну и ту же строку LogId
+	auto& slot = c.cache[(reinterpret_cast<uintptr_t>(&id) >> 4) % TSinkCounters::idCache];
+	TIdCounters* ic = slot.counters;
+	if (slot.key != &id || ic->id.size() != id.size() || memcmp(ic->id.data(), id.data(), id.size()) != 0) {
+		ic = &addId(*s, c, id);
+		slot.key = &id;
+		slot.counters = ic;
+	}
+	ic->count[level < 0 ? 0 : level > ILS_LEVEL_ERR ? ILS_LEVEL_ERR : level].add(1);
+	ic->bytes.add(bytes);
+	if (ns < 0) { c.filtered.add(1); return; }
+	c.calls.add(1);
+	c.total_ns.add((unsigned long long)ns);
+	if ((unsigned long long)ns > c.max_ns.get()) c.max_ns.set((unsigned long long)ns);
+	c.hist[bucket(ns)].add(1);
+}
+LogMetrics::TSinkCounters& LogMetrics::addSink(TShard& s, unsigned sink) {
+	std::lock_guard<std::mutex> lock(s.mutex);
+	if (s.sinks.size() <= sink) s.sinks.resize(sink + 1);
+	s.sinks[sink].reset(new TSinkCounters);
+	return *s.sinks[sink];
+}
+LogMetrics::TIdCounters& LogMetrics::addId(TShard& s, TSinkCounters& c, const LogId& id) {
+	// Таблицу изменяет только владелец: поиск без блокировки
+	auto it = c.ids.find(id);
+	if (it != c.ids.end()) return *it->second;
+	std::unique_ptr<TIdCounters> ic(new TIdCounters);
+	ic->id = id;
+	std::lock_guard<std::mutex> lock(s.mutex);
+	return *c.ids.emplace(id, std::move(ic)).first->second;
+}
+void LogMetrics::clear(TShard& s, unsigned gen) {
+	for (auto& c : s.sinks) {
+		if (!c) continue;
+		c->calls.set(0);
+		c->filtered.set(0);
+		c->total_ns.set(0);
+		c->max_ns.set(0);
+		for (TCounter& h : c->hist) h.set(0);
+		for (auto& ic : c->ids) {
+			for (TCounter& n : ic.second->count) n.set(0);
+			ic.second->bytes.set(0);
+		}
+	}
+	s.gen.store(gen, std::memory_order_release);
+}
+void LogMetrics::retire(const std::shared_ptr<TShard>& s) {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	{
+		std::lock_guard<std::mutex> l(s->mutex);
+		merge(*s, m_Retired);
+	}
+	for (size_t i = 0; i < m_Shards.size(); ++i)
+		if (m_Shards[i] == s) { m_Shards.erase(m_Shards.begin() + i); break; }
+}
+// Счётчики прежнего поколения reset() в итоги не попадают
+void LogMetrics::merge(const TShard& sh, TTotals& t) const {
+	if (sh.gen.load(std::memory_order_acquire) != m_nGen.load(std::memory_order_relaxed)) return;
+	for (size_t n = 0; n < sh.sinks.size() && n < m_SinkNames.size(); ++n) {
+		if (!sh.sinks[n]) continue;
+		const TSinkCounters& c = *sh.sinks[n];
+		const std::string& name = m_SinkNames[n];
+		TSinkStats& s = t.sinks.emplace(name, TSinkStats()).first->second;
+		s.sink = name;
+		s.calls += c.calls.get();
+		s.filtered += c.filtered.get();
+		s.total_ns += (long long)c.total_ns.get();
+		s.max_ns = std::max(s.max_ns, (long long)c.max_ns.get());
+		for (unsigned b = 0; b < latencyBuckets; ++b) s.hist[b] += c.hist[b].get();
+		for (auto& idc : c.ids) {
+			TIdStats& is = t.ids.emplace(std::make_pair(name, idc.first), TIdStats()).first->second;
+			is.id = idc.first;
+			for (int level = 0; level < 5; ++level) is.count[level] += idc.second->count[level].get();
+			is.bytes += idc.second->bytes.get();
+		}
+	}
+}
+void LogMetrics::reset() {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	// Таблицы потоков обнуляют сами владельцы при следующем сообщении
+	m_nGen.fetch_add(1, std::memory_order_relaxed);
+	m_Retired = TTotals();
+}
+void LogMetrics::addCounter(const std::string& name, std::function<unsigned long long()> read) {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (auto& c : m_Counters)
+		if (c.first == name) { c.second = read; return; }
+	m_Counters.emplace_back(name, read);
+}
+void LogMetrics::removeCounter(const std::string& name) {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (size_t i = 0; i < m_Counters.size(); ++i)
+		if (m_Counters[i].first == name) { m_Counters.erase(m_Counters.begin() + i); return; }
+}
+unsigned LogMetrics::bucket(long long ns) {
+	unsigned b = 0;
+	for (unsigned long long v = ns > 0 ? (unsigned long long)ns : 0; v > 1 && b + 1 < latencyBuckets; v >>= 1) ++b;
+	return b;
+}
+long long LogMetrics::quantile(const TSinkStats& s, double q) {
+	unsigned long long rank = (unsigned long long)std::ceil(q * double(s.calls));
+	if (rank < 1) rank = 1;
+	unsigned long long n = 0;
+	for (unsigned b = 0; b < latencyBuckets; ++b) {
+		n += s.hist[b];
+		if (n >= rank) return b + 1 < latencyBuckets && (2LL << b) < s.max_ns ? (2LL << b) : s.max_ns;
+	}
+	return s.max_ns;
+}
+//-----------------------------------------------------------------------------
+// Снимок
+LogMetrics::TSnapshot LogMetrics::snapshot() const {
+	// Таблицы потоков объединяются по именам приёмников и идентификаторов
+	TTotals t;
+	TSnapshot res;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		t = m_Retired;
+		for (auto& sh : m_Shards) {
+			std::lock_guard<std::mutex> l(sh->mutex);
+			merge(*sh, t);
+		}
+		for (auto& c : m_Counters) {
+			unsigned long long v = 0;
+			try { v = c.second(); } catch(...){}
+			res.counters.emplace_back(c.first, v);
+		}
+	}
+	for (auto& it : t.ids) t.sinks[it.first.first].ids.push_back(it.second);
+	for (auto& it : t.sinks) res.sinks.push_back(it.second);
+	res.rate_suppressed = RateLimiter::suppressed();
+	res.wall_us = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+	return res;
+}
+void LogMetrics::formatPrometheus(std::string& res, const TSnapshot& s) {
+	appendHeader(res, "ils_messages_total", "counter", "Messages seen by the sink, by LogId and level.");
+	for (const TSinkStats& sk : s.sinks)
+		for (const TIdStats& id : sk.ids)
+			for (int level = 0; level < 5; ++level) {
+				if (!id.count[level]) continue;
+				appendSink(res, "ils_messages_total", sk.sink);
+				res += ",id=\"";
+				appendLabel(res, id.id);
+				ils_appendf(res, "\",level=\"%s\"} %llu\n", levelNames[level], id.count[level]);
+			}
+	appendHeader(res, "ils_message_bytes_total", "counter", "Message text bytes seen by the sink, by LogId.");
+	for (const TSinkStats& sk : s.sinks)
+		for (const TIdStats& id : sk.ids) {
+			appendSink(res, "ils_message_bytes_total", sk.sink);
+			res += ",id=\"";
+			appendLabel(res, id.id);
+			ils_appendf(res, "\"} %llu\n", id.bytes);
+		}
+	appendHeader(res, "ils_filtered_total", "counter", "Messages below the level threshold of the sink.");
+	for (const TSinkStats& sk : s.sinks) {
+		appendSink(res, "ils_filtered_total", sk.sink);
+		ils_appendf(res, "} %llu\n", sk.filtered);
+	}
+	appendHeader(res, "ils_sink_latency_seconds", "histogram", "Time spent in the sink output call.");
+	for (const TSinkStats& sk : s.sinks) {
+		unsigned long long n = 0;
+		for (unsigned b = 0; b + 1 < latencyBuckets; ++b) {
+			n += sk.hist[b];
+			// Корзины до 128 нс объединяются: время вызова меньше не бывает
+			if (b < 6) continue;
+			appendSink(res, "ils_sink_latency_seconds_bucket", sk.sink);
+			ils_appendf(res, ",le=\"%g\"} %llu\n", double(2LL << b) / 1e9, n);
+		}
+		appendSink(res, "ils_sink_latency_seconds_bucket", sk.sink);
+		ils_appendf(res, ",le=\"+Inf\"} %llu\n", sk.calls);
+		appendSink(res, "ils_sink_latency_seconds_sum", sk.sink);
+		ils_appendf(res, "} %.9f\n", double(sk.total_ns) / 1e9);
+		appendSink(res, "ils_sink_latency_seconds_count", sk.sink);
+		ils_appendf(res, "} %llu\n", sk.calls);
+	}
+	appendHeader(res, "ils_rate_suppressed_total", "counter", "Messages suppressed by call site rate limits.");
+	ils_appendf(res, "ils_rate_suppressed_total %llu\n", s.rate_suppressed);
+	if (s.counters.empty()) return;
+	appendHeader(res, "ils_counter", "counter", "External logger counters (dropped records, errors ...).");
+	for (auto& c : s.counters) {
+		res += "ils_counter{name=\"";
+		appendLabel(res, c.first);
+		ils_appendf(res, "\"} %llu\n", c.second);
+	}
+}
+void LogMetrics::formatJson(std::string& res, const TSnapshot& s) {
+	ils_appendf(res, "{\"ts_us\":%lld,\"rate_suppressed\":%llu,\"sinks\":[", s.wall_us, s.rate_suppressed);
+	for (size_t k = 0; k < s.sinks.size(); ++k) {
+		const TSinkStats& sk = s.sinks[k];
+		res += k ? ",{\"sink\":\"" : "{\"sink\":\"";
+		JsonLogger::appendJson(res, sk.sink);
+		ils_appendf(res, "\",\"calls\":%llu,\"filtered\":%llu,\"latency_ns\":{\"sum\":%lld,\"max\":%lld,\"p50\":%lld,\"p99\":%lld,\"hist\":[",
+			sk.calls, sk.filtered, sk.total_ns, sk.max_ns, quantile(sk, 0.5), quantile(sk, 0.99));
+		for (unsigned b = 0; b < latencyBuckets; ++b) ils_appendf(res, b ? ",%llu" : "%llu", sk.hist[b]);
+		res += "]},\"ids\":[";
+		for (size_t i = 0; i < sk.ids.size(); ++i) {
+			const TIdStats& id = sk.ids[i];
+			res += i ? ",{\"id\":\"" : "{\"id\":\"";
+			JsonLogger::appendJson(res, id.id);
+			res += "\",\"count\":{";
+			for (int level = 0; level < 5; ++level)
+				ils_appendf(res, level ? ",\"%s\":%llu" : "\"%s\":%llu", levelNames[level], id.count[level]);
+			ils_appendf(res, "},\"bytes\":%llu}", id.bytes);
+		}
+		res += "]}";
+	}
+	res += "],\"counters\":{";
+	for (size_t k = 0; k < s.counters.size(); ++k) {
+		res += k ? ",\"" : "\"";
+		JsonLogger::appendJson(res, s.counters[k].first);
+		ils_appendf(res, "\":%llu", s.counters[k].second);
+	}
+	res += "}}\n";
+}
+
+//=============================================================================
+// MetricsLogger - учёт сообщений перед следующим логгером.
+//-----------------------------------------------------------------------------
+MetricsLogger::MetricsLogger(const std::string& sink, std::shared_ptr<ILogger> next)
+	: m_sSink(sink), m_nSink(LogMetrics::instance().sinkNo(sink)), m_pNext(next) {
+	std::function<unsigned long long()> dropped = droppedReader(next);
+	if (!dropped) return;
+	m_sDropped = sink + ".dropped";
+	LogMetrics::instance().addCounter(m_sDropped, dropped);
+}
+MetricsLogger::~MetricsLogger() {
+	if (!m_sDropped.empty()) LogMetrics::instance().removeCounter(m_sDropped);
+}
+const char* MetricsLogger::msgTranslate(const LogId& id, const char* msg, Msg& buf) const {
+	if (m_pNext) return m_pNext->msgTranslate(id, msg, buf);
+	return ILogger::msgTranslate(id, msg, buf);
+}
+void MetricsLogger::count(int level, TOutFunc out, MsgView msg, const LogId& id) const {
+	if (!logEnabled(level)) return;
+	LogMetrics& m = LogMetrics::instance();
+	if (!m_pNext || !m_pNext->logEnabled(level)) {
+		m.add(m_nSink, id, level, msg.size(), -1);
+		return;
+	}
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	(m_pNext.get()->*out)(msg, id);
+	const long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	m.add(m_nSink, id, level, msg.size(), ns);
+}
+// Следующий логгер получает сырые аргументы; если ему нужен текст, сообщение
+// отформатирует ILogger::out() и учтёт count()
+bool MetricsLogger::rawOut(int level, const TFmtSite& site, const LogId& id, va_list marker) const {
+	if (!m_pNext || !logEnabled(level) || !m_pNext->logEnabled(level)) return false;
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (!m_pNext->rawOut(level, site, id, marker)) return false;
+	const long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	LogMetrics::instance().add(m_nSink, id, level, 0, ns);
+	return true;
+}
+
+//=============================================================================
+// MetricsExporter - периодическая запись снимков.
+//-----------------------------------------------------------------------------
+MetricsExporter::MetricsExporter(const std::string& file, unsigned interval_ms, TFormat format)
+	: m_sFile(file), m_nInterval(interval_ms ? interval_ms : 1), m_Format(format), m_bStop(false), m_nExports(0) {
+	m_Thread = std::thread(&MetricsExporter::run, this);
+}
+MetricsExporter::~MetricsExporter() {
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bStop = true;
+	}
+	m_Cond.notify_all();
+	if (m_Thread.joinable()) m_Thread.join();
+	exportNow();
+}
+void MetricsExporter::run() {
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (!m_bStop) {
+		if (m_Cond.wait_for(lock, std::chrono::milliseconds(m_nInterval), [this] { return m_bStop; })) break;
+		lock.unlock();
+		exportNow();
+		lock.lock();
+	}
+}
+bool MetricsExporter::exportNow() {
+	try {
+		std::string text;
+		const LogMetrics::TSnapshot s = LogMetrics::instance().snapshot();
+		if (m_Format == fmtJson) LogMetrics::formatJson(text, s);
+		else LogMetrics::formatPrometheus(text, s);
+		std::lock_guard<std::mutex> lock(m_WriteMutex);
+		// Запись во временный файл и переименование: читатель видит только целый снимок
+		const std::string tmp = m_sFile + ".tmp";
+		FILE* f = fopen(tmp.c_str(), "wb");
+		if (!f) return false;
+		const bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+		if (fclose(f) != 0 || !ok) return false;
+		std::error_code ec;
+		fs::rename(tmp, m_sFile, ec);
+		if (ec) return false;
+		m_nExports.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	} catch(...){}
+	return false;
+}
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ILS_Logger.h"
+
+//=============================================================================
+/// Счётчики нагрузки на лог: сообщения и байты по приёмникам, LogId и уровням,
+/// сообщения, отсечённые порогом приёмника, и гистограммы времени вывода.
+/// @ingroup Kernel
+/// Счётчики пополняет MetricsLogger. Как и в SectProfiler, у каждого потока
+/// своя таблица (выровнена по строке кэша), поэтому потоки не конкурируют за
+/// общие данные. Счётчики таблицы пишет только поток-владелец, без блокировки
+/// и атомарного сложения; snapshot() читает их в любой момент. Приёмник
+/// задаётся номером (sinkNo(), получается один раз при создании
+/// MetricsLogger), идентификатор находится в кэше потока по адресу строки
+/// LogId; блокировка таблицы захватывается, только когда в ней появляется
+/// новый приёмник или идентификатор. При завершении потока его таблица
+/// добавляется к итогам завершившихся потоков, так что память не растёт с
+/// числом созданных потоков.
+///
+/// Внешние счётчики (количество ошибок BaseLogger::errorCount() и т.п.)
+/// подключаются addCounter() и читаются при каждом снимке; потери следующего
+/// логгера (StdLogger::dropped(), FanoutLogger::dropped(), MMapLogger::lost())
+/// MetricsLogger подключает сам под именем "<приёмник>.dropped". Количество
+/// сообщений, подавленных ограничением частоты, берётся из
+/// RateLimiter::suppressed().
+/// \see MetricsLogger, MetricsExporter
+class LogMetrics {
+public:
+	typedef ILogger::LogId LogId;
+	/// Корзин гистограммы времени вывода: [2^k, 2^(k+1)) нс, последняя - всё, что дольше.
+	enum { latencyBuckets = 32 };
+	/// Счётчики идентификатора в приёмнике.
+	struct TIdStats {
+		std::string id;
+		unsigned long long count[5];  ///< Сообщений по уровням ILS_LEVEL_DBG .. ILS_LEVEL_ERR.
+		unsigned long long bytes;     ///< Байт текста сообщений.
+	};
+	/// Счётчики приёмника.
+	struct TSinkStats {
+		std::string sink;
+		unsigned long long calls;      ///< Сообщений, переданных следующему логгеру.
+		unsigned long long filtered;   ///< Сообщений, отсечённых порогом следующего логгера.
+		long long total_ns, max_ns;    ///< Суммарное и наибольшее время вывода.
+		unsigned long long hist[latencyBuckets];
+		std::vector<TIdStats> ids;     ///< По идентификатору.
+	};
+	/// Снимок всех счётчиков.
+	struct TSnapshot {
+		long long wall_us;             ///< Время снимка, мкс от начала эпохи.
+		std::vector<TSinkStats> sinks; ///< По имени приёмника.
+		unsigned long long rate_suppressed;  ///< RateLimiter::suppressed().
+		std::vector<std::pair<std::string, unsigned long long> > counters;  ///< Внешние счётчики.
+	};
+	/// Глобальный реестр.
+	static LogMetrics& instance();
+	/// Включение/выключение учёта (по умолчанию включен).
+	void setActive(bool on) { m_bActive.store(on, std::memory_order_relaxed); }
+	bool isActive() const { return m_bActive.load(std::memory_order_relaxed); }
+	/// Номер приёмника для add() (один и тот же для одного имени).
+	unsigned sinkNo(const std::string& sink);
+	/// Учёт одного сообщения.
+	/// \param sink  - номер приёмника (sinkNo()).
+	/// \param id    - идентификатор сообщения.
+	/// \param level - уровень сообщения.
+	/// \param bytes - длина текста.
+	/// \param ns    - время вывода в наносекундах, -1 - сообщение отсечено порогом приёмника.
+	void add(unsigned sink, const LogId& id, int level, size_t bytes, long long ns);
+	/// Подключение внешнего счётчика (функция вызывается при каждом снимке).
+	/// \note Счётчик надо отключить removeCounter() до разрушения объекта, который он читает.
+	void addCounter(const std::string& name, std::function<unsigned long long()> read);
+	void removeCounter(const std::string& name);
+	/// Снимок счётчиков всех потоков.
+	TSnapshot snapshot() const;
+	/// Сброс счётчиков (внешние счётчики остаются подключёнными).
+	void reset();
+	/// Снимок в текстовом формате Prometheus (exposition format 0.0.4).
+	static void formatPrometheus(std::string& res, const TSnapshot& s);
+	/// Снимок в формате JSON (один объект).
+	static void formatJson(std::string& res, const TSnapshot& s);
+	/// Корзина гистограммы для времени \c ns.
+	static unsigned bucket(long long ns);
+	/// Время, не превышаемое долей \c q вызовов (верхняя граница корзины), нс.
+	static long long quantile(const TSinkStats& s, double q);
+private:
+	/// Счётчик таблицы потока: пишет только владелец, читает snapshot().
+	struct TCounter {
+		std::atomic<unsigned long long> v{ 0 };
+		void add(unsigned long long d) { v.store(v.load(std::memory_order_relaxed) + d, std::memory_order_relaxed); }
+		void set(unsigned long long x) { v.store(x, std::memory_order_relaxed); }
+		unsigned long long get() const { return v.load(std::memory_order_relaxed); }
+	};
+	struct TIdCounters {
+		std::string id;
+		TCounter count[5];
+		TCounter bytes;
+	};
+	struct TSinkCounters {
+		enum { idCache = 16 };
+		TCounter calls, filtered, total_ns, max_ns;
+		TCounter hist[latencyBuckets];
+		// Идентификаторы; дополняются владельцем под mutex таблицы
+		std::unordered_map<std::string, std::unique_ptr<TIdCounters> > ids;
+		// Кэш владельца: адрес строки LogId -> счётчики (текст сверяется с найденным)
+		struct { const LogId* key; TIdCounters* counters; } cache[idCache] = {};
+	};
+	struct alignas(64) TShard {
+		std::mutex mutex;  // Новые приёмники и идентификаторы, snapshot(), завершение потока
+		std::vector<std::unique_ptr<TSinkCounters> > sinks;  // По номеру приёмника
+		std::atomic<unsigned> gen{ 0 };  // Поколение reset(), к которому относятся счётчики
+	};
+	/// Итоги по именам приёмников и идентификаторов.
+	struct TTotals {
+		std::map<std::string, TSinkStats> sinks;
+		std::map<std::pair<std::string, std::string>, TIdStats> ids;
+	};
+	LogMetrics() : m_bActive(true), m_nGen(0) {}
+	/// Таблица текущего потока, NULL - поток завершается.
+	TShard* shard();
+	TSinkCounters& addSink(TShard& s, unsigned sink);
+	TIdCounters& addId(TShard& s, TSinkCounters& c, const LogId& id);
+	/// Обнуление счётчиков таблицы после reset() (вызывает владелец).
+	static void clear(TShard& s, unsigned gen);
+	/// Добавление счётчиков таблицы к итогам (под m_Mutex и mutex таблицы).
+	void merge(const TShard& s, TTotals& t) const;
+	/// Перенос таблицы завершившегося потока в итоги.
+	void retire(const std::shared_ptr<TShard>& s);
+	std::atomic<bool> m_bActive;
+	std::atomic<unsigned> m_nGen;  // Поколение reset()
+	mutable std::mutex m_Mutex;
+	std::vector<std::shared_ptr<TShard> > m_Shards;  // Таблицы работающих потоков
+	std::vector<std::string> m_SinkNames;            // Имена приёмников по номерам
+	TTotals m_Retired;                               // Итоги завершившихся потоков
+	std::vector<std::pair<std::string, std::function<unsigned long long()> > > m_Counters;
+}; //class LogMetrics
+
+//=============================================================================
+/// Логгер-счётчик: учитывает сообщения в LogMetrics и передаёт их дальше.
+/// @ingroup Kernel
+/// Ставится перед приёмником, нагрузку на который надо видеть:
+/// \code
+/// auto file = std::make_shared<StdLogger>("app.log");
+/// app.setPersonalLogger(std::make_shared<MetricsLogger>("file", file));
+/// MetricsExporter exporter("/var/lib/node_exporter/app_log.prom", 10000);
+/// \endcode
+/// Время вывода - время вызова функции вывода следующего логгера (для
+/// асинхронных приёмников - время постановки в очередь). Сообщения
+/// ILS_BLOG/ILS_BWRN передаются следующему логгеру без форматирования
+/// (rawOut()), если он это умеет; текст при этом не формируется, и размер
+/// таких сообщений в \c bytes не учитывается.
+class MetricsLogger : public ILogger {
+public:
+	/// Конструктор.
+	/// \param sink - имя приёмника в счётчиках (метка \c sink).
+	/// \param next - логгер, которому передаются все сообщения (может быть NULL).
+	MetricsLogger(const std::string& sink, std::shared_ptr<ILogger> next);
+	virtual ~MetricsLogger();
+	MetricsLogger(const MetricsLogger&) = delete;
+	MetricsLogger& operator=(const MetricsLogger&) = delete;
+	const std::string& sink() const { return m_sSink; }
+	//---------------------------------------------------------------------------
+public: // Функции интерфейса
+	virtual void infOut(MsgView msg, const LogId& id) const { count(ILS_LEVEL_INF, &ILogger::infOut, msg, id); }
+	virtual void logOut(MsgView msg, const LogId& id) const { count(ILS_LEVEL_LOG, &ILogger::logOut, msg, id); }
+	virtual void wrnOut(MsgView msg, const LogId& id) const { count(ILS_LEVEL_WRN, &ILogger::wrnOut, msg, id); }
+	virtual void errOut(MsgView msg, const LogId& id) const { count(ILS_LEVEL_ERR, &ILogger::errOut, msg, id); }
+	virtual bool rawOut(int level, const TFmtSite& site, const LogId& id, va_list marker) const;
+	virtual void sectOut(bool begin, const char* sect, std::chrono::steady_clock::time_point t) const { if (m_pNext) m_pNext->sectOut(begin, sect, t); }
+	virtual void incidentOut(const char* what) const { if (m_pNext) m_pNext->incidentOut(what); }
+	virtual double logParam(int param) const { return m_pNext ? m_pNext->logParam(param) : 0.; }
+protected:
+	virtual const char* msgTranslate(const LogId& id, const char* msg, Msg& buf) const;
+	/// Учёт сообщения и вывод в следующий логгер с замером времени.
+	void count(int level, TOutFunc out, MsgView msg, const LogId& id) const;
+	std::string m_sSink;
+	unsigned m_nSink;           // Номер приёмника в LogMetrics
+	std::string m_sDropped;     // Имя счётчика потерь следующего логгера, пустое - не подключён
+	std::shared_ptr<ILogger> m_pNext;
+}; //class MetricsLogger
+
+//=============================================================================
+/// Периодическая запись снимков LogMetrics в файл.
+/// @ingroup Kernel
+/// Фоновый поток раз в \c interval_ms записывает снимок во временный файл и
+/// переименовывает его в \c file, так что читатель (например, textfile
+/// collector node_exporter) никогда не видит файл наполовину записанным.
+/// Последний снимок записывается в деструкторе.
+class MetricsExporter {
+public:
+	/// Формат файла.
+	enum TFormat { fmtPrometheus, fmtJson };
+	/// Конструктор, запускает фоновый поток.
+	/// \param file        - имя файла снимка.
+	/// \param interval_ms - период записи, мс.
+	/// \param format      - формат.
+	MetricsExporter(const std::string& file, unsigned interval_ms = 10000, TFormat format = fmtPrometheus);
+	~MetricsExporter();
+	MetricsExporter(const MetricsExporter&) = delete;
+	MetricsExporter& operator=(const MetricsExporter&) = delete;
+	/// Немедленная запись снимка.
+	/// \return false, если файл не удалось записать.
+	bool exportNow();
+	/// Количество записанных снимков.
+	unsigned long long exports() const { return m_nExports.load(std::memory_order_relaxed); }
+private:
+	void run();
+	const std::string m_sFile;
+	const unsigned m_nInterval;
+	const TFormat m_Format;
+	std::mutex m_WriteMutex;  // Запись файла (фоновый поток и exportNow())
+	std::mutex m_Mutex;
+	std::condition_variable m_Cond;
+	bool m_bStop;
+	std::atomic<unsigned long long> m_nExports;
+	std::thread m_Thread;
+}; //class MetricsExporter
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <stdarg.h>
+
+//=============================================================================
+/// Строка с буфером в самом объекте для формирования сообщения.
+/// @ingroup Kernel
+/// Первые \c N - 1 символов хранятся внутри объекта, и только более длинный
+/// текст переносится в динамическую память. Объект создаётся на стеке
+/// (TLoggerStream), поэтому формирование обычной строки лога не выделяет
+/// память вовсе.
+///
+/// put() - форматирование значений как у \c std::ostream с настройками по
+/// умолчанию (целые - десятичные, вещественные - "%g", указатели - "%p",
+/// bool - 0/1), но без потока, локали и промежуточных строк. Остальные типы
+/// выводятся через их operator<< во временный \c std::ostringstream.
+///
+/// Текст всегда завершается нулём (c_str()).
+/// \param N - размер буфера в объекте.
+template<size_t N> class TMsgBuf {
+	char m_Inline[N];
+	char* m_pData;
+	size_t m_nSize;
+	size_t m_nCap;  // Ёмкость без завершающего нуля
+	/// Увеличение ёмкости до \c need символов и более.
+	void grow(size_t need) {
+		size_t cap = m_nCap * 2;
+		if (cap < need) cap = need;
+		char* p = new char[cap + 1];
+		memcpy(p, m_pData, m_nSize + 1);
+		if (m_pData != m_Inline) delete[] m_pData;
+		m_pData = p;
+		m_nCap = cap;
+	}
+	/// Место под \c n символов в конце строки.
+	char* tail(size_t n) {
+		if (m_nSize + n > m_nCap) grow(m_nSize + n);
+		return m_pData + m_nSize;
+	}
+	/// Фиксация \c n символов, записанных по tail().
+	void commit(size_t n) { m_nSize += n; m_pData[m_nSize] = 0; }
+	template<class T> void putInt(T v) {
+		char* p = tail(24);
+		commit(std::to_chars(p, p + 24, v).ptr - p);
+	}
+	void putFloat(double v) {
+		char* p = tail(32);
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+		// Формат general с точностью 6 совпадает с "%g" (и с std::ostream)
+		commit(std::to_chars(p, p + 32, v, std::chars_format::general, 6).ptr - p);
+#else
+		commit(snprintf(p, 33, "%g", v));
+#endif
+	}
+public:
+	TMsgBuf() : m_pData(m_Inline), m_nSize(0), m_nCap(N - 1) { m_Inline[0] = 0; }
+	~TMsgBuf() { if (m_pData != m_Inline) delete[] m_pData; }
+	TMsgBuf(const TMsgBuf&) = delete;
+	TMsgBuf& operator=(const TMsgBuf&) = delete;
+	char* data() { return m_pData; }
+	const char* data() const { return m_pData; }
+	const char* c_str() const { return m_pData; }
+	size_t size() const { return m_nSize; }
+	bool empty() const { return !m_nSize; }
+	std::string_view view() const { return std::string_view(m_pData, m_nSize); }
+	/// Очистка (ёмкость сохраняется).
+	void clear() { m_nSize = 0; m_pData[0] = 0; }
+	//---------------------------------------------------------------------------
+	void append(const char* s, size_t n) {
+		memcpy(tail(n), s, n);
+		commit(n);
+	}
+	void append(std::string_view s) { append(s.data(), s.size()); }
+	void push_back(char c) {
+		*tail(1) = c;
+		commit(1);
+	}
+	/// Форматирование по принципу \c printf() с дописыванием в конец.
+	/// Длина результата не ограничена.
+	void vappendf(const char* fmt, va_list marker) {
+		va_list args;
+		va_copy(args, marker);
+		const size_t avail = m_nCap - m_nSize;
+		int n = vsnprintf(m_pData + m_nSize, avail + 1, fmt, args);
+		va_end(args);
+		if (n < 0) { m_pData[m_nSize] = 0; return; }
+		if (size_t(n) > avail) {
+			char* p = tail(size_t(n));
+			va_copy(args, marker);
+			vsnprintf(p, size_t(n) + 1, fmt, args);
+			va_end(args);
+		}
+		commit(size_t(n));
+	}
+	void appendf(const char* fmt, ...) {
+		va_list marker;
+		va_start(marker, fmt);
+		vappendf(fmt, marker);
+		va_end(marker);
+	}
+	//---------------------------------------------------------------------------
+	/// Вывод значения (как \c std::ostream::operator<<).
+	void put(const char* s) { if (s) append(s, strlen(s)); }
+	void put(const std::string& s) { append(s.data(), s.size()); }
+	void put(std::string_view s) { append(s); }
+	void put(char c) { push_back(c); }
+	void put(signed char c) { push_back(char(c)); }
+	void put(unsigned char c) { push_back(char(c)); }
+	void put(bool b) { push_back(b ? '1' : '0'); }
+	void put(float v) { putFloat(v); }
+	void put(double v) { putFloat(v); }
+	void put(long double v) {
+		char* p = tail(48);
+		commit(snprintf(p, 49, "%Lg", v));
+	}
+	void put(const void* v) {
+		char* p = tail(32);
+		commit(snprintf(p, 33, "%p", v));
+	}
+	template<class T> void put(const T* v) { put(static_cast<const void*>(v)); }
+	template<class T> typename std::enable_if<std::is_integral<T>::value>::type put(T v) { putInt(v); }
+	template<class T> typename std::enable_if<!std::is_arithmetic<T>::value && !std::is_pointer<T>::value>::type
+	put(const T& v) {
+		std::ostringstream out;
+		out << v;
+		const std::string s = out.str();
+		append(s.data(), s.size());
+	}
+}; //class TMsgBuf
@@ -0,0 +1,189 @@
+#include <fstream>
+#include "ILS_FmtSite.h"
+#include "ILS_Logger.h"
+#include "ILS_MsgCatalog.h"
+
+namespace {
+	// Замена ключа %t (время, в том числе с флагами, шириной и точностью) на %f.
+	// "%%t" и модификатор длины "%td" не меняются. Возвращает true, если формат изменён.
+	bool rewriteTime(std::string& fmt) {
+		std::vector<TFmtSpec> specs;
+		ils_parse_format(fmt.c_str(), specs);
+		bool changed = false;
+		for (const TFmtSpec& s : specs)
+			if (s.conv == 't') { fmt[s.end - 1] = 'f'; changed = true; }
+		return changed;
+	}
+	// Типы аргументов формата по порядку
+	bool argKinds(const std::string& fmt, std::vector<TArgKind>& kinds) {
+		std::vector<TFmtSpec> specs;
+		const bool ok = ils_parse_format(fmt.c_str(), specs);
+		for (const TFmtSpec& s : specs) {
+			for (int k = 0; k < s.stars; ++k) kinds.push_back(akInt);
+			if (s.kind != akNone) kinds.push_back(s.kind);
+		}
+		return ok;
+	}
+	// Снятие экранирования \t \n \\ в строке каталога
+	std::string unescape(const std::string& s) {
+		std::string res;
+		res.reserve(s.size());
+		for (size_t i = 0; i < s.size(); ++i) {
+			if (s[i] != '\\' || i + 1 == s.size()) { res += s[i]; continue; }
+			const char c = s[++i];
+			res += c == 't' ? '\t' : c == 'n' ? '\n' : c;
+		}
+		return res;
+	}
+}
+
+//=============================================================================
+// MsgCatalog - каталог переводов и кэш подготовленных форматов.
+//-----------------------------------------------------------------------------
+MsgCatalog& MsgCatalog::instance() {
+	// Объект не разрушается: сообщения могут выводиться в деструкторах статических объектов
+	static MsgCatalog* p = new MsgCatalog();
+	return *p;
+}
+MsgCatalog::MsgCatalog() : m_pTable(NULL), m_nCached(0), m_bTranslations(false), m_pTranslations(NULL) {
+	m_Table = std::make_shared<TTable>(1024);
+	m_Table->strings = std::make_shared<std::deque<std::string> >();
+	m_pTable.store(m_Table.get(), std::memory_order_release);
+}
+bool MsgCatalog::addLocked(const std::string& msg, const std::string& translation) {
+	std::vector<TArgKind> a, b;
+	if (!argKinds(msg, a) || !argKinds(translation, b) || a != b) return false;
+	m_Translations[msg] = translation;
+	return true;
+}
+void MsgCatalog::publishLocked() {
+	// Снимок переводов: форматы уже подготовлены, тексты не меняются
+	std::shared_ptr<TTranslations> tr = std::make_shared<TTranslations>();
+	tr->map.reserve(m_Translations.size());
+	for (const auto& t : m_Translations) {
+		tr->strings.push_back(t.first);
+		const std::string_view key(tr->strings.back());
+		tr->strings.push_back(t.second);
+		rewriteTime(tr->strings.back());
+		tr->map[key] = tr->strings.back().c_str();
+	}
+	// Запомненные константы готовятся заново в новой таблице
+	std::shared_ptr<TTable> t = std::make_shared<TTable>(m_Table->mask + 1);
+	t->translations = tr;
+	t->strings = std::make_shared<std::deque<std::string> >();
+	m_pTranslations.store(tr.get(), std::memory_order_release);
+	m_bTranslations.store(!m_Translations.empty(), std::memory_order_relaxed);
+	m_nCached.store(0, std::memory_order_relaxed);
+	m_pTable.store(t.get(), std::memory_order_release);
+	// Прежние снимок и таблицу ещё могут читать другие потоки
+	LogReaders::retire(std::move(m_Snapshot));
+	LogReaders::retire(std::move(m_Table));
+	m_Snapshot = std::move(tr);
+	m_Table = std::move(t);
+	std::vector<const char*> literals;
+	literals.swap(m_Static);
+	for (const char* l : literals) insertLocked(l);
+	LogReaders::reclaim();
+}
+bool MsgCatalog::add(const std::string& msg, const std::string& translation) {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (!addLocked(msg, translation)) return false;
+	publishLocked();
+	return true;
+}
+size_t MsgCatalog::size() const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Translations.size();
+}
+bool MsgCatalog::load(const std::string& file, std::string* error) {
+	std::ifstream in(file.c_str());
+	if (!in) {
+		if (error) *error += file + ": не удалось открыть файл\n";
+		return false;
+	}
+	// Переводы файла публикуются один раз
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	std::string line;
+	for (unsigned n = 1; std::getline(in, line); ++n) {
+		if (!line.empty() && line.back() == '\r') line.pop_back();
+		if (n == 1 && line.compare(0, 3, "\xEF\xBB\xBF") == 0) line.erase(0, 3);
+		if (line.empty() || line[0] == '#') continue;
+		const size_t tab = line.find('\t');
+		const char* problem = NULL;
+		if (tab == std::string::npos) problem = "нет табуляции между форматом и переводом";
+		else if (!addLocked(unescape(line.substr(0, tab)), unescape(line.substr(tab + 1))))
+			problem = "спецификаторы формата перевода не совпадают с исходными";
+		if (problem && error) *error += file + ":" + std::to_string(n) + ": " + problem + "\n";
+	}
+	publishLocked();
+	return true;
+}
+//-----------------------------------------------------------------------------
+// Подготовка форматов
+void MsgCatalog::addStatic(const char* literal) const {
+	// Таблица освобождается через LogReaders после замены
+	LogReaders::TGuard guard;
+	std::string buf;
+	translateStatic(literal, buf);
+}
+const char* MsgCatalog::prepare(const char* msg, std::string& buf) const {
+	if (const TTranslations* tr = m_pTranslations.load(std::memory_order_acquire)) {
+		const auto t = tr->map.find(std::string_view(msg));
+		if (t != tr->map.end()) return t->second;
+	}
+	if (!strchr(msg, 't')) return msg;
+	buf = msg;
+	return rewriteTime(buf) ? buf.c_str() : msg;
+}
+const char* MsgCatalog::insert(const char* msg, std::string& buf, TMsgSlot* slot) const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	// Константа могла быть запомнена другим потоком
+	const TEntry* e = find(m_Table.get(), msg);
+	if (!e) {
+		if (m_nCached.load(std::memory_order_relaxed) >= maxCached) return prepare(msg, buf);
+		e = insertLocked(msg);
+	}
+	if (slot) slot->entry.store(e, std::memory_order_relaxed);
+	return e->value;
+}
+const MsgCatalog::TEntry* MsgCatalog::insertLocked(const char* msg) const {
+	TTable* t = m_Table.get();
+	// Рост таблицы до заполнения наполовину: новая таблица публикуется целиком
+	if ((t->count + 1) * 2 > t->mask + 1) {
+		std::shared_ptr<TTable> nt = std::make_shared<TTable>((t->mask + 1) * 2);
+		for (size_t k = 0; k <= t->mask; ++k) {
+			const TEntry& e = t->entries[k];
+			const char* key = e.key.load(std::memory_order_relaxed);
+			if (!key) continue;
+			size_t j = hash(key) & nt->mask;
+			while (nt->entries[j].key.load(std::memory_order_relaxed)) j = (j + 1) & nt->mask;
+			TEntry& d = nt->entries[j];
+			d.value = e.value;
+			d.key.store(key, std::memory_order_relaxed);
+		}
+		nt->count = t->count;
+		nt->translations = t->translations;
+		nt->strings = t->strings;
+		t = nt.get();
+		m_pTable.store(t, std::memory_order_release);
+		LogReaders::retire(std::move(m_Table));
+		m_Table = std::move(nt);
+		LogReaders::reclaim();
+	}
+	size_t i = hash(msg) & t->mask;
+	while (t->entries[i].key.load(std::memory_order_relaxed)) i = (i + 1) & t->mask;
+	TEntry& e = t->entries[i];
+	std::string buf;
+	const char* res = prepare(msg, buf);
+	if (res == buf.c_str()) {
+		t->strings->push_back(std::move(buf));
+		res = t->strings->back().c_str();
+	}
+	e.value = res;
+	++t->count;
+	m_Static.push_back(msg);
+	m_nCached.fetch_add(1, std::memory_order_relaxed);
+	// Запись становится видна читателям только после заполнения
+	e.key.store(msg, std::memory_order_release);
+	return &e;
+}
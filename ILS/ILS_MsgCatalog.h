@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+//=============================================================================
+/// Запомненный формат места вызова (статическая переменная макросов ILS_LOG, ILS_WRN ...).
+/// @ingroup Kernel
+/// Хранит запись таблицы MsgCatalog, найденную для формата места вызова;
+/// следующий вызов берёт подготовленный формат без поиска в таблице.
+struct TMsgSlot {
+	std::atomic<const void*> entry{ NULL };  ///< Запись таблицы каталога, NULL - ещё не найдена.
+};
+
+//=============================================================================
+/// Каталог переводов сообщений с кэшем подготовленных форматов.
+/// @ingroup Kernel
+/// Используется ILogger::msgTranslate() по умолчанию. Формат места вызова,
+/// который заведомо является строковой константой (TFmtSite макросов ILS_B*,
+/// ILS_FMT, TMsgSlot макросов ILS_LOG/ILS_WRN), переводится по каталогу и
+/// получает замену ключа %t на %f один раз; результат запоминается в таблице,
+/// ключ которой - адрес константы. Следующие вызовы с тем же форматом получают
+/// готовую строку по одному сравнению адреса, без копирования, хэширования и
+/// сравнения текста, а место вызова с TMsgSlot - без поиска в таблице.
+///
+/// Остальные форматы (переданные как const char*, в том числе собранные в
+/// изменяемой строке) не запоминаются: перевод ищется по тексту в снимке
+/// переводов, и строка копируется, только если в ней есть ключ %t без
+/// перевода.
+///
+/// Чтение не захватывает блокировок. Таблица и снимок переводов при
+/// изменении заменяются новыми, а прежние освобождаются через LogReaders:
+/// результат translate() действителен внутри отметки чтения (её ставят
+/// функции регистрации ILogger).
+///
+/// Каталог загружается из файла при запуске приложения:
+/// \code
+/// MsgCatalog::instance().load("ru.cat");
+/// \endcode
+/// Файл в UTF-8, по записи на строку: исходный формат и перевод через табуляцию,
+/// внутри текста - \\t, \\n и \\\\. Строки, начинающиеся с '#', и пустые
+/// пропускаются. Перевод принимается, только если его спецификаторы формата
+/// (типы аргументов по порядку) совпадают с исходными.
+class MsgCatalog {
+public:
+	/// Наибольшее количество запоминаемых констант; остальные переводятся при каждом вызове.
+	enum { maxCached = 1 << 16 };
+	/// Глобальный каталог.
+	static MsgCatalog& instance();
+	/// Загрузка переводов из файла (добавляются к уже загруженным).
+	/// \param file  - имя файла.
+	/// \param error - сюда дописываются описания отвергнутых строк (может быть NULL).
+	/// \return false, если файл не удалось открыть.
+	bool load(const std::string& file, std::string* error = NULL);
+	/// Добавление перевода.
+	/// \return false, если спецификаторы формата перевода не совпадают с исходными.
+	bool add(const std::string& msg, const std::string& translation);
+	/// Количество переводов.
+	size_t size() const;
+	/// Количество запомненных констант.
+	size_t cached() const { return m_nCached.load(std::memory_order_relaxed); }
+	/// Есть ли переводы (иначе форматы ILS_FMT не нуждаются в подготовке).
+	bool hasTranslations() const { return m_bTranslations.load(std::memory_order_relaxed); }
+	/// Подготовленный формат: перевод и замена %t на %f.
+	/// Запомненная константа находится по адресу, остальные форматы - по тексту в снимке переводов.
+	/// \param msg - исходный формат.
+	/// \param buf - буфер для результата, если формат содержит %t без перевода.
+	/// \return - \c msg, запомненная или переведённая строка или \c buf.c_str().
+	const char* translate(const char* msg, std::string& buf) const {
+		const TTable* t = m_pTable.load(std::memory_order_acquire);
+		if (const TEntry* e = find(t, msg)) return e->value;
+		return prepare(msg, buf);
+	}
+	/// Подготовленный формат места вызова \c slot (формат - строковая константа, запоминается).
+	const char* translate(const char* msg, std::string& buf, TMsgSlot& slot) const {
+		const TTable* t = m_pTable.load(std::memory_order_acquire);
+		// Запись годится, только если она из действующей таблицы и для этого формата
+		const TEntry* e = static_cast<const TEntry*>(slot.entry.load(std::memory_order_relaxed));
+		if (e && e >= &t->entries[0] && e <= &t->entries[t->mask] && e->key.load(std::memory_order_acquire) == msg) return e->value;
+		if ((e = find(t, msg))) {
+			slot.entry.store(e, std::memory_order_relaxed);
+			return e->value;
+		}
+		return insert(msg, buf, &slot);
+	}
+	/// Подготовленный формат строковой константы (запоминается при первом вызове).
+	const char* translateStatic(const char* literal, std::string& buf) const {
+		const TTable* t = m_pTable.load(std::memory_order_acquire);
+		if (const TEntry* e = find(t, literal)) return e->value;
+		return insert(literal, buf, NULL);
+	}
+	/// Запоминание строковой константы (формата места вызова), чтобы translate() находил её по адресу.
+	void addStatic(const char* literal) const;
+private:
+	struct TEntry {
+		std::atomic<const char*> key{ NULL };
+		const char* value = NULL;   // Подготовленный формат (может совпадать с key)
+	};
+	/// Снимок переводов: исходный формат - подготовленный перевод (тексты в strings).
+	struct TTranslations {
+		std::deque<std::string> strings;
+		std::unordered_map<std::string_view, const char*> map;
+	};
+	struct TTable {
+		size_t mask;
+		std::unique_ptr<TEntry[]> entries;
+		size_t count = 0;
+		/// Снимок переводов, на тексты которого ссылаются записи.
+		std::shared_ptr<const TTranslations> translations;
+		/// Форматы с заменой %t без перевода (общие с таблицей, из которой выросла эта).
+		std::shared_ptr<std::deque<std::string> > strings;
+		explicit TTable(size_t size) : mask(size - 1), entries(new TEntry[size]) {}
+	};
+	MsgCatalog();
+	static size_t hash(const char* p) {
+		return size_t((uint64_t(reinterpret_cast<uintptr_t>(p)) * 0x9E3779B97F4A7C15ULL) >> 20);
+	}
+	/// Поиск формата в таблице, NULL - не запомнен.
+	static const TEntry* find(const TTable* t, const char* msg) {
+		for (size_t i = hash(msg) & t->mask;; i = (i + 1) & t->mask) {
+			const TEntry& e = t->entries[i];
+			const char* key = e.key.load(std::memory_order_acquire);
+			if (!key) return NULL;
+			if (key == msg) return &e;
+		}
+	}
+	/// Подготовка формата без запоминания.
+	const char* prepare(const char* msg, std::string& buf) const;
+	/// Подготовка строковой константы и запоминание результата (и записи в \c slot, если задан).
+	const char* insert(const char* msg, std::string& buf, TMsgSlot* slot) const;
+	/// Запись подготовленного формата в текущую таблицу (под блокировкой).
+	const TEntry* insertLocked(const char* msg) const;
+	/// Добавление перевода без публикации (под блокировкой).
+	bool addLocked(const std::string& msg, const std::string& translation);
+	/// Публикация снимка переводов и новой таблицы с заново подготовленными константами (под блокировкой).
+	void publishLocked();
+	mutable std::mutex m_Mutex;
+	mutable std::atomic<TTable*> m_pTable;
+	mutable std::shared_ptr<TTable> m_Table;                  // Действующая таблица (владелец)
+	mutable std::atomic<size_t> m_nCached;
+	mutable std::vector<const char*> m_Static;                // Запомненные константы
+	std::atomic<bool> m_bTranslations;
+	std::unordered_map<std::string, std::string> m_Translations;
+	std::atomic<const TTranslations*> m_pTranslations;        // Действующий снимок переводов
+	std::shared_ptr<const TTranslations> m_Snapshot;          // Действующий снимок (владелец)
+}; //class MsgCatalog
@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "ILS_RateLimit.h"
+
+namespace {
+	struct TRateTag;
+	inline long long nowNs() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+	// Имя файла без пути
+	inline const char* baseName(const char* file) {
+		const char* p = file;
+		for (const char* s = file; *s; ++s)
+			if (*s == '/' || *s == '\\') p = s + 1;
+		return p;
+	}
+	// Вывод сообщения функцией вывода его уровня
+	void levelOutput(const ILogger* log, int level, ILogger::MsgView msg) {
+		static const ILogger::LogId id("RateLimit");
+		switch (level) {
+		case ILS_LEVEL_INF: log->infOut(msg, id); break;
+		case ILS_LEVEL_WRN: log->wrnOut(msg, id); break;
+		case ILS_LEVEL_ERR: log->errOut(msg, id); break;
+		default: log->logOut(msg, id);
+		}
+	}
+}
+
+//=============================================================================
+// TRateSite - ограничение частоты сообщений места вызова.
+//-----------------------------------------------------------------------------
+TRateSite::TRateSite(const char* file, unsigned line, double per_sec, unsigned burst, const char* text)
+	: m_pFile(file), m_nLine(line),
+	  m_nInterval(per_sec > 0. ? std::max(1LL, (long long)std::llround(1e9 / per_sec)) : 0),
+	  m_nBurst(std::max(burst, 1u)), m_nTat(0), m_nPending(0), m_nSuppressed(0),
+	  m_nBurstStart(0), m_nLevel(ILS_LEVEL_LOG), m_pText(text), m_nLastTime(0), m_nRepeats(0), m_pNext(NULL) {
+	RateLimiter::add(this);
+}
+// GCRA: сообщение проходит, если после него "долг" по времени не превысит серию
+bool TRateSite::check(const ILogger* log, int level) {
+	long long interval = m_nInterval;
+	unsigned burst = m_nBurst;
+	if (!interval) {
+		interval = defaultInterval().load(std::memory_order_relaxed);
+		burst = std::max(defaultBurst().load(std::memory_order_relaxed), 1u);
+		if (!interval) return true;
+	}
+	m_nLevel.store(level, std::memory_order_relaxed);
+	const long long now = nowNs();
+	long long tat = m_nTat.load(std::memory_order_relaxed);
+	for (;;) {
+		const long long next = std::max(tat, now) + interval;
+		if (next - now > interval * (long long)burst) {
+			if (m_nPending.fetch_add(1, std::memory_order_relaxed) == 0)
+				m_nBurstStart.store(now, std::memory_order_relaxed);
+			m_nSuppressed.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		if (m_nTat.compare_exchange_weak(tat, next, std::memory_order_relaxed)) break;
+	}
+	// Серия закончилась: её итог выводится перед сообщением
+	summary(log, level, now);
+	return true;
+}
+void TRateSite::summary(const ILogger* log, int level, long long now) {
+	if (!m_nPending.load(std::memory_order_relaxed)) return;
+	const unsigned long long n = m_nPending.exchange(0, std::memory_order_acq_rel);
+	if (!n || !log) return;
+	const long long start = m_nBurstStart.load(std::memory_order_relaxed);
+	try {
+		TThreadBuf<TRateTag> text;
+		text.str() = "Сообщение ";
+		if (m_pText) ils_appendf(text.str(), "\"%s\" (%s:%u)", m_pText, baseName(m_pFile), m_nLine);
+		else {
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (!m_sLast.empty()) ils_appendf(text.str(), "\"%s\" (%s:%u)", m_sLast.c_str(), baseName(m_pFile), m_nLine);
+			else ils_appendf(text.str(), "%s:%u", baseName(m_pFile), m_nLine);
+		}
+		ils_appendf(text.str(), " повторено ещё %llu раз за %.3f с (ограничение частоты)",
+			n, double(std::max(now - start, 0LL)) / 1e9);
+		levelOutput(log, level, text.str());
+	}
+	catch (...) {}
+}
+// Повтор последнего выведенного текста в окне схлопывания не выводится
+bool TRateSite::repeat(const ILogger* log, int level, std::string_view text, const std::string& id) {
+	const long long window = collapseWindow().load(std::memory_order_relaxed);
+	const long long now = nowNs();
+	m_nLevel.store(level, std::memory_order_relaxed);
+	try {
+		TThreadBuf<TRateTag> res;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (window && text == m_sLast && now - m_nLastTime < window) {
+				++m_nRepeats;
+				return true;
+			}
+			// Другой текст или окно истекло: итог повторов - перед сообщением
+			repeatSummary(res.str(), now);
+			m_sLast.assign(text.data(), text.size());
+			m_nLastTime = now;
+		}
+		if (!res.str().empty() && log) levelOutput(log, level, res.str());
+	}
+	catch (...) {}
+	return false;
+}
+void TRateSite::repeatSummary(std::string& res, long long now) {
+	res.clear();
+	if (!m_nRepeats) return;
+	ils_appendf(res, "%s (повторено ещё %llu раз за %.3f с)", m_sLast.c_str(), m_nRepeats,
+		double(std::max(now - m_nLastTime, 0LL)) / 1e9);
+	m_nRepeats = 0;
+}
+void TRateSite::flushExpired(const ILogger* log, long long now) {
+	const int level = m_nLevel.load(std::memory_order_relaxed);
+	if (!log->logEnabled(level)) return;
+	// Серия закончилась, если "ведро" опустело: следующее сообщение прошло бы
+	if (pending() && m_nTat.load(std::memory_order_relaxed) <= now) summary(log, level, now);
+	try {
+		TThreadBuf<TRateTag> res;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			const long long window = collapseWindow().load(std::memory_order_relaxed);
+			if (!m_nRepeats || now - m_nLastTime < window) return;
+			repeatSummary(res.str(), now);
+			// Следующий такой же текст выводится как новый
+			m_sLast.clear();
+		}
+		levelOutput(log, level, res.str());
+	}
+	catch (...) {}
+}
+
+//=============================================================================
+// RateLimiter - общие настройки и статистика.
+//-----------------------------------------------------------------------------
+std::atomic<TRateSite*>& RateLimiter::head() {
+	static std::atomic<TRateSite*> h(NULL);
+	return h;
+}
+void RateLimiter::add(TRateSite* site) {
+	TRateSite* h = head().load(std::memory_order_relaxed);
+	do site->m_pNext = h;
+	while (!head().compare_exchange_weak(h, site, std::memory_order_release, std::memory_order_relaxed));
+}
+void RateLimiter::setDefault(double per_sec, unsigned burst) {
+	TRateSite::defaultBurst().store(std::max(burst, 1u), std::memory_order_relaxed);
+	TRateSite::defaultInterval().store(per_sec > 0. ? std::max(1LL, (long long)std::llround(1e9 / per_sec)) : 0,
+		std::memory_order_relaxed);
+}
+void RateLimiter::getDefault(double& per_sec, unsigned& burst) {
+	const long long interval = TRateSite::defaultInterval().load(std::memory_order_relaxed);
+	per_sec = interval > 0 ? 1e9 / double(interval) : 0.;
+	burst = TRateSite::defaultBurst().load(std::memory_order_relaxed);
+}
+void RateLimiter::setCollapse(double window_sec) {
+	TRateSite::collapseWindow().store(window_sec > 0. ? std::max(1LL, (long long)std::llround(window_sec * 1e9)) : 0,
+		std::memory_order_relaxed);
+}
+void RateLimiter::flushSummaries(const ILogger& log) {
+	const long long now = nowNs();
+	for (TRateSite* s = head().load(std::memory_order_acquire); s; s = s->m_pNext) {
+		const int level = s->m_nLevel.load(std::memory_order_relaxed);
+		if (!log.logEnabled(level)) continue;
+		if (s->pending()) s->summary(&log, level, now);
+		try {
+			TThreadBuf<TRateTag> res;
+			{
+				std::lock_guard<std::mutex> lock(s->m_Mutex);
+				s->repeatSummary(res.str(), now);
+				if (!res.str().empty()) s->m_sLast.clear();
+			}
+			if (!res.str().empty()) levelOutput(&log, level, res.str());
+		}
+		catch (...) {}
+	}
+}
+void RateLimiter::flushExpired(const ILogger& log) {
+	const long long now = nowNs();
+	for (TRateSite* s = head().load(std::memory_order_acquire); s; s = s->m_pNext) s->flushExpired(&log, now);
+}
+std::vector<RateLimiter::TSiteStats> RateLimiter::stats() {
+	std::vector<TSiteStats> res;
+	for (TRateSite* s = head().load(std::memory_order_acquire); s; s = s->m_pNext) {
+		const unsigned long long n = s->suppressed();
+		if (n) res.push_back(TSiteStats{ s->file(), s->line(), n, s->pending() });
+	}
+	return res;
+}
+unsigned long long RateLimiter::suppressed() {
+	unsigned long long n = 0;
+	for (TRateSite* s = head().load(std::memory_order_acquire); s; s = s->m_pNext) n += s->suppressed();
+	return n;
+}
+
+//=============================================================================
+// RateSummaryFlusher - вывод итогов закончившихся серий по таймеру.
+//-----------------------------------------------------------------------------
+RateSummaryFlusher::RateSummaryFlusher(std::shared_ptr<ILogger> log, unsigned period_ms)
+	: m_pLog(log), m_nPeriod(period_ms ? period_ms : 1), m_bStop(false) {
+	m_Thread = std::thread(&RateSummaryFlusher::run, this);
+}
+RateSummaryFlusher::~RateSummaryFlusher() {
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_bStop = true;
+	}
+	m_Cond.notify_all();
+	if (m_Thread.joinable()) m_Thread.join();
+	if (m_pLog) RateLimiter::flushSummaries(*m_pLog);
+}
+void RateSummaryFlusher::run() {
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (!m_bStop) {
+		if (m_Cond.wait_for(lock, std::chrono::milliseconds(m_nPeriod), [this] { return m_bStop; })) break;
+		lock.unlock();
+		if (m_pLog) RateLimiter::flushExpired(*m_pLog);
+		lock.lock();
+	}
+}
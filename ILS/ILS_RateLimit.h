@@ -0,0 +1,186 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ILS_Logger.h"
+
+//=============================================================================
+/// Ограничение частоты сообщений места вызова (макросы ILS_LOG, ILS_WRN, ILS_BLOG ...).
+/// @ingroup Kernel
+/// Каждое место вызова получает статический объект TRateSite с собственным
+/// "ведром токенов" (алгоритм GCRA: одно атомарное время на место вызова).
+/// Проверка выполняется до форматирования сообщения, поэтому подавленное
+/// сообщение не стоит ничего, кроме чтения часов и одного атомарного счётчика.
+///
+/// Подавленные сообщения считаются; когда частота снова укладывается в
+/// ограничение, перед очередным сообщением выводится итог серии:
+/// "Сообщение "текст" (file:line) повторено ещё N раз за T с". Текст - последнее
+/// выведенное сообщение места (для макросов ILS_B* - строка формата). Итоги
+/// серий, после которых сообщений больше не было, выводит
+/// RateLimiter::flushExpired() по окончании серии (например, из
+/// RateSummaryFlusher по таймеру) или RateLimiter::flushSummaries().
+///
+/// Кроме того, одинаковые подряд сообщения места вызова можно схлопывать
+/// (RateLimiter::setCollapse()): повтор того же текста в течение окна не
+/// выводится, а по окончании окна или перед другим сообщением выводится
+/// "текст (повторено ещё N раз за T с)". Схлопываются сообщения макросов
+/// ILS_LOG, ILS_WRN и т.п., текст которых формируется сразу (а не в логгере
+/// с отложенным форматированием).
+///
+/// По умолчанию ограничения нет; оно включается для всех мест вызова
+/// RateLimiter::setDefault() или для одного места макросами ILS_LOG_LIMIT,
+/// ILS_WRN_LIMIT. Пока ограничение выключено, проверка - два чтения.
+/// \see RateLimiter
+class TRateSite {
+public:
+	/// Конструктор.
+	/// \param file    - файл места вызова.
+	/// \param line    - строка места вызова.
+	/// \param per_sec - собственное ограничение (сообщений в секунду), 0 - общее (RateLimiter::setDefault()).
+	/// \param burst   - допустимая серия сообщений подряд (для собственного ограничения).
+	/// \param text    - текст сообщения для итога серии (строка формата), NULL - последнее выведенное.
+	TRateSite(const char* file, unsigned line, double per_sec = 0., unsigned burst = 1, const char* text = NULL);
+	TRateSite(const TRateSite&) = delete;
+	TRateSite& operator=(const TRateSite&) = delete;
+	/// Можно ли выводить сообщение.
+	/// \param log   - логгер, в который выводится итог подавленной серии.
+	/// \param level - уровень сообщения.
+	bool allow(const ILogger* log, int level) {
+		if (!m_nInterval && !defaultInterval().load(std::memory_order_relaxed)) return true;
+		return check(log, level);
+	}
+	/// Учёт сформированного сообщения: запоминание текста для итога серии и
+	/// схлопывание повторов (RateLimiter::setCollapse()).
+	/// \param log   - логгер, в который выводится итог повторов.
+	/// \param level - уровень сообщения.
+	/// \param text  - текст сообщения.
+	/// \param id    - идентификатор сообщения.
+	/// \return true, если сообщение - повтор и выводить его не надо.
+	bool collapse(const ILogger* log, int level, std::string_view text, const std::string& id) {
+		if (!collapseWindow().load(std::memory_order_relaxed) && !m_nInterval && !defaultInterval().load(std::memory_order_relaxed))
+			return false;
+		return repeat(log, level, text, id);
+	}
+	const char* file() const { return m_pFile; }
+	unsigned line() const { return m_nLine; }
+	/// Всего подавлено сообщений.
+	unsigned long long suppressed() const { return m_nSuppressed.load(std::memory_order_relaxed); }
+	/// Подавлено в текущей серии (итог ещё не выведен).
+	unsigned long long pending() const { return m_nPending.load(std::memory_order_relaxed); }
+	/// Общее ограничение: интервал между сообщениями (нс) и допустимая серия.
+	static std::atomic<long long>& defaultInterval() {
+		static std::atomic<long long> ns(0);
+		return ns;
+	}
+	static std::atomic<unsigned>& defaultBurst() {
+		static std::atomic<unsigned> n(1);
+		return n;
+	}
+	/// Окно схлопывания одинаковых сообщений, нс (0 - не схлопываются).
+	static std::atomic<long long>& collapseWindow() {
+		static std::atomic<long long> ns(0);
+		return ns;
+	}
+private:
+	friend class RateLimiter;
+	/// Проверка по ведру токенов и вывод итога завершившейся серии.
+	bool check(const ILogger* log, int level);
+	/// Вывод итога серии, если он есть.
+	void summary(const ILogger* log, int level, long long now);
+	/// Схлопывание повторов и запоминание текста.
+	bool repeat(const ILogger* log, int level, std::string_view text, const std::string& id);
+	/// Итог повторов (под m_Mutex), пусто - повторов нет.
+	void repeatSummary(std::string& res, long long now);
+	/// Вывод итогов, окно которых истекло.
+	void flushExpired(const ILogger* log, long long now);
+	const char* m_pFile;
+	unsigned m_nLine;
+	const long long m_nInterval;               // Собственный интервал, нс (0 - общий)
+	const unsigned m_nBurst;
+	std::atomic<long long> m_nTat;             // Теоретическое время следующего сообщения (GCRA), нс
+	std::atomic<unsigned long long> m_nPending;
+	std::atomic<unsigned long long> m_nSuppressed;
+	std::atomic<long long> m_nBurstStart;      // Время первого подавленного сообщения серии, нс
+	std::atomic<int> m_nLevel;                 // Уровень сообщений места (для flushSummaries())
+	const char* m_pText;                       // Текст для итога серии (строка формата) или NULL
+	std::mutex m_Mutex;                        // Последнее выведенное сообщение и его повторы
+	std::string m_sLast;                       // Текст последнего выведенного сообщения
+	long long m_nLastTime;                     // Время его вывода, нс
+	unsigned long long m_nRepeats;             // Повторов после него (не выведены)
+	TRateSite* m_pNext;                        // Список всех мест вызова
+}; //class TRateSite
+
+//=============================================================================
+/// Общие настройки и статистика ограничения частоты сообщений.
+/// @ingroup Kernel
+/// \code
+/// RateLimiter::setDefault(100, 20);      // не более 100 сообщений/с с места вызова, серия до 20
+/// RateLimiter::setCollapse(5);           // одинаковые сообщения - не чаще раза в 5 с
+/// RateSummaryFlusher flusher(logger);    // итоги закончившихся серий - по таймеру
+/// ...
+/// RateLimiter::flushSummaries(logger);   // итоги незавершённых серий (например, при завершении)
+/// \endcode
+/// \see TRateSite
+class RateLimiter {
+public:
+	/// Статистика места вызова.
+	struct TSiteStats {
+		const char* file;
+		unsigned line;
+		unsigned long long suppressed;  ///< Всего подавлено.
+		unsigned long long pending;     ///< Подавлено в текущей серии.
+	};
+	/// Общее ограничение для всех мест вызова без собственного.
+	/// \param per_sec - сообщений в секунду с одного места, 0 - без ограничения.
+	/// \param burst   - допустимая серия сообщений подряд.
+	static void setDefault(double per_sec, unsigned burst = 1);
+	/// Действующее общее ограничение (per_sec == 0 - без ограничения).
+	static void getDefault(double& per_sec, unsigned& burst);
+	/// Окно схлопывания одинаковых подряд сообщений места вызова.
+	/// \param window_sec - окно, с; 0 - не схлопывать.
+	static void setCollapse(double window_sec);
+	/// Вывод итогов всех незавершённых серий и повторов в \c log.
+	static void flushSummaries(const ILogger& log);
+	/// Вывод итогов серий, которые закончились (частота снова укладывается в
+	/// ограничение), и повторов, окно которых истекло.
+	static void flushExpired(const ILogger& log);
+	/// Статистика мест вызова, на которых подавлялись сообщения.
+	static std::vector<TSiteStats> stats();
+	/// Всего подавлено сообщений на всех местах вызова.
+	static unsigned long long suppressed();
+	/// Добавление места вызова в общий список (из конструктора TRateSite).
+	static void add(TRateSite* site);
+private:
+	static std::atomic<TRateSite*>& head();
+}; //class RateLimiter
+
+//=============================================================================
+/// Вывод итогов закончившихся серий подавленных сообщений по таймеру.
+/// @ingroup Kernel
+/// Фоновый поток раз в \c period_ms вызывает RateLimiter::flushExpired(), так
+/// что итог серии появляется в логе и тогда, когда с места вызова больше нет
+/// сообщений. Деструктор выводит итоги всех незавершённых серий.
+class RateSummaryFlusher {
+public:
+	/// Конструктор, запускает фоновый поток.
+	/// \param log       - логгер итогов (удерживается).
+	/// \param period_ms - период проверки, мс.
+	RateSummaryFlusher(std::shared_ptr<ILogger> log, unsigned period_ms = 1000);
+	~RateSummaryFlusher();
+	RateSummaryFlusher(const RateSummaryFlusher&) = delete;
+	RateSummaryFlusher& operator=(const RateSummaryFlusher&) = delete;
+private:
+	void run();
+	const std::shared_ptr<ILogger> m_pLog;
+	const unsigned m_nPeriod;
+	std::mutex m_Mutex;
+	std::condition_variable m_Cond;
+	bool m_bStop;
+	std::thread m_Thread;
+}; //class RateSummaryFlusher
@@ -0,0 +1,418 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <system_error>
+#include "ILS_RotatingLog.h"
+
+namespace fs = std::filesystem;
+
+//=============================================================================
+// Имена сегментов
+namespace {
+	// Разбор имени сегмента "<stem>.<номер><ext>[.gz]"
+	bool parseSegment(const std::string& name, const std::string& stem, const std::string& ext,
+	                  unsigned long long& no, bool& gz) {
+		std::string s = name;
+		gz = s.size() > 3 && s.compare(s.size() - 3, 3, ".gz") == 0;
+		if (gz) s.resize(s.size() - 3);
+		if (s.size() <= stem.size() + 1 + ext.size()) return false;
+		if (s.compare(0, stem.size(), stem) != 0 || s[stem.size()] != '.') return false;
+		if (s.compare(s.size() - ext.size(), ext.size(), ext) != 0) return false;
+		const std::string digits = s.substr(stem.size() + 1, s.size() - stem.size() - 1 - ext.size());
+		if (digits.empty() || digits.find_first_not_of("0123456789") != std::string::npos) return false;
+		no = strtoull(digits.c_str(), NULL, 10);
+		return true;
+	}
+	struct TSegment {
+		unsigned long long no;
+		bool gz;
+		std::string name;
+	};
+	// Сегменты лога, упорядоченные по номеру
+	std::vector<TSegment> listSegments(const std::string& path) {
+		std::vector<TSegment> res;
+		const fs::path p(path);
+		const fs::path dir = p.has_parent_path() ? p.parent_path() : fs::path(".");
+		const std::string stem = p.stem().string(), ext = p.extension().string();
+		std::error_code ec;
+		for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+			TSegment seg;
+			if (!parseSegment(it->path().filename().string(), stem, ext, seg.no, seg.gz)) continue;
+			seg.name = (p.has_parent_path() ? it->path() : it->path().filename()).string();
+			res.push_back(seg);
+		}
+		std::sort(res.begin(), res.end(), [](const TSegment& a, const TSegment& b) {
+			return a.no != b.no ? a.no < b.no : a.gz > b.gz;
+		});
+		// Во время сжатия сегмент может на мгновение существовать в обоих видах
+		res.erase(std::unique(res.begin(), res.end(), [](const TSegment& a, const TSegment& b) {
+			return a.no == b.no;
+		}), res.end());
+		return res;
+	}
+
+	//---------------------------------------------------------------------------
+	// Сжатие gzip без внешних библиотек: один блок DEFLATE с фиксированными
+	// кодами Хаффмана (RFC 1951, BTYPE=01) и поиском повторов по цепочкам хэшей.
+	// Для текстовых логов это даёт сжатие в несколько раз при скорости,
+	// достаточной для фонового потока.
+	uint32_t crc32(uint32_t crc, const unsigned char* p, size_t n) {
+		static const std::array<uint32_t, 256> table = [] {
+			std::array<uint32_t, 256> t;
+			for (uint32_t i = 0; i < 256; ++i) {
+				uint32_t c = i;
+				for (int k = 0; k < 8; ++k) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				t[i] = c;
+			}
+			return t;
+		}();
+		crc = ~crc;
+		while (n--) crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+	// Поток битов DEFLATE: младший бит первым, коды Хаффмана - старшим битом вперёд
+	struct TBitOut {
+		std::FILE* file;
+		std::string buf;
+		uint32_t acc = 0;
+		int nbits = 0;
+		bool ok = true;
+		explicit TBitOut(std::FILE* f) : file(f) {}
+		void bits(uint32_t v, int n) {
+			acc |= v << nbits;
+			nbits += n;
+			while (nbits >= 8) { buf += char(acc & 0xFF); acc >>= 8; nbits -= 8; }
+			if (buf.size() >= (1 << 16)) flush();
+		}
+		void code(uint32_t c, int n) {
+			uint32_t r = 0;
+			for (int i = 0; i < n; ++i, c >>= 1) r = (r << 1) | (c & 1);
+			bits(r, n);
+		}
+		void bytes(const void* p, size_t n) { buf.append(static_cast<const char*>(p), n); }
+		void flush() {
+			if (ok && !buf.empty()) ok = fwrite(buf.data(), 1, buf.size(), file) == buf.size();
+			buf.clear();
+		}
+		void align() {
+			if (nbits) buf += char(acc & 0xFF);
+			acc = 0;
+			nbits = 0;
+		}
+	};
+	// Фиксированный код символа 0..287
+	void putSymbol(TBitOut& out, unsigned v) {
+		if (v < 144) out.code(0x30 + v, 8);
+		else if (v < 256) out.code(0x190 + v - 144, 9);
+		else if (v < 280) out.code(v - 256, 7);
+		else out.code(0xC0 + v - 280, 8);
+	}
+	void putMatch(TBitOut& out, unsigned len, unsigned dist) {
+		static const unsigned short lbase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const unsigned char lext[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		static const unsigned short dbase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static const unsigned char dext[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+		int l = 28;
+		while (lbase[l] > len) --l;
+		putSymbol(out, 257 + l);
+		if (lext[l]) out.bits(len - lbase[l], lext[l]);
+		int d = 29;
+		while (dbase[d] > dist) --d;
+		out.code(d, 5);
+		if (dext[d]) out.bits(dist - dbase[d], dext[d]);
+	}
+	bool gzipFile(std::FILE* in, std::FILE* file) {
+		const size_t window = 32768, min_match = 3, max_match = 258, chunk = 1 << 16;
+		const int hash_bits = 15, max_chain = 64;
+		std::vector<unsigned char> data;          // Окно и непросмотренный остаток
+		long long base = 0;                       // Смещение data[0] от начала файла
+		std::vector<long long> head(size_t(1) << hash_bits, -1), prev(window, -1);
+		auto hash = [&](size_t i) {
+			return ((unsigned(data[i]) << 10) ^ (unsigned(data[i + 1]) << 5) ^ data[i + 2]) & ((1u << hash_bits) - 1);
+		};
+		TBitOut out(file);
+		static const unsigned char header[10] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF };
+		out.bytes(header, sizeof(header));
+		out.bits(1, 1);  // Последний блок
+		out.bits(1, 2);  // Фиксированные коды
+		uint32_t crc = 0, total = 0;
+		size_t pos = 0;
+		bool eof = false;
+		for (;;) {
+			if (!eof && data.size() - pos < max_match + min_match) {
+				// Отбрасываем данные дальше окна и дочитываем следующую порцию
+				if (pos > window) {
+					data.erase(data.begin(), data.begin() + (pos - window));
+					base += pos - window;
+					pos = window;
+				}
+				const size_t old = data.size();
+				data.resize(old + chunk);
+				const size_t n = fread(&data[old], 1, chunk, in);
+				data.resize(old + n);
+				if (n == 0) {
+					if (ferror(in)) return false;
+					eof = true;
+				}
+				crc = crc32(crc, data.data() + old, n);
+				total += uint32_t(n);
+				continue;
+			}
+			if (pos >= data.size()) break;
+			const size_t avail = data.size() - pos;
+			const long long cur = base + (long long)pos;
+			size_t best = 0, dist = 0;
+			if (avail >= min_match) {
+				const size_t lim = std::min(avail, max_match);
+				long long cand = head[hash(pos)];
+				for (int chain = 0; chain < max_chain && cand >= base && cur - cand <= (long long)window; ++chain) {
+					const unsigned char* a = &data[size_t(cand - base)];
+					const unsigned char* b = &data[pos];
+					size_t len = 0;
+					while (len < lim && a[len] == b[len]) ++len;
+					if (len > best) {
+						best = len;
+						dist = size_t(cur - cand);
+						if (len == lim) break;
+					}
+					cand = prev[size_t(cand) & (window - 1)];
+				}
+			}
+			size_t step = 1;
+			if (best >= min_match) { putMatch(out, unsigned(best), unsigned(dist)); step = best; }
+			else putSymbol(out, data[pos]);
+			for (; step; --step, ++pos) {
+				if (data.size() - pos < min_match) continue;
+				const unsigned h = hash(pos);
+				prev[size_t(base + (long long)pos) & (window - 1)] = head[h];
+				head[h] = base + (long long)pos;
+			}
+		}
+		putSymbol(out, 256);
+		out.align();
+		// Трейлер: CRC-32 и длина исходных данных по модулю 2^32, младшим байтом вперёд
+		const unsigned char trailer[8] = {
+			(unsigned char)crc, (unsigned char)(crc >> 8), (unsigned char)(crc >> 16), (unsigned char)(crc >> 24),
+			(unsigned char)total, (unsigned char)(total >> 8), (unsigned char)(total >> 16), (unsigned char)(total >> 24) };
+		out.bytes(trailer, sizeof(trailer));
+		out.flush();
+		return out.ok;
+	}
+}
+
+//=============================================================================
+// RotatingLogger - запись лога в файл сегментами.
+//-----------------------------------------------------------------------------
+// Конструктор
+RotatingLogger::RotatingLogger(const std::string& path, const TRotation& rot)
+	: m_sPath(path), m_Rot(rot), m_pFile(NULL), m_nSize(0), m_nSegment(0), m_nRetryDelay(0),
+	  m_bBusy(false), m_bStop(false), m_nCompressFailed(0), m_nOpenFailed(0) {
+	// Продолжаем нумерацию; несжатые сегменты прошлого запуска отдаём на сжатие
+	for (const TSegment& seg : listSegments(path)) {
+		m_nSegment = std::max(m_nSegment, seg.no);
+		if (!seg.gz && m_Rot.compress) m_Queue.push_back(TClosed{ NULL, seg.name });
+	}
+	m_sFile = segmentName(path, ++m_nSegment);
+	m_pFile = fopen(m_sFile.c_str(), "wb");
+	if (m_pFile) setvbuf(m_pFile, NULL, _IOFBF, 1 << 16);
+	m_SegStart = std::chrono::steady_clock::now();
+	m_Worker = std::thread(&RotatingLogger::worker, this);
+}
+RotatingLogger::~RotatingLogger() {
+	BaseLogger::onLogFinish(true, false, false);
+	// Последний сегмент закрывается и сжимается фоновым потоком перед остановкой
+	TClosed last{ NULL, std::string() };
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		last.file = m_pFile;
+		last.name = m_sFile;
+		m_pFile = NULL;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_QMutex);
+		if (last.file && m_Rot.compress) m_Queue.push_back(last);
+		else if (last.file) fclose(last.file);
+		m_bStop = true;
+	}
+	m_QCond.notify_all();
+	if (m_Worker.joinable()) m_Worker.join();
+}
+bool RotatingLogger::isOpen() const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_pFile != NULL;
+}
+std::string RotatingLogger::currentFile() const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_sFile;
+}
+void RotatingLogger::rotate() {
+	nextSegment(true);
+}
+void RotatingLogger::flush() const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (m_pFile) fflush(m_pFile);
+}
+void RotatingLogger::waitIdle() const {
+	std::unique_lock<std::mutex> lock(m_QMutex);
+	m_QCond.wait(lock, [this] { return m_Queue.empty() && !m_bBusy; });
+}
+//-----------------------------------------------------------------------------
+// Функции механизма вывода
+void RotatingLogger::lOut(MsgView msg) const { write(msg, false); }
+void RotatingLogger::wOut(MsgView msg) const { write(msg, false); }
+// Ошибки сбрасываются в файл сразу
+void RotatingLogger::eOut(MsgView msg) const { write(msg, true); }
+void RotatingLogger::write(MsgView msg, bool sync) const {
+	bool rotate_now;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!m_pFile) return;
+		fwrite(msg.data(), 1, msg.size(), m_pFile);
+		fputc('\n', m_pFile);
+		m_nSize += msg.size() + 1;
+		if (sync) fflush(m_pFile);
+		rotate_now = needRotate();
+	}
+	if (rotate_now) nextSegment(false);
+}
+bool RotatingLogger::needRotate() const {
+	// После неудачного открытия сегмента повтор - не раньше m_RetryAt
+	if (m_nRetryDelay && std::chrono::steady_clock::now() < m_RetryAt) return false;
+	if (m_Rot.max_size && m_nSize >= m_Rot.max_size) return true;
+	return m_Rot.interval.count() > 0 && std::chrono::steady_clock::now() - m_SegStart >= m_Rot.interval;
+}
+//-----------------------------------------------------------------------------
+// Ротация
+void RotatingLogger::nextSegment(bool force) const {
+	// Ротацию выполняет один поток, остальные продолжают писать в текущий сегмент
+	std::unique_lock<std::mutex> rot(m_RotMutex, std::defer_lock);
+	if (force) rot.lock();
+	else if (!rot.try_lock()) return;
+	unsigned long long no;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!m_pFile || (!force && !needRotate())) return;
+		no = m_nSegment + 1;
+	}
+	// Файл открывается без блокировки записи
+	const std::string name = segmentName(m_sPath, no);
+	std::FILE* f = fopen(name.c_str(), "wb");
+	if (!f) {
+		// Запись продолжается в текущий сегмент; повтор с удвоением паузы до минуты
+		std::string cur;
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_nRetryDelay = std::min<unsigned>(m_nRetryDelay ? m_nRetryDelay * 2 : 1, 64);
+			m_RetryAt = std::chrono::steady_clock::now() + std::chrono::seconds(m_nRetryDelay);
+			cur = m_sFile;
+		}
+		rot.unlock();
+		if (m_nOpenFailed.fetch_add(1, std::memory_order_relaxed) == 0)
+			wrn("rotate", "не удалось открыть сегмент %s, запись продолжается в %s", name.c_str(), cur.c_str());
+		return;
+	}
+	setvbuf(f, NULL, _IOFBF, 1 << 16);
+	TClosed old;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_nRetryDelay = 0;
+		old.file = m_pFile;
+		old.name = m_sFile;
+		m_pFile = f;
+		m_sFile = name;
+		m_nSize = 0;
+		m_nSegment = no;
+		m_SegStart = std::chrono::steady_clock::now();
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_QMutex);
+		m_Queue.push_back(old);
+	}
+	m_QCond.notify_all();
+}
+void RotatingLogger::worker() {
+	prune();
+	for (;;) {
+		TClosed seg;
+		{
+			std::unique_lock<std::mutex> lock(m_QMutex);
+			m_QCond.wait(lock, [this] { return m_bStop || !m_Queue.empty(); });
+			if (m_Queue.empty()) break;
+			seg = m_Queue.front();
+			m_Queue.pop_front();
+			m_bBusy = true;
+		}
+		try {
+			if (seg.file) fclose(seg.file);
+			if (m_Rot.compress) {
+				if (compressFile(seg.name, seg.name + ".gz")) std::remove(seg.name.c_str());
+				// Предупреждение один раз, чтобы несжатые сегменты не проходили незамеченными
+				else if (m_nCompressFailed.fetch_add(1, std::memory_order_relaxed) == 0)
+					wrn("rotate", "не удалось сжать сегмент %s, сегмент оставлен несжатым", seg.name.c_str());
+			}
+			prune();
+		}
+		catch (...) {}
+		{
+			std::lock_guard<std::mutex> lock(m_QMutex);
+			m_bBusy = false;
+		}
+		m_QCond.notify_all();
+	}
+}
+void RotatingLogger::prune() const {
+	if (!m_Rot.keep) return;
+	std::vector<std::string> skip;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		skip.push_back(m_sFile);
+	}
+	size_t queued = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_QMutex);
+		for (const TClosed& c : m_Queue) skip.push_back(c.name);
+		queued = m_Queue.size();
+	}
+	std::vector<TSegment> closed;
+	for (const TSegment& seg : listSegments(m_sPath)) {
+		const std::string plain = seg.gz ? seg.name.substr(0, seg.name.size() - 3) : seg.name;
+		if (std::find(skip.begin(), skip.end(), plain) == skip.end()) closed.push_back(seg);
+	}
+	// Сегменты в очереди ещё не обработаны, но тоже считаются хранимыми
+	for (size_t i = 0; i < closed.size() && closed.size() - i + queued > m_Rot.keep; ++i) {
+		std::error_code ec;
+		fs::remove(closed[i].name, ec);
+	}
+}
+//-----------------------------------------------------------------------------
+// Статические функции
+std::string RotatingLogger::segmentName(const std::string& path, unsigned long long no) {
+	const fs::path p(path);
+	std::string name = p.stem().string();
+	ils_appendf(name, ".%06llu", no);
+	name += p.extension().string();
+	return p.has_parent_path() ? (p.parent_path() / name).string() : name;
+}
+std::vector<std::string> RotatingLogger::segments(const std::string& path) {
+	std::vector<std::string> res;
+	for (const TSegment& seg : listSegments(path)) res.push_back(seg.name);
+	return res;
+}
+bool RotatingLogger::compressFile(const std::string& src, const std::string& dst) {
+	std::FILE* in = fopen(src.c_str(), "rb");
+	if (!in) return false;
+	// Сжатый файл появляется под своим именем только целиком
+	const std::string tmp = dst + ".tmp";
+	std::FILE* out = fopen(tmp.c_str(), "wb");
+	if (!out) { fclose(in); return false; }
+	bool ok = false;
+	try { ok = gzipFile(in, out); } catch(...) {}
+	fclose(in);
+	if (fclose(out) != 0) ok = false;
+	std::error_code ec;
+	if (ok) fs::rename(tmp, dst, ec);
+	if (!ok || ec) { fs::remove(tmp, ec); return false; }
+	return true;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ILS_StdLog.h"
+
+//=============================================================================
+/// Регистратор хода процесса (Логгер) в файл с ротацией.
+/// @ingroup Kernel
+/// Лог пишется сегментами: для пути "logs/app.log" это файлы
+/// "logs/app.000001.log", "logs/app.000002.log" ... Новый сегмент начинается,
+/// когда текущий превысил заданный размер и/или проработал заданное время.
+/// Нумерация продолжается с последнего сегмента, найденного при старте, так
+/// что лексикографический порядок имён совпадает с порядком записи
+/// (см. segments()).
+///
+/// Ротация не переименовывает открытые файлы: новый сегмент открывается до
+/// захвата блокировки, под блокировкой только меняется указатель на файл.
+/// Закрытие старого сегмента, его сжатие в "app.000001.log.gz" и удаление
+/// сегментов сверх TRotation::keep выполняет фоновый поток; последний сегмент
+/// сжимается при разрушении логгера. Сегменты, оставшиеся несжатыми после
+/// предыдущего запуска, сжимаются при старте.
+///
+/// Сжатие gzip встроенное (compressFile(), внешние библиотеки не нужны).
+/// Если сегмент сжать не удалось, он остаётся несжатым, в лог один раз
+/// выводится предупреждение, а количество таких сегментов возвращает
+/// compressFailures(). Если не удалось открыть новый сегмент, запись
+/// продолжается в текущий, предупреждение выводится один раз, а повторная
+/// попытка делается не раньше чем через 1, 2, 4 ... 64 секунды
+/// (openFailures()).
+/// \see BaseLogger
+class RotatingLogger : public BaseLogger {
+public:
+	/// Параметры ротации.
+	struct TRotation {
+		unsigned long long max_size = 0;      ///< Размер сегмента в байтах, 0 - без ограничения.
+		std::chrono::seconds interval{0};     ///< Время жизни сегмента, 0 - без ограничения.
+		unsigned keep = 0;                    ///< Сколько закрытых сегментов хранить, 0 - все.
+		bool compress = true;                 ///< Сжимать закрытые сегменты (gzip).
+	};
+	//---------------------------------------------------------------------------
+	/// Конструктор.
+	/// \param path - базовое имя файла лога (номер сегмента вставляется перед расширением).
+	/// \param rot  - параметры ротации.
+	RotatingLogger(const std::string& path, const TRotation& rot);
+	virtual ~RotatingLogger();
+	RotatingLogger(const RotatingLogger&) = delete;
+	RotatingLogger& operator=(const RotatingLogger&) = delete;
+	/// Удалось ли открыть текущий сегмент.
+	bool isOpen() const;
+	/// Имя текущего сегмента.
+	std::string currentFile() const;
+	/// Принудительное начало нового сегмента.
+	void rotate();
+	/// Сброс буферов текущего сегмента.
+	void flush() const;
+	/// Дождаться окончания сжатия и удаления закрытых сегментов.
+	void waitIdle() const;
+	/// Количество закрытых сегментов, которые не удалось сжать.
+	unsigned long long compressFailures() const { return m_nCompressFailed.load(std::memory_order_relaxed); }
+	/// Количество неудачных попыток открыть новый сегмент.
+	unsigned long long openFailures() const { return m_nOpenFailed.load(std::memory_order_relaxed); }
+	//---------------------------------------------------------------------------
+	/// Имя сегмента с номером \c no.
+	static std::string segmentName(const std::string& path, unsigned long long no);
+	/// Все сегменты лога (сжатые и нет) в порядке записи.
+	static std::vector<std::string> segments(const std::string& path);
+	/// Сжатие файла \c src в \c dst (gzip, DEFLATE с фиксированными кодами Хаффмана).
+	/// \return false, если файл не удалось прочитать или записать.
+	static bool compressFile(const std::string& src, const std::string& dst);
+	//---------------------------------------------------------------------------
+protected: // Функции механизма вывода
+	virtual void lOut(MsgView msg) const;
+	virtual void wOut(MsgView msg) const;
+	virtual void eOut(MsgView msg) const;
+	/// Запись строки в текущий сегмент (с ротацией, если она нужна).
+	void write(MsgView msg, bool sync) const;
+	/// Нужна ли ротация текущего сегмента (вызывается под m_Mutex).
+	bool needRotate() const;
+	/// Открытие следующего сегмента и передача старого фоновому потоку.
+	/// \param force - начать сегмент, даже если условия ротации не выполнены.
+	void nextSegment(bool force) const;
+	/// Фоновый поток: закрытие, сжатие и удаление старых сегментов.
+	void worker();
+	/// Удаление закрытых сегментов сверх TRotation::keep.
+	void prune() const;
+	/// Закрытый сегмент, ожидающий обработки.
+	struct TClosed {
+		std::FILE* file;   // Ещё не закрытый файл (NULL - сегмент предыдущего запуска)
+		std::string name;
+	};
+	std::string m_sPath;
+	TRotation m_Rot;
+	mutable std::mutex m_Mutex;          // Защищает текущий сегмент
+	mutable std::FILE* m_pFile;
+	mutable std::string m_sFile;
+	mutable unsigned long long m_nSize;  // Записано в текущий сегмент
+	mutable unsigned long long m_nSegment;
+	mutable std::chrono::steady_clock::time_point m_SegStart;
+	mutable unsigned m_nRetryDelay;      // Пауза перед повтором открытия сегмента, с (0 - сбоя не было)
+	mutable std::chrono::steady_clock::time_point m_RetryAt;
+	mutable std::mutex m_RotMutex;       // Сериализует открытие новых сегментов
+	mutable std::mutex m_QMutex;         // Защищает очередь фонового потока
+	mutable std::condition_variable m_QCond;
+	mutable std::deque<TClosed> m_Queue;
+	mutable bool m_bBusy;
+	bool m_bStop;
+	std::atomic<unsigned long long> m_nCompressFailed;
+	mutable std::atomic<unsigned long long> m_nOpenFailed;
+	std::thread m_Worker;
+}; //class RotatingLogger
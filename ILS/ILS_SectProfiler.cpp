@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cmath>
+#include "ILS_SectProfiler.h"
+
+//=============================================================================
+// SectProfiler - статистика длительностей секций.
+//-----------------------------------------------------------------------------
+SectProfiler& SectProfiler::instance() {
+	// Объект не разрушается: секции могут завершаться в деструкторах статических объектов
+	static SectProfiler* p = new SectProfiler();
+	return *p;
+}
+// Таблица текущего потока, регистрируется при первом использовании
+SectProfiler::TShard& SectProfiler::shard() {
+	thread_local std::shared_ptr<TShard> tls_shard;
+	if (!tls_shard) {
+		tls_shard = std::make_shared<TShard>();
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Shards.push_back(tls_shard);
+	}
+	return *tls_shard;
+}
+void SectProfiler::add(const char* name, long long ns) {
+	if (!isActive() || !name) return;
+	TShard& s = shard();
+	std::lock_guard<std::mutex> lock(s.mutex);
+	s.stats[name].add(ns);
+}
+void SectProfiler::reset() {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (auto& sh : m_Shards) {
+		std::lock_guard<std::mutex> l(sh->mutex);
+		sh->stats.clear();
+	}
+}
+//-----------------------------------------------------------------------------
+// Гистограмма
+unsigned TDurationStats::bucket(long long ns) {
+	if (ns < subBuckets) return ns < 0 ? 0 : unsigned(ns);
+	unsigned e = 0;
+	for (unsigned long long v = (unsigned long long)ns; v > 1; v >>= 1) ++e;
+	const unsigned sub = unsigned(ns >> (e - subBits)) & (subBuckets - 1);
+	return (e - subBits + 1) * subBuckets + sub;
+}
+long long TDurationStats::bucketValue(unsigned b) {
+	if (b < subBuckets) return b;
+	const unsigned e = b / subBuckets + subBits - 1;
+	const long long width = 1LL << (e - subBits);
+	return ((long long)(subBuckets + b % subBuckets) << (e - subBits)) + width / 2;
+}
+void TDurationStats::add(long long ns) {
+	if (hist.empty()) hist.assign(buckets, 0);
+	if (count == 0 || ns < min) min = ns;
+	if (count == 0 || ns > max) max = ns;
+	++count;
+	total += ns;
+	++hist[bucket(ns)];
+}
+void TDurationStats::merge(const TDurationStats& src) {
+	if (src.count == 0) return;
+	if (hist.empty()) hist.assign(buckets, 0);
+	if (count == 0 || src.min < min) min = src.min;
+	if (count == 0 || src.max > max) max = src.max;
+	count += src.count;
+	total += src.total;
+	for (size_t i = 0; i < hist.size() && i < src.hist.size(); ++i) hist[i] += src.hist[i];
+}
+double TDurationStats::quantile(double q) const {
+	if (!count) return 0;
+	// Ранг по методу ближайшего ранга: ceil(q * count)
+	unsigned long long rank = (unsigned long long)std::ceil(q * double(count));
+	if (rank < 1) rank = 1;
+	// Крайние ранги известны точно
+	if (rank == 1) return double(min);
+	if (rank >= count) return double(max);
+	unsigned long long n = 0;
+	for (size_t b = 0; b < hist.size(); ++b) {
+		n += hist[b];
+		if (n >= rank) {
+			// Значение середины корзины, но не за пределами [min, max]
+			long long v = bucketValue(unsigned(b));
+			return double(std::min(std::max(v, min), max));
+		}
+	}
+	return double(max);
+}
+//-----------------------------------------------------------------------------
+// Сводка
+std::vector<SectProfiler::TSummary> SectProfiler::summary() const {
+	// Один и тот же литерал в разных единицах трансляции может иметь разные
+	// адреса, поэтому таблицы потоков объединяются по тексту имени
+	std::map<std::string, TStats> all;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (auto& sh : m_Shards) {
+			std::lock_guard<std::mutex> l(sh->mutex);
+			for (auto& it : sh->stats) all[it.first].merge(it.second);
+		}
+	}
+	std::vector<TSummary> res;
+	for (auto& it : all) {
+		const TStats& s = it.second;
+		if (s.count == 0) continue;
+		TSummary sum;
+		sum.name = it.first;
+		sum.count = s.count;
+		sum.total_ms = double(s.total) / 1e6;
+		sum.min_ms = double(s.min) / 1e6;
+		sum.max_ms = double(s.max) / 1e6;
+		sum.p50_ms = s.quantile(0.50) / 1e6;
+		sum.p99_ms = s.quantile(0.99) / 1e6;
+		res.push_back(sum);
+	}
+	return res;
+}
+void SectProfiler::formatSummary(std::string& res, const TSummary& s) {
+	ils_appendf(res, "SectionProfile %s count=%llu total=%.3fms min=%.3fms max=%.3fms p50=%.3fms p99=%.3fms",
+		s.name.c_str(), s.count, s.total_ms, s.min_ms, s.max_ms, s.p50_ms, s.p99_ms);
+}
+void SectProfiler::dump(std::ostream& out) const {
+	std::string line;
+	for (const TSummary& s : summary()) {
+		line.clear();
+		formatSummary(line, s);
+		out << line << '\n';
+	}
+}
+void SectProfiler::dump(const ILogger& logger) const {
+	std::string line;
+	for (const TSummary& s : summary()) {
+		line.clear();
+		formatSummary(line, s);
+		logger.infOut(line, "profile");
+	}
+}
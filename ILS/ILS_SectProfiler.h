@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ILS_Logger.h"
+
+//=============================================================================
+/// Статистика длительностей: количество, сумма, min/max и гистограмма для квантилей.
+/// @ingroup Kernel
+/// Гистограмма логарифмически-линейная: 64 степени двойки наносекунд по 16
+/// поддиапазонов, ошибка квантиля < 7%. Память не зависит от количества
+/// значений (гистограмма выделяется при первом значении).
+struct TDurationStats {
+	enum { subBits = 4, subBuckets = 1 << subBits, buckets = 64 * subBuckets };
+	unsigned long long count = 0;
+	long long total = 0, min = 0, max = 0;  ///< Сумма и пределы, нс.
+	std::vector<unsigned> hist;
+	/// Учёт длительности \c ns наносекунд.
+	void add(long long ns);
+	/// Добавление статистики \c src.
+	void merge(const TDurationStats& src);
+	/// Квантиль \c q (0..1) в наносекундах (0 - нет значений); крайние ранги - точные min и max.
+	double quantile(double q) const;
+	static unsigned bucket(long long ns);
+	static long long bucketValue(unsigned b);
+};
+
+//=============================================================================
+/// Накопитель статистики длительностей секций (ILS_SECTB/ILS_SECTE).
+/// @ingroup Kernel
+/// Каждая завершённая секция добавляет свою длительность в таблицу текущего
+/// потока (без конкуренции за общие данные). Нумерованные секции (ILS_SECTBI)
+/// учитываются под базовым именем: LoadBox0, LoadBox1 ... - как LoadBox.
+/// Сводка (количество, сумма, min/max, p50/p99) собирается из всех потоков
+/// по запросу: dump() или при завершении логгера (BaseLogger::bProfileOnFinish).
+class SectProfiler {
+public:
+	/// Сводная статистика секции.
+	struct TSummary {
+		std::string name;
+		unsigned long long count;
+		double total_ms, min_ms, max_ms, p50_ms, p99_ms;
+	};
+	/// Глобальный накопитель.
+	static SectProfiler& instance();
+	/// Включение/выключение накопления (по умолчанию включено).
+	void setActive(bool on) { m_bActive.store(on, std::memory_order_relaxed); }
+	bool isActive() const { return m_bActive.load(std::memory_order_relaxed); }
+	/// Учёт одной завершённой секции.
+	/// \param name - базовое имя секции (строковый литерал из макроса).
+	/// \param ns   - длительность в наносекундах.
+	void add(const char* name, long long ns);
+	/// Сводка по всем секциям, упорядоченная по имени.
+	std::vector<TSummary> summary() const;
+	/// Вывод сводки в поток (по строке на секцию).
+	void dump(std::ostream& out) const;
+	/// Вывод сводки в лог как информационных сообщений (для анализатора логов).
+	void dump(const ILogger& logger) const;
+	/// Сброс накопленной статистики.
+	void reset();
+	/// Форматирование строки сводки.
+	static void formatSummary(std::string& res, const TSummary& s);
+private:
+	typedef TDurationStats TStats;
+	struct TShard {
+		std::mutex mutex;  // Захватывается владельцем и, изредка, dump()
+		std::unordered_map<const char*, TStats> stats;
+	};
+	SectProfiler() : m_bActive(true) {}
+	TShard& shard();
+	std::atomic<bool> m_bActive;
+	mutable std::mutex m_Mutex;
+	std::vector<std::shared_ptr<TShard> > m_Shards;  // Таблицы всех потоков (живут и после их завершения)
+}; //class SectProfiler
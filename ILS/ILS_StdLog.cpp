@@ -2,6 +2,37 @@
 #include <time.h>
 #include <string.h>
 #include "ILS_StdLog.h"
+#include "ILS_SectProfiler.h"
+
+//=============================================================================
+// Строка сообщения собирается целиком в буфере текущего потока (TThreadBuf)
+// и только потом передаётся на вывод, поэтому сообщения разных потоков не 
+// перемешиваются, а после прогрева буфера не выделяется память.
+namespace {
+	struct TStagingTag;
+	typedef TThreadBuf<TStagingTag> TStagingLine;
+
+	// Потокобезопасный localtime
+	inline void safe_localtime(const time_t& t, struct tm& res) {
+#ifdef _WIN32
+		localtime_s(&res, &t);
+#else
+		localtime_r(&t, &res);
+#endif
+	}
+
+	// Кэш текстовой части заголовка (дата и время с точностью до секунды).
+	// Кэш свой у каждого потока, поэтому не требует синхронизации;
+	// strftime() вызывается только при смене секунды или набора полей.
+	struct TTitleCache {
+		long long sec = -1;    // Секунда, для которой сформирован текст
+		unsigned mask = 0;     // Поля (BaseLogger::siDate | BaseLogger::siTime)
+		char text[64];
+		size_t len = 0;
+	};
+	thread_local TTitleCache tls_title;
+
+}
 
 //=============================================================================
 // BaseLogger - стандартая реализация основных механизмов Logger-а. 
@@ -9,15 +40,23 @@
 // собственного механизма регистрации хода процесса.
 //-----------------------------------------------------------------------------
 // Конструктор
-BaseLogger::BaseLogger() {
+BaseLogger::BaseLogger() : bStarted(false) {
 	// По умолчанию ничего не выводим в заголовке
 	show_info = 0;
-	// Время начала
-	bStarted = false;
 	// флаг вывода лога в консоль
 	bLogToConsole = false;
+	// сводку профиля секций выводим только по запросу
+	bProfileOnFinish = false;
 };
 //-----------------------------------------------------------------------------
+// Завершение лога
+void BaseLogger::onLogFinish(bool l, bool w, bool e) {
+	if (!bProfileOnFinish) return;
+	try {
+		SectProfiler::instance().dump(*this);
+	} catch(...) {}
+}
+//-----------------------------------------------------------------------------
 // Функции интерфейса
 // Регистрация сообщений разных типов, каждая функция имеет праметры:
 // id  - идентификатор сообщений
@@ -25,8 +64,12 @@ BaseLogger::BaseLogger() {
 // ... - набор данных для вывода в сообщении по принципу printf
 // Функции:
 // Регистрация информационного сообщения
-void BaseLogger::infOut(const Msg& msg, const LogId& id) const {
-	lOut(iTitle() + msg);
+void BaseLogger::infOut(MsgView msg, const LogId& id) const {
+	if (!logEnabled(ILS_LEVEL_INF)) return;
+	TStagingLine line;
+	iTitle(line.str());
+	line.str() += msg;
+	recordOut(ILS_LEVEL_INF, line.str(), id);
 }
 //-----------------------------------------------------------------------------
 // Функции интерфейса
@@ -36,61 +79,119 @@ void BaseLogger::infOut(const Msg& msg, const LogId& id) const {
 // ... - набор данных для вывода в сообщении по принципу printf
 // Функции:
 // Регистрация информационного сообщения
-void BaseLogger::logOut(const Msg& msg, const LogId& id) const {
-	lOut(lTitle()+msg);
+void BaseLogger::logOut(MsgView msg, const LogId& id) const {
+	if (!logEnabled(ILS_LEVEL_LOG)) return;
+	TStagingLine line;
+	lTitle(line.str());
+	line.str() += msg;
+	recordOut(ILS_LEVEL_LOG, line.str(), id);
 }
 // Регистрация предупреждения (warning) и не фатальной ошибки
-void BaseLogger::wrnOut(const Msg& msg, const LogId& id) const {
-	++warnings;
-	wOut(wTitle()+msg);
+void BaseLogger::wrnOut(MsgView msg, const LogId& id) const {
+	if (!logEnabled(ILS_LEVEL_WRN)) return;
+	warnings.fetch_add(1, std::memory_order_relaxed);
+	TStagingLine line;
+	wTitle(line.str());
+	line.str() += msg;
+	recordOut(ILS_LEVEL_WRN, line.str(), id);
 }
 // Регистрация фатальной ошибки, 
 // после которой результаты процесса не определены
-void BaseLogger::errOut(const Msg& msg, const LogId& id) const {
-	++errors;
-	eOut(eTitle()+msg);
+void BaseLogger::errOut(MsgView msg, const LogId& id) const {
+	if (!logEnabled(ILS_LEVEL_ERR)) return;
+	errors.fetch_add(1, std::memory_order_relaxed);
+	TStagingLine line;
+	eTitle(line.str());
+	line.str() += msg;
+	recordOut(ILS_LEVEL_ERR, line.str(), id);
+}
+// Вывод готовой строки по уровню
+void BaseLogger::recordOut(int level, MsgView line, const LogId& id) const {
+	if (level >= ILS_LEVEL_ERR) eOut(line);
+	else if (level == ILS_LEVEL_WRN) wOut(line);
+	else lOut(line);
 }
 //-----------------------------------------------------------------------------
 // Вспомогательные функции
 // Создается общая для всех типов сообщений строка с заголовком
 // на основе значений настроек
-std::string BaseLogger::title() const {
-	std::string res = "";
-	char s[128];
-	time_t ltime;
-	time( &ltime );
-	struct tm *today;
-	today = localtime( &ltime );
-	if(show_info & 1) {
-		strftime(s, 128, "%Y/%m/%d ", today );
-		res += s;
+void BaseLogger::title(std::string& res) const {
+	const unsigned info = show_info;
+	// Время старта устанавливает ровно один (первый) вызов, независимо от настроек
+	bool first = false;
+	if (!bStarted.load(std::memory_order_acquire)) {
+		std::call_once(start_once, [&]() {
+			start_time = std::chrono::steady_clock::now();
+			bStarted.store(true, std::memory_order_release);
+			first = true;
+		});
 	}
-	if((show_info & 2) || ((show_info & 4) && (!bStarted))) {
-		strftime(s, 128, "%H:%M:%S ", today );
-		res += s;
+	if (!(info & (siDate | siTime | siElapsed | siThread))) return;
+	long long wall_us = 0, elapsed_ms = 0;
+	if ((info & (siDate | siTime)) || ((info & siElapsed) && first))
+		wall_us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+	if (!first && (info & siElapsed))
+		elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - start_time).count();
+	formatTitle(res, info, wall_us, elapsed_ms, first, (info & siThread) ? ils_thread_no() : 0);
+}
+// Формирование заголовка по готовым значениям времени
+void BaseLogger::formatTitle(std::string& res, unsigned info, long long wall_us, long long elapsed_ms, bool first, unsigned thread) {
+	// Дата и время: текст до секунды берётся из кэша потока
+	unsigned mask = info & siDate;
+	if ((info & siTime) || ((info & siElapsed) && first)) mask |= siTime;
+	if (mask) {
+		const long long us = wall_us;
+		const long long sec = us / 1000000;
+		TTitleCache& cache = tls_title;
+		if (cache.sec != sec || cache.mask != mask) {
+			time_t ltime = time_t(sec);
+			struct tm today;
+			safe_localtime(ltime, today);
+			cache.len = 0;
+			if (mask & siDate)
+				cache.len += strftime(cache.text, sizeof(cache.text), "%Y/%m/%d ", &today);
+			if (mask & siTime)
+				cache.len += strftime(cache.text + cache.len, sizeof(cache.text) - cache.len, "%H:%M:%S", &today);
+			cache.sec = sec;
+			cache.mask = mask;
+		}
+		res.append(cache.text, cache.len);
+		if (mask & siTime) {
+			if (info & siMicro) { res += '.'; ils_append_uint(res, us % 1000000, 6); }
+			else if (info & siMilli) { res += '.'; ils_append_uint(res, us % 1000000 / 1000, 3); }
+			res += ' ';
+		}
 	}
-	if (!bStarted) {
-		start_time = std::chrono::steady_clock::now();
-		bStarted = true;
+	// Секунды с начала работы по монотонным часам
+	if (!first && (info & siElapsed)) {
+		char s[32];
+		const int n = snprintf(s, sizeof(s), "% 8.2f ", double(elapsed_ms) / 1000.0);
+		if (n > 0) res.append(s, size_t(n) < sizeof(s) ? size_t(n) : sizeof(s) - 1);
 	}
-	else if (show_info & 4) {
-		long fDurationMilli = long(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count());
-		sprintf(s, "% 8.2f ", double(fDurationMilli) / 1000.0);
-		res += s;
+	// Номер потока
+	if ((info & siThread) && thread) {
+		res += '#';
+		ils_append_uint(res, thread, 0);
+		res += ' ';
 	}
-	return res;
 }
 // Для кажного типа сообзения задается отдельная функция, которая 
 // реализуется на основе общей
-std::string BaseLogger::lTitle() const {
-	return title()+"> ";
+void BaseLogger::lTitle(std::string& res) const {
+	title(res);
+	res += "> ";
 }
-std::string BaseLogger::iTitle() const {
-	return title() + "|INFO> ";
+void BaseLogger::iTitle(std::string& res) const {
+	title(res);
+	res += "|INFO> ";
 }
-std::string BaseLogger::wTitle() const {
-	return title()+"|WARNING> ";
+void BaseLogger::wTitle(std::string& res) const {
+	title(res);
+	res += "|WARNING> ";
 }
-std::string BaseLogger::eTitle() const {
-	return title()+"|ERROR> ";
+void BaseLogger::eTitle(std::string& res) const {
+	title(res);
+	res += "|ERROR> ";
 }
@@ -4,8 +4,12 @@
 #include <ios>
 #include <iostream>
 #include <fstream>
+#include <atomic>
 #include <chrono>
+#include <memory>
+#include <mutex>
 #include "ILS_Logger.h"
+#include "ILS_AsyncWriter.h"
 
 //=============================================================================
 /// Стандартная реализация большинства методов интерфейса \c ILogger.
@@ -16,68 +20,103 @@
 /// Данный класс реализует:
 /// - формирование заголовка сообщений;
 /// - элементарные настройки формата сообщений.
+///
+/// Функции регистрации можно вызывать из нескольких потоков одновременно:
+/// счётчики атомарны, время старта инициализируется однократно, а строка 
+/// сообщения (заголовок + текст) собирается в буфере текущего потока и 
+/// передаётся в lOut()/wOut()/eOut() целиком, так что записи не перемешиваются.
 /// \see ILogger , StdLogger
 class BaseLogger : public ILogger {
 	//---------------------------------------------------------------------------
 protected: // Управляющие аттрибуты
 	/// Общее количество ошибок зафиксированных этим логгером.
-	mutable unsigned int errors = 0;
+	mutable std::atomic<unsigned int> errors{0};
 	/// Общее количество предупреждеий зафиксированных этим логгером.
-	mutable unsigned int warnings = 0;
+	mutable std::atomic<unsigned int> warnings{0};
 	//---------------------------------------------------------------------------
 public: // Конструктор
 	BaseLogger();
+	/// Количество зарегистрированных ошибок.
+	unsigned int errorCount() const { return errors.load(std::memory_order_relaxed); }
+	/// Количество зарегистрированных предупреждений.
+	unsigned int warningCount() const { return warnings.load(std::memory_order_relaxed); }
 	//---------------------------------------------------------------------------
 public: // Настройки StdLogger-а
 	/// Маска битов, определяющая что именно выводить в заголовке.
 	///  - 1 выводить дату
 	///  - 2 выводить время
 	///  - 4 выводить количество секунд с начала
+	///  - 8 добавлять к времени миллисекунды (HH:MM:SS.mmm)
+	///  - 16 добавлять к времени микросекунды (HH:MM:SS.uuuuuu)
+	///  - 32 выводить номер потока ("#3 ", см. ils_thread_no(); по нему LogAnalyzer разделяет секции потоков)
 	mutable unsigned int show_info;
+	/// Биты маски show_info.
+	enum { siDate = 1, siTime = 2, siElapsed = 4, siMilli = 8, siMicro = 16, siThread = 32 };
 	/// Флаг того, что стартовали отсчёт времени
-	mutable bool bStarted;
+	mutable std::atomic<bool> bStarted;
 	/// Флаг того, что нужно выводить лог в консоль
 	mutable bool bLogToConsole;
+	/// Флаг того, что при завершении лога нужно вывести сводку профиля секций (SectProfiler)
+	mutable bool bProfileOnFinish;
 	/// Время начала работы.
+	/// Устанавливается однократно (через start_once) первым сообщением.
 	mutable std::chrono::steady_clock::time_point start_time;
+protected:
+	mutable std::once_flag start_once;
 protected: // Функции интерфейса
+	//---------------------------------------------------------------------------
+	// Завершение лога: вывод сводки профиля секций, если задан bProfileOnFinish
+	virtual void onLogFinish(bool l, bool w, bool e);
 	//---------------------------------------------------------------------------
 	// Регистрация сообщения для анализатора логов
-	virtual void infOut(const Msg& msg, const LogId& id) const;
+	virtual void infOut(MsgView msg, const LogId& id) const;
 	// Регистрация информационного сообщения
-	virtual void logOut(const Msg& msg, const LogId& id) const;
+	virtual void logOut(MsgView msg, const LogId& id) const;
 	// Регистрация предупреждения (warning) и не фатальной ошибки
-	virtual void wrnOut(const Msg& msg, const LogId& id) const;
+	virtual void wrnOut(MsgView msg, const LogId& id) const;
 	// Регистрация фатальной ошибки, после которой результаты процесса не определены
-	virtual void errOut(const Msg& msg, const LogId& id) const;
+	virtual void errOut(MsgView msg, const LogId& id) const;
 protected: // Вспомогательные функции
 	/// Создание строки со стандартным заголовком для сообщения.
 	/// Создается общая для всех типов сообщений строка с заголовком на основе 
-	/// значений настроек.
+	/// значений настроек. Заголовок дописывается в конец \c res (буфера строки
+	/// текущего потока), чтобы не создавать временных строк.
 	/// \note Эту функцию можно переопределить, в случае необходимости 
 	/// генерировать заголовок сообщения отличный  от стандартного.
 	/// \see log() , wrn() , error() 
-	virtual std::string title() const;
+	virtual void title(std::string& res) const;
+public:
+	/// Формирование стандартного заголовка по готовым значениям времени.
+	/// Используется в title() и при декодировании бинарных логов (ils-decode),
+	/// чтобы текст заголовка совпадал в точности.
+	/// \param res        - строка, в конец которой дописывается заголовок.
+	/// \param info       - маска полей (см. show_info).
+	/// \param wall_us    - системное время в микросекундах от начала эпохи.
+	/// \param elapsed_ms - миллисекунды с первого сообщения.
+	/// \param first      - это первое сообщение логгера.
+	/// \param thread     - номер потока (для siThread), 0 - не известен.
+	static void formatTitle(std::string& res, unsigned info, long long wall_us, long long elapsed_ms, bool first, unsigned thread = 0);
+protected:
 	/// Создание строки со стандартным заголовком для информационного сообщения.
 	/// Создание строки со стандартным заголовком для информационного сообщения.
 	/// \note Эту функцию можно переопределить, в случае необходимости 
 	/// генерировать заголовок сообщения отличный  от стандартного.
-	virtual std::string lTitle() const;
+	virtual void lTitle(std::string& res) const;
 	/// Создание строки со стандартным заголовком для информационного сообщения.
 	/// Создание строки со стандартным заголовком для информационного сообщения.
 	/// \note Эту функцию можно переопределить, в случае необходимости 
 	/// генерировать заголовок сообщения отличный  от стандартного.
-	virtual std::string iTitle() const;
+	virtual void iTitle(std::string& res) const;
 	/// Создание строки со стандартным заголовком для анализатора логов.
 	/// Создание строки со стандартным заголовком для анализатора логов.
 	/// \note Эту функцию можно переопределить, в случае необходимости 
 	/// генерировать заголовок сообщения отличный  от стандартного.
-	virtual std::string wTitle() const;
+	virtual void wTitle(std::string& res) const;
 	/// Создание строки со стандартным заголовком для ошибки.
 	/// Создание строки со стандартным заголовком для ошибки.
 	/// \note Эту функцию можно переопределить, в случае необходимости 
 	/// генерировать заголовок сообщения отличный  от стандартного.
-	virtual std::string eTitle() const;
+	virtual void eTitle(std::string& res) const;
 	//---------------------------------------------------------------------------
 protected: // Функиции механизма вывода
 	/// Вывод информационного сообщения.
@@ -85,19 +124,27 @@ protected: // Функиции механизма вывода
 	/// как вывод пользователю информационного сообщения, чтобы происходил 
 	/// реальный вывод на экран или в файл или в графическое окно и т.п.
 	/// \param msg - текст информационного сообщения.
-	virtual void lOut(const std::string& msg) const = 0;
+	virtual void lOut(MsgView msg) const = 0;
 	/// Вывод предупреждения.
 	/// Вируальная функция, которая <b>должна быть обязательно переопределена</b>
 	/// как вывод пользователю предупреждения, чтобы происходил 
 	/// реальный вывод на экран или в файл или в графическое окно и т.п.
 	/// \param msg - текст предупреждения.
-	virtual void wOut(const std::string& msg) const = 0;
+	virtual void wOut(MsgView msg) const = 0;
 	/// Вывод ошибки.
 	/// Вируальная функция, которая <b>должна быть обязательно переопределена</b>
 	/// как вывод пользователю обшибки, чтобы происходил 
 	/// реальный вывод на экран или в файл или в графическое окно и т.п.
 	/// \param msg - текст ошибки.
-	virtual void eOut(const std::string& msg) const = 0;
+	virtual void eOut(MsgView msg) const = 0;
+	/// Вывод готовой строки (заголовок и текст) с уровнем и идентификатором.
+	/// По умолчанию передаёт строку в lOut() (ILS_LEVEL_LOG, ILS_LEVEL_INF),
+	/// wOut() или eOut(). Переопределяется приёмниками, которым нужен
+	/// идентификатор сообщения, например для индекса LogIndexWriter.
+	/// \param level - уровень сообщения (ILS_LEVEL_...).
+	/// \param line  - строка лога.
+	/// \param id    - идентификатор сообщения.
+	virtual void recordOut(int level, MsgView line, const LogId& id) const;
 }; //struct BaseLogger
 
 //=============================================================================
@@ -108,13 +155,23 @@ protected: // Функиции механизма вывода
 /// всю его функциональность, переопределив только функции вывода сообщений так,
 /// чтобы реальный вывод осуществлялся на потоки вывода библиотеки STL переданные
 /// в конструкторе данного класса.
-/// \see ILogger , BaseLogger
-class StdLogger : public BaseLogger {
+///
+/// По умолчанию вывод синхронный - в потоке, вызвавшем функцию регистрации.
+/// После вызова setAsync() производители только копируют готовую запись в 
+/// очередь \c AsyncWriter, а вывод в потоки выполняет фоновый поток.
+/// \see ILogger , BaseLogger , AsyncWriter
+class StdLogger : public BaseLogger, protected IAsyncSink {
 protected:
 	using BaseLogger::bLogToConsole;
 	// Потоки для вывода информационных сообщений, предупрежнений и ошибок
 	mutable std::ostream *log_out, *wrn_out, *err_out;
 	bool l_del,w_del,e_del;
+	// Асинхронный писатель, NULL если вывод синхронный
+	std::unique_ptr<AsyncWriter> async;
+	// Защита потоков при синхронном выводе: строка записывается целиком под блокировкой
+	mutable std::mutex out_mutex;
+	/// Номера каналов асинхронного писателя.
+	enum { chLog = 0, chWrn = 1, chErr = 2 };
 	//---------------------------------------------------------------------------
 public: // Конструктор
 	/// Конструктор.
@@ -249,27 +306,76 @@ public: // Конструктор
 	}
 	//---------------------------------------------------------------------------
 	virtual ~StdLogger() {
+		// Барьер: всё, что было принято асинхронным писателем, должно попасть в потоки
+		async.reset();
 		BaseLogger::onLogFinish(true,wrn_out!=log_out,err_out!=wrn_out&&err_out!=log_out);
 		if(l_del && log_out) delete log_out;
 		if(w_del && wrn_out) delete wrn_out;
 		if(e_del && err_out) delete err_out;
 	}
 	//---------------------------------------------------------------------------
+public: // Асинхронный режим
+	/// Включение асинхронного режима вывода.
+	/// \param capacity - ёмкость кольцевого буфера записей.
+	/// \param policy   - поведение при переполнении буфера.
+	/// \note Режим нужно переключать до начала регистрации сообщений из других потоков.
+	/// \note Повторный вызов пересоздаёт писателя, предварительно выведя все принятые записи.
+	void setAsync(size_t capacity = 8192, OverflowPolicy policy = OverflowPolicy::Block) {
+		async.reset();
+		async.reset(new AsyncWriter(*this, capacity, policy));
+	}
+	/// Возврат к синхронному выводу (с выводом всех принятых записей).
+	void setSync() { async.reset(); }
+	/// Включен ли асинхронный режим.
+	bool isAsync() const { return async != NULL; }
+	/// Барьер: дожидается вывода всех записей, зарегистрированных до вызова,
+	/// и сбрасывает буферы потоков.
+	void flush() const {
+		if (async) async->flush();
+		else {
+			std::lock_guard<std::mutex> lock(out_mutex);
+			if (log_out) log_out->flush();
+			if (wrn_out) wrn_out->flush();
+			if (err_out) err_out->flush();
+		}
+	}
+	/// Количество записей, потерянных при переполнении (OverflowPolicy::DropNewest).
+	unsigned long long dropped() const { return async ? async->dropped() : 0; }
+	//---------------------------------------------------------------------------
 protected: // Функиции механизма вывода
-	virtual void ConsoleOut(const std::string& msg) const {
+	virtual void ConsoleOut(MsgView msg) const {
 		if (bLogToConsole)
 			std::cout << msg << std::endl;
 	}
-	virtual void lOut(const std::string& msg) const {
+	virtual void lOut(MsgView msg) const {
+		if (async) { async->push(chLog, msg.data(), msg.size()); return; }
+		std::lock_guard<std::mutex> lock(out_mutex);
 		if (log_out) (*log_out) << msg << std::endl;
 		ConsoleOut(msg);
 	}
-	virtual void wOut(const std::string& msg) const {
+	virtual void wOut(MsgView msg) const {
+		if (async) { async->push(chWrn, msg.data(), msg.size()); return; }
+		std::lock_guard<std::mutex> lock(out_mutex);
 		if (wrn_out) (*wrn_out) << msg << std::endl;
 		ConsoleOut(msg);
 	}
-	virtual void eOut(const std::string& msg) const {
+	virtual void eOut(MsgView msg) const {
+		if (async) { async->push(chErr, msg.data(), msg.size()); return; }
+		std::lock_guard<std::mutex> lock(out_mutex);
 		if (err_out) (*err_out) << msg << std::endl;
 		ConsoleOut(msg);
 	}
+	//---------------------------------------------------------------------------
+protected: // Вывод из фонового потока асинхронного писателя
+	virtual void asyncWrite(int chan, const std::string& rec) {
+		std::ostream* out = chan == chLog ? log_out : chan == chWrn ? wrn_out : err_out;
+		// Без std::endl: сброс буферов выполняется пачкой в asyncFlush()
+		if (out) (*out) << rec << '\n';
+		ConsoleOut(rec);
+	}
+	virtual void asyncFlush() {
+		if (log_out) log_out->flush();
+		if (wrn_out) wrn_out->flush();
+		if (err_out) err_out->flush();
+	}
 }; //struct StdLogger
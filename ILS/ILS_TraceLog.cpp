@@ -0,0 +1,117 @@
+#include "ILS_JsonLog.h"
+#include "ILS_TraceLog.h"
+
+//=============================================================================
+// TraceLogger - временная шкала секций в формате Chrome Trace Event.
+//-----------------------------------------------------------------------------
+namespace {
+	struct TTraceTag;
+	struct TTraceFmtTag;
+	struct TTraceMsgTag;
+}
+// Конструктор
+TraceLogger::TraceLogger(const std::string& file, std::shared_ptr<ILogger> next)
+	: m_pFile(NULL), m_pNext(next), m_Start(std::chrono::steady_clock::now()), m_bFirst(true) {
+	m_pFile = fopen(file.c_str(), "wb");
+	if (!m_pFile) return;
+	// Буфер фиксированного размера: события уходят в файл по мере заполнения
+	setvbuf(m_pFile, NULL, _IOFBF, 1 << 16);
+	fputs("[", m_pFile);
+}
+TraceLogger::~TraceLogger() {
+	if (!m_pFile) return;
+	fputs("\n]\n", m_pFile);
+	fclose(m_pFile);
+}
+void TraceLogger::flush() const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (m_pFile) fflush(m_pFile);
+}
+//-----------------------------------------------------------------------------
+// Функции интерфейса: всё передаётся следующему логгеру,
+// предупреждения и ошибки дополнительно отмечаются на шкале
+const char* TraceLogger::msgTranslate(const LogId& id, const char* msg, Msg& buf) const {
+	if (m_pNext) return m_pNext->msgTranslate(id, msg, buf);
+	return ILogger::msgTranslate(id, msg, buf);
+}
+void TraceLogger::infOut(MsgView msg, const LogId& id) const {
+	if (m_pNext) m_pNext->infOut(msg, id);
+}
+void TraceLogger::logOut(MsgView msg, const LogId& id) const {
+	if (m_pNext) m_pNext->logOut(msg, id);
+}
+void TraceLogger::wrnOut(MsgView msg, const LogId& id) const {
+	if (m_pNext) m_pNext->wrnOut(msg, id);
+	if (logEnabled(ILS_LEVEL_WRN)) instantOut("warning", msg, id);
+}
+void TraceLogger::errOut(MsgView msg, const LogId& id) const {
+	if (m_pNext) m_pNext->errOut(msg, id);
+	if (logEnabled(ILS_LEVEL_ERR)) instantOut("error", msg, id);
+}
+// Следующий логгер получает сырые аргументы (отложенное форматирование, BinLogger);
+// текст форматируется здесь, только если он нужен для мгновенного события
+bool TraceLogger::rawOut(int level, const TFmtSite& site, const LogId& id, va_list marker) const {
+	if (!m_pNext) return false;
+	va_list args;
+	va_copy(args, marker);
+	const bool raw = m_pNext->rawOut(level, site, id, args);
+	va_end(args);
+	// Следующему логгеру нужен текст: сообщение отформатирует ILogger::out() и передаст в wrnOut() ...
+	if (!raw) return false;
+	if (level >= ILS_LEVEL_WRN && m_pFile && logEnabled(level)) {
+		TThreadBuf<TTraceFmtTag> fmt;
+		TThreadBuf<TTraceMsgTag> str;
+		ils_vappendf(str.str(), msgTranslate(id, site.fmt, fmt.str()), marker);
+		instantOut(level >= ILS_LEVEL_ERR ? "error" : "warning", str.str(), id);
+	}
+	return true;
+}
+void TraceLogger::sectOut(bool begin, const char* sect, std::chrono::steady_clock::time_point t) const {
+	if (m_pNext) m_pNext->sectOut(begin, sect, t);
+	if (!m_pFile || !logEnabled(ILS_LEVEL_INF)) return;
+	TThreadBuf<TTraceTag> buf;
+	std::string& rec = buf.str();
+	rec += "{\"name\":\"";
+	appendJson(rec, sect ? sect : "");
+	rec += "\",\"cat\":\"section\",";
+	putEvent(rec, begin ? 'B' : 'E', t);
+	rec += '}';
+	commit(rec);
+}
+//-----------------------------------------------------------------------------
+// Формирование и запись событий
+void TraceLogger::instantOut(const char* cat, MsgView msg, const LogId& id) const {
+	if (!m_pFile) return;
+	const std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+	TThreadBuf<TTraceTag> buf;
+	std::string& rec = buf.str();
+	rec += "{\"name\":\"";
+	appendJson(rec, id.empty() ? MsgView(cat) : MsgView(id));
+	rec += "\",\"cat\":\"";
+	rec += cat;
+	rec += "\",";
+	putEvent(rec, 'i', t);
+	// Область "t" - отметка на шкале потока
+	rec += ",\"s\":\"t\",\"args\":{\"msg\":\"";
+	appendJson(rec, msg);
+	rec += "\"}}";
+	commit(rec);
+}
+void TraceLogger::putEvent(std::string& rec, char phase, std::chrono::steady_clock::time_point t) const {
+	long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t - m_Start).count();
+	if (ns < 0) ns = 0;  // секция начата до создания логгера
+	ils_appendf(rec, "\"ph\":\"%c\",\"ts\":%lld.%03d,\"pid\":1,\"tid\":%u",
+		phase, ns / 1000, int(ns % 1000), threadNo());
+}
+void TraceLogger::commit(const std::string& rec) const {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	fputs(m_bFirst ? "\n" : ",\n", m_pFile);
+	m_bFirst = false;
+	fwrite(rec.data(), 1, rec.size(), m_pFile);
+}
+unsigned TraceLogger::threadNo() {
+	return ils_thread_no();
+}
+void TraceLogger::appendJson(std::string& res, MsgView s) {
+	JsonLogger::appendJson(res, s);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "ILS_Logger.h"
+
+//=============================================================================
+/// Регистратор временной шкалы в формате Chrome Trace Event (JSON).
+/// @ingroup Kernel
+/// Секции ILS_SECTB/ILS_SECTE записываются как события длительности
+/// ("ph":"B" / "ph":"E"), предупреждения и ошибки - как мгновенные события
+/// ("ph":"i"). Каждое событие содержит номер потока и время в микросекундах
+/// от создания логгера, поэтому файл открывается в chrome://tracing или
+/// Perfetto (ui.perfetto.dev) без преобразований.
+///
+/// События пишутся в файл сразу, через буфер фиксированного размера, так что
+/// память не растёт с длиной трассы. Массив событий закрывается в деструкторе;
+/// если процесс завершился аварийно, незакрытый файл всё равно читается
+/// обоими просмотрщиками.
+///
+/// Все сообщения (включая текстовые строки секций) передаются дальше,
+/// следующему логгеру \c next, если он задан, так что трассировку можно
+/// включить поверх обычного лога. Сообщения ILS_BLOG/ILS_BWRN передаются
+/// следующему логгеру без форматирования (rawOut()), если он это умеет:
+/// \code
+/// auto log = std::make_shared<StdLogger>("app.log");
+/// app.setPersonalLogger(std::make_shared<TraceLogger>("app.trace.json", log));
+/// \endcode
+/// \see ILogger::sectOut()
+class TraceLogger : public ILogger {
+public:
+	/// Конструктор.
+	/// \param file - имя файла трассы (.json).
+	/// \param next - логгер, которому передаются все сообщения (может быть NULL).
+	TraceLogger(const std::string& file, std::shared_ptr<ILogger> next = NULL);
+	virtual ~TraceLogger();
+	TraceLogger(const TraceLogger&) = delete;
+	TraceLogger& operator=(const TraceLogger&) = delete;
+	/// Удалось ли открыть файл.
+	bool isOpen() const { return m_pFile != NULL; }
+	/// Сброс буферов файла.
+	void flush() const;
+	//---------------------------------------------------------------------------
+public: // Функции интерфейса
+	virtual void infOut(MsgView msg, const LogId& id) const;
+	virtual void logOut(MsgView msg, const LogId& id) const;
+	virtual void wrnOut(MsgView msg, const LogId& id) const;
+	virtual void errOut(MsgView msg, const LogId& id) const;
+	virtual bool rawOut(int level, const TFmtSite& site, const LogId& id, va_list marker) const;
+	virtual void sectOut(bool begin, const char* sect, std::chrono::steady_clock::time_point t) const;
+	virtual void incidentOut(const char* what) const { if (m_pNext) m_pNext->incidentOut(what); }
+	virtual double logParam(int param) const { return m_pNext ? m_pNext->logParam(param) : 0.; }
+protected:
+	virtual const char* msgTranslate(const LogId& id, const char* msg, Msg& buf) const;
+	/// Запись мгновенного события для предупреждения или ошибки.
+	void instantOut(const char* cat, MsgView msg, const LogId& id) const;
+	/// Дописывание общих полей события: фаза, время и номер потока.
+	void putEvent(std::string& rec, char phase, std::chrono::steady_clock::time_point t) const;
+	/// Запись готового события в файл.
+	void commit(const std::string& rec) const;
+	/// Номер текущего потока (1, 2, ... в порядке первого события), см. ils_thread_no().
+	static unsigned threadNo();
+	/// Дописывание строки с экранированием по правилам JSON.
+	static void appendJson(std::string& res, MsgView s);
+	std::FILE* m_pFile;
+	std::shared_ptr<ILogger> m_pNext;
+	mutable std::mutex m_Mutex;
+	std::chrono::steady_clock::time_point m_Start;
+	mutable bool m_bFirst;  // Ещё не записано ни одного события (нет разделителя)
+}; //class TraceLogger
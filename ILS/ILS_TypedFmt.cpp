@@ -0,0 +1,95 @@
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include "ILS_TypedFmt.h"
+
+namespace {
+	// Значение целого аргумента для беззнаковых преобразований (%u %x %o):
+	// отрицательное знаковое приводится к беззнаковому того же размера, как у printf()
+	inline unsigned long long unsignedValue(const TFmtArg& a) {
+		if (!a.is_signed || a.size >= sizeof(unsigned long long)) return a.u;
+		return a.u & ((1ULL << (a.size * 8)) - 1);
+	}
+	inline size_t toChars(char* buf, size_t size, const std::to_chars_result& r) {
+		return r.ec == std::errc() ? size_t(r.ptr - buf) : size;
+	}
+}
+
+//=============================================================================
+// Форматирование значения по спецификатору ILS_FMT.
+//-----------------------------------------------------------------------------
+size_t ils_format_value(char* buf, size_t size, const char* pct, const TTypedSpec& spec, const TFmtArg& arg, int width, int prec) {
+	char conv = spec.conv == 't' ? 'f' : spec.conv;
+	if (arg.cls == acInt && (conv == 'd' || conv == 'i') && !arg.is_signed) conv = 'u';
+	if (spec.plain) {
+		// Частые случаи - без разбора формата в snprintf()
+		size_t n = size;
+		switch (conv) {
+		case 'd': case 'i': n = toChars(buf, size, std::to_chars(buf, buf + size, arg.i)); break;
+		case 'u': n = toChars(buf, size, std::to_chars(buf, buf + size, unsignedValue(arg))); break;
+		case 'x': n = toChars(buf, size, std::to_chars(buf, buf + size, unsignedValue(arg), 16)); break;
+		case 'o': n = toChars(buf, size, std::to_chars(buf, buf + size, unsignedValue(arg), 8)); break;
+		case 'c': if (size > 1) { buf[0] = char(arg.i); n = 1; } break;
+#ifdef __GLIBC__
+		// %p в glibc: "0x" и шестнадцатеричный адрес, "(nil)" для NULL
+		case 'p':
+			if (!arg.p) n = size > 5 ? size_t(snprintf(buf, size, "(nil)")) : size;
+			else if (size > 2) {
+				buf[0] = '0'; buf[1] = 'x';
+				n = toChars(buf, size, std::to_chars(buf + 2, buf + size, (unsigned long long)(uintptr_t)arg.p, 16));
+			}
+			break;
+#endif
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+		// Форматы fixed/scientific/general с точностью 6 совпадают с %f/%e/%g
+		case 'f': if (!arg.is_long) n = toChars(buf, size, std::to_chars(buf, buf + size, arg.d, std::chars_format::fixed, 6)); break;
+		case 'e': if (!arg.is_long) n = toChars(buf, size, std::to_chars(buf, buf + size, arg.d, std::chars_format::scientific, 6)); break;
+		case 'g': if (!arg.is_long) n = toChars(buf, size, std::to_chars(buf, buf + size, arg.d, std::chars_format::general, 6)); break;
+#endif
+		}
+		if (n < size) return n;
+	}
+	// Общий случай: спецификатор без модификатора длины, с модификатором по типу аргумента
+	char fmt[64];
+	size_t k = 0;
+	fmt[k++] = '%';
+	const char* p = pct + 1;
+	for (; ils_fmt_in(*p, "-+ #0'") && k < 16; ++p) fmt[k++] = *p;
+	if (*p == '*') {
+		++p;
+		k += toChars(fmt + k, 12, std::to_chars(fmt + k, fmt + k + 12, width));
+	}
+	else for (; *p >= '0' && *p <= '9'; ++p) if (k < 28) fmt[k++] = *p;
+	if (*p == '.') {
+		fmt[k++] = '.';
+		++p;
+		if (*p == '*') {
+			++p;
+			// Отрицательная точность из аргумента - как если бы её не было
+			if (prec < 0) --k;
+			else k += toChars(fmt + k, 12, std::to_chars(fmt + k, fmt + k + 12, prec));
+		}
+		else for (; *p >= '0' && *p <= '9'; ++p) if (k < 44) fmt[k++] = *p;
+	}
+	int n = -1;
+	switch (arg.cls) {
+	case acInt:
+		if (conv == 'c') { fmt[k++] = 'c'; fmt[k] = 0; n = snprintf(buf, size, fmt, int(arg.i)); break; }
+		fmt[k++] = 'l'; fmt[k++] = 'l'; fmt[k++] = conv; fmt[k] = 0;
+		if (conv == 'd' || conv == 'i') n = snprintf(buf, size, fmt, arg.i);
+		else n = snprintf(buf, size, fmt, unsignedValue(arg));
+		break;
+	case acFloat:
+		if (arg.is_long) fmt[k++] = 'L';
+		fmt[k++] = conv; fmt[k] = 0;
+		n = arg.is_long ? snprintf(buf, size, fmt, *arg.ld) : snprintf(buf, size, fmt, arg.d);
+		break;
+	case acPtr: case acCStr:
+		fmt[k++] = 'p'; fmt[k] = 0;
+		n = snprintf(buf, size, fmt, arg.p);
+		break;
+	default:
+		break;
+	}
+	return n < 0 ? 0 : size_t(n);
+}
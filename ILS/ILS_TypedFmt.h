@@ -0,0 +1,249 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+//=============================================================================
+/// Класс аргумента форматирования с проверкой типов (ILS_FMT).
+/// @ingroup Kernel
+enum TArgClass {
+	acInt,    ///< Целое, bool, char, перечисление (%d %i %o %u %x %X %c, ширина/точность '*').
+	acFloat,  ///< float, double, long double (%f %F %e %E %g %G %a %A и ключ %t).
+	acStr,    ///< std::string, std::string_view (%s).
+	acCStr,   ///< const char*, char*, массив char (%s, %p).
+	acPtr,    ///< Остальные указатели, nullptr (%p).
+	acOther,  ///< Тип, который нельзя форматировать.
+	acEnd     ///< Конец списка аргументов.
+};
+
+/// Результат проверки формата.
+/// @ingroup Kernel
+enum TFmtError {
+	feOk,
+	feTooFewArgs,   ///< Спецификаторов больше, чем аргументов.
+	feTooManyArgs,  ///< Аргументов больше, чем спецификаторов.
+	feMismatch,     ///< Тип аргумента не подходит спецификатору.
+	feUnsupported   ///< Неизвестный спецификатор (%n, %ls ...) или '%' в конце строки.
+};
+
+//-----------------------------------------------------------------------------
+/// Класс аргумента типа \c T.
+template<class T> constexpr TArgClass ils_arg_class() {
+	typedef typename std::decay<T>::type U;
+	if (std::is_integral<U>::value || std::is_enum<U>::value) return acInt;
+	if (std::is_floating_point<U>::value) return acFloat;
+	if (std::is_same<U, char*>::value || std::is_same<U, const char*>::value) return acCStr;
+	if (std::is_same<U, std::string>::value || std::is_same<U, std::string_view>::value) return acStr;
+	if (std::is_pointer<U>::value || std::is_null_pointer<U>::value) return acPtr;
+	return acOther;
+}
+
+//-----------------------------------------------------------------------------
+/// Разобранный спецификатор формата.
+struct TTypedSpec {
+	const char* end;  ///< Позиция за символом преобразования.
+	char conv;        ///< Символ преобразования, 0 - ошибка разбора.
+	bool plain;       ///< Нет флагов, ширины и точности.
+	bool width_arg;   ///< Ширина задана аргументом ('*').
+	bool prec_arg;    ///< Точность задана аргументом ('*').
+	bool wide;        ///< Широкая строка или символ (%ls, %lc) - не поддерживается.
+};
+constexpr bool ils_fmt_in(char c, const char* set) {
+	for (; *set; ++set) if (*set == c) return true;
+	return false;
+}
+/// Разбор спецификатора, \c p указывает за '%' (не "%%").
+/// Модификаторы длины пропускаются: размер аргумента известен по его типу.
+/// Исключение - 'l' перед 's' и 'c' (wchar_t), такой спецификатор отмечается \c wide.
+/// Ключ %t (время) - отдельное преобразование, выводится как %f.
+constexpr TTypedSpec ils_fmt_spec(const char* p) {
+	TTypedSpec spec{ p, 0, true, false, false, false };
+	while (*p && ils_fmt_in(*p, "-+ #0'")) { ++p; spec.plain = false; }
+	if (*p == '*') { ++p; spec.width_arg = true; spec.plain = false; }
+	else while (*p >= '0' && *p <= '9') { ++p; spec.plain = false; }
+	if (*p == '.') {
+		++p;
+		spec.plain = false;
+		if (*p == '*') { ++p; spec.prec_arg = true; }
+		else while (*p >= '0' && *p <= '9') ++p;
+	}
+	if (*p == 'l' && (p[1] == 's' || p[1] == 'c')) { spec.wide = true; ++p; }
+	else if (*p == 'h' || *p == 'l') { if (p[1] == *p) ++p; ++p; }
+	else if (*p == 'z' || *p == 'j' || *p == 'L') ++p;
+	else if (*p == 't' && p[1] && ils_fmt_in(p[1], "diouxX")) ++p;
+	else if (*p == 'I' && p[1] == '6' && p[2] == '4') p += 3;
+	if (!*p) return spec;
+	spec.conv = *p;
+	spec.end = p + 1;
+	return spec;
+}
+/// Подходит ли аргумент класса \c a преобразованию \c conv.
+constexpr bool ils_fmt_accepts(char conv, TArgClass a) {
+	if (ils_fmt_in(conv, "diouxXc")) return a == acInt;
+	if (ils_fmt_in(conv, "fFeEgGaAt")) return a == acFloat;
+	if (conv == 's') return a == acStr || a == acCStr;
+	if (conv == 'p') return a == acPtr || a == acCStr;
+	return false;
+}
+/// Проверка строки формата по классам аргументов (список завершается acEnd).
+constexpr TFmtError ils_fmt_check(const char* fmt, const TArgClass* args) {
+	size_t n = 0;
+	for (const char* p = fmt; *p; ++p) {
+		if (*p != '%') continue;
+		if (p[1] == '%') { ++p; continue; }
+		const TTypedSpec spec = ils_fmt_spec(p + 1);
+		if (!spec.conv || spec.wide || !ils_fmt_in(spec.conv, "diouxXcfFeEgGaAtsp")) return feUnsupported;
+		for (int star = int(spec.width_arg) + int(spec.prec_arg); star > 0; --star, ++n) {
+			if (args[n] == acEnd) return feTooFewArgs;
+			if (args[n] != acInt) return feMismatch;
+		}
+		if (args[n] == acEnd) return feTooFewArgs;
+		if (!ils_fmt_accepts(spec.conv, args[n++])) return feMismatch;
+		p = spec.end - 1;
+	}
+	return args[n] == acEnd ? feOk : feTooManyArgs;
+}
+
+//=============================================================================
+/// База строк формата, проверяемых при компиляции (см. ILS_FMT).
+/// @ingroup Kernel
+struct TFmtString {};
+template<class F> struct TIsFmtString : std::is_base_of<TFmtString, F> {};
+
+/// Строка формата, проверяемая при компиляции.
+/// Литерал заворачивается в тип, так что функции с проверкой типов
+/// (ILogger::log(const LogId&, F, const Args&...), TLoggerStream::operator() ...)
+/// получают формат как константу и сверяют его с типами аргументов в static_assert:
+/// \code
+/// log("app", ILS_FMT("loaded %d boxes in %t s"), n, seconds);
+/// ILS_WRN(("app", ILS_FMT("loading box %d [this=0x%p]"), i, this) << " line #" << __LINE__);
+/// \endcode
+/// Несовпадение количества или типов аргументов - ошибка компиляции.
+/// Модификаторы длины не нужны (тип известен): "%d" выводит и int, и long long, и size_t.
+/// @ingroup Common
+#define ILS_FMT(S) ([] { struct TFmt : TFmtString { static constexpr const char* str() { return S; } }; return TFmt(); }())
+
+/// Метка буфера текущего потока для форматирования ILS_FMT (TThreadBuf).
+struct TTypedFmtTag;
+
+/// Проверка формата \c F при компиляции.
+template<class F, class... Args> inline void ils_fmt_assert() {
+	static constexpr TArgClass args[] = { ils_arg_class<Args>()..., acEnd };
+	static constexpr TFmtError error = ils_fmt_check(F::str(), args);
+	static_assert(error != feTooFewArgs, "ILS_FMT: спецификаторов формата больше, чем аргументов");
+	static_assert(error != feTooManyArgs, "ILS_FMT: аргументов больше, чем спецификаторов формата");
+	static_assert(error != feMismatch, "ILS_FMT: тип аргумента не подходит спецификатору формата");
+	static_assert(error != feUnsupported, "ILS_FMT: неподдерживаемый спецификатор формата");
+}
+
+//=============================================================================
+/// Аргумент форматирования с проверкой типов (без шаблонов: одна функция
+/// форматирования на все сочетания типов).
+/// @ingroup Kernel
+struct TFmtArg {
+	TArgClass cls;
+	bool is_signed;     ///< acInt: знаковый тип.
+	bool is_long;       ///< acFloat: long double.
+	unsigned char size; ///< acInt: размер исходного типа (для %u %x %o отрицательных).
+	union {
+		long long i;
+		unsigned long long u;
+		double d;
+		const long double* ld;  ///< Аргумент живёт до конца вызова функции вывода.
+		const void* p;
+		const char* s;
+	};
+	size_t len;         ///< acStr: длина строки.
+	TFmtArg() : cls(acEnd), is_signed(false), is_long(false), size(0), u(0), len(0) {}
+};
+template<class T> inline typename std::enable_if<std::is_integral<T>::value, TFmtArg>::type ils_fmt_arg(T v) {
+	TFmtArg a;
+	a.cls = acInt;
+	a.size = sizeof(T);
+	a.is_signed = std::is_signed<T>::value;
+	if (a.is_signed) a.i = (long long)v; else a.u = (unsigned long long)v;
+	return a;
+}
+template<class T> inline typename std::enable_if<std::is_enum<T>::value, TFmtArg>::type ils_fmt_arg(T v) {
+	return ils_fmt_arg(typename std::underlying_type<T>::type(v));
+}
+inline TFmtArg ils_fmt_arg(double v) { TFmtArg a; a.cls = acFloat; a.d = v; return a; }
+inline TFmtArg ils_fmt_arg(float v) { return ils_fmt_arg(double(v)); }
+inline TFmtArg ils_fmt_arg(const long double& v) { TFmtArg a; a.cls = acFloat; a.is_long = true; a.ld = &v; return a; }
+inline TFmtArg ils_fmt_arg(const char* v) { TFmtArg a; a.cls = acCStr; a.s = v; return a; }
+inline TFmtArg ils_fmt_arg(std::string_view v) { TFmtArg a; a.cls = acStr; a.s = v.data(); a.len = v.size(); return a; }
+inline TFmtArg ils_fmt_arg(const std::string& v) { return ils_fmt_arg(std::string_view(v)); }
+inline TFmtArg ils_fmt_arg(std::nullptr_t) { TFmtArg a; a.cls = acPtr; a.p = NULL; return a; }
+template<class T> inline TFmtArg ils_fmt_arg(const T* v) { TFmtArg a; a.cls = acPtr; a.p = v; return a; }
+template<class T> inline typename std::enable_if<ils_arg_class<T>() == acOther, TFmtArg>::type ils_fmt_arg(const T&) { TFmtArg a; a.cls = acOther; return a; }
+
+//-----------------------------------------------------------------------------
+/// Форматирование числа или указателя по спецификатору.
+/// \param buf  - буфер результата.
+/// \param size - размер буфера.
+/// \param pct  - начало спецификатора ('%').
+/// \param spec - разобранный спецификатор.
+/// \param arg  - аргумент (класс уже проверен).
+/// \param width, prec - значения ширины и точности из аргументов ('*').
+/// \return длина результата (если не меньше \c size - результат не поместился).
+size_t ils_format_value(char* buf, size_t size, const char* pct, const TTypedSpec& spec, const TFmtArg& arg, int width, int prec);
+
+/// Форматирование по строке формата ILS_FMT с дописыванием в конец \c out.
+/// Спецификатор, которому не хватило аргумента или тип которого не совпадает
+/// (например, в формате, изменённом переводом), выводится как есть.
+/// \param out  - строка (std::string, TMsgBuf) с функциями append(const char*, size_t) и push_back(char).
+/// \param fmt  - строка формата.
+/// \param args - аргументы, список завершается аргументом класса acEnd.
+template<class Out> void ils_format_typed(Out& out, const char* fmt, const TFmtArg* args) {
+	for (;;) {
+		const char* pct = strchr(fmt, '%');
+		if (!pct) { out.append(fmt, strlen(fmt)); return; }
+		out.append(fmt, size_t(pct - fmt));
+		if (pct[1] == '%') { out.push_back('%'); fmt = pct + 2; continue; }
+		const TTypedSpec spec = ils_fmt_spec(pct + 1);
+		if (!spec.conv) { out.append(pct, strlen(pct)); return; }
+		fmt = spec.end;
+		int width = 0, prec = -1;
+		const TFmtArg* a = args;
+		bool ok = true;
+		if (spec.width_arg) { if (a->cls == acInt) width = int((a++)->i); else ok = false; }
+		if (spec.prec_arg && ok) { if (a->cls == acInt) prec = int((a++)->i); else ok = false; }
+		if (!ok || spec.wide || !ils_fmt_accepts(spec.conv, a->cls)) {
+			out.append(pct, size_t(spec.end - pct));
+			continue;
+		}
+		args = a + 1;
+		if (spec.conv == 's') {
+			// Строки - без промежуточного буфера, с выравниванием по ширине и обрезкой по точности
+			size_t len = a->cls == acStr ? a->len : a->s ? strlen(a->s) : 6;
+			const char* s = a->cls == acStr || a->s ? a->s : "(null)";
+			if (spec.plain) { out.append(s, len); continue; }
+			// Флаги разбираются всегда ('-' бывает и при ширине и точности из аргументов),
+			// цифры ширины и точности - только если они не заданы аргументами
+			bool left = width < 0;
+			const char* p = pct + 1;
+			for (; ils_fmt_in(*p, "-+ #0'"); ++p) left = left || *p == '-';
+			if (!spec.width_arg) for (width = 0; *p >= '0' && *p <= '9'; ++p) width = width * 10 + (*p - '0');
+			else if (*p == '*') ++p;
+			if (*p == '.' && !spec.prec_arg) for (prec = 0, ++p; *p >= '0' && *p <= '9'; ++p) prec = prec * 10 + (*p - '0');
+			if (width < 0) width = -width;
+			if (prec >= 0 && size_t(prec) < len) len = size_t(prec);
+			const size_t pad = size_t(width) > len ? size_t(width) - len : 0;
+			if (!left) for (size_t k = 0; k < pad; ++k) out.push_back(' ');
+			out.append(s, len);
+			if (left) for (size_t k = 0; k < pad; ++k) out.push_back(' ');
+			continue;
+		}
+		char buf[128];
+		const size_t n = ils_format_value(buf, sizeof(buf), pct, spec, *a, width, prec);
+		if (n < sizeof(buf)) out.append(buf, n);
+		else {
+			std::string big(n + 1, '\0');
+			big.resize(ils_format_value(&big[0], n + 1, pct, spec, *a, width, prec));
+			out.append(big.data(), big.size());
+		}
+	}
+}
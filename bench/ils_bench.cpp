@@ -0,0 +1,565 @@
+// Замеры накладных расходов логгирования.
+// Для каждого сценария выводится среднее время на вызов, количество выделений
+// памяти на сообщение (подсчитываются через глобальные operator new/delete) и
+// задержки отдельных вызовов p50/p99/p99.9. Многопоточные сценарии повторяются
+// на 1, 2, 4 ... N потоках.
+//
+//   ils-bench [--calls N] [--threads N] [--filter ТЕКСТ] [--json ФАЙЛ|-]
+//
+// --json пишет результаты в машиночитаемом виде (для отслеживания регрессий);
+// при "--json -" JSON выводится в stdout, а таблица - в stderr.
+// Файлы приёмников создаются во временном каталоге, который удаляется при выходе.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../ILS/ILS_StdLog.h"
+#include "../ILS/ILS_BinLog.h"
+#include "../ILS/ILS_MMapLog.h"
+#include "../ILS/ILS_RotatingLog.h"
+#include "../ILS/ILS_TraceLog.h"
+#include "../ILS/ILS_JsonLog.h"
+#include "../ILS/ILS_Metrics.h"
+#include "../ILS/ILS_LogConfig.h"
+#include "../ILS/ILS_BatchLog.h"
+#include "../ILS/ILS_FanoutLog.h"
+#include "../ILS/ILS_FlightRecorder.h"
+#include "../ILS/ILS_Defines.h"
+
+//=============================================================================
+// Подсчёт выделений памяти
+static std::atomic<unsigned long long> g_nAllocs(0);
+
+// GCC, встроив замещённый operator delete, видит free() для памяти из operator new
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t n) {
+	g_nAllocs.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(n ? n : 1)) return p;
+	throw std::bad_alloc();
+}
+void* operator new[](std::size_t n) {
+	g_nAllocs.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(n ? n : 1)) return p;
+	throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+//=============================================================================
+// Логгер без вывода: измеряется только формирование сообщения.
+// Счётчик у каждого потока свой, чтобы потоки не делили строку кэша.
+static thread_local size_t t_nNullBytes = 0;
+class NullLogger : public BaseLogger {
+protected:
+	virtual void lOut(MsgView msg) const { t_nNullBytes += msg.size(); }
+	virtual void wOut(MsgView msg) const { t_nNullBytes += msg.size(); }
+	virtual void eOut(MsgView msg) const { t_nNullBytes += msg.size(); }
+};
+
+//=============================================================================
+// Логгер, только считающий сообщения: измеряется передача сообщения.
+struct CountLogger : public ILogger {
+	mutable std::atomic<unsigned long long> m_nCount{0};
+	virtual void infOut(MsgView msg, const LogId& id) const { m_nCount.fetch_add(1, std::memory_order_relaxed); }
+	virtual void logOut(MsgView msg, const LogId& id) const { m_nCount.fetch_add(1, std::memory_order_relaxed); }
+	virtual void wrnOut(MsgView msg, const LogId& id) const { m_nCount.fetch_add(1, std::memory_order_relaxed); }
+	virtual void errOut(MsgView msg, const LogId& id) const { m_nCount.fetch_add(1, std::memory_order_relaxed); }
+};
+
+//=============================================================================
+// Прежний TLoggerStream (std::ostringstream, буфер в 1024 символа на каждый
+// вызов форматирования, имя секции в std::string, копия out.str() при выводе) -
+// для сравнения с текущим на тех же макросах, что и в main.cpp.
+class TLegacyLoggerStream {
+	typedef ILogger::TOutFunc TFuncPtr;
+	mutable std::ostringstream out;
+	mutable std::string m_sSectId;
+	mutable std::string id;
+	const ILogger* m_pLogger;
+	TFuncPtr m_pFunc;
+	bool m_bEnabled = true;
+	void Format(const char* msg, va_list marker) const {
+		std::vector<char> str(1024);
+		std::string buf;
+		if (strstr(msg, "%t")) {
+			buf = msg;
+			for (size_t t = buf.find("%t"); t != std::string::npos; t = buf.find("%t")) buf[t + 1] = 'f';
+		}
+		vsnprintf(str.data(), str.size(), buf.empty() ? msg : buf.c_str(), marker);
+		out << str.data();
+	}
+public:
+	TLegacyLoggerStream(const ILogger* pLogger, TFuncPtr pFunc) : m_pLogger(pLogger), m_pFunc(pFunc) {}
+	TLegacyLoggerStream(const ILogger* pLogger, TFuncPtr pFunc, const char* sect, unsigned int ind)
+		: m_sSectId(sect + std::to_string(ind)), m_pLogger(pLogger), m_pFunc(pFunc) {}
+	const TLegacyLoggerStream& operator()(const std::string& id, const char* msg, ...) const {
+		va_list marker;
+		va_start(marker, msg);
+		Format(msg, marker);
+		va_end(marker);
+		return *this;
+	}
+	const TLegacyLoggerStream& SectBegin(const char* msg, ...) const {
+		out << "SectionBegin " << m_sSectId << " ";
+		va_list marker;
+		va_start(marker, msg);
+		Format(msg, marker);
+		va_end(marker);
+		return *this;
+	}
+	const TLegacyLoggerStream& SectEnd(const char* msg, ...) const {
+		out << "SectionEnd " << m_sSectId << " ";
+		va_list marker;
+		va_start(marker, msg);
+		Format(msg, marker);
+		va_end(marker);
+		m_sSectId = "";
+		return *this;
+	}
+	void Flush() const {
+		(m_pLogger->*m_pFunc)(out.str(), id);
+		out.str("");
+	}
+	template<class T> const TLegacyLoggerStream& operator<<(const T& t) const { out << t; return *this; }
+	~TLegacyLoggerStream() { if (m_bEnabled && m_sSectId.empty()) (m_pLogger->*m_pFunc)(out.str(), id); }
+};
+#define LEGACY_WRN(LOG_ARG) {if (ILS_ENABLED(this, ILS_LEVEL_WRN)) TLegacyLoggerStream(this, &ILogger::wrnOut)LOG_ARG;}
+#define LEGACY_SECTBI(SECTID, INDEX, LOG_ARG) {\
+	TLegacyLoggerStream oSection##SECTID(this, &ILogger::infOut, #SECTID, INDEX); \
+	oSection##SECTID.SectBegin LOG_ARG; \
+	oSection##SECTID.Flush();
+#define LEGACY_SECTEI(SECTID, LOG_ARG) oSection##SECTID.SectEnd LOG_ARG; }
+
+//=============================================================================
+// Объект приложения, пишущий в лог через Logger (как App в main.cpp).
+class BenchObj : public Logger {
+public:
+	void Log(int i) { ILS_LOG(("bench", "value %d [this=0x%p]", i, this) << " line #" << __LINE__); }
+	void Wrn(int i) { ILS_WRN(("bench", "value %d [this=0x%p]", i, this) << " line #" << __LINE__); }
+	void BLog(int i) { ILS_BLOG("bench", "value %d [this=0x%p] %s %f", i, this, "text", 1.5); }
+	void Sect(int i) {
+		ILS_SECTB(Bench, ("section %d", i)) {
+		} ILS_SECTE(Bench, ("section %d", i));
+	}
+	// Шаблоны main.cpp: printf-формат и дописывание через <<
+	void MainWrn(int i) { ILS_WRN(("app", "loading box %d [this=0x%p]", i, this) << " line #" << __LINE__); }
+	void MainSect(int i) {
+		ILS_SECTBI(LoadBox, i, ("загружаем коробку [this=0x%p]", this) << " line #" << __LINE__) {
+		} ILS_SECTEI(LoadBox, i, ("загружена коробка [this=0x%p]", this) << " line #" << __LINE__);
+	}
+	void TypedWrn(int i) { ILS_WRN(("app", ILS_FMT("loading box %d [this=0x%p]"), i, this) << " line #" << __LINE__); }
+	void LegacyWrn(int i) { LEGACY_WRN(("app", "loading box %d [this=0x%p]", i, this) << " line #" << __LINE__); }
+	void LegacySect(int i) {
+		LEGACY_SECTBI(LoadBox, i, ("загружаем коробку [this=0x%p]", this) << " line #" << __LINE__)
+		LEGACY_SECTEI(LoadBox, ("загружена коробка [this=0x%p]", this) << " line #" << __LINE__);
+	}
+};
+
+//=============================================================================
+// Параметры запуска и результаты замеров
+struct TOptions {
+	int calls = 200000;   // Вызовов на поток
+	int threads = 1;      // Наибольшее количество потоков многопоточных сценариев
+	std::string filter;   // Подстрока имени сценария
+	std::string json;     // Файл результатов JSON ("-" - stdout)
+};
+static TOptions g_Opt;
+static FILE* g_pText = stdout;  // Таблица результатов
+
+struct TResult {
+	std::string name;
+	int threads;
+	double ns;       // Среднее время вызова в одном потоке
+	double rate;     // Вызовов в секунду во всех потоках
+	double allocs;   // Выделений памяти на вызов
+	double p50, p99, p999, max;  // Задержка отдельного вызова, нс
+};
+static std::vector<TResult> g_Results;
+
+// Не более стольких замеров задержки на поток
+enum { maxSamples = 100000 };
+// Стоимость замера времени (пары вызовов steady_clock::now()), вычитается из задержек
+static double g_dClockNs = 0;
+
+static double nsSince(std::chrono::steady_clock::time_point t0, std::chrono::steady_clock::time_point t1) {
+	return double(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+}
+static void calibrateClock() {
+	std::vector<double> d(10000);
+	for (double& x : d) {
+		auto t0 = std::chrono::steady_clock::now();
+		x = nsSince(t0, std::chrono::steady_clock::now());
+	}
+	std::nth_element(d.begin(), d.begin() + d.size() / 2, d.end());
+	g_dClockNs = d[d.size() / 2];
+}
+static double percentile(std::vector<double>& v, double p) {
+	size_t k = std::min(v.size() - 1, size_t(p * v.size()));
+	std::nth_element(v.begin(), v.begin() + k, v.end());
+	return v[k];
+}
+
+//=============================================================================
+// Замер сценария на \c threads потоках. Каждый поток прогревается (буферы
+// потока, кольца FlightRecorder и т.п.), затем все одновременно выполняют два
+// прохода: calls вызовов без замеров отдельных вызовов (среднее время и
+// выделения памяти) и до maxSamples вызовов с замером каждого (задержки).
+// Первым рабочим потоком служит сам вызывающий поток.
+template<class F> void measure(const char* name, int threads, F& f) {
+	const int n = g_Opt.calls;
+	const int samples = std::min(n, int(maxSamples));
+	std::vector<std::vector<double> > lat(threads, std::vector<double>(samples));
+	std::atomic<int> ready(0), done(0), go(0);
+	std::chrono::steady_clock::time_point t0, t1;
+	unsigned long long a0 = 0, a1 = 0;
+	auto wait = [](std::atomic<int>& v, int value) { while (v.load() < value) std::this_thread::yield(); };
+	auto worker = [&](int t) {
+		for (int i = 0; i < n / 10; ++i) f(i);
+		for (int phase = 1; phase <= 2; ++phase) {
+			// Синхронный старт: первый поток ждёт остальных и даёт команду
+			if (t) { ++ready; wait(go, phase); }
+			else {
+				wait(ready, (threads - 1) * phase);
+				if (phase == 1) { a0 = g_nAllocs.load(); t0 = std::chrono::steady_clock::now(); }
+				go.store(phase);
+			}
+			if (phase == 1) for (int i = 0; i < n; ++i) f(i);
+			else {
+				double* out = lat[t].data();
+				for (int i = 0; i < samples; ++i) {
+					auto s = std::chrono::steady_clock::now();
+					f(i);
+					out[i] = nsSince(s, std::chrono::steady_clock::now()) - g_dClockNs;
+				}
+			}
+			if (t) ++done;
+			else {
+				wait(done, (threads - 1) * phase);
+				if (phase == 1) { t1 = std::chrono::steady_clock::now(); a1 = g_nAllocs.load(); }
+			}
+		}
+	};
+	std::vector<std::thread> th;
+	for (int t = 1; t < threads; ++t) th.emplace_back(worker, t);
+	worker(0);
+	for (auto& t : th) t.join();
+
+	std::vector<double> all;
+	all.reserve(size_t(samples) * threads);
+	for (auto& v : lat) all.insert(all.end(), v.begin(), v.end());
+	for (double& x : all) if (x < 0) x = 0;
+	TResult r;
+	r.name = name;
+	r.threads = threads;
+	const double total = nsSince(t0, t1);
+	r.ns = total / n;
+	r.rate = total > 0 ? 1e9 * n * threads / total : 0;
+	r.allocs = double(a1 - a0) / (double(n) * threads);
+	r.p50 = percentile(all, 0.5);
+	r.p99 = percentile(all, 0.99);
+	r.p999 = percentile(all, 0.999);
+	r.max = *std::max_element(all.begin(), all.end());
+	fprintf(g_pText, "%-40s %3d %9.1f ns %7.2f allocs  p50 %7.0f  p99 %7.0f  p99.9 %8.0f  max %9.0f\n",
+		name, threads, r.ns, r.allocs, r.p50, r.p99, r.p999, r.max);
+	fflush(g_pText);
+	g_Results.push_back(r);
+}
+static bool selected(const char* name) {
+	return g_Opt.filter.empty() || strstr(name, g_Opt.filter.c_str());
+}
+// Сценарий в одном потоке
+template<class F> void run(const char* name, F f) {
+	if (selected(name)) measure(name, 1, f);
+}
+// Потокобезопасный сценарий: 1, 2, 4 ... потоков и наибольшее их количество
+template<class F> void runMT(const char* name, F f) {
+	if (!selected(name)) return;
+	for (int t = 1; t < g_Opt.threads; t *= 2) measure(name, t, f);
+	measure(name, g_Opt.threads, f);
+}
+
+//=============================================================================
+// Файлы приёмников: временный каталог создаётся при первом обращении
+namespace fs = std::filesystem;
+static fs::path g_TmpDir;
+static std::string tmpFile(const char* name) {
+	if (g_TmpDir.empty()) {
+		std::error_code ec;
+		const fs::path base = fs::temp_directory_path(ec);
+		const long long stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+		for (int k = 0; k < 100 && g_TmpDir.empty(); ++k) {
+			const fs::path dir = base / ("ils_bench." + std::to_string(stamp + k));
+			if (fs::create_directory(dir, ec)) g_TmpDir = dir;
+		}
+		if (g_TmpDir.empty()) {
+			fprintf(stderr, "cannot create a temporary directory in %s\n", base.string().c_str());
+			exit(1);
+		}
+	}
+	return (g_TmpDir / name).string();
+}
+// Удаление временного каталога (после разрушения приёмников)
+struct TTmpCleanup {
+	~TTmpCleanup() {
+		std::error_code ec;
+		if (!g_TmpDir.empty()) fs::remove_all(g_TmpDir, ec);
+	}
+};
+
+//=============================================================================
+// Вывод результатов в JSON
+static void jsonString(FILE* f, const std::string& s) {
+	fputc('"', f);
+	for (unsigned char c : s) {
+		if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+		else if (c < 0x20) fprintf(f, "\\u%04x", c);
+		else fputc(c, f);
+	}
+	fputc('"', f);
+}
+static bool writeJson(const std::string& file) {
+	FILE* f = file == "-" ? stdout : fopen(file.c_str(), "w");
+	if (!f) return false;
+	fprintf(f, "{\n  \"calls\": %d,\n  \"max_threads\": %d,\n  \"hardware_threads\": %u,\n  \"clock_ns\": %.1f,\n  \"results\": [",
+		g_Opt.calls, g_Opt.threads, std::thread::hardware_concurrency(), g_dClockNs);
+	for (size_t k = 0; k < g_Results.size(); ++k) {
+		const TResult& r = g_Results[k];
+		fprintf(f, "%s\n    {\"name\": ", k ? "," : "");
+		jsonString(f, r.name);
+		fprintf(f, ", \"threads\": %d, \"ns_per_call\": %.2f, \"calls_per_sec\": %.0f, \"allocs_per_call\": %.3f, "
+			"\"p50_ns\": %.0f, \"p99_ns\": %.0f, \"p999_ns\": %.0f, \"max_ns\": %.0f}",
+			r.threads, r.ns, r.rate, r.allocs, r.p50, r.p99, r.p999, r.max);
+	}
+	fprintf(f, "\n  ]\n}\n");
+	return f == stdout ? fflush(f) == 0 : fclose(f) == 0;
+}
+
+static bool parseArgs(int argc, char* argv[]) {
+	const unsigned hw = std::thread::hardware_concurrency();
+	g_Opt.threads = hw ? int(hw) : 1;
+	for (int k = 1; k < argc; ++k) {
+		const std::string a = argv[k];
+		const char* v = k + 1 < argc ? argv[k + 1] : NULL;
+		if (a == "--calls" && v) { g_Opt.calls = atoi(v); ++k; }
+		else if (a == "--threads" && v) { g_Opt.threads = atoi(v); ++k; }
+		else if (a == "--filter" && v) { g_Opt.filter = v; ++k; }
+		else if (a == "--json" && v) { g_Opt.json = v; ++k; }
+		else if (a[0] >= '0' && a[0] <= '9') g_Opt.calls = atoi(a.c_str());
+		else return false;
+	}
+	return g_Opt.calls > 0 && g_Opt.threads > 0;
+}
+
+int main(int argc, char* argv[]) {
+	if (!parseArgs(argc, argv)) {
+		fprintf(stderr, "usage: %s [--calls N] [--threads N] [--filter TEXT] [--json FILE|-]\n", argv[0]);
+		return 2;
+	}
+	if (g_Opt.json == "-") g_pText = stderr;
+	TTmpCleanup cleanup;
+	calibrateClock();
+	fprintf(g_pText, "%d calls per thread, up to %d threads, clock %.1f ns\n", g_Opt.calls, g_Opt.threads, g_dClockNs);
+	auto logger = std::make_shared<NullLogger>();
+	const ILogger& il = *logger;
+	std::string longText(3000, 'x');
+
+	runMT("ILogger::inf", [&](int i) { il.inf("bench", "value %d", i); });
+	runMT("ILogger::log", [&](int i) { il.log("bench", "value %d %s", i, "text"); });
+	runMT("ILogger::wrn", [&](int i) { il.wrn("bench", "value %d %t", i, 1.5); });
+	run("ILogger::wrn ILS_FMT", [&](int i) { il.wrn("bench", ILS_FMT("value %d %t"), i, 1.5); });
+	run("ILogger::err", [&](int i) { il.err("bench", "value %d", i); });
+	run("ILogger::log (3000 chars)", [&](int i) { il.log("bench", "%d %s", i, longText.c_str()); });
+	logger->show_info = BaseLogger::siDate | BaseLogger::siTime | BaseLogger::siElapsed | BaseLogger::siMilli;
+	runMT("ILogger::log (full title)", [&](int i) { il.log("bench", "value %d", i); });
+	logger->show_info = 0;
+	// Перевод по каталогу: формат const char* ищется в снимке переводов без блокировок
+	MsgCatalog::instance().add("translated %d %t", "переведено %d за %t с");
+	run("ILogger::log translated", [&](int i) { il.log("bench", "translated %d %t", i, 1.5); });
+
+	BenchObj obj;
+	obj.setPersonalLogger(logger);
+	runMT("ILS_LOG via Logger", [&](int i) { obj.Log(i); });
+	runMT("ILS_WRN via Logger", [&](int i) { obj.Wrn(i); });
+	// Ограничение частоты: почти все вызовы подавляются до форматирования
+	RateLimiter::setDefault(1000, 10);
+	runMT("ILS_WRN rate-limited", [&](int i) { obj.Wrn(i); });
+	RateLimiter::setDefault(0);
+	RateLimiter::flushSummaries(obj);
+	runMT("ILS_SECTB/ILS_SECTE", [&](int i) { obj.Sect(i); });
+	// Прежний TLoggerStream против текущего (TMsgBuf)
+	run("main.cpp ILS_WRN (legacy)", [&](int i) { obj.LegacyWrn(i); });
+	run("main.cpp ILS_WRN", [&](int i) { obj.MainWrn(i); });
+	run("main.cpp ILS_WRN ILS_FMT", [&](int i) { obj.TypedWrn(i); });
+	run("main.cpp ILS_SECTBI (legacy)", [&](int i) { obj.LegacySect(i); });
+	run("main.cpp ILS_SECTBI/EI", [&](int i) { obj.MainSect(i); });
+
+	// Передача готового сообщения через цепочку Logger-ов
+	{
+		auto sink = std::make_shared<CountLogger>();
+		const ILogger::LogId id("bench");
+		for (int depth : { 1, 2, 4, 8 }) {
+			std::vector<std::shared_ptr<Logger> > chain(depth);
+			std::shared_ptr<ILogger> next = sink;
+			for (int k = depth - 1; k >= 0; --k) {
+				chain[k] = std::make_shared<Logger>();
+				chain[k]->setPersonalLogger(next);
+				next = chain[k];
+			}
+			char name[64];
+			snprintf(name, sizeof(name), "Logger::logOut depth %d", depth);
+			if (depth == 4) runMT(name, [&](int i) { chain[0]->logOut("value", id); });
+			else run(name, [&](int i) { chain[0]->logOut("value", id); });
+		}
+		// Дерево объектов: логгер задан у корня, потомки наследуют его через родителей
+		std::vector<Logger> tree(8);
+		tree[0].setPersonalLogger(sink);
+		for (size_t k = 1; k < tree.size(); ++k) tree[k].setParentLogger(tree[k - 1]);
+		run("Logger::logOut tree depth 8", [&](int i) { tree.back().logOut("value", id); });
+		tree[0].setLogPrefix("app.");
+		run("Logger::logOut tree + prefix", [&](int i) { tree.back().logOut("value", id); });
+	}
+
+	// Раздача одного отформатированного сообщения нескольким приёмникам
+	{
+		auto fan = std::make_shared<FanoutLogger>();
+		std::vector<std::shared_ptr<CountLogger> > sinks;
+		for (int k = 0; k < 4; ++k) {
+			sinks.push_back(std::make_shared<CountLogger>());
+			FanoutLogger::TSinkOptions opt;
+			if (k == 3) opt.include.push_back("net.");
+			fan->addSink(sinks.back(), opt);
+		}
+		runMT("FanoutLogger::log 4 sinks (1 filtered)", [&](int i) { fan->log("bench", "value %d", i); });
+	}
+
+	// Бортовой самописец: сообщение отсечено следующим логгером, но сохранено в памяти
+	{
+		auto sink = std::make_shared<CountLogger>();
+		sink->setLogLevel(ILS_LEVEL_WRN);
+		auto rec = std::make_shared<FlightRecorder>(sink);
+		runMT("FlightRecorder::log (next filtered)", [&](int i) { rec->log("bench", "value %d", i); });
+	}
+
+	// Счётчики нагрузки: учёт сообщения и замер времени вывода
+	{
+		auto metrics = std::make_shared<MetricsLogger>("null", logger);
+		runMT("MetricsLogger::log", [&](int i) { metrics->log("bench", "value %d", i); });
+		LogMetrics::instance().reset();
+	}
+
+	// Пороги по идентификаторам (LogConfig): проверка опубликованного набора без блокировок
+	{
+		Logger node;
+		node.setPersonalLogger(std::make_shared<CountLogger>());
+		node.setLogPrefix("app.");
+		runMT("Logger::log (no id levels)", [&](int i) { node.log("bench", "value %d", i); });
+		LogConfig::instance().apply("level app.net.* dbg\nlevel app.db wrn\nlevel * log\n");
+		runMT("Logger::log (id levels, passed)", [&](int i) { node.log("bench", "value %d", i); });
+		runMT("Logger::log (id levels, filtered)", [&](int i) { node.log("db", "value %d", i); });
+		LogConfig::instance().apply("");
+	}
+
+	// Отложенное форматирование: текстовый файл против бинарного
+	if (selected("ILS_BLOG -> StdLogger(async)")) {
+		auto file = std::make_shared<StdLogger>(tmpFile("blog.txt"));
+		file->setAsync();
+		obj.setPersonalLogger(file);
+		runMT("ILS_BLOG -> StdLogger(async)", [&](int i) { obj.BLog(i); });
+		obj.setPersonalLogger(logger);
+	}
+	if (selected("ILS_BLOG -> BinLogger")) {
+		auto bin = std::make_shared<BinLogger>(tmpFile("blog.bin"));
+		obj.setPersonalLogger(bin);
+		runMT("ILS_BLOG -> BinLogger", [&](int i) { obj.BLog(i); });
+		obj.setPersonalLogger(logger);
+	}
+
+	// Каждый приёмник: готовое текстовое сообщение через ILogger::log.
+	// Приёмник создаётся, только если его сценарий выбран (--filter)
+	if (selected("ILogger::log -> StdLogger(file)")) {
+		auto file = std::make_shared<StdLogger>(tmpFile("std.txt"));
+		runMT("ILogger::log -> StdLogger(file)", [&](int i) { file->log("bench", "value %d", i); });
+	}
+	if (selected("ILogger::log -> StdLogger(async)")) {
+		auto async = std::make_shared<StdLogger>(tmpFile("async.txt"));
+		async->setAsync();
+		runMT("ILogger::log -> StdLogger(async)", [&](int i) { async->log("bench", "value %d", i); });
+	}
+	if (selected("ILogger::log -> MMapLogger")) {
+		auto mm = std::make_shared<MMapLogger>(tmpFile("mmap.txt"));
+		runMT("ILogger::log -> MMapLogger", [&](int i) { mm->log("bench", "value %d", i); });
+	}
+	if (selected("ILogger::log -> BatchLogger")) {
+		auto batch = std::make_shared<BatchLogger>(tmpFile("batch.txt"));
+		runMT("ILogger::log -> BatchLogger", [&](int i) { batch->log("bench", "value %d", i); });
+		batch->flush();
+		std::string st;
+		BatchLogger::formatStats(st, batch->stats());
+		fprintf(g_pText, "  %s\n", st.c_str());
+	}
+	if (selected("ILogger::log -> RotatingLogger")) {
+		RotatingLogger::TRotation rot;
+		rot.max_size = 16 << 20;
+		rot.keep = 2;
+		rot.compress = false;
+		auto rotating = std::make_shared<RotatingLogger>(tmpFile("rot.txt"), rot);
+		runMT("ILogger::log -> RotatingLogger", [&](int i) { rotating->log("bench", "value %d", i); });
+		rotating->waitIdle();
+	}
+	if (selected("ILogger::log -> BinLogger")) {
+		auto bin = std::make_shared<BinLogger>(tmpFile("text.bin"));
+		runMT("ILogger::log -> BinLogger", [&](int i) { bin->log("bench", "value %d", i); });
+	}
+	if (selected("ILogger::log -> RingLogger")) {
+		auto ring = std::make_shared<RingLogger>();
+		runMT("ILogger::log -> RingLogger", [&](int i) { ring->log("bench", "value %d", i); });
+	}
+	// Структурированный вывод против текстового, в том числе для кириллицы
+	if (selected("ILogger::log -> JsonLogger")) {
+		auto json = std::make_shared<JsonLogger>(tmpFile("json.jsonl"));
+		runMT("ILogger::log -> JsonLogger", [&](int i) { json->log("bench", "value %d", i); });
+	}
+	if (selected("ILogger::log cyrillic -> StdLogger(file)")) {
+		auto file = std::make_shared<StdLogger>(tmpFile("cyrillic.txt"));
+		run("ILogger::log cyrillic -> StdLogger(file)", [&](int i) { file->log("bench", "значение %d \"ок\"", i); });
+	}
+	if (selected("ILogger::log cyrillic -> JsonLogger")) {
+		auto json = std::make_shared<JsonLogger>(tmpFile("cyrillic.jsonl"));
+		run("ILogger::log cyrillic -> JsonLogger", [&](int i) { json->log("bench", "значение %d \"ок\"", i); });
+	}
+	// Трасса: секции становятся событиями Chrome Trace Event
+	if (selected("ILS_SECTB/E -> TraceLogger")) {
+		auto trace = std::make_shared<TraceLogger>(tmpFile("trace.json"));
+		obj.setPersonalLogger(trace);
+		runMT("ILS_SECTB/E -> TraceLogger", [&](int i) { obj.Sect(i); });
+		obj.setPersonalLogger(logger);
+	}
+
+	// Отсечённые порогом вызовы: аргументы не должны вычисляться
+	obj.setLogLevel(ILS_LEVEL_ERR);
+	runMT("ILS_LOG filtered", [&](int i) { obj.Log(i); });
+	run("ILS_SECTB/E filtered", [&](int i) { obj.Sect(i); });
+	run("ILogger::log filtered", [&](int i) { obj.log("bench", "value %d", i); });
+	BenchObj orphan; // без логгера
+	run("ILS_WRN without logger", [&](int i) { orphan.Wrn(i); });
+
+	if (!g_Opt.json.empty() && !writeJson(g_Opt.json)) {
+		fprintf(stderr, "cannot write %s\n", g_Opt.json.c_str());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,439 @@
+// Самопроверка разбора и форматирования на граничных случаях.
+// TypedFmt - вывод ils_format_typed() сравнивается с snprintf для тех же
+// флагов, ширины, точности и значений; спецификатор без подходящего
+// аргумента должен выводиться как есть.
+// MsgCatalog - загрузка файла переводов: BOM, CRLF, комментарии, экранирование,
+// отвергнутые строки с номерами, замена %t, формат в изменяемом буфере,
+// повторная загрузка и места вызова, запомнившие формат прежней таблицы.
+// LogAnalyzer - секции потоков вперемешку (в том числе при разборе мелкими
+// частями), несогласованные и неоткрытые секции, секция через два файла
+// сеанса, длительности из суффикса и из меток времени, квантили TDurationStats.
+// LogIndex - индекс, построенный по тексту лога (как в ils-query без файла
+// индекса): строки без заголовка и без даты, точные смещения, выбор блоков
+// по времени и уровню, оборванный файл индекса.
+//
+//   ils-selfcheck
+//
+// Код возврата 0 - все проверки пройдены, 1 - найдены ошибки.
+#include <cfloat>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "../ILS/ILS_LogAnalyzer.h"
+#include "../ILS/ILS_LogIndex.h"
+#include "../ILS/ILS_Logger.h"
+#include "../ILS/ILS_MsgCatalog.h"
+#include "../ILS/ILS_TypedFmt.h"
+
+namespace {
+	// Итог раздела: строка OK/FAILED с количеством случаев
+	bool summary(const char* name, unsigned cases, unsigned failed) {
+		printf("%-6s %s: %u cases, failed %u\n", failed ? "FAILED" : "OK", name, cases, failed);
+		return !failed;
+	}
+	// Сравнение с ожидаемым текстом, расхождение выводится
+	bool expect(const char* what, const std::string& got, const std::string& want, unsigned& cases, unsigned& failed) {
+		++cases;
+		if (got == want) return true;
+		++failed;
+		printf("FAILED %s: \"%s\", expected \"%s\"\n", what, got.c_str(), want.c_str());
+		return false;
+	}
+	// Временный файл с текстом (удаляется деструктором)
+	struct TTempFile {
+		std::string name;
+		TTempFile(const char* suffix, const std::string& text) {
+			std::error_code ec;
+			name = (std::filesystem::temp_directory_path(ec) / ("ils-selfcheck." + std::to_string(
+				std::chrono::steady_clock::now().time_since_epoch().count()) + suffix)).string();
+			std::ofstream(name.c_str(), std::ios::binary) << text;
+		}
+		~TTempFile() { std::error_code ec; std::filesystem::remove(name, ec); }
+		TTempFile(const TTempFile&) = delete;
+		TTempFile& operator=(const TTempFile&) = delete;
+	};
+
+	//-------------------------------------------------------------------------
+	// TypedFmt
+	template<class... A> std::string typed(const char* fmt, const A&... a) {
+		const TFmtArg args[] = { ils_fmt_arg(a)..., TFmtArg() };
+		std::string out;
+		ils_format_typed(out, fmt, args);
+		return out;
+	}
+	template<class... A> std::string printed(const char* fmt, A... a) {
+		char buf[512];
+		snprintf(buf, sizeof(buf), fmt, a...);
+		return buf;
+	}
+	struct TFmtCheck {
+		unsigned cases = 0, failed = 0;
+		// Формат без модификаторов длины и формат snprintf для тех же аргументов
+		template<class... A> void like(const char* fmt, const char* cfmt, A... a) {
+			expect(fmt, typed(fmt, a...), printed(cfmt, a...), cases, failed);
+		}
+		template<class... A> void same(const char* fmt, A... a) { like(fmt, fmt, a...); }
+	};
+	bool checkTypedFmt() {
+		TFmtCheck c;
+		// Целые: флаги, ширина, точность, граничные значения
+		c.same("%d|%i|%5d|%-5d|%05d|%+d|% d", 42, -42, 7, 7, -7, 7, 7);
+		c.same("%.0d|%.3d|%8.3d|%-8.3d|%+.0d", 0, 5, -5, 5, 0);
+		c.same("%d|%d", INT_MIN, INT_MAX);
+		c.like("%d|%d", "%lld|%lld", LLONG_MIN, LLONG_MAX);
+		c.like("%u", "%llu", ULLONG_MAX);
+		c.same("%o|%#o|%x|%#x|%X|%#X|%#.0x", 8u, 8u, 255u, 255u, 255u, 255u, 0u);
+		// Отрицательные для беззнаковых преобразований - по размеру исходного типа
+		c.same("%u|%x", -1, -1);
+		c.like("%x", "%hx", (short)-1);
+		c.like("%x", "%hhx", (signed char)-1);
+		c.like("%x", "%llx", -1LL);
+		c.same("%c|%3c|%-3c|", 'a', 'b', 'c');
+		c.like("%d|%d", "%d|%d", true, false);
+		// Ширина и точность аргументами, отрицательная ширина - выравнивание влево
+		c.same("%*d|%-*d|%*d|%.*d", 6, 1, 6, 2, -6, 3, 4, 5);
+		c.same("%*.*f|%.*f", 10, 3, 3.14159, -1, 2.5);
+		// Плавающая точка
+		c.same("%f|%.0f|%.1f|%10.4f|%-10.2f|%+f|% f|%#.0f", 1.5, 2.5, 0.05, 3.14159, 2.0, 1.0, 1.0, 3.0);
+		c.same("%e|%.2E|%g|%G|%#g|%g|%g", 12345.678, 0.000123, 100000.0, 1e-10, 1.0, 1e100, 0.0001);
+		c.same("%a|%A", 1.0, -0.5);
+		c.same("%g|%g|%e", DBL_MAX, DBL_MIN, -0.0);
+		c.same("%f|%F|%f", HUGE_VAL, -HUGE_VAL, NAN);
+		c.like("%f", "%f", 1.25f);
+		c.like("%.3f|%Le", "%.3Lf|%Le", 1.0L / 3, 2.5L);
+		// Ключ %t - время в секундах, выводится как %f
+		c.like("%t|%.3t", "%f|%.3f", 0.5, 12.3456);
+		// Строки: ширина, точность, выравнивание, std::string и string_view без '\0'
+		c.same("%s|%8s|%-8s|%.2s|%8.2s|%-8.2s|%.0s|", "abc", "abc", "abc", "abc", "abc", "abc", "abc");
+		c.same("%*s|%-*s|%.*s|%*.*s|", 5, "ab", 5, "ab", 1, "ab", -5, 1, "ab");
+		c.same("[%-*.*s]|[%*.*s]|[%-*.*s]|[%-*.*s]", 8, 3, "abcdef", 8, 3, "abcdef", -8, 3, "abcdef", 2, -1, "abcdef");
+		c.same("[%s]", "");
+		expect("%s std::string", typed("%s|%5s|%.1s", std::string("xy"), std::string("xy"), std::string("xy")), "xy|   xy|x", c.cases, c.failed);
+		const std::string_view part = std::string_view("abcdef").substr(1, 3);
+		expect("%s string_view", typed("[%s][%-5s]", part, part), "[bcd][bcd  ]", c.cases, c.failed);
+		expect("%s NULL", typed("%s|%8s", (const char*)NULL, (const char*)NULL), "(null)|  (null)", c.cases, c.failed);
+		// Указатели
+		int x = 0;
+		c.same("%p|%20p|%-20p|", (const void*)&x, (const void*)&x, (const void*)&x);
+		expect("%p char*", typed("%p", (const char*)"q"), printed("%p", (const void*)"q"), c.cases, c.failed);
+		// '%%' и спецификаторы без подходящего аргумента выводятся как есть,
+		// аргумент остаётся следующему спецификатору
+		c.same("100%% %d%%", 5);
+		expect("too few args", typed("a=%d b=%d", 1), "a=1 b=%d", c.cases, c.failed);
+		expect("mismatch", typed("%d %s", "str", 2), "%d str", c.cases, c.failed);
+		expect("mismatch skips", typed("%s|%d", 1.5, 7), "%s|%d", c.cases, c.failed);
+		expect("star not int", typed("%*d", "w", 3), "%*d", c.cases, c.failed);
+		expect("%ls", typed("%ls", "w"), "%ls", c.cases, c.failed);
+		expect("trailing %", typed("end %", 1), "end %", c.cases, c.failed);
+		// Результат длиннее внутреннего буфера
+		c.same("%300d|%.200f", 1, 1.0);
+		expect("empty", typed(""), "", c.cases, c.failed);
+		return summary("TypedFmt", c.cases, c.failed);
+	}
+
+	//-------------------------------------------------------------------------
+	// MsgCatalog
+	bool checkMsgCatalog() {
+		unsigned cases = 0, failed = 0;
+		MsgCatalog& cat = MsgCatalog::instance();
+		LogReaders::TGuard guard;
+		std::string buf, error;
+		// Нет файла
+		const bool missing = cat.load("ils-selfcheck.no-such-file.cat", &error);
+		expect("missing file", missing ? "loaded" : error, "ils-selfcheck.no-such-file.cat: не удалось открыть файл\n", cases, failed);
+		expect("missing file: no translations", cat.hasTranslations() ? "yes" : "no", "no", cases, failed);
+		// Строки: BOM и CRLF, комментарий, пустая, без табуляции, чужие спецификаторы, экранирование
+		TTempFile file(".cat",
+			"\xEF\xBB\xBFloaded %d boxes\tзагружено ящиков: %d\r\n"
+			"# comment\tignored %s\n"
+			"\n"
+			"no tab here\n"
+			"box %d of %s\tящик %s из %d\n"
+			"tab\\there\tтаб\\tздесь\\\\\n"
+			"done in %t s\tготово за %.3t с\n"
+			"width %*d\tширина %*d");
+		error.clear();
+		const bool loaded = cat.load(file.name, &error);
+		expect("load", loaded ? "loaded" : "failed", "loaded", cases, failed);
+		expect("load: rejected lines", error, file.name + ":4: нет табуляции между форматом и переводом\n" +
+			file.name + ":5: спецификаторы формата перевода не совпадают с исходными\n", cases, failed);
+		expect("load: size", std::to_string(cat.size()), "4", cases, failed);
+		expect("BOM and CRLF", cat.translate("loaded %d boxes", buf), "загружено ящиков: %d", cases, failed);
+		expect("comment", cat.translate("# comment", buf), "# comment", cases, failed);
+		expect("rejected", cat.translate("box %d of %s", buf), "box %d of %s", cases, failed);
+		expect("escapes", cat.translate("tab\there", buf), "таб\tздесь\\", cases, failed);
+		expect("%t in translation", cat.translate("done in %t s", buf), "готово за %.3f с", cases, failed);
+		expect("no line feed at end", cat.translate("width %*d", buf), "ширина %*d", cases, failed);
+		expect("%t untranslated", cat.translate("took %t s", buf), "took %f s", cases, failed);
+		expect("%t with precision", cat.translate("%5.1t|%%t|%td|%-*t", buf), "%5.1f|%%t|%td|%-*f", cases, failed);
+		// Формат в изменяемом буфере не запоминается: после смены текста по
+		// тому же адресу готовится новый формат
+		const size_t cached = cat.cached();
+		char fmt[64];
+		strcpy(fmt, "took %t s");
+		expect("reused buffer", cat.translate(fmt, buf), "took %f s", cases, failed);
+		strcpy(fmt, "name %s %d");
+		expect("reused buffer: new text", cat.translate(fmt, buf), "name %s %d", cases, failed);
+		expect("reused buffer: not cached", std::to_string(cat.cached() - cached), "0", cases, failed);
+		// Место вызова запоминает запись таблицы; после повторной загрузки
+		// таблица новая, и запись прежней не используется
+		static const char* const site = "site %s";
+		TMsgSlot slot;
+		cat.add(site, "место %s");
+		expect("slot", cat.translate(site, buf, slot), "место %s", cases, failed);
+		expect("slot: cached", cat.translate(site, buf, slot), "место %s", cases, failed);
+		TTempFile again(".cat", "site %s\tместо (2) %s\n");
+		const size_t literals = cat.cached();
+		cat.load(again.name);
+		expect("reload: literals cached", std::to_string(cat.cached()), std::to_string(literals), cases, failed);
+		expect("reload: stale slot", cat.translate(site, buf, slot), "место (2) %s", cases, failed);
+		expect("reload: others kept", cat.translate("loaded %d boxes", buf), "загружено ящиков: %d", cases, failed);
+		expect("reload: size", std::to_string(cat.size()), "5", cases, failed);
+		return summary("MsgCatalog", cases, failed);
+	}
+
+	//-------------------------------------------------------------------------
+	// LogAnalyzer
+	// Узел по пути из имён displayName() через '/', NULL - нет
+	const LogAnalyzer::TNode* node(const LogAnalyzer& a, const std::string& path) {
+		size_t n = 0;
+		std::istringstream in(path);
+		for (std::string name; std::getline(in, name, '/');) {
+			size_t found = 0;
+			for (size_t c : a.nodes()[n].children)
+				if (LogAnalyzer::displayName(a.nodes()[c]) == name) found = c;
+			if (!found) return NULL;
+			n = found;
+		}
+		return &a.nodes()[n];
+	}
+	// Сводка узла: "закрытых/незакрытых min..max ms" или "нет"
+	std::string nodeText(const LogAnalyzer& a, const std::string& path) {
+		const LogAnalyzer::TNode* n = node(a, path);
+		if (!n) return "нет";
+		std::string res;
+		ils_appendf(res, "%llu/%llu", n->count, n->unclosed);
+		if (n->durations.count) ils_appendf(res, " %.3f..%.3f ms", n->durations.min / 1e6, n->durations.max / 1e6);
+		return res;
+	}
+	// Проблемы: "вид id:строка[>closer:строка]" через ';'
+	std::string problemText(const LogAnalyzer& a) {
+		static const char* kinds[] = { "unclosed", "mismatched", "unopened" };
+		std::string res;
+		for (const LogAnalyzer::TProblem& p : a.problems()) {
+			ils_appendf(res, "%s%s %s:%llu", res.empty() ? "" : ";", kinds[p.kind], p.id.c_str(), p.line);
+			if (p.kind == LogAnalyzer::pkMismatched) ils_appendf(res, ">%s:%llu", p.closer.c_str(), p.closer_line);
+		}
+		return res;
+	}
+	bool checkLogAnalyzer() {
+		unsigned cases = 0, failed = 0;
+		// Секции двух потоков вперемешку, индексные секции, строка продолжения
+		const std::string threads =
+			"    0.01 #1 |INFO> SectionBegin Load\n"
+			"    0.01 #2 |INFO> SectionBegin Save\n"
+			"    0.02 #1 |INFO> SectionBegin Box0\n"
+			"    0.03 #2 |INFO> SectionEnd Save [10.000 ms]\n"
+			"    0.04 #1 |INFO> SectionEnd Box0 [2.500 ms]\n"
+			"    0.04 #1 |INFO> SectionBegin Box1\n"
+			"continuation of the message\n"
+			"    0.08 #1 |INFO> SectionEnd Box1\n"
+			"    0.10 #1 |INFO> SectionEnd Load [90.000 ms]\n"
+			"    0.11 #2 |INFO> SectionBegin Open\n";
+		LogAnalyzer::TOptions small;
+		small.chunk = 16;
+		small.threads = 4;
+		for (const LogAnalyzer::TOptions& opt : { LogAnalyzer::TOptions(), small }) {
+			LogAnalyzer a(opt);
+			a.analyze(threads.data(), threads.size(), "threads");
+			const std::string what = opt.chunk == small.chunk ? "threads (16-byte chunks): " : "threads: ";
+			expect((what + "lines").c_str(), std::to_string(a.lines()) + "/" + std::to_string(a.levelCounts()[0]), "10/1", cases, failed);
+			expect((what + "open before finish").c_str(), problemText(a), "", cases, failed);
+			a.finish();
+			expect((what + "problems").c_str(), problemText(a), "unclosed Open:10", cases, failed);
+			expect((what + "Load").c_str(), nodeText(a, "Load"), "1/0 90.000..90.000 ms", cases, failed);
+			expect((what + "Load/Box").c_str(), nodeText(a, "Load/Box[0..1]"), "2/0 2.500..40.000 ms", cases, failed);
+			expect((what + "Save").c_str(), nodeText(a, "Save"), "1/0 10.000..10.000 ms", cases, failed);
+			expect((what + "Open").c_str(), nodeText(a, "Open"), "0/1", cases, failed);
+		}
+		// Без номеров потоков: окончание объемлющей секции и окончание без начала
+		const std::string broken =
+			"    0.01 |INFO> SectionBegin A\n"
+			"    0.02 |INFO> SectionBegin B\n"
+			"    0.03 |INFO> SectionEnd A\n"
+			"    0.04 |INFO> SectionEnd C\n";
+		{
+			LogAnalyzer a;
+			a.analyze(broken.data(), broken.size());
+			a.finish();
+			expect("mismatched: problems", problemText(a), "mismatched B:2>A:3;unopened C:4", cases, failed);
+			expect("mismatched: A", nodeText(a, "A"), "1/0 20.000..20.000 ms", cases, failed);
+			expect("mismatched: A/B", nodeText(a, "A/B"), "0/1", cases, failed);
+			expect("unopened: no node", nodeText(a, "C"), "нет", cases, failed);
+		}
+		// Сеанс из двух файлов: текст первого освобождается до разбора второго
+		{
+			LogAnalyzer a;
+			{
+				const std::string first = "    1.00 #3 |INFO> SectionBegin Long\n    1.50 #3 |INFO> SectionBegin Step7\n";
+				a.analyze(first.data(), first.size(), "first");
+			}
+			{
+				const std::string second = "    2.00 #3 |INFO> SectionEnd Step7\n    3.00 #3 |INFO> SectionEnd Long\n";
+				a.analyze(second.data(), second.size(), "second");
+			}
+			a.finish();
+			expect("session: problems", problemText(a), "", cases, failed);
+			expect("session: Long", nodeText(a, "Long"), "1/0 2000.000..2000.000 ms", cases, failed);
+			expect("session: Long/Step", nodeText(a, "Long/Step[7]"), "1/0 500.000..500.000 ms", cases, failed);
+		}
+		// exact_ids: секции с индексом не объединяются
+		{
+			LogAnalyzer::TOptions opt;
+			opt.exact_ids = true;
+			LogAnalyzer a(opt);
+			a.analyze(threads.data(), threads.size());
+			expect("exact_ids", nodeText(a, "Load/Box0") + "," + nodeText(a, "Load/Box1"), "1/0 2.500..2.500 ms,1/0 40.000..40.000 ms", cases, failed);
+		}
+		// Квантили гистограммы: погрешность - половина корзины (1/32)
+		{
+			TDurationStats all, lo, hi;
+			expect("quantile: empty", std::to_string(all.quantile(0.5)), std::to_string(0.), cases, failed);
+			for (long long ms = 1; ms <= 1000; ++ms) {
+				all.add(ms * 1000000);
+				(ms <= 500 ? lo : hi).add(ms * 1000000);
+			}
+			lo.merge(hi);
+			std::string got;
+			for (double q : { 0.5, 0.99, 1.0 }) {
+				const double want = q * 1000 * 1e6;
+				const double v = all.quantile(q);
+				ils_appendf(got, "%s%s", got.empty() ? "" : ",", v >= want * 0.96 && v <= want * 1.04 ? "ok" : std::to_string(v).c_str());
+			}
+			expect("quantile: p50,p99,p100", got, "ok,ok,ok", cases, failed);
+			expect("quantile: min..max", std::to_string(all.quantile(0.)) + ".." + std::to_string(all.quantile(1.)),
+				std::to_string(1e6) + ".." + std::to_string(1e9), cases, failed);
+			expect("merge", std::to_string(lo.count) + " " + std::to_string(lo.total) + " " + std::to_string(lo.quantile(0.5)),
+				std::to_string(all.count) + " " + std::to_string(all.total) + " " + std::to_string(all.quantile(0.5)), cases, failed);
+			TDurationStats edge;
+			edge.add(0);
+			edge.add(1);
+			edge.add(LLONG_MAX / 2);
+			expect("extreme values", std::to_string(edge.quantile(0.)) + " " + std::to_string(edge.quantile(1.) == double(LLONG_MAX / 2)),
+				std::to_string(0.) + " 1", cases, failed);
+		}
+		return summary("LogAnalyzer", cases, failed);
+	}
+
+	//-------------------------------------------------------------------------
+	// LogIndex
+	// Системное время местного времени 2026/03/01 h:m:s, мкс
+	long long wallUs(int h, int m, int s) {
+		struct tm t = {};
+		t.tm_year = 2026 - 1900;
+		t.tm_mon = 2;
+		t.tm_mday = 1;
+		t.tm_hour = h;
+		t.tm_min = m;
+		t.tm_sec = s;
+		t.tm_isdst = -1;
+		return (long long)mktime(&t) * 1000000;
+	}
+	// Номера блоков через ','
+	std::string blockList(const std::vector<size_t>& blocks) {
+		std::string res;
+		for (size_t b : blocks) ils_appendf(res, "%s%zu", res.empty() ? "" : ",", b);
+		return res;
+	}
+	bool checkLogIndex() {
+		unsigned cases = 0, failed = 0;
+		// Сообщения: строка до первого заголовка, продолжение, строка без даты, конец без '\n'
+		const std::string text =
+			"preface without a header\n"
+			"2026/03/01 10:00:00.000 > start\n"
+			"2026/03/01 10:00:01.000 |WARNING> disk low\n"
+			"  detail of the warning\n"
+			"2026/03/01 10:00:02.000 |INFO> step\n"
+			"    5.00 > undated\n"
+			"2026/03/01 10:00:03.500 |ERROR> failed\n"
+			"2026/03/01 10:00:04.000 > done";
+		const size_t warn = text.find("2026/03/01 10:00:01"), step = text.find("2026/03/01 10:00:02"), err = text.find("2026/03/01 10:00:03");
+		TTempFile log(".log", text);
+		TTempFile idx(".idx", std::string());
+		// Блок в 1 байт: по блоку на сообщение
+		LogIndex index;
+		const bool built = LogIndexWriter::build(log.name, idx.name, 1) && index.open(idx.name);
+		expect("build", built ? "ok" : "failed", "ok", cases, failed);
+		expect("blocks", std::to_string(index.blocks().size()) + " " + std::to_string(index.indexedEnd()), "7 " + std::to_string(text.size()), cases, failed);
+		if (index.blocks().size() == 7) {
+			const LogIndex::TBlock* b = index.blocks().data();
+			expect("preface: no time", std::to_string(b[0].first_us == LogIndexWriter::noTime && b[0].last_us == -LogIndexWriter::noTime) + " " +
+				std::to_string(b[0].levels), "1 " + std::to_string(1u << ILS_LEVEL_LOG), cases, failed);
+			expect("continuation", std::to_string(b[2].begin) + ".." + std::to_string(b[2].end), std::to_string(warn) + ".." + std::to_string(step), cases, failed);
+			expect("local time", std::to_string(b[6].first_us - wallUs(10, 0, 4)) + " " + std::to_string(b[5].first_us - wallUs(10, 0, 3)), "0 500000", cases, failed);
+		}
+		expect("ids", index.ids().size() == 1 ? "[" + index.ids()[0] + "]" : std::to_string(index.ids().size()), "[]", cases, failed);
+		std::string records;
+		for (const LogIndex::TRecord& r : index.records())
+			ils_appendf(records, "%s%llu:%d", records.empty() ? "" : ",", r.offset, r.level);
+		expect("exact records", records, std::to_string(warn) + ":" + std::to_string(ILS_LEVEL_WRN) + "," +
+			std::to_string(err) + ":" + std::to_string(ILS_LEVEL_ERR), cases, failed);
+		// Блоки без известного времени выбираются при любом интервале
+		const long long t2 = wallUs(10, 0, 2);
+		expect("select time", blockList(index.select(t2, t2, -1, LogIndex::levelMask(ILS_LEVEL_LOG))), "0,3,4", cases, failed);
+		expect("select level", blockList(index.select(LogIndexWriter::noTime, -LogIndexWriter::noTime, 0, LogIndex::levelMask(ILS_LEVEL_WRN))), "2,5", cases, failed);
+		expect("select empty window", blockList(index.select(wallUs(11, 0, 0), wallUs(12, 0, 0), -1, LogIndex::levelMask(ILS_LEVEL_WRN))), "", cases, failed);
+		// Крупные блоки покрывают лог без пропусков, точные смещения от размера блока не зависят
+		{
+			LogIndex big;
+			const bool ok = LogIndexWriter::build(log.name, idx.name, 64) && big.open(idx.name);
+			unsigned long long pos = 0, messages = 0;
+			for (const LogIndex::TBlock& b : big.blocks()) {
+				if (b.begin != pos) break;
+				pos = b.end;
+				messages += b.records;
+			}
+			expect("64-byte blocks", std::to_string(ok) + " " + std::to_string(pos) + " " + std::to_string(messages) + " " + std::to_string(big.records().size()),
+				"1 " + std::to_string(text.size()) + " 7 2", cases, failed);
+		}
+		// Оборванная последняя запись игнорируется
+		{
+			LogIndexWriter::build(log.name, idx.name, 1);
+			std::filesystem::resize_file(idx.name, std::filesystem::file_size(idx.name) - 3);
+			LogIndex cut;
+			const bool ok = cut.open(idx.name);
+			expect("truncated index", std::to_string(ok) + " " + std::to_string(cut.blocks().size()) + " " + std::to_string(cut.indexedEnd()),
+				"1 6 " + std::to_string(text.find("2026/03/01 10:00:04")), cases, failed);
+		}
+		// Пустой лог и лог, которого нет
+		{
+			TTempFile empty(".log", std::string());
+			LogIndex none;
+			const bool ok = LogIndexWriter::build(empty.name, idx.name) && none.open(idx.name);
+			expect("empty log", std::to_string(ok) + " " + std::to_string(none.blocks().size()), "1 0", cases, failed);
+			expect("missing log", std::to_string(LogIndexWriter::build(empty.name + ".missing", idx.name)), "0", cases, failed);
+		}
+		return summary("LogIndex", cases, failed);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	if (argc > 1) {
+		fprintf(stderr, "usage: ils-selfcheck\n");
+		return 2;
+	}
+	(void)argv;
+	bool ok = checkTypedFmt();
+	ok = checkMsgCatalog() && ok;
+	ok = checkLogAnalyzer() && ok;
+	ok = checkLogIndex() && ok;
+	return ok ? 0 : 1;
+}
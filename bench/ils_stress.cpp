@@ -0,0 +1,106 @@
+// Проверка одновременной регистрации из нескольких потоков.
+// Потоки пишут сообщения log/wrn/err в один StdLogger (синхронный и
+// асинхронный режимы), после чего вывод разбирается построчно: каждая строка
+// с сообщением должна совпадать с ожидаемой целиком, каждое сообщение
+// должно встретиться ровно один раз, а счётчики warningCount()/errorCount() -
+// совпадать с количеством отправленных предупреждений и ошибок.
+//
+//   ils-stress [--threads N] [--calls N]
+//
+// Код возврата 0 - все проверки пройдены, 1 - найдены ошибки.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../ILS/ILS_StdLog.h"
+
+namespace {
+	// Текст сообщения n потока t: переменной длины, чтобы разрыв строки был заметен
+	std::string payload(int t, int n) {
+		return std::string(size_t(16 + n % 97), char('a' + (t + n) % 26));
+	}
+	// Уровень сообщения n: каждое 7-е - ошибка, каждое 3-е - предупреждение
+	int levelOf(int n) { return n % 7 == 0 ? ILS_LEVEL_ERR : n % 3 == 0 ? ILS_LEVEL_WRN : ILS_LEVEL_LOG; }
+
+	// Один прогон: true - вывод и счётчики верны
+	bool run(const char* name, bool async, int threads, int calls) {
+		std::ostringstream out;
+		unsigned wrn = 0, err = 0;
+		{
+			StdLogger log(out, out, out);
+			if (async) log.setAsync(1024);
+			std::vector<std::thread> th;
+			for (int t = 0; t < threads; ++t)
+				th.emplace_back([&log, t, calls] {
+					for (int n = 0; n < calls; ++n) {
+						const std::string p = payload(t, n);
+						switch (levelOf(n)) {
+						case ILS_LEVEL_ERR: log.err("stress", "stress t=%d n=%d %s|end", t, n, p.c_str()); break;
+						case ILS_LEVEL_WRN: log.wrn("stress", "stress t=%d n=%d %s|end", t, n, p.c_str()); break;
+						default:            log.log("stress", "stress t=%d n=%d %s|end", t, n, p.c_str());
+						}
+					}
+				});
+			for (std::thread& x : th) x.join();
+			log.flush();
+			wrn = log.warningCount();
+			err = log.errorCount();
+		}
+		// Разбор вывода: строки с сообщениями должны быть целыми
+		std::vector<std::vector<unsigned char> > seen(size_t(threads), std::vector<unsigned char>(size_t(calls), 0));
+		unsigned long long records = 0, torn = 0, dup = 0;
+		const std::string text = out.str();
+		std::istringstream lines(text);
+		for (std::string line; std::getline(lines, line);) {
+			const size_t pos = line.find("stress t=");
+			if (pos == std::string::npos) continue;
+			int t = -1, n = -1, len = 0;
+			if (sscanf(line.c_str() + pos, "stress t=%d n=%d %n", &t, &n, &len) != 2 || t < 0 || t >= threads || n < 0 || n >= calls ||
+			    line.compare(pos + size_t(len), std::string::npos, payload(t, n) + "|end") != 0) {
+				++torn;
+				continue;
+			}
+			const char* marker = levelOf(n) == ILS_LEVEL_ERR ? "|ERROR> " : levelOf(n) == ILS_LEVEL_WRN ? "|WARNING> " : "> ";
+			if (pos < strlen(marker) || line.compare(pos - strlen(marker), strlen(marker), marker) != 0) { ++torn; continue; }
+			if (seen[size_t(t)][size_t(n)]++) ++dup;
+			++records;
+		}
+		unsigned long long expectWrn = 0, expectErr = 0;
+		for (int n = 0; n < calls; ++n) {
+			if (levelOf(n) == ILS_LEVEL_WRN) ++expectWrn;
+			if (levelOf(n) == ILS_LEVEL_ERR) ++expectErr;
+		}
+		expectWrn *= unsigned(threads);
+		expectErr *= unsigned(threads);
+		const unsigned long long total = (unsigned long long)threads * unsigned(calls);
+		const bool ok = records == total && !torn && !dup && wrn == expectWrn && err == expectErr;
+		printf("%-6s %s: %d threads x %d calls, records %llu/%llu, torn %llu, duplicated %llu, warnings %u/%llu, errors %u/%llu\n",
+			ok ? "OK" : "FAILED", name, threads, calls, records, total, torn, dup, wrn, expectWrn, err, expectErr);
+		return ok;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	int threads = std::max(4, int(std::thread::hardware_concurrency()));
+	int calls = 20000;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--calls") && i + 1 < argc) calls = atoi(argv[++i]);
+		else {
+			fprintf(stderr, "usage: ils-stress [--threads N] [--calls N]\n");
+			return 2;
+		}
+	}
+	if (threads < 1 || calls < 1) {
+		fprintf(stderr, "ils-stress: bad arguments\n");
+		return 2;
+	}
+	bool ok = run("StdLogger(sync)", false, threads, calls);
+	ok = run("StdLogger(async)", true, threads, calls) && ok;
+	return ok ? 0 : 1;
+}
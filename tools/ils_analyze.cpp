@@ -0,0 +1,36 @@
+// ils-analyze - дерево секций, длительности и ошибки вложенности по текстовому логу.
+// Использование:
+//   ils-analyze [-j потоков] [-e] [-p проблем] <файл.log>...
+// -e - не объединять секции с индексом (LoadBox0, LoadBox1 ...) в один узел;
+// -p - сколько проблем вывести (0 - все, по умолчанию 20).
+// Несколько файлов (например, сегменты RotatingLogger в порядке записи)
+// разбираются подряд как один лог: секция может начаться в одном сегменте и
+// закончиться в следующем; результаты суммируются.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "../ILS/ILS_LogAnalyzer.h"
+
+int main(int argc, char* argv[]) {
+	LogAnalyzer::TOptions opt;
+	std::vector<const char*> files;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-j") && i + 1 < argc) opt.threads = unsigned(atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-p") && i + 1 < argc) opt.max_problems = size_t(atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-e")) opt.exact_ids = true;
+		else files.push_back(argv[i]);
+	}
+	if (files.empty()) {
+		fprintf(stderr, "usage: ils-analyze [-j threads] [-e] [-p problems] <log.txt>...\n");
+		return 2;
+	}
+	LogAnalyzer analyzer(opt);
+	for (const char* f : files) {
+		if (!analyzer.analyze(f)) { fprintf(stderr, "ils-analyze: cannot open %s\n", f); return 1; }
+	}
+	analyzer.report(std::cout);
+	return 0;
+}
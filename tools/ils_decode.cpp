@@ -0,0 +1,41 @@
+// ils-decode - восстановление текстового лога из бинарного файла BinLogger.
+// Использование:
+//   ils-decode [-i show_info] <файл.bin> [<файл.txt>]
+// Без выходного файла текст выводится в стандартный поток вывода.
+// Код возврата 1, если файл не удалось прочитать или декодирование остановилось
+// на повреждённой записи (записи до неё выводятся).
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "../ILS/ILS_BinLog.h"
+
+int main(int argc, char* argv[]) {
+	unsigned show_info = unsigned(-1);
+	const char* in = NULL;
+	const char* out = NULL;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-i") && i + 1 < argc) show_info = unsigned(strtoul(argv[++i], NULL, 0));
+		else if (!in) in = argv[i];
+		else if (!out) out = argv[i];
+	}
+	if (!in) {
+		fprintf(stderr, "usage: ils-decode [-i show_info] <log.bin> [<log.txt>]\n");
+		return 2;
+	}
+	long long n, bad = -1;
+	if (out) {
+		std::ofstream file(out);
+		if (!file) { fprintf(stderr, "ils-decode: cannot create %s\n", out); return 1; }
+		n = BinLogDecoder::decode(in, file, show_info, &bad);
+	}
+	else n = BinLogDecoder::decode(in, std::cout, show_info, &bad);
+	if (n < 0) { fprintf(stderr, "ils-decode: %s is not a binary ILS log\n", in); return 1; }
+	if (bad >= 0) {
+		fprintf(stderr, "ils-decode: %s: damaged or truncated record at offset %lld, %lld records decoded\n", in, bad, n);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,238 @@
+// ils-query - выборка строк текстового лога по индексу (см. LogIndexWriter).
+// Использование:
+//   ils-query [-x индекс] [-f С] [-t ПО] [-i LogId] [-l log|inf|wrn|err] [-s] <файл.log>
+// -x - файл индекса, по умолчанию "<файл.log>.idx"; если его нет, индекс
+//      строится по тексту лога (логи StdLogger, RotatingLogger) - время
+//      берётся из заголовков строк с датой, идентификаторов в нём нет;
+// -f, -t - интервал времени "YYYY/MM/DD HH:MM:SS[.дробь]" или "HH:MM:SS[.дробь]"
+//          (без даты берётся дата первой строки индекса);
+// -i - только блоки, содержащие строки идентификатора;
+// -l - наименьший уровень строк;
+// -s - сводка индекса и объём прочитанного в stderr.
+// Сообщения идентификатора с уровнем не ниже точного уровня индекса (по
+// умолчанию -l wrn и -l err) берутся по точным смещениям. В остальных случаях
+// читаются только подходящие блоки и непроиндексированный хвост лога; строки
+// внутри блока по идентификатору не различаются.
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <ctime>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "../ILS/ILS_LogAnalyzer.h"
+#include "../ILS/ILS_LogIndex.h"
+
+namespace {
+	const long long minTime = -(1LL << 62), maxTime = 1LL << 62;
+	// Запас при выборе блоков: время строки берётся при её создании, время блока - при записи
+	const long long slackUs = 1000000;
+
+	bool localTime(time_t t, struct tm& res) {
+#ifdef _WIN32
+		return localtime_s(&res, &t) == 0;
+#else
+		return localtime_r(&t, &res) != NULL;
+#endif
+	}
+	// Разбор границы интервала: системное время (для блоков) и местное время в
+	// представлении TLogLine (для строк с датой)
+	bool parseTime(const char* text, long long day_us, long long& wall_us, long long& line_us) {
+		int y, mo, d, h, mi;
+		double sec;
+		struct tm t = {};
+		if (sscanf(text, "%d/%d/%d %d:%d:%lf", &y, &mo, &d, &h, &mi, &sec) == 6) {
+			t.tm_year = y - 1900;
+			t.tm_mon = mo - 1;
+			t.tm_mday = d;
+		}
+		else if (sscanf(text, "%d:%d:%lf", &h, &mi, &sec) == 3) {
+			if (!localTime(time_t(day_us / 1000000), t)) return false;
+		}
+		else return false;
+		t.tm_hour = h;
+		t.tm_min = mi;
+		t.tm_sec = int(sec);
+		t.tm_isdst = -1;
+		const long long frac = (long long)((sec - int(sec)) * 1000000 + 0.5);
+		const time_t tt = mktime(&t);
+		if (tt == time_t(-1)) return false;
+		wall_us = (long long)tt * 1000000 + frac;
+		char buf[64];
+		strftime(buf, sizeof(buf), "%Y/%m/%d %H:%M:%S > ", &t);
+		TLogLine line;
+		if (!TLogLine::parse(buf, buf + strlen(buf), line)) return false;
+		line_us = line.time_us + frac;
+		return true;
+	}
+	// Индекс по тексту лога во временном файле (удаляется сразу после загрузки)
+	bool buildIndex(const char* logFile, LogIndex& index) {
+		namespace fs = std::filesystem;
+		std::error_code ec;
+		const fs::path dir = fs::temp_directory_path(ec);
+		if (ec) return false;
+		const long long stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+		const std::string file = (dir / ("ils-query." + std::to_string(stamp) + ".idx")).string();
+		const bool ok = LogIndexWriter::build(logFile, file) && index.open(file);
+		fs::remove(file, ec);
+		return ok;
+	}
+	int parseLevel(const char* text) {
+		static const char* names[] = { "dbg", "log", "inf", "wrn", "err" };
+		for (int level = 0; level < 5; ++level)
+			if (!strcmp(text, names[level])) return level;
+		return isdigit((unsigned char)*text) ? atoi(text) : -1;
+	}
+
+	// Вывод выбранных строк
+	struct TPrinter {
+		const char* data;
+		size_t size;
+		long long from_us, to_us;  // Интервал для строк с датой
+		unsigned levels;
+		unsigned long long bytes = 0, lines = 0;
+		bool inWindow(const TLogLine& line) const {
+			// Строки без даты (или с секундами от начала) по времени не отсекаются
+			if (line.time_kind != TLogLine::tkWall || line.time_us < 86400000000LL) return true;
+			return line.time_us >= from_us && line.time_us <= to_us;
+		}
+		// Строка по смещению и следующие за ней строки без заголовка
+		void entry(unsigned long long offset) {
+			if (offset >= size) return;
+			const char* p = data + offset;
+			const char* end = data + size;
+			bool first = true;
+			while (p < end) {
+				const char* nl = TLogLine::find(p, end, '\n');
+				if (!first) {
+					TLogLine line;
+					if (TLogLine::parse(p, nl, line)) break;
+				}
+				put(p, nl);
+				first = false;
+				p = nl + (nl < end);
+			}
+			bytes += size_t(p - (data + offset));
+		}
+		// Строки в [begin, end) с отбором по уровню и времени
+		void range(unsigned long long begin, unsigned long long end) {
+			if (end > size) end = size;
+			if (begin >= end) return;
+			const char* p = data + begin;
+			const char* e = data + end;
+			bool keep = false;
+			while (p < e) {
+				const char* nl = TLogLine::find(p, e, '\n');
+				TLogLine line;
+				if (TLogLine::parse(p, nl, line))
+					keep = (levels & (1u << line.level)) && inWindow(line);
+				if (keep) put(p, nl);
+				p = nl + (nl < e);
+			}
+			bytes += end - begin;
+		}
+		void put(const char* p, const char* nl) {
+			fwrite(p, 1, size_t(nl - p), stdout);
+			fputc('\n', stdout);
+			++lines;
+		}
+	};
+}
+
+int main(int argc, char* argv[]) {
+	std::string indexFile;
+	const char* logFile = NULL;
+	const char* fromText = NULL;
+	const char* toText = NULL;
+	const char* id = NULL;
+	int minLevel = ILS_LEVEL_LOG;
+	bool stats = false;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-x") && i + 1 < argc) indexFile = argv[++i];
+		else if (!strcmp(argv[i], "-f") && i + 1 < argc) fromText = argv[++i];
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc) toText = argv[++i];
+		else if (!strcmp(argv[i], "-i") && i + 1 < argc) id = argv[++i];
+		else if (!strcmp(argv[i], "-l") && i + 1 < argc) minLevel = parseLevel(argv[++i]);
+		else if (!strcmp(argv[i], "-s")) stats = true;
+		else logFile = argv[i];
+	}
+	if (!logFile || minLevel < 0 || minLevel > ILS_LEVEL_ERR) {
+		fprintf(stderr, "usage: ils-query [-x index] [-f from] [-t to] [-i id] [-l log|inf|wrn|err] [-s] <log.txt>\n");
+		return 2;
+	}
+	const bool explicitIndex = !indexFile.empty();
+	if (!explicitIndex) indexFile = std::string(logFile) + ".idx";
+	LogIndex index;
+	bool built = false;
+	if (!index.open(indexFile)) {
+		if (explicitIndex || !std::filesystem::exists(logFile)) { fprintf(stderr, "ils-query: cannot read index %s\n", indexFile.c_str()); return 1; }
+		if (!buildIndex(logFile, index)) { fprintf(stderr, "ils-query: cannot build an index of %s\n", logFile); return 1; }
+		built = true;
+	}
+	LogFileMap log;
+	if (!log.open(logFile)) { fprintf(stderr, "ils-query: cannot open %s\n", logFile); return 1; }
+
+	TPrinter out;
+	out.data = log.data();
+	out.size = log.size();
+	out.levels = LogIndex::levelMask(minLevel);
+	out.from_us = minTime;
+	out.to_us = maxTime;
+	long long fromWall = minTime, toWall = maxTime;
+	// Дата первого блока с известным временем
+	long long day = 0;
+	for (const LogIndex::TBlock& blk : index.blocks())
+		if (blk.first_us != LogIndexWriter::noTime) { day = blk.first_us; break; }
+	if (fromText && !parseTime(fromText, day, fromWall, out.from_us)) { fprintf(stderr, "ils-query: bad time %s\n", fromText); return 2; }
+	if (toText && !parseTime(toText, day, toWall, out.to_us)) { fprintf(stderr, "ils-query: bad time %s\n", toText); return 2; }
+
+	int idNo = -1;
+	if (id) {
+		idNo = index.idNo(id);
+		if (idNo < 0) {
+			fprintf(stderr, built ? "ils-query: id '%s' cannot be selected: no index, the log text has no ids\n"
+			                      : "ils-query: id '%s' is not in the index\n", id);
+			return 1;
+		}
+	}
+	size_t selected = 0;
+	if (id && minLevel >= index.exactLevel()) {
+		// Точные смещения: блоки лога не читаются
+		for (const LogIndex::TRecord& rec : index.records()) {
+			if (rec.id != unsigned(idNo) || rec.level < minLevel) continue;
+			if (rec.wall_us != LogIndexWriter::noTime && (rec.wall_us < fromWall - slackUs || rec.wall_us > toWall + slackUs)) continue;
+			if (fromText || toText) {
+				const char* p = out.data + rec.offset;
+				TLogLine line;
+				if (rec.offset < out.size && TLogLine::parse(p, TLogLine::find(p, out.data + out.size, '\n'), line) && !out.inWindow(line)) continue;
+			}
+			out.entry(rec.offset);
+			++selected;
+		}
+	}
+	else {
+		if (id) fprintf(stderr, "ils-query: lines of other ids in the selected blocks are printed too\n");
+		const std::vector<size_t> blocks = index.select(fromWall - slackUs, toWall + slackUs, idNo, out.levels);
+		selected = blocks.size();
+		// Соседние блоки читаются одним диапазоном
+		for (size_t k = 0; k < blocks.size();) {
+			const unsigned long long begin = index.blocks()[blocks[k]].begin;
+			unsigned long long end = index.blocks()[blocks[k]].end;
+			for (++k; k < blocks.size() && index.blocks()[blocks[k]].begin == end; ++k) end = index.blocks()[blocks[k]].end;
+			out.range(begin, end);
+		}
+		// Хвост, ещё не покрытый сводками блоков (текущий блок работающего приёмника)
+		out.range(index.indexedEnd(), out.size);
+	}
+	fflush(stdout);
+	if (stats) {
+		fprintf(stderr, "index%s: %zu blocks, %zu exact records, %zu ids, exact level %d\n",
+			built ? " (built from the log)" : "", index.blocks().size(), index.records().size(), index.ids().size(), index.exactLevel());
+		fprintf(stderr, "selected: %zu %s, %llu lines; read %llu of %zu bytes\n",
+			selected, id && minLevel >= index.exactLevel() ? "records" : "blocks", out.lines, out.bytes, out.size);
+	}
+	return 0;
+}